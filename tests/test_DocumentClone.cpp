@@ -42,3 +42,42 @@ TESTFUNC(DocumentClone) {
 	delete wnd;
 	xo::AddOrRemoveDocsFromGlobalList();
 }
+
+// Modify one node and one class after the first clone. The next clone must pick up both
+// changes, and leave the untouched nodes alone.
+TESTFUNC(DocumentClone_NodeAndClass) {
+	xo::SysWnd* wnd = xo::SysWnd::New();
+	xo::AddOrRemoveDocsFromGlobalList();
+	xo::DocGroup* g = wnd->DocGroup;
+	xo::Doc*      d = g->Doc;
+	SetDocDims(d, 16, 16);
+
+	d->ClassParse("box", "width: 10px;");
+	xo::DomNode* div1 = d->Root.AddNode(xo::TagDiv);
+	xo::DomNode* div2 = d->Root.AddNode(xo::TagDiv);
+	div1->AddClass("box");
+	g->Render();
+	uint32_t numEls         = g->RenderStats.Clone_NumEls;
+	uint32_t numClassTables = g->RenderStats.Clone_NumClassTables;
+
+	div2->StyleParsef("left: 10px;");
+	d->ClassParse("box", "width: 20px;");
+	g->Render();
+	TTASSERT(g->RenderStats.Clone_NumEls == numEls + 1); // div2 only
+	TTASSERT(g->RenderStats.Clone_NumClassTables == numClassTables + 1);
+
+	const xo::Doc&     rd    = g->RenderDoc->Doc;
+	const xo::DomNode* rdiv2 = static_cast<const xo::DomNode*>(rd.GetChildByInternalID(div2->GetInternalID()));
+	TTASSERT(rdiv2->GetStyle().Get(xo::CatLeft) != nullptr);
+	TTASSERT(rdiv2->GetStyle().Get(xo::CatLeft)->GetSize().Val == 10);
+	const xo::StyleClass* box = rd.ClassStyles.GetByID(d->ClassStyles.GetClassID("box"));
+	TTASSERT(box->Default.Get(xo::CatWidth)->GetSize().Val == 20);
+
+	// Nothing changed, so nothing is copied
+	g->Render();
+	TTASSERT(g->RenderStats.Clone_NumEls == numEls + 1);
+	TTASSERT(g->RenderStats.Clone_NumClassTables == numClassTables + 1);
+
+	delete wnd;
+	xo::AddOrRemoveDocsFromGlobalList();
+}
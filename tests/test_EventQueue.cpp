@@ -0,0 +1,83 @@
+#include "pch.h"
+
+class TestDocGroup : public xo::DocGroup {
+protected:
+	void InternalTouchedByOtherThread() override {}
+};
+
+static xo::OriginalEvent MakeEvent(xo::DocGroup* dg, xo::Events type, float x) {
+	xo::OriginalEvent ev;
+	ev.DocGroup             = dg;
+	ev.Event.Type           = type;
+	ev.Event.PointCount     = 1;
+	ev.Event.PointsAbs[0].x = x;
+	return ev;
+}
+
+TESTFUNC(EventQueue) {
+	TestDocGroup      a, b;
+	xo::EventQueue    q;
+	xo::OriginalEvent ev;
+
+	q.AddOrCoalesce(MakeEvent(&a, xo::EventMouseMove, 1));
+	q.Add(MakeEvent(&a, xo::EventMouseDown, 2));
+	q.AddOrCoalesce(MakeEvent(&b, xo::EventMouseMove, 10));
+	q.AddOrCoalesce(MakeEvent(&a, xo::EventMouseMove, 3));
+	q.AddOrCoalesce(MakeEvent(&a, xo::EventMouseMove, 4));
+	TTASSERT(q.Size() == 3);
+
+	// The pending move keeps its place in the queue, and carries the samples that it replaced
+	TTASSERT(q.PopTail(ev));
+	TTASSERT(ev.DocGroup == &a && ev.Event.Type == xo::EventMouseMove);
+	TTASSERT(ev.Event.PointsAbs[0].x == 4);
+	TTASSERT(ev.Event.HistoryCount == 2);
+	TTASSERT(ev.Event.History[0].PointsAbs[0].x == 1);
+	TTASSERT(ev.Event.History[1].PointsAbs[0].x == 3);
+
+	TTASSERT(q.PopTail(ev));
+	TTASSERT(ev.Event.Type == xo::EventMouseDown);
+	TTASSERT(ev.Event.HistoryCount == 0);
+
+	TTASSERT(q.PopTail(ev));
+	TTASSERT(ev.DocGroup == &b && ev.Event.PointsAbs[0].x == 10);
+	TTASSERT(ev.Event.HistoryCount == 0);
+	TTASSERT(!q.PopTail(ev));
+
+	// Once the slot has been consumed, the next move is queued again
+	q.AddOrCoalesce(MakeEvent(&a, xo::EventMouseMove, 5));
+	TTASSERT(q.PopTail(ev));
+	TTASSERT(ev.Event.PointsAbs[0].x == 5 && ev.Event.HistoryCount == 0);
+
+	// We have been popping without waiting, so drain the semaphore
+	while (q.SemObj().tryWait()) {
+	}
+
+	// Many producers, one consumer
+	const int                nThreads = 4;
+	const int                nEach    = 5000;
+	std::vector<std::thread> producers;
+	for (int t = 0; t < nThreads; t++) {
+		producers.push_back(std::thread([&, t] {
+			for (int i = 0; i < nEach; i++)
+				q.Add(MakeEvent(&a, xo::EventKeyDown, (float) (t * nEach + i)));
+		}));
+	}
+	int  received = 0;
+	int  last[nThreads];
+	bool inOrder = true;
+	for (int t = 0; t < nThreads; t++)
+		last[t] = -1;
+	while (received < nThreads * nEach) {
+		q.SemObj().wait();
+		q.PopTailAfterSignal(ev);
+		int v = (int) ev.Event.PointsAbs[0].x;
+		int t = v / nEach;
+		inOrder &= v > last[t];
+		last[t] = v;
+		received++;
+	}
+	for (auto& p : producers)
+		p.join();
+	TTASSERT(inOrder);
+	TTASSERT(!q.PopTail(ev));
+}
@@ -0,0 +1,120 @@
+#include "pch.h"
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+namespace {
+// Exposes the persistent cache lookup. Each instance opens the file afresh.
+class DiskCacheProbe : public xo::GlyphCache {
+public:
+	bool IsOnDisk(const xo::Font* font, const xo::GlyphCacheKey& key) { return FindOnDisk(font, key) != nullptr; }
+};
+} // namespace
+
+static std::string ReadBytes(const char* filename) {
+	std::string bytes;
+	FILE*       f = fopen(filename, "rb");
+	if (f == nullptr)
+		return bytes;
+	char        buf[4096];
+	size_t      n;
+	while ((n = fread(buf, 1, sizeof(buf), f)) != 0)
+		bytes.append(buf, n);
+	fclose(f);
+	return bytes;
+}
+
+static void WriteBytes(const char* filename, const std::string& bytes) {
+	FILE* f = fopen(filename, "wb");
+	TTASSERT(f != nullptr);
+	TTASSERT(fwrite(bytes.data(), 1, bytes.size(), f) == bytes.size());
+	fclose(f);
+}
+
+static bool IsOnDisk(const xo::Font* font, const xo::GlyphCacheKey& key) {
+	DiskCacheProbe probe;
+	return probe.IsOnDisk(font, key);
+}
+
+TESTFUNC(GlyphDiskCache) {
+	auto       g         = xo::Global();
+	xo::String oldDir    = g->CacheDir;
+	bool       oldEnable = g->EnableGlyphDiskCache;
+	g->CacheDir          = oldDir + XO_DIR_SEP_STR + "test-glyphs";
+#ifdef _WIN32
+	_mkdir(g->CacheDir.CStr());
+#else
+	mkdir(g->CacheDir.CStr(), 0700);
+#endif
+	g->EnableGlyphDiskCache = true;
+	xo::String filename     = g->CacheDir + XO_DIR_SEP_STR + "glyphs";
+	remove(filename.CStr());
+
+	// The font may have been loaded before the disk cache was enabled, so give it an identity of our own
+	xo::Font* font        = const_cast<xo::Font*>(g->FontStore->GetByFontID(g->FontStore->GetFallbackFontID()));
+	uint64_t  oldFileHash = font->FileHash;
+	font->FileHash        = 0x5eed5eed5eed5eedull;
+
+	xo::GlyphCacheKey             key(font->ID, 'A', 20, 0);
+	xo::GlyphCacheKey             other(font->ID, 'B', 20, 0);
+	ohash::set<xo::GlyphCacheKey> keys;
+	keys.insert(key);
+
+	xo::Glyph saved;
+	{
+		xo::GlyphCache cache;
+		cache.RenderGlyphs(keys);
+		auto table = cache.GetTable();
+		TTASSERT(table->GetGlyph(key) != nullptr);
+		saved = *table->GetGlyph(key);
+		cache.SaveDiskCache();
+	}
+
+	// Reopen, and read the glyph back out of the file
+	TTASSERT(IsOnDisk(font, key));
+	TTASSERT(!IsOnDisk(font, other));
+	{
+		DiskCacheProbe cache;
+		cache.RenderGlyphs(keys);
+		auto        table  = cache.GetTable();
+		const auto* loaded = table->GetGlyph(key);
+		TTASSERT(loaded != nullptr);
+		TTASSERT(loaded->FTGlyphIndex == saved.FTGlyphIndex);
+		TTASSERT(loaded->Width == saved.Width && loaded->Height == saved.Height);
+		TTASSERT(loaded->MetricHoriAdvance == saved.MetricHoriAdvance);
+	}
+
+	std::string good = ReadBytes(filename.CStr());
+	TTASSERT(good.size() > 0);
+
+	// A different font file
+	font->FileHash = 0x5eed5eed5eed5eeeull;
+	TTASSERT(!IsOnDisk(font, key));
+	font->FileHash = 0x5eed5eed5eed5eedull;
+
+	// Truncated file
+	WriteBytes(filename.CStr(), good.substr(0, good.size() - 1));
+	TTASSERT(!IsOnDisk(font, key));
+
+	// Wrong magic
+	std::string bad = good;
+	bad[0] ^= 0xff;
+	WriteBytes(filename.CStr(), bad);
+	TTASSERT(!IsOnDisk(font, key));
+
+	// Built with different rasterizer settings
+	WriteBytes(filename.CStr(), good);
+	TTASSERT(IsOnDisk(font, key));
+	float oldGamma       = g->SubPixelTextGamma;
+	g->SubPixelTextGamma = oldGamma + 0.5f;
+	TTASSERT(!IsOnDisk(font, key));
+	g->SubPixelTextGamma = oldGamma;
+
+	remove(filename.CStr());
+	font->FileHash          = oldFileHash;
+	g->EnableGlyphDiskCache = oldEnable;
+	g->CacheDir             = oldDir;
+}
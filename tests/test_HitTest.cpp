@@ -0,0 +1,45 @@
+#include "pch.h"
+
+static xo::RenderDomNode* AddChild(xo::LayoutResult& layout, xo::RenderDomNode* parent, xo::InternalID id, xo::Box pos) {
+	xo::RenderDomNode* node = new (layout.Pool.AllocT<xo::RenderDomNode>(true)) xo::RenderDomNode(id, xo::TagDiv, &layout.Pool);
+	node->Pos               = pos;
+	parent->Children += node;
+	return node;
+}
+
+static xo::Box MakeBox(int left, int top, int right, int bottom) {
+	return xo::Box(xo::IntToPos(left), xo::IntToPos(top), xo::IntToPos(right), xo::IntToPos(bottom));
+}
+
+TESTFUNC(HitTest) {
+	xo::Doc          doc(nullptr);
+	xo::LayoutResult layout(doc);
+	xo::InternalID   id = 1;
+
+	// A background behind a long column of rows, and an overlay on top of rows 50 to 52
+	xo::RenderDomNode* list = AddChild(layout, &layout.Root, id++, MakeBox(0, 0, 100, 1000));
+	AddChild(layout, list, id++, MakeBox(0, 0, 100, 1000));
+	for (int i = 0; i < 100; i++)
+		AddChild(layout, list, id++, MakeBox(0, i * 10, 100, i * 10 + 10));
+	AddChild(layout, list, id++, MakeBox(10, 500, 90, 530));
+
+	auto hit = [&](int x, int y) -> int {
+		auto el = layout.ChildAt(list, xo::Point(xo::IntToPos(x), xo::IntToPos(y)));
+		return el ? (int) el->InternalID : -1;
+	};
+
+	TTASSERT(hit(50, 5) == 3);
+	TTASSERT(hit(50, 10) == 4);
+	TTASSERT(hit(50, 999) == 102);
+	TTASSERT(hit(50, 505) == 103); // overlay
+	TTASSERT(hit(5, 505) == 53);   // beside the overlay
+	TTASSERT(hit(150, 5) == -1);
+	TTASSERT(hit(50, 1000) == -1);
+
+	// Too few children to be worth indexing
+	xo::RenderDomNode* small = AddChild(layout, &layout.Root, id++, MakeBox(0, 0, 100, 100));
+	AddChild(layout, small, id++, MakeBox(0, 0, 100, 100));
+	AddChild(layout, small, id++, MakeBox(0, 0, 50, 50));
+	TTASSERT(layout.ChildAt(small, xo::Point(xo::IntToPos(10), xo::IntToPos(10)))->InternalID == id - 1);
+	TTASSERT(layout.ChildAt(small, xo::Point(xo::IntToPos(60), xo::IntToPos(10)))->InternalID == id - 2);
+}
@@ -17,3 +17,132 @@ TESTFUNC(Layout_All)
 {
 	xoImageTester::DoDirectory("");
 }
+
+// The Layout_Reuse tests lay out a document, mutate it, and lay it out again, which lets the layout
+// reuse the subtrees that it believes are unchanged. The result must be identical to a layout of the
+// mutated document from scratch.
+
+namespace {
+class ReuseDoc
+{
+public:
+	xo::DocGroup* Group;
+	xo::DomNode*  Panels[3];
+	xo::DomNode*  FirstItem; // First item inside Panels[0]
+	xo::DomNode*  Label;     // Text inside Panels[1]
+
+	ReuseDoc()
+	{
+		Group                      = xo::DocGroup::New();
+		Group->Doc                 = new xo::Doc(Group);
+		Group->DestroyDocWithGroup = true;
+		Resize(400, 200);
+
+		xo::Doc* d = Group->Doc;
+		d->ClassParse("panel", "flow-context: new; width: 30%; height: 120px; padding: 4px; background: #eee");
+		d->ClassParse("item", "width: 30px; height: 10px; margin: 2px; background: #00f");
+		for (int i = 0; i < 3; i++)
+		{
+			Panels[i] = d->Root.AddNode(xo::TagDiv);
+			Panels[i]->AddClass("panel");
+			for (int j = 0; j < 6; j++)
+				Panels[i]->AddNode(xo::TagDiv)->AddClass("item");
+		}
+		FirstItem = Panels[0]->ChildByIndex(0)->ToNode();
+		Label     = Panels[1]->AddNode(xo::TagLab);
+		Label->SetText("hello world");
+	}
+
+	~ReuseDoc()
+	{
+		delete Group;
+	}
+
+	void Resize(int width, int height)
+	{
+		xo::Event ev;
+		ev.MakeWindowSize(width, height);
+		Group->ProcessEvent(ev);
+	}
+
+	void Render()
+	{
+		xo::Image img;
+		TTASSERT(Group->RenderToImage(img) == xo::RenderResultDone);
+	}
+};
+} // namespace
+
+// Returns true if two layouts are identical, down to the position of every glyph
+static bool SameLayout(const xo::RenderDomEl* a, const xo::RenderDomEl* b)
+{
+	xo::Box pos = a->Pos;
+	if (a->Tag != b->Tag || a->InternalID != b->InternalID || !(pos == b->Pos))
+		return false;
+
+	if (a->IsText())
+	{
+		auto ta = (const xo::RenderDomText*) a;
+		auto tb = (const xo::RenderDomText*) b;
+		if (ta->FontID != tb->FontID || ta->FontSizePx != tb->FontSizePx || !(ta->Color == tb->Color) || ta->Text.size() != tb->Text.size())
+			return false;
+		for (size_t i = 0; i < ta->Text.size(); i++)
+		{
+			const auto& ca = ta->Text[i];
+			const auto& cb = tb->Text[i];
+			if (ca.Char != cb.Char || ca.X != cb.X || ca.Y != cb.Y || ca.Width != cb.Width)
+				return false;
+		}
+		return true;
+	}
+
+	auto na = (const xo::RenderDomNode*) a;
+	auto nb = (const xo::RenderDomNode*) b;
+	if (!(na->Style.BackgroundColor == nb->Style.BackgroundColor) || na->Children.size() != nb->Children.size())
+		return false;
+	for (size_t i = 0; i < na->Children.size(); i++)
+	{
+		if (!SameLayout(na->Children[i], nb->Children[i]))
+			return false;
+	}
+	return true;
+}
+
+static void CheckReuse(std::function<void(ReuseDoc& doc)> mutate)
+{
+	ReuseDoc reused;
+	reused.Render();
+	mutate(reused);
+	reused.Render();
+
+	ReuseDoc fresh;
+	mutate(fresh);
+	fresh.Render();
+
+	xo::LayoutResult* a = reused.Group->RenderDoc->AcquireLatestLayout();
+	xo::LayoutResult* b = fresh.Group->RenderDoc->AcquireLatestLayout();
+	TTASSERT(a != nullptr && b != nullptr);
+	TTASSERT(SameLayout(a->Body(), b->Body()));
+	reused.Group->RenderDoc->ReleaseLayout(a);
+	fresh.Group->RenderDoc->ReleaseLayout(b);
+}
+
+TESTFUNC(Layout_Reuse_Style)
+{
+	CheckReuse([](ReuseDoc& doc) { doc.FirstItem->StyleParse("width: 50px; height: 20px"); });
+}
+
+TESTFUNC(Layout_Reuse_Text)
+{
+	CheckReuse([](ReuseDoc& doc) { doc.Label->SetText("goodbye cruel world"); });
+}
+
+TESTFUNC(Layout_Reuse_Viewport)
+{
+	CheckReuse([](ReuseDoc& doc) { doc.Resize(300, 160); });
+}
+
+TESTFUNC(Layout_Reuse_ClassTable)
+{
+	CheckReuse([](ReuseDoc& doc) { doc.Group->Doc->ClassParse("item", "width: 20px; height: 14px; margin: 2px; background: #0c0"); });
+}
@@ -0,0 +1,165 @@
+#include "pch.h"
+
+static uint32_t PixelAt(const xo::Image& img, int x, int y) {
+	const uint8_t* p = (const uint8_t*) img.DataAt(x, y);
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3];
+}
+
+// Render a document without a window, which goes through RenderSoft
+TESTFUNC(RenderSoft) {
+	xo::DocGroup* g        = xo::DocGroup::New();
+	g->Doc                 = new xo::Doc(g);
+	g->DestroyDocWithGroup = true;
+	xo::Doc* d             = g->Doc;
+
+	xo::Event ev;
+	ev.MakeWindowSize(150, 100);
+	g->ProcessEvent(ev);
+
+	// The body is white by default. Make it transparent, so that the clear color shows through.
+	d->Root.StyleParse("background: #0000");
+
+	xo::DomNode* div = d->Root.AddNode(xo::TagDiv);
+	div->StyleParse("position: absolute; left: 10px; top: 20px; width: 100px; height: 70px; background: #00c040");
+
+	xo::Image img;
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(img.Width == 150 && img.Height == 100);
+
+	// Pink is the clear color, which the test runner sets
+	TTASSERT(PixelAt(img, 5, 5) == 0xff1ef0ff);
+	TTASSERT(PixelAt(img, 149, 99) == 0xff1ef0ff);
+	TTASSERT(PixelAt(img, 10, 20) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 109, 89) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 110, 89) == 0xff1ef0ff);
+	TTASSERT(PixelAt(img, 109, 90) == 0xff1ef0ff);
+
+	// Rendering again, after a change, must only repaint what changed, and keep the rest
+	div->StyleParse("background: #0000ff");
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(PixelAt(img, 50, 50) == 0x0000ffff);
+	TTASSERT(PixelAt(img, 5, 5) == 0xff1ef0ff);
+
+	delete g;
+}
+
+// Subtrees that have not changed are replayed from the display list, and moved if they only moved
+TESTFUNC(RenderSoft_DisplayList) {
+	xo::DocGroup* g        = xo::DocGroup::New();
+	g->Doc                 = new xo::Doc(g);
+	g->DestroyDocWithGroup = true;
+	xo::Doc* d             = g->Doc;
+
+	xo::Event ev;
+	ev.MakeWindowSize(150, 100);
+	g->ProcessEvent(ev);
+
+	d->Root.StyleParse("background: #0000");
+	xo::DomNode* box = d->Root.AddNode(xo::TagDiv);
+	box->StyleParse("position: absolute; left: 10px; top: 20px; width: 40px");
+	xo::DomNode* rows[10];
+	for (int i = 0; i < 10; i++) {
+		rows[i] = box->AddNode(xo::TagDiv);
+		rows[i]->StyleParse("width: 40px; height: 5px; background: #00c040");
+	}
+
+	// Enough empty elements that the whole document is too large to be a single subtree
+	for (int i = 0; i < xo::DisplayList::MaxElements; i++)
+		d->Root.AddNode(xo::TagDiv);
+
+	xo::Image img;
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(PixelAt(img, 10, 20) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 49, 69) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 9, 20) == 0xff1ef0ff);
+
+	box->StyleParse("left: 30px");
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(PixelAt(img, 30, 20) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 69, 69) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 29, 20) == 0xff1ef0ff);
+	TTASSERT(PixelAt(img, 10, 20) == 0xff1ef0ff);
+
+	rows[0]->StyleParse("background: #0000ff");
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(PixelAt(img, 30, 20) == 0x0000ffff);
+	TTASSERT(PixelAt(img, 30, 25) == 0x00c040ff);
+
+	delete g;
+}
+
+// RenderSoft can't queue a read back, so every frame is captured immediately
+TESTFUNC(RenderSoft_Capture) {
+	xo::DocGroup* g        = xo::DocGroup::New();
+	g->Doc                 = new xo::Doc(g);
+	g->DestroyDocWithGroup = true;
+	xo::Doc* d             = g->Doc;
+
+	xo::Event ev;
+	ev.MakeWindowSize(50, 40);
+	g->ProcessEvent(ev);
+
+	d->Root.StyleParse("background: #0000");
+	xo::DomNode* div = d->Root.AddNode(xo::TagDiv);
+	div->StyleParse("position: absolute; left: 0px; top: 0px; width: 10px; height: 10px; background: #00c040");
+
+	xo::Image img;
+	bool      captured = false;
+	g->RenderAndCapture(img, captured);
+	TTASSERT(captured);
+	TTASSERT(img.Width == 50 && img.Height == 40);
+	TTASSERT(PixelAt(img, 5, 5) == 0x00c040ff);
+	TTASSERT(PixelAt(img, 20, 20) == 0xff1ef0ff);
+
+	// Nothing was queued, so there is nothing left to flush
+	TTASSERT(!g->FlushCapture(img));
+
+	delete g;
+}
+
+static uint64_t CanvasHash(xo::DocGroup* g, const xo::DomCanvas* canvas) {
+	xo::LayoutResult*        layout = g->RenderDoc->AcquireLatestLayout();
+	const xo::RenderDomNode* node   = layout->Node(canvas->GetInternalID());
+	uint64_t                 hash   = node != nullptr ? xo::DamageTracker::ElementHash(&g->RenderDoc->Doc, xo::Point(0, 0), node) : 0;
+	g->RenderDoc->ReleaseLayout(layout);
+	return hash;
+}
+
+// Drawing straight onto a canvas' image, without going through DomCanvas, must change the element
+// hash, which decides what gets repainted, and whether a recording from the display list is replayed.
+TESTFUNC(RenderSoft_CanvasHash) {
+	xo::DocGroup* g        = xo::DocGroup::New();
+	g->Doc                 = new xo::Doc(g);
+	g->DestroyDocWithGroup = true;
+	xo::Doc* d             = g->Doc;
+
+	xo::Event ev;
+	ev.MakeWindowSize(50, 40);
+	g->ProcessEvent(ev);
+
+	xo::DomCanvas* canvas = d->Root.AddCanvas();
+	canvas->StyleParse("position: absolute; left: 0px; top: 0px");
+	TTASSERT(canvas->SetSize(20, 20));
+	canvas->Fill(xo::Color::RGBA(0, 0xc0, 0x40, 0xff));
+
+	xo::Image img;
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	uint64_t before = CanvasHash(g, canvas);
+	TTASSERT(before != 0);
+
+	// Nothing changed, so neither does the hash
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(CanvasHash(g, canvas) == before);
+
+	xo::Image*    pixels = d->Images.Get(canvas->GetImageID());
+	xo::Canvas2D* c2d    = new xo::Canvas2D(pixels);
+	c2d->Fill(xo::Color::RGBA(0, 0, 0xff, 0xff));
+	c2d->Invalidate();
+	pixels->InvalidRect.ExpandToFit(c2d->GetInvalidRect());
+	delete c2d;
+
+	TTASSERT(g->RenderToImage(img) == xo::RenderResultDone);
+	TTASSERT(CanvasHash(g, canvas) != before);
+
+	delete g;
+}
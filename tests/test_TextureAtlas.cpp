@@ -0,0 +1,39 @@
+#include "pch.h"
+
+TESTFUNC(TextureAtlas) {
+	const int padding = 2;
+
+	xo::TextureAtlas atlas;
+	atlas.Initialize(256, 256, xo::TexFormatGrey8, padding);
+
+	// Glyph-like sizes, which are all different
+	xo::cheapvec<xo::Box> boxes;
+	for (int i = 0; true; i++) {
+		uint16_t w = 4 + (i * 7) % 19;
+		uint16_t h = 6 + (i * 13) % 23;
+		uint16_t x = 0;
+		uint16_t y = 0;
+		if (!atlas.Alloc(w, h, x, y))
+			break;
+		boxes += xo::Box(x, y, x + w, y + h);
+	}
+	TTASSERT(atlas.GetNumAllocs() == boxes.size());
+
+	for (size_t i = 0; i < boxes.size(); i++) {
+		const auto& a = boxes[i];
+		TTASSERT(a.Left >= padding && a.Top >= padding);
+		TTASSERT(a.Right + padding <= 256 && a.Bottom + padding <= 256);
+		for (size_t j = i + 1; j < boxes.size(); j++) {
+			const auto& b = boxes[j];
+			bool apart = a.Right + padding <= b.Left || b.Right + padding <= a.Left || a.Bottom + padding <= b.Top || b.Bottom + padding <= a.Top;
+			TTASSERT(apart);
+		}
+	}
+
+	xo::AtlasStats stats;
+	atlas.AddToStats(stats);
+	TTASSERT(stats.NumAtlases == 1);
+	TTASSERT(stats.Occupancy() > 0.7f);
+
+	atlas.Free();
+}
@@ -0,0 +1,46 @@
+#include "pch.h"
+
+static void TimerFunc(xo::Event& ev) {
+}
+
+TESTFUNC(Timers) {
+	xo::Doc doc(nullptr);
+	TTASSERT(doc.NextTimerDueMS() == INT64_MAX);
+
+	xo::DomNode* slow   = doc.Root.AddNode(xo::TagDiv);
+	xo::DomNode* fast   = doc.Root.AddNode(xo::TagDiv);
+	uint64_t     slowID = slow->OnTimer(TimerFunc, nullptr, 100);
+	uint64_t     fastID = fast->OnTimer([] {}, 10);
+	int64_t      due    = doc.NextTimerDueMS();
+	TTASSERT(due == fast->HandlerByID(fastID)->TimerDueMS);
+
+	xo::cheapvec<xo::NodeEventIDPair> ready;
+	doc.ReadyTimers(due - 1, ready);
+	TTASSERT(ready.size() == 0);
+
+	doc.ReadyTimers(due, ready);
+	TTASSERT(ready.size() == 1);
+	TTASSERT(ready[0].NodeID == fast->GetInternalID() && ready[0].EventID == fastID);
+	TTASSERT(doc.NextTimerDueMS() == due + 10);
+
+	// A removed timer never fires again
+	fast->RemoveHandler(fastID);
+	ready.clear();
+	doc.ReadyTimers(due + 10, ready);
+	TTASSERT(ready.size() == 0);
+
+	// Changing the period replaces the old schedule, instead of adding a second one
+	slow->OnTimer(TimerFunc, nullptr, 5);
+	int64_t slowDue = slow->HandlerByID(slowID)->TimerDueMS;
+	TTASSERT(doc.NextTimerDueMS() == slowDue);
+	ready.clear();
+	doc.ReadyTimers(slowDue + 1000, ready);
+	TTASSERT(ready.size() == 1);
+	TTASSERT(ready[0].EventID == slowID);
+
+	slow->RemoveAllHandlers();
+	ready.clear();
+	doc.ReadyTimers(slowDue + 2000, ready);
+	TTASSERT(ready.size() == 0);
+	TTASSERT(doc.NextTimerDueMS() == INT64_MAX);
+}
@@ -0,0 +1,47 @@
+#include "pch.h"
+
+TESTFUNC(WordCache) {
+	xo::WordCache        cache;
+	xo::WordCache::Local local;
+
+	xo::RenderCharEl chars[3];
+	for (int i = 0; i < 3; i++) {
+		chars[i].OriginalCharIndex = i + 1;
+		chars[i].Char              = 'a' + i;
+		chars[i].X                 = i * 100;
+	}
+
+	xo::WordCache::Key key;
+	key.Font       = 1;
+	key.FontSizePx = 12;
+	key.Flags      = 0;
+	key.Bytes      = "abc";
+	key.NumBytes   = 3;
+	TTASSERT(cache.Get(key, local) == nullptr);
+	TTASSERT(cache.Insert(key, 300, chars, 3, local) != nullptr);
+
+	// A different thread, which has not seen the word yet
+	xo::WordCache::Local other;
+	auto                 word = cache.Get(key, other);
+	TTASSERT(word != nullptr);
+	TTASSERT(word->Width == 300);
+	TTASSERT(word->NumChars == 3);
+	TTASSERT(word->Chars()[2].Char == 'c');
+	TTASSERT(word->Chars()[2].X == 200);
+
+	key.FontSizePx = 13;
+	TTASSERT(cache.Get(key, local) == nullptr);
+	cache.EndLayout();
+
+	// Bulk pushes that wrap around the end of the ring
+	xo::RingBuf<xo::RenderCharEl> ring;
+	for (int i = 0; i < 30; i++)
+		ring.PushHead();
+	for (int i = 0; i < 30; i++)
+		ring.PopTail();
+	ring.PushHead(chars, 3);
+	ring.PushHead(chars, 3);
+	TTASSERT(ring.Size() == 6);
+	for (int i = 0; i < 6; i++)
+		TTASSERT(ring.PopTail().Char == 'a' + i % 3);
+}
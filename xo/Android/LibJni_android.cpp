@@ -60,10 +60,10 @@ static OriginalEvent MakeEvent() {
 static void ProcessAllEvents() {
 	while (true) {
 		ProcessDocQueue();
-		if (!AbcSemaphoreWait(Global()->UIEventQueue.SemaphoreObj(), 0))
+		if (!Global()->UIEventQueue.SemObj().tryWait())
 			break;
 		OriginalEvent ev;
-		XO_VERIFY(Global()->UIEventQueue.PopTail(ev));
+		Global()->UIEventQueue.PopTailAfterSignal(ev);
 		ev.DocGroup->ProcessEvent(ev.Event);
 	}
 }
@@ -49,6 +49,7 @@
 #include <algorithm>
 #include <limits>
 #include <functional>
+#include <memory>
 #include <vector>
 #include <mutex>
 #include <thread>
@@ -139,6 +140,7 @@ typedef Mat4T<float> Mat4f;
 #include "../Base/CPU.h"
 #include "../Base/Error.h"
 #include "../Base/Queue.h"
+#include "../Base/MPSCQueue.h"
 #include "../Base/xoString.h"
 #include "../Base/OS_Error.h"
 #include "../Base/OS_Time.h"
@@ -0,0 +1,105 @@
+#pragma once
+
+namespace xo {
+/*
+
+Lock-free multi-producer, single-consumer queue
+===============================================
+
+* Bounded ring buffer. The capacity is fixed at construction, and is always a power of 2.
+* Any number of threads may Add, but only one thread may PopTail.
+* No locks. Producers claim a cell with a single compare-and-swap on Head.
+* The ring never grows. When it is full, Add waits for the consumer to make space, so the consumer
+  thread must never Add to a queue that might be full. It would wait on itself forever.
+* A producer publishes its cell some time after claiming it. If a later producer publishes first,
+  then PopTail can see an empty queue even though an item has been added. A consumer that has been
+  told about an item (eg by a semaphore) must use PopTailAfterSignal.
+
+This is Dmitry Vyukov's bounded queue (http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue),
+with the consumer side simplified, because there is only one consumer.
+
+Every cell carries a sequence number, which tells a producer whether the cell is free for position
+'pos' (Seq == pos), and tells the consumer whether the cell has been published (Seq == pos + 1).
+
+T may be an incomplete type at the point where the queue is declared, as long as it is complete
+wherever the member functions are used.
+
+*/
+template <typename T>
+class MPSCQueue {
+public:
+	MPSCQueue(uint32_t capacity = 1024) {
+		XO_ASSERT(capacity >= 2 && (capacity & (capacity - 1)) == 0);
+		Mask  = capacity - 1;
+		Cells = new Cell[capacity];
+		for (uint32_t i = 0; i < capacity; i++)
+			Cells[i].Seq.store(i, std::memory_order_relaxed);
+	}
+	~MPSCQueue() { delete[] Cells; }
+
+	// Returns false if the queue is full
+	bool TryAdd(const T& item) {
+		Cell*    cell;
+		uint32_t pos = Head.load(std::memory_order_relaxed);
+		while (true) {
+			cell         = &Cells[pos & Mask];
+			uint32_t seq = cell->Seq.load(std::memory_order_acquire);
+			int32_t  dif = (int32_t) (seq - pos);
+			if (dif == 0) {
+				if (Head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+					break;
+			} else if (dif < 0) {
+				return false;
+			} else {
+				pos = Head.load(std::memory_order_relaxed);
+			}
+		}
+		cell->Item = item;
+		cell->Seq.store(pos + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Waits for the consumer to make space, if the queue is full
+	void Add(const T& item) {
+		while (!TryAdd(item))
+			std::this_thread::yield();
+	}
+
+	// Returns false if the queue is empty. Must only be called by the consumer thread.
+	bool PopTail(T& item) {
+		uint32_t pos  = Tail.load(std::memory_order_relaxed);
+		Cell*    cell = &Cells[pos & Mask];
+		if ((int32_t) (cell->Seq.load(std::memory_order_acquire) - (pos + 1)) < 0)
+			return false;
+		item = cell->Item;
+		cell->Seq.store(pos + Mask + 1, std::memory_order_release);
+		Tail.store(pos + 1, std::memory_order_relaxed);
+		return true;
+	}
+
+	// Use this when we know that an item has been added. If the oldest cell has been claimed but not yet
+	// published, then its producer is between two instructions, so we wait for it.
+	void PopTailAfterSignal(T& item) {
+		while (!PopTail(item))
+			std::this_thread::yield();
+	}
+
+	// Approximate, if producers are busy
+	int32_t Size() const { return (int32_t) (Head.load(std::memory_order_relaxed) - Tail.load(std::memory_order_relaxed)); }
+
+private:
+	struct Cell {
+		std::atomic<uint32_t> Seq;
+		T                     Item;
+	};
+
+	Cell*                 Cells = nullptr;
+	uint32_t              Mask  = 0;
+	std::atomic<uint32_t> Head{0};
+	char                  Pad[64]; // Keep the producers' cache line away from the consumer's
+	std::atomic<uint32_t> Tail{0}; // Only written by the consumer
+
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+};
+} // namespace xo
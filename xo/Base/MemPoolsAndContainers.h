@@ -230,6 +230,16 @@ public:
 		return item;
 	}
 
+	// Push n items, with at most two memcpy calls
+	void PushHead(const T* items, size_t n) {
+		while (Size() + n > Mask)
+			Grow();
+		size_t first = std::min(n, (size_t) (RingSize() - Head));
+		memcpy(Ring + Head, items, first * sizeof(T));
+		memcpy(Ring, items + first, (n - first) * sizeof(T));
+		Head = (Head + (uint32_t) n) & Mask;
+	}
+
 	const T& PopTail() {
 		XO_DEBUG_ASSERT(Head != Tail);
 		const T& item = Ring[Tail];
@@ -4,6 +4,7 @@
 #ifndef _WIN32
 #include <dirent.h>
 #include <sys/stat.h> // Added for Android
+#include <sys/mman.h>
 #endif
 
 #ifndef _WIN32
@@ -138,6 +139,82 @@ XO_API bool FindFiles(const char* _dir, std::function<bool(const FilesystemItem&
 #endif
 }
 
+XO_API bool RenameFile(const char* from, const char* to) {
+#ifdef _WIN32
+	return !!MoveFileExW(ConvertUTF8ToWide(from).c_str(), ConvertUTF8ToWide(to).c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+	return rename(from, to) == 0;
+#endif
+}
+
+MappedFile::MappedFile() {
+}
+
+MappedFile::~MappedFile() {
+	Close();
+}
+
+bool MappedFile::Open(const char* filename) {
+	Close();
+#ifdef _WIN32
+	File = CreateFileW(ConvertUTF8ToWide(filename).c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (File == INVALID_HANDLE_VALUE)
+		return false;
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(File, &size) || size.QuadPart == 0 || (uint64_t) size.QuadPart > (uint64_t) SIZE_MAX) {
+		Close();
+		return false;
+	}
+	Mapping = CreateFileMappingW(File, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (Mapping == NULL) {
+		Close();
+		return false;
+	}
+	Data = (const uint8_t*) MapViewOfFile(Mapping, FILE_MAP_READ, 0, 0, 0);
+	if (Data == nullptr) {
+		Close();
+		return false;
+	}
+	Size = (size_t) size.QuadPart;
+	return true;
+#else
+	int fd = open(filename, O_RDONLY);
+	if (fd == -1)
+		return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+		close(fd);
+		return false;
+	}
+	// The mapping holds its own reference to the file, so we can close the descriptor immediately
+	void* data = mmap(nullptr, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED)
+		return false;
+	Data = (const uint8_t*) data;
+	Size = (size_t) st.st_size;
+	return true;
+#endif
+}
+
+void MappedFile::Close() {
+#ifdef _WIN32
+	if (Data != nullptr)
+		UnmapViewOfFile(Data);
+	if (Mapping != NULL)
+		CloseHandle(Mapping);
+	if (File != INVALID_HANDLE_VALUE)
+		CloseHandle(File);
+	Mapping = NULL;
+	File    = INVALID_HANDLE_VALUE;
+#else
+	if (Data != nullptr)
+		munmap((void*) Data, Size);
+#endif
+	Data = nullptr;
+	Size = 0;
+}
+
 #ifndef _WIN32
 #undef STAT_TIME
 #endif
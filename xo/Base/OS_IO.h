@@ -35,4 +35,30 @@ The callback must respond in the following ways
 This function returns false if an error occurred other than "no files found"
 */
 XO_API bool FindFiles(const char* dir, std::function<bool(const FilesystemItem& item)> callback);
+
+// Rename a file, replacing 'to' if it exists. On POSIX systems this is atomic, and processes that
+// have the old file mapped keep seeing the old file. Windows refuses to replace a mapped file.
+XO_API bool RenameFile(const char* from, const char* to);
+
+// A read-only view of an entire file, which is mapped into memory by the OS
+// Data is null if the file could not be opened, or if it is empty.
+class XO_API MappedFile {
+	XO_DISALLOW_COPY_AND_ASSIGN(MappedFile);
+
+public:
+	const uint8_t* Data = nullptr;
+	size_t         Size = 0;
+
+	MappedFile();
+	~MappedFile();
+
+	bool Open(const char* filename);
+	void Close();
+
+private:
+#ifdef _WIN32
+	HANDLE File    = INVALID_HANDLE_VALUE;
+	HANDLE Mapping = NULL;
+#endif
+};
 }
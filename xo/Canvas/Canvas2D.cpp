@@ -261,16 +261,16 @@ void Canvas2D::Text(float x, float y, float angle, float size, Color color, cons
 	auto col = ColorToAggS8(color);
 
 	if (useCache) {
-		auto                        cache = Global()->GlyphCache;
-		std::lock_guard<std::mutex> cache_lock(cache->Lock);
-		int                         flags = 0;
-		int                         posX  = (int) pos.x;
-		int                         posY  = (int) pos.y;
+		auto          cache = Global()->GlyphCache;
+		GlyphTableRef table = cache->GetTable();
+		int           flags = 0;
+		int           posX  = (int) pos.x;
+		int           posY  = (int) pos.y;
 		for (auto ch : utfz::cp(str)) {
 			GlyphCacheKey key(fnt->ID, ch, isize, flags);
-			auto          glyph = cache->GetOrRenderGlyph(key);
+			auto          glyph = cache->GetOrRenderGlyph(key, table);
 			if (!glyph->IsNull()) {
-				auto atlas = cache->GetAtlas(glyph->AtlasID);
+				auto atlas = table->GetAtlas(glyph->AtlasID);
 				for (unsigned y = 0; y < glyph->Height; y++) {
 					int         outX = posX + glyph->MetricLeft;
 					int         outY = posY + y - glyph->MetricTop;
@@ -44,13 +44,17 @@ void VariableTable::CloneFrom_Incremental(const VariableTable& src) {
 
 	// copy new
 	size_t orgSize = Values.size();
-	for (size_t i = orgSize; i < src.Values.size(); i++)
+	for (size_t i = orgSize; i < src.Values.size(); i++) {
 		Values.push(src.Values[i]);
+		IsModified.push(true);
+	}
 
 	// copy changed
 	for (size_t i = 0; i < orgSize; i++) {
-		if (src.IsModified[i])
-			Values[i] = src.Values[i];
+		if (src.IsModified[i]) {
+			Values[i]     = src.Values[i];
+			IsModified[i] = true;
+		}
 	}
 
 	// modified bits are cleared by Doc::ResetModified()
@@ -60,4 +64,12 @@ void VariableTable::ResetModified() {
 	//IDTable.ResetModified();
 	IsModified.fill(false);
 }
+
+bool VariableTable::AnyModified() const {
+	for (size_t i = 0; i < IsModified.size(); i++) {
+		if (IsModified[i])
+			return true;
+	}
+	return false;
+}
 }
\ No newline at end of file
@@ -38,8 +38,9 @@ public:
 	const char* GetByID(int id) const;            // Returns null if not defined
 	int         GetID(const char* var) const;
 
-	void CloneFrom_Incremental(const VariableTable& src);
+	void CloneFrom_Incremental(const VariableTable& src); // Entries that are copied are marked as modified in this table too
 	void ResetModified();
+	bool AnyModified() const;
 
 protected:
 	xo::Doc*             Doc;
@@ -267,6 +267,73 @@ void WorkerThreadFunc() {
 	}
 }
 
+// Shared by the thread that calls RunJobsInParallel, and the worker threads that help it.
+// A worker thread can pick up its queue entry long after the batch is finished, so the last
+// thread out deletes the batch, and a thread may only call Func while it holds a job.
+struct ParallelJobBatch {
+	void (*Func)(void* context, int job, int thread);
+	void*            Context;
+	int              NumJobs;
+	std::atomic<int> NextJob;
+	std::atomic<int> NextThread;
+	std::atomic<int> RefCount;
+	Semaphore        JobDone; // Signalled by the worker threads, once for every job that they finish
+};
+
+// Returns the number of jobs that we ran
+static int RunParallelJobs(ParallelJobBatch* batch, bool signalEachJob) {
+	int thread = -1;
+	int ran    = 0;
+	while (true) {
+		int i = batch->NextJob++;
+		if (i >= batch->NumJobs)
+			break;
+		if (thread == -1)
+			thread = batch->NextThread++;
+		batch->Func(batch->Context, i, thread);
+		ran++;
+		// Once the final job is signalled, the caller of RunJobsInParallel is free to carry on
+		if (signalEachJob)
+			batch->JobDone.signal();
+	}
+	return ran;
+}
+
+static void ReleaseParallelJobs(ParallelJobBatch* batch) {
+	if (--batch->RefCount == 0)
+		delete batch;
+}
+
+static void ParallelJobFunc(void* data) {
+	ParallelJobBatch* batch = (ParallelJobBatch*) data;
+	RunParallelJobs(batch, true);
+	ReleaseParallelJobs(batch);
+}
+
+XO_API void RunJobsInParallel(int numJobs, int maxThreads, void* context, void (*func)(void* context, int job, int thread)) {
+	int numThreads = Min(numJobs, Min(maxThreads, (int) Global()->WorkerThreads.size() + 1));
+	if (numThreads <= 1) {
+		for (int i = 0; i < numJobs; i++)
+			func(context, i, 0);
+		return;
+	}
+
+	ParallelJobBatch* batch = new ParallelJobBatch();
+	batch->Context          = context;
+	batch->Func             = func;
+	batch->NumJobs          = numJobs;
+	batch->NextJob          = 0;
+	batch->NextThread       = 0;
+	batch->RefCount         = numThreads;
+	for (int i = 1; i < numThreads; i++)
+		Global()->JobQueue.Add({batch, ParallelJobFunc});
+
+	int ranHere = RunParallelJobs(batch, false);
+	for (int i = ranHere; i < numJobs; i++)
+		batch->JobDone.wait();
+	ReleaseParallelJobs(batch);
+}
+
 static void InitializeThread();
 static void ShutdownThread();
 
@@ -277,11 +344,8 @@ void UIThread() {
 		Global()->UIEventQueue.SemObj().wait();
 		if (Global()->ExitSignalled)
 			break;
-		OriginalEvent          ev;
-		TQueue<OriginalEvent>& q      = Global()->UIEventQueue;
-		uint32_t               qsize1 = q.Size();
-		XO_VERIFY(Global()->UIEventQueue.PopTail(ev));
-		uint32_t qsize2 = q.Size();
+		OriginalEvent ev;
+		Global()->UIEventQueue.PopTailAfterSignal(ev);
 		ev.DocGroup->ProcessEvent(ev.Event);
 	}
 }
@@ -385,7 +449,7 @@ XO_API void Initialize(const InitParams* init) {
 		Globals->CacheDir = DefaultCacheDir();
 
 	Globals->TargetFPS            = 60;
-	Globals->NumWorkerThreads     = Min(numCPUCores, 4); // I can't think of a reason right now why you'd want lots of these
+	Globals->NumWorkerThreads     = Max(numCPUCores - 1, 1); // The render thread participates in parallel layout, so leave one core for it
 	Globals->MaxSubpixelGlyphSize = 60;
 	Globals->PreferOpenGL         = false; // Should be false on Windows, because DX generally starts up faster than OpenGL
 	Globals->EnableVSync          = false;
@@ -413,20 +477,22 @@ XO_API void Initialize(const InitParams* init) {
 #endif
 	// Do we round text line heights to whole pixels?
 	// We only render sub-pixel text on low resolution monitors that do not change orientation (ie desktop).
-	Globals->RoundLineHeights    = Globals->EnableSubpixelText || Globals->EpToPixel < 2.0f;
-	Globals->SnapBoxes           = true;
-	Globals->SnapHorzText        = false;
-	Globals->UseFreetypeSubpixel = false;
-	Globals->EnableKerning       = !Globals->EnableSubpixelText || !Globals->SnapHorzText;
-	Globals->EnableKerning       = false; // Freetype's kerning is CRAZY SLOW.. from one quick profile that I did. Will investigate more later.
-	Globals->ShowCoarseTimes     = false;
+	Globals->RoundLineHeights     = Globals->EnableSubpixelText || Globals->EpToPixel < 2.0f;
+	Globals->SnapBoxes            = true;
+	Globals->SnapHorzText         = false;
+	Globals->UseFreetypeSubpixel  = false;
+	Globals->EnableKerning        = !Globals->EnableSubpixelText || !Globals->SnapHorzText;
+	Globals->EnableParallelLayout = true;
+	Globals->EnablePartialRepaint = true;
+	Globals->EnableDisplayList    = true;
+	Globals->EnableGlyphDiskCache = false;
+	Globals->ShowCoarseTimes      = false;
 	//Globals->DebugZeroClonedChildList = true;
 	Globals->MaxTextureID = ~((TextureID) 0);
 	//Globals->ClearColor.Set( 200, 0, 200, 255 );  // Make our clear color a very noticeable purple, so you know when you've screwed up the root node
 	Globals->ClearColor.Set(255, 150, 255, 255); // Make our clear color a very noticeable purple, so you know when you've screwed up the root node
 	Globals->DocAddQueue.Initialize(false);
 	Globals->DocRemoveQueue.Initialize(false);
-	Globals->UIEventQueue.Initialize(true);
 	Globals->JobQueue.Initialize(true);
 	Globals->FontStore = new FontStore();
 	Globals->FontStore->InitializeFreetype();
@@ -466,6 +532,7 @@ XO_API void Shutdown() {
 	for (size_t i = 0; i < Globals->WorkerThreads.size(); i++)
 		Globals->WorkerThreads[i].join();
 
+	Globals->GlyphCache->SaveDiskCache();
 	Globals->GlyphCache->Clear();
 	delete Globals->GlyphCache;
 	Globals->GlyphCache = NULL;
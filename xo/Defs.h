@@ -34,6 +34,7 @@ struct RenderCharEl;
 class RenderBase;
 class RenderGL;
 class RenderDX;
+class RenderSoft;
 class String;
 class StringTable;
 class Style;
@@ -103,6 +104,21 @@ inline uint8_t MulUBCheap(uint8_t a, uint8_t b) {
 	return (uint8_t)(i >> 8);
 }
 
+// A frame number that many threads may write to at once, such as the last time that a cache entry
+// was used. Relaxed ordering is enough, because a stale value only affects what gets evicted.
+struct FrameStamp {
+	std::atomic<uint32_t> V;
+
+	FrameStamp() : V(0) {}
+	FrameStamp(const FrameStamp& b) : V(b.Load()) {}
+	FrameStamp& operator=(const FrameStamp& b) {
+		Store(b.Load());
+		return *this;
+	}
+	uint32_t Load() const { return V.load(std::memory_order_relaxed); }
+	void     Store(uint32_t v) { V.store(v, std::memory_order_relaxed); }
+};
+
 template <typename T>
 int Sign(T real) {
 	return (real == 0) ? 0 : (real < 0 ? -1 : 1);
@@ -389,7 +405,9 @@ struct Job {
 };
 
 struct XO_API RenderStats {
-	uint32_t Clone_NumEls; // Number of DOM elements cloned
+	uint32_t Clone_NumEls;         // Number of DOM elements cloned
+	uint32_t Clone_NumClassTables; // Number of times the class style table was cloned
+	uint32_t Clone_NumTagStyles;   // Number of tag styles cloned
 
 	void Reset();
 };
@@ -461,9 +479,49 @@ enum Shaders {
 	ShaderArc,
 	ShaderQuadraticSpline,
 	ShaderUber,
+	ShaderBox,
 	// We may someday want to have slots down here available for application-defined custom shaders
 };
 
+/* The process-wide queue of UI events, consumed by the one-and-only UI thread.
+
+Any thread may add events. The ring is lock-free (see MPSCQueue), and the consumer waits on
+a lightweight semaphore, which only enters the kernel when the queue is empty.
+
+High frequency events (mouse moves, timers) are added with AddOrCoalesce. Each DocGroup has a
+slot per coalesced event type, which holds the latest pending event of that type. While the
+slot is queued, new events overwrite it in O(1), instead of adding to the queue, and the pointer
+samples that they replace are appended to the slot's history. The UI thread receives the history
+in Event::History, so that a drawing program can see every sample that the OS sent, no matter how
+far behind the UI thread falls.
+
+Consumers must obey the same pattern as Queue: wait on SemObj(), and then pop one event with
+PopTailAfterSignal. The ring holds a fixed number of events. The UI thread may add events to its
+own queue, but if the ring is full at that moment, then we abort, because nobody else can make space.
+*/
+class XO_API EventQueue {
+public:
+	EventQueue();
+	~EventQueue();
+
+	void    Add(const OriginalEvent& ev);
+	void    AddOrCoalesce(const OriginalEvent& ev); // Falls back to Add() if the event type is not coalesced
+	bool    PopTail(OriginalEvent& ev);             // Only the UI thread may call this
+	void    PopTailAfterSignal(OriginalEvent& ev);  // Only the UI thread may call this, after SemObj() has been signaled
+	int32_t Size() const { return Ring.Size(); }
+
+	LightweightSemaphore& SemObj() { return Sem; }
+
+private:
+	struct Item;
+	MPSCQueue<Item>              Ring;
+	LightweightSemaphore         Sem;
+	std::atomic<std::thread::id> Consumer{std::thread::id()}; // Thread that last popped an event
+
+	void AddToRing(const Item& item);
+	void Deliver(Item& item, OriginalEvent& ev);
+};
+
 // A single instance of this is accessible via Global()
 struct GlobalStruct {
 	int  TargetFPS;
@@ -474,6 +532,10 @@ struct GlobalStruct {
 	bool EnableSubpixelText;    // Enable sub-pixel text rendering. Assumes pixels are the standard RGB layout. Enabled by default on Windows desktop only.
 	bool EnableSRGBFramebuffer; // Enable sRGB framebuffer (implies linear blending)
 	bool EnableKerning;         // Enable kerning on text
+	bool EnableParallelLayout;  // Lay out independent subtrees on the worker threads.
+	bool EnablePartialRepaint;  // Only repaint the parts of the window that changed, on devices that can tell us the age of their back buffer.
+	bool EnableDisplayList;     // Replay the vertices of subtrees that have not changed since a previous frame, instead of generating them again.
+	bool EnableGlyphDiskCache;  // Keep rasterized glyphs in CacheDir between runs, so that startup doesn't wait for Freetype. Set this before any fonts are loaded.
 	bool RoundLineHeights;      // Round text line heights to integer amounts, so that text line separation is not subject to sub-pixel positioning differences.
 	bool SnapBoxes;             // Round certain boxes up to integer pixels.
 	                            // From the perspective of having the exact same layout on multiple devices, it seems desirable to operate
@@ -506,7 +568,7 @@ struct GlobalStruct {
 	cheapvec<DocGroup*>   Docs;           // Only Main thread is allowed to touch this.
 	TQueue<DocGroup*>     DocAddQueue;    // Documents requesting addition
 	TQueue<DocGroup*>     DocRemoveQueue; // Documents requesting removal
-	TQueue<OriginalEvent> UIEventQueue;   // Global event queue, consumed by the one-and-only UI thread
+	EventQueue            UIEventQueue;   // Global event queue, consumed by the one-and-only UI thread
 	TQueue<Job>           JobQueue;       // Global job queue, consumed by the worker thread pool
 	xo::FontStore*        FontStore;      // All fonts known to the system.
 	xo::GlyphCache*       GlyphCache;     // This might have to move into a less global domain.
@@ -544,6 +606,10 @@ XO_API void    ParseFail(const char* msg, ...);
 XO_API void    StyleVarLookupFailed(const char* var);
 XO_API void    TimeTraceBuf(const char* msg);
 
+// Run func(context, job, thread) for every job in [0, numJobs), on at most maxThreads threads, one of which is the calling
+// thread. 'thread' is unique to every thread that participates, and is less than maxThreads. Returns once all jobs are done.
+XO_API void RunJobsInParallel(int numJobs, int maxThreads, void* context, void (*func)(void* context, int job, int thread));
+
 template <typename... Args>
 void Trace(const char* fs, const Args&... args) {
 	XO_TRACE_WRITE(tsf::fmt(fs, args...).c_str());
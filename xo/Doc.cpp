@@ -14,8 +14,9 @@ namespace xo {
 
 Doc::Doc(DocGroup* group)
     : Root(this, TagBody, InternalIDNull), UI(this), Group(group), StyleVariables(this), VectorIcons(this) {
-	IsReadOnly = false;
-	Version    = 0;
+	IsReadOnly     = false;
+	Version        = 0;
+	TimerNextDueMS = INT64_MAX;
 	ClassStyles.AddDummyStyleZero();
 	ResetInternalIDs();
 	InitializeDefaultTagStyles();
@@ -35,8 +36,9 @@ void Doc::IncVersion() {
 }
 
 void Doc::ResetModifiedBitmap() {
-	if (ChildIsModified.size() != 0)
-		ChildIsModified.fill(false);
+	for (auto id : ModifiedIDs)
+		ChildIsModified[id] = false;
+	ModifiedIDs.clear_noalloc();
 	StyleVariables.ResetModified();
 	StyleVerbatimStrings.ResetModified();
 }
@@ -47,6 +49,8 @@ void Doc::MakeFreeIDsUsable() {
 }
 
 // This clones only the objects that are marked as modified.
+// The modified bits are carried over into the clone, where they accumulate until the clone's
+// owner calls ResetModifiedBitmap(). Layout uses them to find the subtrees that it cannot reuse.
 void Doc::CloneSlowInto(Doc& c, uint32_t cloneFlags, RenderStats& stats) const {
 	c.IsReadOnly = true;
 
@@ -58,37 +62,53 @@ void Doc::CloneSlowInto(Doc& c, uint32_t cloneFlags, RenderStats& stats) const {
 	// since I suspect these passes will be bandwidth limited.
 
 	// Pass 1: Ensure that all objects that are present in the source document have a valid pointer in the target document
-	for (size_t i = 0; i < ChildIsModified.size(); i++) {
-		if (ChildIsModified[i]) {
-			stats.Clone_NumEls++;
-			const DomEl* src = GetChildByInternalID((xo::InternalID) i);
-			DomEl*       dst = c.GetChildByInternalIDMutable((xo::InternalID) i);
-			if (src && !dst) {
-				// create in destination
-				c.ChildByInternalID[i] = c.AllocChild(src->GetTag(), src->GetParentID());
-			} else if (!src && dst) {
-				// destroy destination. Make it forget its children, because this loop takes care of all elements.
-				dst->ForgetChildren();
-				c.FreeChild(dst);
-				c.ChildByInternalID[i] = nullptr;
-			}
+	for (auto i : ModifiedIDs) {
+		stats.Clone_NumEls++;
+		const DomEl* src = GetChildByInternalID(i);
+		DomEl*       dst = c.GetChildByInternalIDMutable(i);
+		if (src && !dst) {
+			// create in destination
+			c.ChildByInternalID[i] = c.AllocChild(src->GetTag(), src->GetParentID());
+		} else if (!src && dst) {
+			// destroy destination. Make it forget its children, because this loop takes care of all elements.
+			dst->ForgetChildren();
+			c.FreeChild(dst);
+			c.ChildByInternalID[i] = nullptr;
 		}
 	}
 
 	// Pass 2: Clone the contents of all our modified objects into our target
-	for (size_t i = 0; i < ChildIsModified.size(); i++) {
-		if (ChildIsModified[i]) {
-			const DomEl* src = GetChildByInternalID((xo::InternalID) i);
-			DomEl*       dst = c.GetChildByInternalIDMutable((xo::InternalID) i);
-			if (src)
-				src->CloneSlowInto(*dst, cloneFlags);
-		}
+	for (auto i : ModifiedIDs) {
+		const DomEl* src = GetChildByInternalID(i);
+		DomEl*       dst = c.GetChildByInternalIDMutable(i);
+		if (src)
+			src->CloneSlowInto(*dst, cloneFlags);
+		c.MarkModified(i);
 	}
 
-	ClassStyles.CloneSlowInto(c.ClassStyles);
-	CloneStaticArrayWithCloneSlowInto(c.TagStyles, TagStyles);
-
 	c.StyleVariables.CloneFrom_Incremental(StyleVariables);
+
+	// The clone's class table has its $variables expanded in place, so it must be refreshed
+	// whenever the variables change, even if the canonical classes are untouched.
+	if (c.ClonedClassStylesVersion != ClassStyles.GetVersion() || c.StyleVariables.AnyModified()) {
+		stats.Clone_NumClassTables++;
+		ClassStyles.CloneSlowInto(c.ClassStyles);
+		c.ClonedClassStylesVersion = ClassStyles.GetVersion();
+#ifdef _DEBUG
+		c.ClonedClassStylesHash = ClassStyles.Hash();
+#endif
+	} else {
+		// If this fires, then a class was modified through a StyleClass* that was not freshly obtained from GetOrCreate
+		XO_DEBUG_ASSERT(ClassStyles.Hash() == c.ClonedClassStylesHash);
+	}
+	for (size_t i = 0; i < TagEND; i++) {
+		if (!c.TagStyles[i].Equals(TagStyles[i])) {
+			stats.Clone_NumTagStyles++;
+			TagStyles[i].CloneSlowInto(c.TagStyles[i]);
+			c.TagStylesVersion++;
+		}
+	}
+
 	c.Strings.CloneFrom_Incremental(Strings);
 	c.StyleVerbatimStrings.CloneFrom_Incremental(StyleVerbatimStrings);
 
@@ -196,32 +216,44 @@ String Doc::Parse(const char* src) {
 	return Root.Parse(src);
 }
 
-void Doc::NodeGotTimer(InternalID node) {
-	NodesWithTimers.insert(node);
+bool Doc::TimerIsLater(const TimerEntry& a, const TimerEntry& b) {
+	return a.DueMS > b.DueMS;
 }
 
-void Doc::NodeLostTimer(InternalID node) {
-	NodesWithTimers.erase(node);
+void Doc::PushTimer(const TimerEntry& t) {
+	Timers += t;
+	std::push_heap(Timers.data, Timers.data + Timers.size(), TimerIsLater);
 }
 
-// Return the interval of the fastest timer of any node. Returns zero if no timers are set.
-uint32_t Doc::FastestTimerMS() {
-	uint32_t fastest = UINT32_MAX - 1;
-	for (InternalID it : NodesWithTimers) {
-		const DomNode* node = GetNodeByInternalID(it);
-		uint32_t       t    = node->FastestTimerMS();
-		if (t != 0)
-			fastest = Min(fastest, t);
-	}
-	return fastest != UINT32_MAX - 1 ? fastest : 0;
+void Doc::UpdateTimerNextDue() {
+	TimerNextDueMS = Timers.size() == 0 ? INT64_MAX : Timers[0].DueMS;
+}
+
+void Doc::ScheduleTimer(InternalID node, EventHandler& handler, int64_t nowTicksMS) {
+	// The previous entry for this handler (if any) becomes stale, because its DueMS no longer matches
+	handler.TimerDueMS = nowTicksMS + handler.TimerPeriodMS;
+	PushTimer({handler.TimerDueMS, node, handler.ID});
+	UpdateTimerNextDue();
 }
 
-// Returns all nodes that have timers which have elapsed
+// Returns all timers which have elapsed. The caller is expected to run them immediately, so their
+// next tick is scheduled for one period from now.
 void Doc::ReadyTimers(int64_t nowTicksMS, cheapvec<NodeEventIDPair>& handlers) {
-	for (InternalID id : NodesWithTimers) {
-		DomNode* node = GetNodeByInternalIDMutable(id);
-		node->ReadyTimers(nowTicksMS, handlers);
+	while (Timers.size() != 0 && Timers[0].DueMS <= nowTicksMS) {
+		TimerEntry t = Timers[0];
+		std::pop_heap(Timers.data, Timers.data + Timers.size(), TimerIsLater);
+		Timers.pop();
+
+		DomNode*      node = (size_t) t.Node < ChildByInternalID.size() ? GetNodeByInternalIDMutable(t.Node) : nullptr;
+		EventHandler* h    = node ? node->HandlerByID(t.HandlerID) : nullptr;
+		if (h == nullptr || h->TimerPeriodMS == 0 || h->TimerDueMS != t.DueMS)
+			continue;
+
+		handlers.push({t.Node, t.HandlerID});
+		h->TimerDueMS = nowTicksMS + h->TimerPeriodMS;
+		PushTimer({h->TimerDueMS, t.Node, t.HandlerID});
 	}
+	UpdateTimerNextDue();
 }
 
 void Doc::NodeGotRender(InternalID node) {
@@ -284,8 +316,6 @@ void Doc::ChildRemoved(DomEl* el) {
 	XO_ASSERT(el->GetDoc() == this);
 	DomNode* node = el->ToNode();
 	if (node) {
-		if (node->HandlesEvent(EventTimer))
-			NodeLostTimer(elID);
 		if (node->HandlesEvent(EventRender))
 			NodeLostRender(elID);
 	}
@@ -299,11 +329,18 @@ void Doc::ChildRemoved(DomEl* el) {
 }
 
 void Doc::SetChildModified(InternalID id) {
+	MarkModified(id);
+	IncVersion();
+}
+
+void Doc::MarkModified(InternalID id) {
 	size_t index = id;
 	while (ChildIsModified.size() <= index)
 		ChildIsModified.push_back(false);
-	ChildIsModified[index] = true;
-	IncVersion();
+	if (!ChildIsModified[index]) {
+		ChildIsModified[index] = true;
+		ModifiedIDs += id;
+	}
 }
 
 void Doc::Reset() {
@@ -319,8 +356,10 @@ void Doc::Reset() {
 	Pool.FreeAll();
 	Root.SetInternalID(InternalIDNull); // Root will be assigned InternalIDRoot when we call ChildAdded() on it.
 	ChildIsModified.clear();
+	ModifiedIDs.clear();
 	ResetInternalIDs();
-	NodesWithTimers.clear();
+	Timers.clear();
+	UpdateTimerNextDue();
 }
 
 void Doc::ResetInternalIDs() {
@@ -74,10 +74,10 @@ public:
 
 	String Parse(const char* src); // Set the entire document from a single xml-like string. Returns empty string on success, or error message.
 
-	void     NodeGotTimer(InternalID node);
-	void     NodeLostTimer(InternalID node);
-	uint32_t FastestTimerMS();
-	void     ReadyTimers(int64_t nowTicksMS, cheapvec<NodeEventIDPair>& handlers);
+	// Timers are kept in a min-heap, ordered by the time at which they next tick
+	void    ScheduleTimer(InternalID node, EventHandler& handler, int64_t nowTicksMS); // Called whenever a timer handler is added, or its period changes
+	int64_t NextTimerDueMS() const { return TimerNextDueMS; }                           // Time in MilliTicks() of our earliest timer, or INT64_MAX if none. Safe to call from any thread.
+	void    ReadyTimers(int64_t nowTicksMS, cheapvec<NodeEventIDPair>& handlers);       // Fetch the timers that are due, and schedule their next tick
 
 	// Register a handler that is called the next time we have finished rendering.
 	// These callbacks are called only once.
@@ -96,6 +96,10 @@ public:
 	void           ChildAdded(DomEl* el);
 	void           ChildRemoved(DomEl* el);
 	void           SetChildModified(InternalID id);
+	bool           IsChildModified(InternalID id) const { return (size_t) id < ChildIsModified.size() && ChildIsModified[id]; }
+	const cheapvec<InternalID>& GetModifiedIDs() const { return ModifiedIDs; }
+	bool           AnyStyleVariablesModified() const { return StyleVariables.AnyModified(); }
+	uint64_t       GetStyleTablesVersion() const { return ((uint64_t) ClonedClassStylesVersion << 32) | TagStylesVersion; } // Render clone only. Changes whenever class or tag styles are copied in.
 	size_t         ChildByInternalIDListSize() const { return ChildByInternalID.size(); }
 	const DomEl**  ChildByInternalIDList() const { return (const DomEl**) ChildByInternalID.data; }
 	const DomEl*   GetChildByInternalID(InternalID id) const { return ChildByInternalID[id]; } // A NULL result means this child has been deleted
@@ -104,14 +108,27 @@ public:
 	DomNode*       GetNodeByInternalIDMutable(InternalID id) { return ChildByInternalID[id] ? ChildByInternalID[id]->ToNode() : nullptr; }
 
 protected:
+	// A timer inside the Timers heap. Entries whose handler has been removed or rescheduled since they were
+	// added are discarded when they reach the top of the heap.
+	struct TimerEntry {
+		int64_t    DueMS;
+		InternalID Node;
+		uint64_t   HandlerID;
+	};
+
 	volatile uint32_t      Version;
 	xo::Pool               Pool;       // Used only when making a clone via CloneFast()
 	bool                   IsReadOnly; // Read-only clone used for rendering
 	cheapvec<DomEl*>       ChildByInternalID;
 	cheapvec<bool>         ChildIsModified; // Bit is set if child has been modified since we last synced with the renderer -- TODO - change to proper bitmap
+	cheapvec<InternalID>   ModifiedIDs;     // Every ID whose ChildIsModified bit is set, so that a sync costs O(modified) instead of O(document)
+	uint32_t               ClonedClassStylesVersion = 0; // Render clone only: canonical ClassStyles version at our last copy
+	uint32_t               TagStylesVersion         = 0; // Render clone only: incremented whenever a tag style is copied in
+	uint64_t               ClonedClassStylesHash    = 0; // Render clone only, debug builds: hash of the canonical ClassStyles at our last copy
 	cheapvec<InternalID>   UsableIDs;       // When we do a render sync, then FreeIDs are moved into UsableIDs
 	cheapvec<InternalID>   FreeIDs;
-	ohash::set<InternalID> NodesWithTimers;     // Set of all nodes that have an OnTimer event handler registered
+	cheapvec<TimerEntry>   Timers;              // Min-heap of timers, ordered by DueMS
+	std::atomic<int64_t>   TimerNextDueMS;      // DueMS of the top of Timers, so that the message loop can read it without a lock
 	ohash::set<InternalID> NodesWithRender;     // Set of all nodes that have an OnRender event handler registered
 	ohash::set<InternalID> NodesWithDocProcess; // Set of all nodes that have an OnDocProcess event handler registered
 	VariableTable          StyleVariables;
@@ -119,6 +136,11 @@ protected:
 	VariableTable          VectorIcons;          // SVG Icons. Abuse VariableTable... VariableTable might need a rename or a slight refactor!
 
 	void ResetInternalIDs();
+	void MarkModified(InternalID id);
+	void PushTimer(const TimerEntry& t);
+	void UpdateTimerNextDue();
+
+	static bool TimerIsLater(const TimerEntry& a, const TimerEntry& b);
 	void InitializeDefaultTagStyles();
 	void InitializeDefaultControls();
 };
@@ -8,6 +8,7 @@
 #include "Render/RenderDomEl.h"
 #include "Render/RenderBase.h"
 #include "Render/RenderGL.h"
+#include "Render/RenderSoft.h"
 #include "Render/StyleResolve.h"
 #include "Image/Image.h"
 
@@ -39,6 +40,7 @@ DocGroup::DocGroup() {
 
 DocGroup::~DocGroup() {
 	delete RenderDoc;
+	delete HeadlessRenderer;
 	if (DestroyDocWithGroup)
 		delete Doc;
 }
@@ -56,6 +58,11 @@ RenderResult DocGroup::RenderToImage(Image& image) {
 	return res;
 }
 
+RenderResult DocGroup::RenderAndCapture(Image& image, bool& captured) {
+	captured = false;
+	return RenderInternal(&image, &captured);
+}
+
 /* This is always called from the Render thread
 You might ask: Why do we copy from Doc to RenderDoc from here, running
 in the Render thread? The only time that Doc is modified, is when an event
@@ -68,8 +75,8 @@ Secondly, as part of the copy operation, we upload any altered textures
 to the GPU. This is obviously a can of worms that we don't want to open
 (ie multithreaded access to the GPU).
 */
-RenderResult DocGroup::RenderInternal(Image* targetImage) {
-	bool wndDirty = Wnd->GetInvalidateRect().IsAreaPositive();
+RenderResult DocGroup::RenderInternal(Image* targetImage, bool* captured) {
+	bool wndDirty = Wnd != nullptr && Wnd->GetInvalidateRect().IsAreaPositive();
 	bool haveLock = false;
 
 	// If docAge = 0, then we do not need to make a new copy of Doc.
@@ -113,27 +120,41 @@ RenderResult DocGroup::RenderInternal(Image* targetImage) {
 	RenderResult rendResult   = RenderResultDone;
 	bool         presentFrame = false;
 
-	if (docValid && Wnd != nullptr) {
+	if (docValid) {
 		//TimeTrace( "Render start\n" );
-		if (!beganRender && !Wnd->BeginRender()) {
+		if (!beganRender && !BeginRender()) {
 			TimeTrace("BeginRender failed\n");
 			return RenderResultNeedMore;
 		}
 		beganRender = true;
 
 		//TimeTrace( "Render DO\n" );
-		rendResult = RenderDoc->Render(Wnd->Renderer);
+		// The OS may have trashed the window, and a read back needs every pixel
+		rendResult = RenderDoc->Render(Driver(), wndDirty || targetImage != nullptr);
 
 		presentFrame = true;
 
-		if (targetImage != nullptr)
-			Wnd->Renderer->ReadBackbuffer(*targetImage);
+		if (captured != nullptr && !Driver()->CanQueueReadBackbuffer()) {
+			*captured = Driver()->ReadBackbuffer(*targetImage);
+		} else if (captured != nullptr) {
+			// Deliver the oldest frame if it's ready, which frees up a slot for this one. Frames are only ever
+			// delivered through the queue, because reading this frame directly would put it ahead of the queued ones.
+			*captured = Driver()->ReadQueuedBackbuffer(*targetImage, false);
+			if (!Driver()->QueueReadBackbuffer()) {
+				// The queue is full, so wait for the oldest frame, and queue this one in the slot that it frees up
+				*captured = Driver()->ReadQueuedBackbuffer(*targetImage, true);
+				if (!Driver()->QueueReadBackbuffer())
+					XOTRACE_WARNING("The GPU is too far behind to queue another read back. The frame is lost.\n");
+			}
+		} else if (targetImage != nullptr) {
+			Driver()->ReadBackbuffer(*targetImage);
+		}
 	}
 
 	if (beganRender) {
 		// presentFrame will be false when the only action we've taken on the GPU is uploading textures.
 		//TimeTrace( "Render Finish\n" );
-		Wnd->EndRender(presentFrame ? 0 : EndRenderNoSwap);
+		EndRender(presentFrame ? 0 : EndRenderNoSwap);
 	}
 
 	// If anybody is listening, queue a "post render" event
@@ -159,13 +180,14 @@ void DocGroup::UploadImagesToGPU(bool& beganRender) {
 	beganRender                    = false;
 	cheapvec<Image*> invalidImages = Doc->Images.InvalidList();
 	if (invalidImages.size() != 0) {
-		if (!Wnd->BeginRender())
+		if (!BeginRender())
 			return;
 
 		beganRender = true;
 
 		for (size_t i = 0; i < invalidImages.size(); i++) {
-			if (Wnd->Renderer->LoadTexture(invalidImages[i], 0)) {
+			invalidImages[i]->ContentVersion++;
+			if (Driver()->LoadTexture(invalidImages[i], 0)) {
 				invalidImages[i]->ClearInvalidRect();
 			} else {
 				XOTRACE_WARNING("Failed to upload image to GPU\n");
@@ -174,41 +196,62 @@ void DocGroup::UploadImagesToGPU(bool& beganRender) {
 	}
 }
 
+bool DocGroup::FlushCapture(Image& image) {
+	if (!BeginRender())
+		return false;
+	bool ok = Driver()->ReadQueuedBackbuffer(image, true);
+	EndRender(EndRenderNoSwap);
+	return ok;
+}
+
 uint32_t DocGroup::DocAge() const {
 	return Doc->GetVersion() - RenderDoc->Doc.GetVersion();
 }
 
-struct AddOrReplaceMessage_Context {
-	const OriginalEvent* NewEvent;
-	bool                 DidReplace;
-};
-
-static bool AddOrReplaceMessage_Scan(void* context, OriginalEvent* iter) {
-	AddOrReplaceMessage_Context* cx = (AddOrReplaceMessage_Context*) context;
-	if (iter->DocGroup == cx->NewEvent->DocGroup && iter->Event.Type == cx->NewEvent->Event.Type) {
-		// TODO: Keep a history of the replaced events, so that a program that needs to have
-		// smooth cursor input can use all of the events that were sent by the OS. To do this, we'll
-		// want to store time of events, as well as extend Event to be able to store a chain of
-		// missed events that came before it.
-		cx->DidReplace = true;
-		*iter          = *cx->NewEvent;
-		return false;
+RenderBase* DocGroup::Driver() {
+	if (Wnd != nullptr)
+		return Wnd->Renderer;
+	if (HeadlessRenderer == nullptr)
+		HeadlessRenderer = new RenderSoft();
+	return HeadlessRenderer;
+}
+
+// Without a window, the size of the frame comes from the document's viewport
+bool DocGroup::BeginRender() {
+	if (Wnd != nullptr)
+		return Wnd->BeginRender();
+	Driver();
+	int width  = Doc->UI.GetViewportWidth();
+	int height = Doc->UI.GetViewportHeight();
+	// We may need to upload textures before the first viewport size arrives
+	if (width == 0 || height == 0)
+		width = height = 1;
+	return HeadlessRenderer->BeginRender(width, height);
+}
+
+void DocGroup::EndRender(uint32_t endRenderFlags) {
+	if (Wnd != nullptr)
+		Wnd->EndRender(endRenderFlags);
+	else
+		HeadlessRenderer->EndRender(endRenderFlags);
+}
+
+EventCoalesceSlot* DocGroup::CoalesceSlot(Events type) {
+	switch (type) {
+	case EventMouseMove: return &MouseMoveSlot;
+	case EventTimer: return &TimerSlot;
+	default: return nullptr;
 	}
-	return true;
 }
 
 // Why do we do this? Normally the OS does this for us - it coalesces mouse move messages into
 // a single message, when we ask for it. However, because our message polling loop runs on a different
 // thread to our 'program' thread, we can consume mouse move messages faster than the 'program'
 // can process them. By 'program' here, we mean the DOM event handlers that run from our UI thread.
-// Because of this, we can end up with a massive backlog of messages to process. Right now
-// all we do is replace old events from the queue, but in future.. see the TODO message above.
+// Because of this, we can end up with a massive backlog of messages to process. Instead, we replace
+// the pending event, and the replaced samples are delivered to the program in Event::History.
 void DocGroup::AddOrReplaceMessage(const OriginalEvent& ev) {
-	AddOrReplaceMessage_Context cx = {&ev, false};
-	Global()->UIEventQueue.Scan(false, &cx, &AddOrReplaceMessage_Scan);
-	if (!cx.DidReplace) {
-		Global()->UIEventQueue.Add(ev);
-	}
+	Global()->UIEventQueue.AddOrCoalesce(ev);
 }
 
 // This function is called from the one and only UIThread, inside Defs.cpp
@@ -237,25 +280,32 @@ void DocGroup::ProcessEvent(Event& ev) {
 
 	LayoutResult* layout = RenderDoc->AcquireLatestLayout();
 
-	Cursors oldCursor  = Doc->UI.GetCursor();
-	auto    oldVersion = Doc->GetVersion();
+	Cursors oldCursor   = Doc->UI.GetCursor();
+	auto    oldVersion  = Doc->GetVersion();
+	int64_t oldTimerDue = Doc->NextTimerDueMS();
 
 	Doc->UI.InternalProcessEvent(ev, layout);
 
 	// Get the main thread to update it's cursor now
-	if (Doc->UI.GetCursor() != oldCursor) {
+	// When headless, there is no message loop to notify.
+	if (Wnd != nullptr && Doc->UI.GetCursor() != oldCursor) {
 		Wnd->PostCursorChangedMessage();
 	}
 
-	if (Doc->GetVersion() != oldVersion) {
+	if (Wnd != nullptr && Doc->GetVersion() != oldVersion) {
 		Wnd->PostRepaintMessage();
 	}
 
+	// Get the main thread to sleep until our new earliest timer
+	if (Wnd != nullptr && Doc->NextTimerDueMS() != oldTimerDue) {
+		Wnd->PostTimersChangedMessage();
+	}
+
 	RenderDoc->ReleaseLayout(layout);
 }
 
 bool DocGroup::IsDirty() const {
-	return IsDocVersionDifferentToRenderer() || Wnd->GetInvalidateRect().IsAreaPositive();
+	return IsDocVersionDifferentToRenderer() || (Wnd != nullptr && Wnd->GetInvalidateRect().IsAreaPositive());
 }
 
 bool DocGroup::IsDocVersionDifferentToRenderer() const {
@@ -12,7 +12,7 @@ class XO_API DocGroup {
 
 public:
 	xo::Doc*        Doc                 = nullptr; // Canonical Document, which the UI thread manipulates. Guarded by DocLock.
-	SysWnd*         Wnd                 = nullptr;
+	SysWnd*         Wnd                 = nullptr; // If null, then we render headless, with RenderSoft
 	xo::RenderDoc*  RenderDoc           = nullptr; // Copy of Canonical Document, as well as rendered state of document
 	bool            DestroyDocWithGroup = false;
 	xo::RenderStats RenderStats;
@@ -22,11 +22,21 @@ public:
 	DocGroup();
 	virtual ~DocGroup();
 
-	// These are the only 3 entry points into our content
+	// These are the only entry points into our content
 	RenderResult Render();                    // This is always called from the Render thread
 	RenderResult RenderToImage(Image& image); // This is always called from the Render thread
 	void         ProcessEvent(Event& ev);     // This is always called from the UI thread
 
+	// For capturing a stream of frames. Renders a frame, and queues a read back of it, without waiting for the GPU.
+	// If a frame that was queued earlier is ready, then it is delivered into image, and captured is set to true.
+	// Frames are delivered in the order in which they were rendered. A frame that can't be queued or read is
+	// dropped with a warning. Devices that can't queue a read back deliver the current frame immediately.
+	RenderResult RenderAndCapture(Image& image, bool& captured); // This is always called from the Render thread
+
+	// Delivers the oldest frame that RenderAndCapture has queued, waiting for the GPU if necessary. Call this until
+	// it returns false, after the last call to RenderAndCapture, to receive the frames that are still in flight.
+	bool FlushCapture(Image& image); // This is always called from the Render thread
+
 	bool IsDirty() const;
 	bool IsDocVersionDifferentToRenderer() const;
 
@@ -45,15 +55,24 @@ public:
 	// the necessary event handler, and then re-render the world if necessary.
 	void TouchedByOtherThread();
 
+	// Returns null if events of this type are never coalesced. See EventQueue::AddOrCoalesce.
+	EventCoalesceSlot* CoalesceSlot(Events type);
+
 protected:
 	std::mutex        DocLock; // Mutation of 'Doc', or cloning of 'Doc' for the renderer
 	std::atomic<bool> IsTouchedByOtherThread;
+	EventCoalesceSlot MouseMoveSlot;
+	EventCoalesceSlot TimerSlot;
+	RenderSoft*       HeadlessRenderer = nullptr; // Created on first use, when there is no Wnd
 
 	virtual void InternalTouchedByOtherThread() = 0;
 
-	RenderResult RenderInternal(Image* targetImage);
+	RenderResult RenderInternal(Image* targetImage, bool* captured = nullptr); // If captured is not null, then the read back of targetImage is queued
 	void         UploadImagesToGPU(bool& beganRender);
 	uint32_t     DocAge() const;
+	RenderBase*  Driver();
+	bool         BeginRender();
+	void         EndRender(uint32_t endRenderFlags);
 
 	static void AddOrReplaceMessage(const OriginalEvent& ev);
 };
@@ -9,6 +9,9 @@ public:
 	DocGroupLinux();
 	~DocGroupLinux() override;
 
+	int64_t TimerPostedDueMS = INT64_MAX; // Deadline of the EventTimer that we've posted to the UI thread, but which it has not yet run. Owned by the message loop.
+	bool    IsRenderPending  = false;     // True if we're on the message loop's list of documents to render on the next frame
+
 protected:
 	void InternalTouchedByOtherThread() override;
 };
@@ -293,6 +293,11 @@ LRESULT DocGroupWindows::WndProc(HWND hWnd, UINT message, WPARAM wParam, LPARAM
 		UpdateWindowsCursor(hWnd, Doc->UI.GetCursor(), wParam, lParam);
 		break;
 
+	case SysWndWindows::WM_XO_TIMERS_CHANGED:
+		// The UI thread has changed our earliest timer. All we need to do is wake up the message loop,
+		// which resets our timer before it goes back to sleep.
+		break;
+
 	case SysWndWindows::WM_XO_CURSOR_CHANGED:
 		// The UI thread will post this message to us after it has processed a mouse move
 		// message, and detected that the cursor changed as a result of that.
@@ -59,10 +59,8 @@ void DocUI::InternalProcessEvent(Event& ev, const LayoutResult* layout) {
 	case EventTimer: {
 		// Remember that any callback can do *anything* to our DOM, so we cannot assume that
 		// anything is still alive between calls to different callbacks.
-		int64_t                   nowTicksMS    = MilliTicks();
-		uint32_t                  nowTicksMS_32 = MilliTicks_32(nowTicksMS);
 		cheapvec<NodeEventIDPair> handlers;
-		Doc->ReadyTimers(nowTicksMS, handlers);
+		Doc->ReadyTimers(MilliTicks(), handlers);
 
 		Event localEv = ev;
 		for (NodeEventIDPair h : handlers) {
@@ -80,7 +78,6 @@ void DocUI::InternalProcessEvent(Event& ev, const LayoutResult* layout) {
 			// If the timer has destroyed it's owning DOM element, then 'eh' and 'target' will be dead.
 			if (!Doc->GetNodeByInternalIDMutable(h.NodeID))
 				continue;
-			eh->TimerLastTickMS = nowTicksMS_32;
 			if (localEv.IsCancelTimerToggled)
 				target->RemoveHandler(h.EventID);
 		}
@@ -337,38 +334,25 @@ void DocUI::FindTarget(Vec2f p, const LayoutResult* layout, SelectorChain& selCh
 		const RenderDomNode* top    = selChain.Nodes[stackPos];
 		Point                relPos = selChain.PosInNode[stackPos];
 		stackPos++;
-		// Walk backwards, yielding implicit z-order from child order.
 		// Pick the last (ie the top-most) child who's border-box contains
 		// this point, and continue recursing down into that node.
-		for (size_t i = top->Children.size() - 1; i != -1; i--) {
-			if (top->Children[i]->IsNode()) {
-				const RenderDomNode* childNode = static_cast<const RenderDomNode*>(top->Children[i]);
-				if (childNode->BorderBox().IsInsideMe(relPos)) {
-					selChain.Nodes.push(childNode);
-					selChain.PosInNode.push(relPos - childNode->Pos.TopLeft());
-					// Only allow a single path to the inner-most object.
-					// This code would need to be extended to handle explicit z-order
-					break;
-				}
-			} else if (top->Children[i]->IsText()) {
-				const RenderDomText* childTxt = static_cast<const RenderDomText*>(top->Children[i]);
-				if (childTxt->Pos.IsInsideMe(relPos)) {
-					// Find the nearest glyph inside this rendertext object.
-					// Because we're not adding anything new to selChain.Nodes here,
-					// this is the final stop in our walk down the DOM tree.
-					selChain.PosInNode.push(relPos - childTxt->Pos.TopLeft());
-					Point relPosToText = selChain.PosInNode.back();
-					selChain.Text      = childTxt;
-					for (size_t j = 0; j < childTxt->Text.size(); j++) {
-						const auto& g = childTxt->Text[j];
-						if (g.X <= relPosToText.X && relPosToText.X < g.X + g.Width) {
-							selChain.Glyph = &g;
-							break;
-						}
-					}
-					break;
-				}
-			}
+		// Only allow a single path to the inner-most object.
+		// This would need to be extended to handle explicit z-order.
+		const RenderDomEl* child = layout->ChildAt(top, relPos);
+		if (child == nullptr)
+			break;
+		if (child->IsNode()) {
+			const RenderDomNode* childNode = static_cast<const RenderDomNode*>(child);
+			selChain.Nodes.push(childNode);
+			selChain.PosInNode.push(relPos - childNode->Pos.TopLeft());
+		} else {
+			// Find the glyph inside this rendertext object.
+			// Because we're not adding anything new to selChain.Nodes here,
+			// this is the final stop in our walk down the DOM tree.
+			const RenderDomText* childTxt = static_cast<const RenderDomText*>(child);
+			selChain.PosInNode.push(relPos - childTxt->Pos.TopLeft());
+			selChain.Text  = childTxt;
+			selChain.Glyph = childTxt->GlyphAt(selChain.PosInNode.back().X);
 		}
 	}
 }
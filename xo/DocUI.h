@@ -33,10 +33,13 @@ public:
 	uint32_t GetViewportWidth() const { return ViewportWidth; }
 	uint32_t GetViewportHeight() const { return ViewportHeight; }
 
-	bool    IsHovering(InternalID id) const { return HoverSet.contains(id); }
-	bool    IsFocused(InternalID id) const { return CurrentFocusID == id; }
-	bool    IsCaptured(InternalID id) const { return CurrentCaptureID == id; }
-	Cursors GetCursor() const { return Cursor; }
+	bool                          IsHovering(InternalID id) const { return HoverSet.contains(id); }
+	bool                          IsFocused(InternalID id) const { return CurrentFocusID == id; }
+	bool                          IsCaptured(InternalID id) const { return CurrentCaptureID == id; }
+	InternalID                    GetFocusID() const { return CurrentFocusID; }
+	InternalID                    GetCaptureID() const { return CurrentCaptureID; }
+	const ohash::set<InternalID>& GetHoverSet() const { return HoverSet; }
+	Cursors                       GetCursor() const { return Cursor; }
 
 	// Capture input, so that all UI events are dispatched only to this node, until ReleaseCapture is called.
 	void SetCapture(InternalID id);
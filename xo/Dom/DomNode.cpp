@@ -266,6 +266,8 @@ uint64_t DomNode::AddHandler(Events ev, EventHandlerF func, EventHandlerFlags fl
 			Handlers[i].Mask |= ev;
 			Handlers[i].TimerPeriodMS = timerPeriodMS;
 			RecalcAllEventMask();
+			if (ev == EventTimer)
+				Doc->ScheduleTimer(InternalID, Handlers[i], MilliTicks());
 			return Handlers[i].ID;
 		}
 	}
@@ -277,6 +279,8 @@ uint64_t DomNode::AddHandler(Events ev, EventHandlerF func, EventHandlerFlags fl
 	h.TimerPeriodMS = timerPeriodMS;
 	h.Flags         = flags;
 	RecalcAllEventMask();
+	if (ev == EventTimer)
+		Doc->ScheduleTimer(InternalID, h, MilliTicks());
 	return h.ID;
 }
 
@@ -325,26 +329,6 @@ EventHandler* DomNode::HandlerByID(uint64_t id) {
 	return nullptr;
 }
 
-uint32_t DomNode::FastestTimerMS() const {
-	uint32_t f = UINT32_MAX - 1;
-	for (const auto& h : Handlers) {
-		if (h.TimerPeriodMS != 0) {
-			XO_ASSERT(!!(h.Mask & EventTimer));
-			f = Min(f, h.TimerPeriodMS);
-		}
-	}
-	return f != UINT32_MAX - 1 ? f : 0;
-}
-
-// This function is not const, because we're going to update EventHandler.TimerLastTickMS after retrieving the list
-void DomNode::ReadyTimers(int64_t nowTicksMS, cheapvec<NodeEventIDPair>& handlers) {
-	auto ms32 = MilliTicks_32(nowTicksMS);
-	for (auto& h : Handlers) {
-		if (h.TimerPeriodMS != 0 && ms32 - h.TimerLastTickMS > h.TimerPeriodMS)
-			handlers.push({InternalID, h.ID});
-	}
-}
-
 void DomNode::RenderHandlers(cheapvec<NodeEventIDPair>& handlers) const {
 	for (auto& h : Handlers) {
 		if (!!(h.Mask & EventRender))
@@ -372,7 +356,6 @@ void DomNode::ReleaseCapture() const {
 }
 
 void DomNode::RecalcAllEventMask() {
-	bool hadTimer      = !!(AllEventMask & EventTimer);
 	bool hadRender     = !!(AllEventMask & EventRender);
 	bool hadDocProcess = !!(AllEventMask & EventDocProcess);
 
@@ -381,15 +364,9 @@ void DomNode::RecalcAllEventMask() {
 		m |= Handlers[i].Mask;
 	AllEventMask = m;
 
-	bool hasTimerNow      = !!(AllEventMask & EventTimer);
 	bool hasRenderNow     = !!(AllEventMask & EventRender);
 	bool hasDocProcessNow = !!(AllEventMask & EventDocProcess);
 
-	if (!hadTimer && hasTimerNow)
-		Doc->NodeGotTimer(InternalID);
-	else if (hadTimer && !hasTimerNow)
-		Doc->NodeLostTimer(InternalID);
-
 	if (!hadRender && hasRenderNow)
 		Doc->NodeGotRender(InternalID);
 	else if (hadRender && !hasRenderNow)
@@ -81,8 +81,6 @@ public:
 	void          RemoveAllHandlers();
 	EventHandler* HandlerByID(uint64_t id);
 	bool          HandlesEvent(Events ev) const { return !!(AllEventMask & ev); }
-	uint32_t      FastestTimerMS() const;                                               // Returns the period of our fastest ticking timer event (or zero if none)
-	void          ReadyTimers(int64_t nowTicksMS, cheapvec<NodeEventIDPair>& handlers); // Fetch the list of timer events that are ready to run
 	void          RenderHandlers(cheapvec<NodeEventIDPair>& handlers) const;            // Fetch the list of handlers for the Render event
 	void          DocProcessHandlers(cheapvec<NodeEventIDPair>& handlers);              // Fetch the list of handlers for the DocProcess event
 	bool          HasFocus() const;                                                     // Return true if this node has the keyboard focus
@@ -157,6 +157,13 @@ public:
 	bool IsPressed(Button btn) const;
 };
 
+// A sample of pointer input that was coalesced into a later event. See Event::History.
+struct EventSample {
+	int64_t TimeMS     = 0; // MilliTicks() when the sample was queued
+	int     PointCount = 0;
+	Vec2f   PointsAbs[XO_MAX_TOUCHES]; // Points in pixels, relative to viewport top-left
+};
+
 /* User interface event (keyboard, mouse, touch, etc).
 */
 class XO_API Event {
@@ -177,6 +184,9 @@ public:
 	Vec2f                   PointsRel[XO_MAX_TOUCHES];           // Points relative to Target's content-box top-left
 	bool                    IsStopPropagationToggled = false;    // True if StopPropagation() has been called, and the event must not bubble out to enclosing DOM elements
 	bool                    IsCancelTimerToggled     = false;    // True if CancelTimer() has been called, in which case the timer will be cancelled
+	int64_t                 TimeMS                   = 0;        // MilliTicks() when the event was queued
+	const EventSample*      History                  = nullptr;  // Samples that were coalesced into this event, oldest first. Only valid while the event is being dispatched.
+	int                     HistoryCount             = 0;        // Number of samples in History
 
 	Event();
 	~Event();
@@ -195,6 +205,25 @@ public:
 	xo::Event     Event;
 };
 
+// The latest pending event of one type, for one DocGroup. See EventQueue::AddOrCoalesce.
+// The slot is guarded by a spin flag, which is only ever held for the duration of a copy.
+class XO_API EventCoalesceSlot {
+public:
+	static const size_t MaxHistory = 1024;
+
+	std::atomic<bool>     Busy{false};
+	bool                  IsQueued = false; // True if the queue holds a reference to this slot
+	xo::Event             Pending;
+	cheapvec<EventSample> History;   // Samples replaced by Pending, oldest first
+	cheapvec<EventSample> Delivered; // History of the event that the UI thread is dispatching. Only touched by the UI thread.
+
+	void Lock() {
+		while (Busy.exchange(true, std::memory_order_acquire))
+			std::this_thread::yield();
+	}
+	void Unlock() { Busy.store(false, std::memory_order_release); }
+};
+
 typedef std::function<void()>          EventHandlerLambda0; // 0 Parameters
 typedef std::function<void(Event& ev)> EventHandlerLambda1; // 1 Parameter
 
@@ -211,13 +240,13 @@ enum EventHandlerFlags {
 
 class XO_API EventHandler {
 public:
-	uint64_t      ID              = 0;
-	uint32_t      Mask            = 0;
-	uint32_t      Flags           = 0;
-	uint32_t      TimerPeriodMS   = 0; // Only applicable to Timer event handlers
-	uint32_t      TimerLastTickMS = 0; // Only applicable to Timer event handlers. Time in xo::MilliTicks() when we last ticked, truncated to uint32.
-	void*         Context         = nullptr;
-	EventHandlerF Func            = nullptr;
+	uint64_t      ID            = 0;
+	uint32_t      Mask          = 0;
+	uint32_t      Flags         = 0;
+	uint32_t      TimerPeriodMS = 0; // Only applicable to Timer event handlers
+	int64_t       TimerDueMS    = 0; // Only applicable to Timer event handlers. Time in xo::MilliTicks() when we next tick.
+	void*         Context       = nullptr;
+	EventHandlerF Func          = nullptr;
 
 	EventHandler();
 	~EventHandler();
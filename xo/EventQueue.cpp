@@ -0,0 +1,107 @@
+#include "pch.h"
+#include "Defs.h"
+#include "Event.h"
+#include "DocGroup.h"
+
+namespace xo {
+
+// If Slot is not null, then the event lives inside the slot, and only Event.DocGroup is valid here
+struct EventQueue::Item {
+	OriginalEvent      Event;
+	EventCoalesceSlot* Slot = nullptr;
+};
+
+static bool KeepsHistory(Events type) {
+	return type == EventMouseMove || type == EventTouch;
+}
+
+EventQueue::EventQueue() {
+}
+
+EventQueue::~EventQueue() {
+}
+
+void EventQueue::Add(const OriginalEvent& ev) {
+	Item item;
+	item.Event = ev;
+	if (item.Event.Event.TimeMS == 0)
+		item.Event.Event.TimeMS = MilliTicks();
+	AddToRing(item);
+}
+
+void EventQueue::AddToRing(const Item& item) {
+	if (!Ring.TryAdd(item)) {
+		// Only the consumer can make space, so it would wait on itself forever
+		XO_ASSERT(Consumer.load(std::memory_order_relaxed) != std::this_thread::get_id());
+		Ring.Add(item);
+	}
+	Sem.signal();
+}
+
+void EventQueue::AddOrCoalesce(const OriginalEvent& ev) {
+	EventCoalesceSlot* slot = ev.DocGroup != nullptr ? ev.DocGroup->CoalesceSlot(ev.Event.Type) : nullptr;
+	if (slot == nullptr) {
+		Add(ev);
+		return;
+	}
+
+	slot->Lock();
+	bool wasQueued = slot->IsQueued;
+	if (wasQueued && KeepsHistory(slot->Pending.Type)) {
+		if (slot->History.size() == EventCoalesceSlot::MaxHistory) {
+			// The UI thread is hopelessly behind. Discard the oldest half, so that this stays amortized O(1).
+			slot->History.erase(0, EventCoalesceSlot::MaxHistory / 2);
+		}
+		EventSample& s = slot->History.add();
+		s.TimeMS       = slot->Pending.TimeMS;
+		s.PointCount   = slot->Pending.PointCount;
+		memcpy(s.PointsAbs, slot->Pending.PointsAbs, sizeof(s.PointsAbs));
+	}
+	slot->Pending = ev.Event;
+	if (slot->Pending.TimeMS == 0)
+		slot->Pending.TimeMS = MilliTicks();
+	slot->IsQueued = true;
+	slot->Unlock();
+
+	if (!wasQueued) {
+		Item item;
+		item.Event.DocGroup = ev.DocGroup;
+		item.Slot           = slot;
+		AddToRing(item);
+	}
+}
+
+bool EventQueue::PopTail(OriginalEvent& ev) {
+	Item item;
+	if (!Ring.PopTail(item))
+		return false;
+	Deliver(item, ev);
+	return true;
+}
+
+void EventQueue::PopTailAfterSignal(OriginalEvent& ev) {
+	Item item;
+	Ring.PopTailAfterSignal(item);
+	Deliver(item, ev);
+}
+
+void EventQueue::Deliver(Item& item, OriginalEvent& ev) {
+	Consumer.store(std::this_thread::get_id(), std::memory_order_relaxed);
+	if (item.Slot == nullptr) {
+		ev = item.Event;
+		return;
+	}
+
+	EventCoalesceSlot* slot = item.Slot;
+	slot->Delivered.clear_noalloc();
+	slot->Lock();
+	ev.DocGroup = item.Event.DocGroup;
+	ev.Event    = slot->Pending;
+	std::swap(slot->History, slot->Delivered);
+	slot->IsQueued = false;
+	slot->Unlock();
+
+	ev.Event.History      = slot->Delivered.data;
+	ev.Event.HistoryCount = (int) slot->Delivered.size();
+}
+} // namespace xo
@@ -5,6 +5,8 @@ namespace xo {
 
 class XO_API Image : public Texture {
 public:
+	uint32_t ContentVersion = 0; // Incremented whenever the renderer finds that the pixels have changed, so that it knows to repaint the image
+
 	Image();
 	~Image(); // Destructor calls Free()
 
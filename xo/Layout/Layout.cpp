@@ -3,27 +3,50 @@
 #include "Doc.h"
 #include "Dom/DomNode.h"
 #include "Dom/DomText.h"
+#include "Render/RenderDoc.h"
 #include "Render/RenderDomEl.h"
 #include "Render/StyleResolve.h"
 #include "Text/FontStore.h"
 #include "Text/GlyphCache.h"
+#include "../dependencies/hash/xxhash_xo_wrapper.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XO_CHUNKER_SSE2 1
+#include <emmintrin.h>
+#else
+#define XO_CHUNKER_SSE2 0
+#endif
 
 namespace xo {
 
-/* This is called serially.
+Layout::Layout() {
+	Words          = nullptr;
+	EnableParallel = false;
+	IsWorker       = false;
+	JobParent      = nullptr;
+	NextJob        = 0;
+}
 
-Why do we perform layout in multiple passes, loading all missing glyphs at the end of each pass?
-The reason is because we eventually want to be able to parallelize layout.
+Layout::~Layout() {
+	DeleteAll(Workers);
+	DeleteAll(AsciiTables);
+}
 
-Missing glyphs are a once-off cost (ie once per application instance),
-so it's not worth trying to use a mutable glyph cache.
+/* This is called serially.
 
+Layout never waits for glyphs to be rasterized. It only needs glyph metrics, and when those are
+missing, we ask Freetype for them on the spot (see GetGlyphMetrics), which is much cheaper than
+rasterizing. The new metrics are handed to the glyph cache at the end, which rasterizes those
+glyphs before the next render.
 */
-void Layout::PerformLayout(const xo::Doc& doc, RenderDomNode& root, xo::Pool* pool) {
+void Layout::PerformLayout(const xo::Doc& doc, LayoutResult& result, const LayoutResult* previous, CompiledStyleCache* compiledStyles, WordCache* words) {
 	Doc        = &doc;
-	Pool       = pool;
-	Boxer.Pool = pool;
+	Result     = &result;
+	Pool       = &result.Pool;
+	Boxer.Pool = Pool;
 	Stack.Initialize(Doc, Pool);
+	Stack.CompiledStyles = compiledStyles;
+	Words                = words;
 
 	// These are thumbsuck numbers.
 	// 100 is max expected tree depth.
@@ -31,41 +54,341 @@ void Layout::PerformLayout(const xo::Doc& doc, RenderDomNode& root, xo::Pool* po
 	// inside the vectors that store LayoutOutput inside RunNode
 	FHeap.Initialize(100, 64);
 
-	SnapBoxes     = Global()->SnapBoxes;
-	SnapHorzText  = Global()->SnapHorzText;
-	EnableKerning = Global()->EnableKerning;
+	SnapBoxes      = Global()->SnapBoxes;
+	SnapHorzText   = Global()->SnapHorzText;
+	EnableKerning  = Global()->EnableKerning;
+	EnableParallel = Global()->EnableParallelLayout && Global()->NumWorkerThreads != 0;
+
+	RememberLayoutState();
+	Previous = previous;
+	if (Previous != nullptr && (Previous->EnvironmentHash != Result->EnvironmentHash || Doc->AnyStyleVariablesModified()))
+		Previous = nullptr;
+	if (Previous != nullptr)
+		FindDirtyPaths();
+
+	// Missing fonts and glyph metrics are loaded as we go, so one pass is always enough
+	Fonts  = Global()->FontStore->GetImmutableTable();
+	Glyphs = Global()->GlyphCache->GetTable();
+
+	LayoutInternal(result.Root);
+	XOTRACE_LAYOUT_VERBOSE("Layout done\n");
+
+	Global()->GlyphCache->AddMetrics(NewMetrics);
+	NewMetrics.clear();
+	Glyphs = nullptr;
+
+	if (Words != nullptr) {
+		WordsLocal.Map.clear();
+		for (auto w : Workers)
+			w->WordsLocal.Map.clear();
+		Words->EndLayout();
+	}
+}
 
-	while (true) {
-		Fonts = Global()->FontStore->GetImmutableTable();
+void Layout::RememberLayoutState() {
+	Result->EnvironmentHash = EnvironmentHash(Doc);
+	Result->FocusID         = Doc->UI.GetFocusID();
+	Result->CaptureID       = Doc->UI.GetCaptureID();
+	Result->HoverSet        = Doc->UI.GetHoverSet();
+}
+
+// Find every element that has changed since the previous layout, either because it was modified,
+// or because its hover/focus/capture state has changed. Mark it and all of its ancestors as dirty.
+void Layout::FindDirtyPaths() {
+	DirtyPaths.clear();
+
+	for (auto id : Doc->GetModifiedIDs())
+		MarkDirtyPath(id);
 
-		LayoutInternal(root);
+	const auto& hover = Doc->UI.GetHoverSet();
+	for (auto id : hover) {
+		if (!Previous->HoverSet.contains(id))
+			MarkDirtyPath(id);
+	}
+	for (auto id : Previous->HoverSet) {
+		if (!hover.contains(id))
+			MarkDirtyPath(id);
+	}
+
+	if (Previous->FocusID != Result->FocusID) {
+		MarkDirtyPath(Previous->FocusID);
+		MarkDirtyPath(Result->FocusID);
+	}
 
-		if (GlyphsNeeded.size() == 0 && FontsNeeded.size() == 0) {
-			XOTRACE_LAYOUT_VERBOSE("Layout done\n");
+	if (Previous->CaptureID != Result->CaptureID) {
+		MarkDirtyPath(Previous->CaptureID);
+		MarkDirtyPath(Result->CaptureID);
+	}
+}
+
+void Layout::MarkDirtyPath(InternalID id) {
+	if (id == InternalIDNull || (size_t) id >= Doc->ChildByInternalIDListSize())
+		return;
+
+	// A deleted element has no path, but its parent was modified when the element was removed
+	for (const DomEl* el = Doc->GetChildByInternalID(id); el != nullptr; el = el->GetParent()) {
+		if (DirtyPaths.contains(el->GetInternalID()))
 			break;
-		} else {
-			XOTRACE_LAYOUT_VERBOSE("Layout done (but need another pass for missing fonts/glyphs)\n");
-			RenderFontsNeeded();
-			RenderGlyphsNeeded();
+		DirtyPaths.insert(el->GetInternalID());
+	}
+}
+
+// The style tables are identified by their versions, so that we don't need to hash every class and tag style
+uint64_t Layout::EnvironmentHash(const xo::Doc* doc) {
+	struct Settings {
+		uint64_t StyleTablesVersion;
+		float    EpToPixel;
+		int      MaxSubpixelGlyphSize;
+		bool     EnableSubpixelText;
+		bool     EnableKerning;
+		bool     SnapBoxes;
+		bool     SnapHorzText;
+	};
+	Settings s;
+	memset(&s, 0, sizeof(s));
+	s.StyleTablesVersion   = doc->GetStyleTablesVersion();
+	s.EpToPixel            = Global()->EpToPixel;
+	s.MaxSubpixelGlyphSize = Global()->MaxSubpixelGlyphSize;
+	s.EnableSubpixelText   = Global()->EnableSubpixelText;
+	s.EnableKerning        = Global()->EnableKerning;
+	s.SnapBoxes            = Global()->SnapBoxes;
+	s.SnapHorzText         = Global()->SnapHorzText;
+
+	return XXH64(&s, sizeof(s), 0);
+}
+
+// Returns the children of 'node' from the previous layout, if they can be reused
+const RenderDomNode* Layout::FindReusableChildren(const DomNode* node, uint64_t styleHash, Pos contentWidth, Pos contentHeight) {
+	InternalID id = node->GetInternalID();
+	if (Previous == nullptr || (size_t) id >= Previous->Cache.size() || DirtyPaths.contains(id))
+		return nullptr;
+
+	const LayoutResult::NodeCache& c = Previous->Cache[id];
+	if (!c.IsValid || !c.OwnFlow || c.StyleHash != styleHash || c.ContentWidth != contentWidth || c.ContentHeight != contentHeight)
+		return nullptr;
+
+	const RenderDomNode* prev = Previous->Node(id);
+	if (prev == nullptr || prev->Tag != node->GetTag())
+		return nullptr;
+
+	return prev;
+}
+
+// Copy a laid out subtree into our pool. If copyCache is true, then the subtree comes from the
+// previous layout, and we must bring its cache entries along with it.
+void Layout::CopyChildren(const RenderDomNode* src, RenderDomNode* dst, bool copyCache) {
+	dst->Children.resize(src->Children.size());
+	for (size_t i = 0; i < src->Children.size(); i++)
+		dst->Children[i] = CopyRenderEl(src->Children[i], copyCache);
+}
+
+RenderDomEl* Layout::CopyRenderEl(const RenderDomEl* src, bool copyCache) {
+	if (copyCache)
+		CopyCache(src->InternalID);
+	if (src->IsText()) {
+		const RenderDomText* stxt = static_cast<const RenderDomText*>(src);
+		RenderDomText*       txt  = new (Pool->AllocT<RenderDomText>(false)) RenderDomText(*stxt);
+		txt->Text.Pool            = Pool;
+		txt->Text.Data            = (RenderCharEl*) Pool->Copy(stxt->Text.Data, stxt->Text.Count * sizeof(RenderCharEl));
+		txt->Text.Capacity        = stxt->Text.Count;
+		return txt;
+	} else {
+		const RenderDomNode* snode = static_cast<const RenderDomNode*>(src);
+		RenderDomNode*       node  = new (Pool->AllocT<RenderDomNode>(false)) RenderDomNode(snode->InternalID, snode->Tag, Pool);
+		node->Pos                  = snode->Pos;
+		node->Style                = snode->Style;
+		CopyChildren(snode, node, copyCache);
+		return node;
+	}
+}
+
+void Layout::CopyCache(InternalID id) {
+	if ((size_t) id < Previous->Cache.size() && (size_t) id < Result->Cache.size())
+		Result->Cache[id] = Previous->Cache[id];
+}
+
+void Layout::InitializeWorker(const Layout& parent) {
+	Doc            = parent.Doc;
+	Result         = parent.Result;
+	Previous       = parent.Previous;
+	DirtyPaths     = parent.DirtyPaths;
+	Pool           = &WorkerPool;
+	Boxer.Pool     = Pool;
+	PtToPixel      = parent.PtToPixel;
+	EpToPixel      = parent.EpToPixel;
+	SnapBoxes      = parent.SnapBoxes;
+	SnapHorzText   = parent.SnapHorzText;
+	EnableKerning  = parent.EnableKerning;
+	EnableParallel = false;
+	IsWorker       = true;
+	Stack.Initialize(Doc, Pool);
+	Stack.CompiledStyles = parent.Stack.CompiledStyles;
+	Words                = parent.Words;
+	FHeap.Initialize(100, 64);
+}
+
+// Returns true if the layout of node's children does not depend on where node gets placed
+bool Layout::IsParallelCandidate(const DomNode* node, bool styleChanged) {
+	if (node->ChildCount() == 0)
+		return false;
+
+	// If nothing has changed, then the subtree will most likely be reused from the previous layout
+	if (Previous != nullptr && !styleChanged && !DirtyPaths.contains(node->GetInternalID()))
+		return false;
+
+	// Use the previous layout's verdict when we have one. It may be stale if the node's own style has
+	// changed, but a wrong guess only costs us some wasted work, because TakeJobResult rejects any
+	// subtree that the worker laid out under different conditions.
+	InternalID id = node->GetInternalID();
+	if (Previous != nullptr && (size_t) id < Previous->Cache.size() && Previous->Cache[id].IsValid)
+		return Previous->Cache[id].Independent;
+
+	// This is a new node, so we have no choice but to resolve it
+	StyleResolver::ResolveAndPush(Stack, node);
+	bool ok = Stack.Get(CatFlowContext).GetFlowContext() == FlowContextNew &&
+	          Stack.Get(CatWidth).GetSize().Type != Size::REMAINING &&
+	          Stack.Get(CatHeight).GetSize().Type != Size::REMAINING;
+	Stack.StackPop();
+	return ok;
+}
+
+// Find the children of node that can be laid out independently, and if there are enough of them,
+// lay them out on the worker threads. We help out, and return once all of the jobs are done.
+void Layout::LaunchJobs(const DomNode* node, const LayoutInput& childIn) {
+	Jobs.clear_noalloc();
+	for (size_t i = 0; i < node->ChildCount(); i++) {
+		const DomEl* c = node->ChildByIndex(i);
+		if (c->IsNode() && IsParallelCandidate(static_cast<const DomNode*>(c), childIn.StyleChanged)) {
+			SubtreeJob& job  = Jobs.add();
+			job.Node         = static_cast<const DomNode*>(c);
+			job.ParentWidth  = childIn.ParentWidth;
+			job.ParentHeight = childIn.ParentHeight;
+			job.StyleChanged = childIn.StyleChanged;
+			job.RNode        = nullptr;
 		}
 	}
+
+	if ((int) Jobs.size() < MinParallelJobs) {
+		Jobs.clear_noalloc();
+		return;
+	}
+
+	int numThreads = Min((int) Jobs.size(), Global()->NumWorkerThreads + 1);
+	while (Workers.size() < (size_t) numThreads) {
+		Workers += new xo::Layout();
+		Workers.back()->InitializeWorker(*this);
+	}
+	for (int i = 0; i < numThreads; i++) {
+		Workers[i]->Fonts  = Fonts;
+		Workers[i]->Glyphs = Glyphs;
+		Workers[i]->Pool->FreeAll();
+		Workers[i]->Stack.Reset();
+	}
+
+	JobParent = node;
+	NextJob   = 0;
+
+	RunJobsInParallel((int) Jobs.size(), numThreads, this, JobFunc);
+
+	for (int i = 0; i < numThreads; i++) {
+		Layout* w = Workers[i];
+		for (const auto& it : w->NewMetrics)
+			NewMetrics.insert(it.first, it.second);
+		w->NewMetrics.clear();
+		w->Glyphs = nullptr;
+	}
 }
 
-void Layout::RenderFontsNeeded() {
-	for (auto p : FontsNeeded) {
-		FontID  fontID;
-		uint8_t weight;
-		SplitFontIDWeightPair(p, fontID, weight);
-		auto fnt = Global()->FontStore->GetByFontIDAndWeight(fontID, weight);
-		XO_ASSERT(fnt); // we expect a fallback path here, if the weight can't be found
+void Layout::JobFunc(void* layout, int job, int thread) {
+	Layout* self = (Layout*) layout;
+	self->Workers[thread]->RunJob(self->Jobs[job], self->Stack);
+}
+
+void Layout::RunJob(SubtreeJob& job, const RenderStack& parentStack) {
+	// The launching thread has already resolved the subtree's ancestors, and it leaves its stack
+	// alone until all of the jobs are done, so we can borrow its resolved styles instead of resolving
+	// them again. The copies are shallow, and we only ever read from them.
+	size_t depth = parentStack.StackSize();
+	for (size_t i = 0; i < depth; i++) {
+		RenderStackEl& el   = Stack.StackPush();
+		xo::Pool*      pool = el.Pool;
+		el                  = parentStack.StackAt(i);
+		el.Pool             = pool;
 	}
-	FontsNeeded.clear();
+
+	const DomNode* parent  = job.Node->GetParent();
+	RenderDomNode* rparent = new (Pool->AllocT<RenderDomNode>(false)) RenderDomNode(parent->GetInternalID(), parent->GetTag(), Pool);
+
+	cheapvec<int32_t> restartPoints;
+	LayoutInput       in;
+	in.ParentWidth   = job.ParentWidth;
+	in.ParentHeight  = job.ParentHeight;
+	in.ParentRNode   = rparent;
+	in.RestartPoints = &restartPoints;
+	in.StyleChanged  = job.StyleChanged;
+
+	// Our dummy root is not the real parent, but the subtree only cares about its own flow context
+	LayoutOutput out;
+	Boxer.BeginDocument();
+	RunNode(job.Node, in, out);
+	Boxer.EndDocument();
+
+	for (size_t i = 0; i < depth; i++)
+		Stack.StackPop();
+
+	job.RNode = static_cast<const RenderDomNode*>(rparent->Children[0]);
 }
 
-void Layout::RenderGlyphsNeeded() {
-	for (auto it = GlyphsNeeded.begin(); it != GlyphsNeeded.end(); it++)
-		Global()->GlyphCache->RenderGlyph(*it);
-	GlyphsNeeded.clear();
+// Returns the worker's output for node, if node is the next subtree in the current batch of jobs
+const RenderDomNode* Layout::TakeJobResult(const DomNode* node, uint64_t styleHash, Pos contentWidth, Pos contentHeight) {
+	if (NextJob >= Jobs.size() || Jobs[NextJob].Node != node)
+		return nullptr;
+
+	const SubtreeJob& job = Jobs[NextJob++];
+
+	// The worker should have reached the same conclusions as us. If it didn't, then rather do the work again.
+	const LayoutResult::NodeCache& c = Result->Cache[node->GetInternalID()];
+	if (job.RNode == nullptr || !c.IsValid || c.StyleHash != styleHash || c.ContentWidth != contentWidth || c.ContentHeight != contentHeight)
+		return nullptr;
+
+	return job.RNode;
+}
+
+Layout::AsciiGlyphs* Layout::GetAsciiGlyphs(const GlyphCacheKey& key) {
+	for (auto t : AsciiTables) {
+		if (t->Key.FontID == key.FontID && t->Key.Size == key.Size && t->Key.Flags == key.Flags)
+			return t;
+	}
+	AsciiGlyphs* t = new AsciiGlyphs();
+	t->Key         = key;
+	memset(t->IsLoaded, 0, sizeof(t->IsLoaded));
+	AsciiTables += t;
+	return t;
+}
+
+const GlyphMetrics* Layout::GetAsciiGlyphMetrics(AsciiGlyphs* table, uint32_t ch) {
+	if (!table->IsLoaded[ch]) {
+		GlyphCacheKey key   = table->Key;
+		key.Char            = ch;
+		table->Metrics[ch]  = *GetGlyphMetrics(key);
+		table->IsLoaded[ch] = true;
+	}
+	return &table->Metrics[ch];
+}
+
+// Returns the metrics of a glyph, asking Freetype for them if they are not yet in the glyph cache.
+// The pointer is only valid until the next call.
+const GlyphMetrics* Layout::GetGlyphMetrics(const GlyphCacheKey& key) {
+	const GlyphMetrics* m = Glyphs->GetMetrics(key);
+	if (m != nullptr)
+		return m;
+	m = NewMetrics.getp(key);
+	if (m != nullptr)
+		return m;
+	GlyphMetrics loaded;
+	Global()->GlyphCache->LoadMetrics(key, loaded);
+	NewMetrics.insert(key, loaded);
+	return NewMetrics.getp(key);
 }
 
 void Layout::LayoutInternal(RenderDomNode& root) {
@@ -77,6 +400,11 @@ void Layout::LayoutInternal(RenderDomNode& root) {
 	Pool->FreeAll();
 	root.Children.clear();
 	Stack.Reset();
+	Result->Cache.resize(0);
+	Result->Cache.resize(Doc->InternalIDSize());
+	Jobs.clear_noalloc();
+	JobParent = nullptr;
+	NextJob   = 0;
 
 	XOTRACE_LAYOUT_VERBOSE("Layout 2\n");
 
@@ -85,6 +413,7 @@ void Layout::LayoutInternal(RenderDomNode& root) {
 	in.ParentHeight  = IntToPos(Doc->UI.GetViewportHeight());
 	in.ParentRNode   = &root;
 	in.RestartPoints = nullptr;
+	in.StyleChanged  = Previous == nullptr;
 
 	LayoutOutput out;
 
@@ -94,12 +423,10 @@ void Layout::LayoutInternal(RenderDomNode& root) {
 }
 
 void Layout::RunNode(const DomNode* node, const LayoutInput& in, LayoutOutput& out) {
-	static int debug_num_run;
-	debug_num_run++;
-
 	BoxLayout::NodeInput boxIn;
 
 	StyleResolver::ResolveAndPush(Stack, node);
+	uint64_t styleHash = Stack.StackBack().Styles.Hash();
 
 	Box         margin        = ComputeBox(in.ParentWidth, in.ParentHeight, CatMargin_Left);
 	Box         padding       = ComputeBox(in.ParentWidth, in.ParentHeight, CatPadding_Left);
@@ -153,11 +480,27 @@ void Layout::RunNode(const DomNode* node, const LayoutInput& in, LayoutOutput& o
 	childIn.ParentWidth  = contentWidth;
 	childIn.ParentHeight = contentHeight;
 	childIn.ParentRNode  = rnode;
+	childIn.StyleChanged = in.StyleChanged || Previous == nullptr || (size_t) node->GetInternalID() >= Previous->Cache.size() || Previous->Cache[node->GetInternalID()].StyleHash != styleHash;
 	if (boxIn.NewFlowContext)
 		childIn.RestartPoints = &myRestartPoints;
 	else
 		childIn.RestartPoints = in.RestartPoints;
 
+	// If our children have already been laid out, either by the previous layout or by a worker,
+	// then we tell the boxer our final content size upfront, and skip straight to EndNode.
+	const RenderDomNode* reuse    = nullptr;
+	const RenderDomNode* prebuilt = nullptr;
+	if (boxIn.NewFlowContext) {
+		const RenderDomNode* fromJob = TakeJobResult(node, styleHash, contentWidth, contentHeight);
+		if (!in.StyleChanged)
+			reuse = FindReusableChildren(node, styleHash, contentWidth, contentHeight);
+		prebuilt = reuse != nullptr ? reuse : fromJob;
+	}
+	if (prebuilt) {
+		boxIn.ContentWidth  = prebuilt->Pos.Width();
+		boxIn.ContentHeight = prebuilt->Pos.Height();
+	}
+
 	Boxer.BeginNode(boxIn);
 
 	size_t istart = 0;
@@ -177,7 +520,11 @@ void Layout::RunNode(const DomNode* node, const LayoutInput& in, LayoutOutput& o
 	// RunText returns with a non-empty RestartPoints, it means a node inside that child
 	// has begun a new restart.
 
-	for (size_t i = istart; i < node->ChildCount(); i++) {
+	if (prebuilt == nullptr && EnableParallel && JobParent == nullptr && istart == 0)
+		LaunchJobs(node, childIn);
+
+	size_t iend = prebuilt ? 0 : node->ChildCount();
+	for (size_t i = istart; i < iend; i++) {
 		LayoutOutput childOut;
 		const DomEl* c = node->ChildByIndex(i);
 		if (c->IsNode()) {
@@ -244,32 +591,50 @@ void Layout::RunNode(const DomNode* node, const LayoutInput& in, LayoutOutput& o
 	if (childIn.ParentHeight == PosNULL)
 		childIn.ParentHeight = rnode->Pos.Height();
 
-	// This tracks the line that we're on. The boxer keeps track of the last entity that got placed
-	// on every line, and we use that information to figure out which line our child is on.
-	int  linebox_index = 0;
-	auto linebox       = Boxer.GetLineFromPreviousNode(linebox_index);
-	for (size_t i = 0; i < childOuts.Size(); i++) {
-		while ((ssize_t) i > linebox->LastChild)
-			linebox = Boxer.GetLineFromPreviousNode(++linebox_index);
-
-		if (childOuts[i].RNode != nullptr) {
-			Point offset = PositionChildFromBindings(childIn, linebox->InnerBaseline, childOuts[i]);
-			if (linebox->InnerBaselineDefinedBy == i && IsDefined(linebox->InnerBaseline)) {
-				// The child that originally defined the baseline has been moved, so we need to move the baseline along with it
-				linebox->InnerBaseline += offset.Y;
+	Pos myBaseline;
+	if (reuse) {
+		CopyChildren(reuse, rnode, true);
+		myBaseline = Previous->Cache[node->GetInternalID()].Baseline;
+	} else if (prebuilt) {
+		CopyChildren(prebuilt, rnode, false);
+		myBaseline = Result->Cache[node->GetInternalID()].Baseline;
+	} else {
+		// This tracks the line that we're on. The boxer keeps track of the last entity that got placed
+		// on every line, and we use that information to figure out which line our child is on.
+		int  linebox_index = 0;
+		auto linebox       = Boxer.GetLineFromPreviousNode(linebox_index);
+		for (size_t i = 0; i < childOuts.Size(); i++) {
+			while ((ssize_t) i > linebox->LastChild)
+				linebox = Boxer.GetLineFromPreviousNode(++linebox_index);
+
+			if (childOuts[i].RNode != nullptr) {
+				Point offset = PositionChildFromBindings(childIn, linebox->InnerBaseline, childOuts[i]);
+				if (linebox->InnerBaselineDefinedBy == i && IsDefined(linebox->InnerBaseline)) {
+					// The child that originally defined the baseline has been moved, so we need to move the baseline along with it
+					linebox->InnerBaseline += offset.Y;
+				}
 			}
 		}
-	}
 
-	// This node's baseline is the baseline of it's first linebox. Note that if the baseline has been moved
-	// by the previous alignment phase, then we will receive the updated baseline here.
-	Pos myBaseline = Boxer.GetLineFromPreviousNode(0)->InnerBaseline;
+		// This node's baseline is the baseline of it's first linebox. Note that if the baseline has been moved
+		// by the previous alignment phase, then we will receive the updated baseline here.
+		myBaseline = Boxer.GetLineFromPreviousNode(0)->InnerBaseline;
+	}
 
 	if (myBaseline != PosNULL)
 		out.Baseline = myBaseline;
 	else
 		out.Baseline = PosNULL;
 
+	LayoutResult::NodeCache& cache = Result->Cache[node->GetInternalID()];
+	cache.StyleHash                = styleHash;
+	cache.ContentWidth             = contentWidth;
+	cache.ContentHeight            = contentHeight;
+	cache.Baseline                 = myBaseline;
+	cache.IsValid                  = true;
+	cache.OwnFlow                  = boxIn.NewFlowContext;
+	cache.Independent              = boxIn.NewFlowContext && Stack.Get(CatWidth).GetSize().Type != Size::REMAINING && Stack.Get(CatHeight).GetSize().Type != Size::REMAINING;
+
 	PopulateBindings(out.Binds);
 
 	out.RNode     = rnode;
@@ -277,6 +642,12 @@ void Layout::RunNode(const DomNode* node, const LayoutInput& in, LayoutOutput& o
 	out.MarginBox = marginBox;
 	out.Break     = Stack.Get(CatBreak).GetBreakType();
 
+	if (node == JobParent) {
+		Jobs.clear_noalloc();
+		JobParent = nullptr;
+		NextJob   = 0;
+	}
+
 	Stack.StackPop();
 }
 
@@ -302,6 +673,13 @@ void Layout::RunText(const DomText* node, const LayoutInput& in, LayoutOutput& o
 
 	// Check if we have this font/weight combination loaded
 	const Font* font = Fonts.GetByFontIDAndWeight(fontID, fontWeight);
+	if (!font) {
+		// Load it now, and refresh our copy of the font table. FontStore is thread safe.
+		auto fnt = Global()->FontStore->GetByFontIDAndWeight(fontID, fontWeight);
+		XO_ASSERT(fnt); // we expect a fallback path here, if the weight can't be found
+		Fonts = Global()->FontStore->GetImmutableTable();
+		font  = Fonts.GetByFontIDAndWeight(fontID, fontWeight);
+	}
 	if (font) {
 		// Reset font weight, because now that we've found the appropriate real font,
 		// we're back to "normal" for in it's eyes. In future, we may want to synthesize
@@ -309,7 +687,6 @@ void Layout::RunText(const DomText* node, const LayoutInput& in, LayoutOutput& o
 		fontID     = font->ID;
 		fontWeight = 4;
 	} else {
-		FontsNeeded.insert(MakeFontIDWeightPair(fontID, fontWeight));
 		canRun = false;
 	}
 
@@ -413,9 +790,9 @@ void Layout::GenerateTextWords(TextRunState& ts) {
 		XO_ASSERT(ts.RestartPoints->size() == 0); // Text is a leaf node. The restart stack must be empty now.
 	}
 
-	GlyphCache*   glyphCache = Global()->GlyphCache;
-	GlyphCacheKey key        = MakeGlyphCacheKey(ts);
-	const Font*   font       = Fonts.GetByFontID(ts.FontID);
+	GlyphCacheKey key  = MakeGlyphCacheKey(ts);
+	const Font*   font = Fonts.GetByFontID(ts.FontID);
+	ts.Ascii           = GetAsciiGlyphs(key);
 
 	Pos fontHeightRounded = RealToPos((float) ts.FontSizePx);
 	Pos charWidth_32      = Realx256ToPos(font->LinearHoriAdvance_Space_x256) * ts.FontSizePx;
@@ -445,8 +822,6 @@ void Layout::GenerateTextWords(TextRunState& ts) {
 		return;
 	}
 
-	ts.GlyphsNeeded            = false;
-	const Glyph*   prevGlyph   = nullptr;
 	RenderDomText* rtxt        = nullptr;
 	Pos            rtxt_left   = PosNULL;
 	Pos            lastWordTop = PosNULL;
@@ -460,9 +835,6 @@ void Layout::GenerateTextWords(TextRunState& ts) {
 			int32_t chunkLen  = chunk.End - chunk.Start;
 			Pos     wordWidth = MeasureWord(txt, font, fontAscender, chunk, ts);
 
-			if (ts.GlyphsNeeded)
-				continue;
-
 			// output word
 			BoxLayout::WordInput wordin;
 			wordin.Width  = wordWidth;
@@ -556,33 +928,48 @@ Pos Layout::MeasureWord(const char* txt, const Font* font, Pos fontAscender, Chu
 	// I find it easier to understand when referring to this value as "baseline" instead of "ascender"
 	Pos baseline = fontAscender;
 
-	Pos           posX      = 0;
-	GlyphCacheKey key       = MakeGlyphCacheKey(ts);
-	const Glyph*  prevGlyph = nullptr;
+	Pos           posX           = 0;
+	GlyphCacheKey key            = MakeGlyphCacheKey(ts);
+	bool          havePrevGlyph  = false;
+	uint32_t      prevGlyphIndex = 0;
+
+	WordCache::Key wordKey;
+	if (Words != nullptr) {
+		wordKey.Font       = ts.FontID;
+		wordKey.FontSizePx = (uint8_t) ts.FontSizePx;
+		wordKey.Flags      = key.Flags | (SnapHorzText ? WordCache::FlagSnapHorzText : 0) | (EnableKerning ? WordCache::FlagKerning : 0);
+		wordKey.Bytes      = txt + chunk.Start;
+		wordKey.NumBytes   = chunk.End - chunk.Start;
+		if (const WordCache::Word* word = Words->Get(wordKey, WordsLocal)) {
+			ts.Chars.PushHead(word->Chars(), word->NumChars);
+			for (int i = 0; i < (int) word->NumChars; i++)
+				ts.Chars.FromHead(i).OriginalCharIndex += chunk.Start;
+			return word->Width;
+		}
+	}
+	size_t numCharsBefore = ts.Chars.Size();
 
 	for (int32_t i = chunk.Start; i < chunk.End;) {
-		int seq_len = 0;
-		key.Char    = utfz::decode(txt + i, seq_len);
-		i += seq_len;
-		const Glyph* glyph = Global()->GlyphCache->GetGlyph(key);
-		if (!glyph) {
-			ts.GlyphsNeeded = true;
-			GlyphsNeeded.insert(key);
-			continue;
+		const GlyphMetrics* glyph = nullptr;
+		if (chunk.IsASCII) {
+			key.Char = (uint8_t) txt[i];
+			i++;
+			glyph = GetAsciiGlyphMetrics(ts.Ascii, key.Char);
+		} else {
+			int seq_len = 0;
+			key.Char    = utfz::decode(txt + i, seq_len);
+			i += seq_len;
+			glyph = GetGlyphMetrics(key);
 		}
 		if (glyph->IsNull()) {
 			// TODO: Handle missing glyph by drawing a rectangle or something
 			continue;
-			prevGlyph = nullptr;
+			havePrevGlyph = false;
 		}
-		if (EnableKerning && prevGlyph) {
-			// Multithreading hazard here. I'm not sure whether FT_Get_Kerning is thread safe.
-			// Also, I have stepped inside there and I see it does a binary search. We might
-			// be better off caching the kerning for frequent pairs of glyphs in a hash table.
-			FT_Vector kern;
-			FT_Get_Kerning(font->FTFace, prevGlyph->FTGlyphIndex, glyph->FTGlyphIndex, FT_KERNING_UNSCALED, &kern);
-			Pos kerning = ((kern.x * ts.FontSizePx) << PosShift) / font->FTFace->units_per_EM;
-			posX += kerning;
+		if (EnableKerning && havePrevGlyph) {
+			int32_t kern = font->GetKerning(prevGlyphIndex, glyph->FTGlyphIndex);
+			if (kern != 0)
+				posX += ((kern * ts.FontSizePx) << PosShift) / font->FTFace->units_per_EM;
 		}
 
 		// For determining the word width, one might want to not use the horizontal advance for the very last glyph, but instead
@@ -596,7 +983,18 @@ Pos Layout::MeasureWord(const char* txt, const Font* font, Pos fontAscender, Chu
 		rtxt.Y                 = baseline - RealToPos(glyph->MetricTop); // rtxt.Y is the top of the glyph bitmap. glyph->MetricTop is the distance from the baseline to the top of the glyph
 		rtxt.Width             = RealToPos(glyph->MetricWidth);
 		posX += HoriAdvance(glyph, ts);
-		prevGlyph = glyph;
+		havePrevGlyph  = true;
+		prevGlyphIndex = glyph->FTGlyphIndex;
+	}
+
+	if (Words != nullptr) {
+		size_t numChars = ts.Chars.Size() - numCharsBefore;
+		WordChars.resize(numChars);
+		for (size_t i = 0; i < numChars; i++) {
+			WordChars[i] = ts.Chars.FromHead((int) (numChars - 1 - i));
+			WordChars[i].OriginalCharIndex -= chunk.Start;
+		}
+		Words->Insert(wordKey, posX, WordChars.data, numChars, WordsLocal);
 	}
 	return posX;
 }
@@ -799,7 +1197,7 @@ void Layout::PopulateBindings(BindingSet& bindings) {
 	bindings.VChildBaseline = Stack.Get(CatBaseline);
 }
 
-Pos Layout::HoriAdvance(const Glyph* glyph, const TextRunState& ts) {
+Pos Layout::HoriAdvance(const GlyphMetrics* glyph, const TextRunState& ts) {
 	if (SnapHorzText)
 		return IntToPos(glyph->MetricHoriAdvance);
 	else
@@ -897,6 +1295,7 @@ bool Layout::Chunker::Next(Chunk& c) {
 
 	char first = Txt[Pos];
 	c.Start    = Pos;
+	c.IsASCII  = true;
 	switch (first) {
 	case 9:
 	case 32:
@@ -906,7 +1305,7 @@ bool Layout::Chunker::Next(Chunk& c) {
 		break;
 	case '\r':
 		c.Type = ChunkLineBreak;
-		if (Txt[Pos] == '\n')
+		if (Txt[Pos + 1] == '\n')
 			Pos += 2;
 		else
 			Pos += 1;
@@ -916,18 +1315,75 @@ bool Layout::Chunker::Next(Chunk& c) {
 		Pos++;
 		break;
 	default:
-		c.Type = ChunkWord;
-		while (true) {
-			Pos++;
-			char ch = Txt[Pos];
-			if (ch == 0 || ch == 9 || ch == 32 || ch == '\r' || ch == '\n')
-				break;
-		}
+		c.Type    = ChunkWord;
+		c.IsASCII = ((uint8_t) first & 0x80) == 0;
+		Pos       = FindWordEnd(Pos + 1, c.IsASCII);
 	}
 	c.End = Pos;
 	return true;
 }
 
+static inline bool IsWordEnd(uint8_t ch) {
+	return ch == 0 || ch == 9 || ch == 32 || ch == '\r' || ch == '\n';
+}
+
+#if XO_CHUNKER_SSE2
+static inline uint32_t FirstSetBit(uint32_t mask) {
+#ifdef _MSC_VER
+	unsigned long i;
+	_BitScanForward(&i, mask);
+	return i;
+#else
+	return __builtin_ctz(mask);
+#endif
+}
+#endif
+
+// Returns the position of the first byte at or after pos that ends a word.
+// Clears isASCII if any byte of the word is 128 or above.
+int32_t Layout::Chunker::FindWordEnd(int32_t pos, bool& isASCII) const {
+	const uint8_t* s    = (const uint8_t*) Txt;
+	uint32_t       high = 0;
+#if XO_CHUNKER_SSE2
+	// Go one byte at a time until we're aligned. An aligned load never crosses a page
+	// boundary, so it's safe for our loads to read beyond the terminating null.
+	for (; ((uintptr_t) (s + pos) & 15) != 0; pos++) {
+		if (IsWordEnd(s[pos])) {
+			isASCII = isASCII && (high & 0x80) == 0;
+			return pos;
+		}
+		high |= s[pos];
+	}
+	isASCII = isASCII && (high & 0x80) == 0;
+
+	const __m128i zero  = _mm_setzero_si128();
+	const __m128i tab   = _mm_set1_epi8(9);
+	const __m128i space = _mm_set1_epi8(32);
+	const __m128i cr    = _mm_set1_epi8('\r');
+	const __m128i lf    = _mm_set1_epi8('\n');
+	while (true) {
+		__m128i  v       = _mm_load_si128((const __m128i*) (s + pos));
+		__m128i  end     = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(v, tab)), _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_or_si128(_mm_cmpeq_epi8(v, cr), _mm_cmpeq_epi8(v, lf))));
+		uint32_t endMask = (uint32_t) _mm_movemask_epi8(end);
+		uint32_t hiMask  = (uint32_t) _mm_movemask_epi8(v); // The top bit of every byte
+		if (endMask != 0) {
+			uint32_t n = FirstSetBit(endMask);
+			if ((hiMask & ((1u << n) - 1)) != 0)
+				isASCII = false;
+			return pos + (int32_t) n;
+		}
+		if (hiMask != 0)
+			isASCII = false;
+		pos += 16;
+	}
+#else
+	for (; !IsWordEnd(s[pos]); pos++)
+		high |= s[pos];
+	isASCII = isASCII && (high & 0x80) == 0;
+	return pos;
+#endif
+}
+
 Pos Layout::VBindHelper::Parent(StyleAttrib bind) {
 	if (bind.IsBindingTypeEnum()) {
 		return Layout::VBindOffset(bind.GetVerticalBinding(), 0, ParentBaseline, ParentHeight);
@@ -6,6 +6,7 @@
 #include "../Text/FontStore.h"
 #include "../Base/MemPoolsAndContainers.h"
 #include "BoxLayout.h"
+#include "WordCache.h"
 
 namespace xo {
 
@@ -16,16 +17,47 @@ because we will probably end up splitting the text stuff out into a separate
 class, due to the fact that it gets complex if you're doing it properly
 (ie non-latin fonts, bidirectional, asian, etc).
 
-Hidden things that would bite you if you tried to multithread this:
-* We get kerning data from Freetype for each glyph pair, and I'm not sure
-that is thread safe.
+Layout never touches a Freetype face directly. Kerning comes from the immutable
+table inside Font, and missing glyph metrics are loaded through the GlyphCache, which
+takes the face's lock.
 
+Parallel Layout
+
+The children of a node that defines its own flow context are laid out without
+any knowledge of the node's position, so if such a node's width and height
+do not depend on the space remaining in its parent's flow, then its entire
+subtree can be laid out before its parent gets to it. When a node has at least
+MinParallelJobs such children, we hand those subtrees out as jobs to the worker
+threads (see LaunchJobs). Every worker has its own Layout object, and therefore its
+own RenderStack, Pool, and FixedSizeHeap. The worker starts by resolving the styles
+of the subtree's ancestors, and then runs the subtree through RunNode, exactly as
+we would have. When the parent reaches that child, it consumes the worker's output
+in the same way that it consumes a reused subtree from the previous layout.
+Workers never launch jobs of their own. The glyph metrics that the workers had to load
+are merged into ours once all of the jobs are done.
+
+Incremental Layout
+
+If we're given the previous layout, then we reuse the children of any node that
+defines its own flow context, provided that the following are all unchanged:
+* The style tables and global layout settings
+* The resolved styles of the node and all of its ancestors
+* The content box that the node's children were laid out inside
+* The node and all of its descendants (the Doc's modified bits, and the hover/focus/capture state)
+Positions are relative to the parent, so such a subtree is position independent.
+The reused subtree is copied into the new layout's pool, which is cheap compared to
+resolving styles and measuring text.
 */
 class XO_API Layout {
 public:
-	void PerformLayout(const Doc& doc, RenderDomNode& root, Pool* pool);
+	Layout();
+	~Layout();
+
+	void PerformLayout(const Doc& doc, LayoutResult& result, const LayoutResult* previous, CompiledStyleCache* compiledStyles = nullptr, WordCache* words = nullptr);
 
 protected:
+	static const int MinParallelJobs = 2; // Don't bother launching jobs unless there are at least this many independent subtrees
+
 	// Packed set of bindings between child and parent node
 	// This is unfortunately a large data structure. I haven't found a simple way of making it smaller.
 	// The key thing driving the size up here, is that each binding point can be either a Size type,
@@ -48,6 +80,7 @@ protected:
 		RenderDomNode*     ParentRNode;
 		Pos                ParentWidth;
 		Pos                ParentHeight;
+		bool               StyleChanged; // The resolved style of an ancestor differs from the previous layout, so nothing beneath it can be reused
 	};
 
 	struct LayoutOutput {
@@ -70,6 +103,15 @@ protected:
 		int32_t   Start;
 		int32_t   End;
 		ChunkType Type;
+		bool      IsASCII; // Only meaningful for words. True if every byte of the word is below 128.
+	};
+
+	// Metrics of the first 128 code points of one [font, size, glyph flags], so that
+	// pure ASCII words can skip the UTF-8 decoder and the glyph hash tables.
+	struct AsciiGlyphs {
+		GlyphCacheKey Key; // Char is ignored
+		bool          IsLoaded[128];
+		GlyphMetrics  Metrics[128];
 	};
 
 	struct TextRunState {
@@ -80,13 +122,22 @@ protected:
 		cheapvec<int32_t>*    RestartPoints;
 		float                 FontWidthScale;
 		int                   FontSizePx;
-		bool                  GlyphsNeeded;
 		bool                  IsSubPixel;
 		Pos                   FontAscender;
+		AsciiGlyphs*          Ascii;
 		xo::FontID            FontID;
 		xo::Color             Color;
 	};
 
+	// A subtree that is laid out by a worker
+	struct SubtreeJob {
+		const DomNode*       Node;         // Root of the subtree
+		Pos                  ParentWidth;  // Content width of Node's parent
+		Pos                  ParentHeight; // Content height of Node's parent
+		bool                 StyleChanged; // Same meaning as LayoutInput.StyleChanged
+		const RenderDomNode* RNode;        // Output. This lives inside the worker's pool, until the parent copies it out.
+	};
+
 	struct FlowState {
 		Pos PosMinor; // In default flow, this is the horizontal (X) position
 		Pos PosMajor; // In default flow, this is the vertical (Y) position
@@ -98,24 +149,50 @@ protected:
 		// bool	ReverseMinor;	// Minor goes from high to low numbers (right to left, or bottom to top)
 	};
 
-	const xo::Doc*               Doc;
-	BoxLayout                    Boxer;
-	xo::Pool*                    Pool;
-	RenderStack                  Stack;
-	FixedSizeHeap                FHeap;
-	float                        PtToPixel;
-	float                        EpToPixel;
-	FontTableImmutable           Fonts;
-	ohash::set<GlyphCacheKey>    GlyphsNeeded;
-	ohash::set<FontIDWeightPair> FontsNeeded; // Will only be here because of a weight that is not 400 (regular)
-	TextRunState                 TempText;
-	bool                         SnapBoxes;
-	bool                         SnapHorzText;
-	bool                         EnableKerning;
-
-	void  RenderFontsNeeded();
-	void  RenderGlyphsNeeded();
+	const xo::Doc*                          Doc;
+	LayoutResult*                           Result;
+	const LayoutResult*                     Previous;   // Null if we cannot reuse anything from the previous layout
+	ohash::set<InternalID>                  DirtyPaths; // Elements that have changed since the previous layout, and all of their ancestors
+	BoxLayout                               Boxer;
+	xo::Pool*                               Pool;
+	RenderStack                             Stack;
+	FixedSizeHeap                           FHeap;
+	float                                   PtToPixel;
+	float                                   EpToPixel;
+	FontTableImmutable                      Fonts;
+	GlyphTableRef                           Glyphs;
+	ohash::map<GlyphCacheKey, GlyphMetrics> NewMetrics; // Metrics that we have loaded from Freetype during this layout
+	WordCache*                              Words;      // Optional. Shared with the workers.
+	WordCache::Local                        WordsLocal; // Our private view of Words
+	cheapvec<RenderCharEl>                  WordChars;  // Scratch space for MeasureWord
+	cheapvec<AsciiGlyphs*>                  AsciiTables;
+	TextRunState                            TempText;
+	bool                                    SnapBoxes;
+	bool                                    SnapHorzText;
+	bool                                    EnableKerning;
+	bool                                    EnableParallel;
+	bool                                    IsWorker;   // Workers never launch jobs of their own
+	xo::Pool                                WorkerPool; // Only used by workers, which cannot write into LayoutResult.Pool
+	cheapvec<xo::Layout*>                   Workers;    // Created on demand, and kept for the rest of the layout
+	cheapvec<SubtreeJob>                    Jobs;       // The most recent batch of jobs
+	const DomNode*                          JobParent;  // Parent of the subtrees in Jobs. Jobs is cleared when this node is done.
+	size_t                                  NextJob;    // Index of the next job whose result we expect to consume
+
 	void  LayoutInternal(RenderDomNode& root);
+	void  RememberLayoutState();
+	void  FindDirtyPaths();
+	void  MarkDirtyPath(InternalID id);
+	void  CopyChildren(const RenderDomNode* src, RenderDomNode* dst, bool copyCache);
+	void  CopyCache(InternalID id);
+	void  InitializeWorker(const Layout& parent);
+	void  LaunchJobs(const DomNode* node, const LayoutInput& childIn);
+	bool  IsParallelCandidate(const DomNode* node, bool styleChanged);
+	void  RunJob(SubtreeJob& job, const RenderStack& parentStack);
+
+	const RenderDomNode* FindReusableChildren(const DomNode* node, uint64_t styleHash, Pos contentWidth, Pos contentHeight);
+	const RenderDomNode* TakeJobResult(const DomNode* node, uint64_t styleHash, Pos contentWidth, Pos contentHeight);
+	RenderDomEl*         CopyRenderEl(const RenderDomEl* src, bool copyCache);
+
 	void  RunNode(const DomNode* node, const LayoutInput& in, LayoutOutput& out);
 	void  RunText(const DomText* node, const LayoutInput& in, LayoutOutput& out);
 	Point PositionChildFromBindings(const LayoutInput& cin, Pos parentBaseline, LayoutOutput& cout);
@@ -124,6 +201,10 @@ protected:
 	void  OffsetTextHorz(TextRunState& ts, Pos offsetHorz, size_t numChars);
 	Pos   MeasureWord(const char* txt, const Font* font, Pos fontAscender, Chunk chunk, TextRunState& ts);
 
+	const GlyphMetrics* GetGlyphMetrics(const GlyphCacheKey& key);
+	const GlyphMetrics* GetAsciiGlyphMetrics(AsciiGlyphs* table, uint32_t ch);
+	AsciiGlyphs*        GetAsciiGlyphs(const GlyphCacheKey& key);
+
 	Pos  ComputeWidthOrHeightDimension(Pos containerSize, Pos containerRemaining, StyleCategories cat);
 	Pos  ComputeWidthOrHeightDimension(Pos containerSize, Pos containerRemaining, Size size);
 	Pos  ComputeDimension(Pos container, StyleCategories cat);
@@ -132,7 +213,7 @@ protected:
 	Box  ComputeBox(Pos containerWidth, Pos containerHeight, StyleBox box);
 	void PopulateBindings(BindingSet& bindings);
 
-	Pos HoriAdvance(const Glyph* glyph, const TextRunState& ts);
+	Pos HoriAdvance(const GlyphMetrics* glyph, const TextRunState& ts);
 
 	static Pos           HBindOffset(HorizontalBindings bind, Pos left, Pos width);
 	static Pos           VBindOffset(VerticalBindings bind, Pos top, Pos baseline, Pos height);
@@ -143,6 +224,8 @@ protected:
 	static GlyphCacheKey MakeGlyphCacheKey(bool isSubPixel, FontID fontID, int fontSizePx);
 	static bool          IsAllZeros(const cheapvec<int32_t>& list);
 	static void          MoveChildren(RenderDomEl* relem, Point delta);
+	static uint64_t      EnvironmentHash(const xo::Doc* doc);
+	static void          JobFunc(void* layout, int job, int thread);
 
 	static bool IsDefined(Pos p) { return p != PosNULL; }
 	static bool IsNull(Pos p) { return p == PosNULL; }
@@ -150,7 +233,8 @@ protected:
 	// Break a string up into chunks, where each chunk is either a word, or
 	// a series of one or more identical whitespace characters. A linebreak
 	// such as \r\n is emitted as a single chunk.
-	// When I get around to it, this will probably do UTF8 interpretation too
+	// Words are scanned 16 bytes at a time with SSE2, where available. Since
+	// UTF-8 continuation bytes are never whitespace, we don't need to decode here.
 	class Chunker {
 	public:
 		Chunker(const char* txt);
@@ -161,6 +245,8 @@ protected:
 	private:
 		const char* Txt;
 		int32_t     Pos;
+
+		int32_t FindWordEnd(int32_t pos, bool& isASCII) const;
 	};
 
 	// These helpers make the binding code a lot less repetitive.
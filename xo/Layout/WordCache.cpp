@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "WordCache.h"
+#include "../../dependencies/hash/xxhash_xo_wrapper.h"
+
+namespace xo {
+
+WordCache::~WordCache() {
+	Clear();
+}
+
+void WordCache::Clear() {
+	for (auto& it : Table)
+		free(it.second);
+	Table.clear();
+	TotalBytes = 0;
+}
+
+uint64_t WordCache::Hash(const Key& key) {
+	uint64_t seed = ((uint64_t) (uint32_t) key.Font << 16) | ((uint64_t) key.FontSizePx << 8) | key.Flags;
+	return XXH64(key.Bytes, key.NumBytes, seed);
+}
+
+bool WordCache::Equals(const Word* w, const Key& key) {
+	return w->Font == key.Font && w->FontSizePx == key.FontSizePx && w->Flags == key.Flags && w->NumBytes == key.NumBytes && memcmp(w->Bytes(), key.Bytes, key.NumBytes) == 0;
+}
+
+const WordCache::Word* WordCache::Get(const Key& key, Local& local) {
+	uint64_t     hash = Hash(key);
+	const Word** lw   = local.Map.getp(hash);
+	if (lw == nullptr) {
+		std::lock_guard<std::mutex> lock(Lock);
+		Word**                      sw = Table.getp(hash);
+		if (sw == nullptr)
+			return nullptr;
+		local.Map.insert(hash, *sw);
+		lw = local.Map.getp(hash);
+	}
+	if (!Equals(*lw, key))
+		return nullptr;
+	// Every thread that touches this word during a layout writes the same value
+	if ((*lw)->LastUsed.Load() != Generation)
+		(*lw)->LastUsed.Store(Generation);
+	return *lw;
+}
+
+const WordCache::Word* WordCache::Insert(const Key& key, Pos width, const RenderCharEl* chars, size_t numChars, Local& local) {
+	if (numChars > UINT16_MAX)
+		return nullptr;
+
+	uint64_t hash  = Hash(key);
+	size_t   bytes = sizeof(Word) + numChars * sizeof(RenderCharEl) + key.NumBytes;
+	Word*    w     = new (MallocOrDie(bytes)) Word();
+	w->Width       = width;
+	w->Font        = key.Font;
+	w->FontSizePx  = key.FontSizePx;
+	w->Flags       = key.Flags;
+	w->NumChars    = (uint16_t) numChars;
+	w->NumBytes    = key.NumBytes;
+	w->LastUsed.Store(Generation);
+	memcpy((void*) w->Chars(), chars, numChars * sizeof(RenderCharEl));
+	memcpy((void*) w->Bytes(), key.Bytes, key.NumBytes);
+
+	const Word* result = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(Lock);
+		Word**                      sw = Table.getp(hash);
+		if (sw == nullptr) {
+			Table.insert(hash, w);
+			TotalBytes += bytes;
+			result = w;
+			w      = nullptr;
+		} else if (Equals(*sw, key)) {
+			// Another thread measured the same word at the same time
+			result = *sw;
+		}
+	}
+	free(w);
+
+	if (result != nullptr)
+		local.Map.insert(hash, result);
+	return result;
+}
+
+void WordCache::EndLayout() {
+	uint32_t generation = Generation++;
+	if (TotalBytes <= MaxBytes)
+		return;
+
+	// Discard the least recently used words, until we're comfortably below the limit
+	cheapvec<std::pair<uint32_t, uint64_t>> age;
+	for (auto& it : Table)
+		age += std::pair<uint32_t, uint64_t>(generation - it.second->LastUsed.Load(), it.first);
+	std::sort(age.data, age.data + age.size(), [](const std::pair<uint32_t, uint64_t>& a, const std::pair<uint32_t, uint64_t>& b) {
+		return a.first > b.first;
+	});
+
+	size_t   target     = MaxBytes * 3 / 4;
+	uint32_t numEvicted = 0;
+	for (size_t i = 0; i < age.size() && TotalBytes > target; i++) {
+		Word* w = Table.get(age[i].second);
+		TotalBytes -= w->TotalBytes();
+		free(w);
+		Table.erase(age[i].second);
+		numEvicted++;
+	}
+	XOTRACE_LAYOUT_VERBOSE("WordCache: evicted %u words\n", numEvicted);
+}
+} // namespace xo
@@ -0,0 +1,78 @@
+#pragma once
+#include "../Defs.h"
+#include "../Render/RenderDomEl.h"
+
+namespace xo {
+
+/* Measurements of words, which are shared by every layout of a document.
+
+Documents repeat the same words (numbers, units, labels) over and over, so instead of decoding
+and measuring every word during every layout, we remember the width of every word, and the
+placement of each of its glyphs. The key is [font, size, flags, bytes of the word], where the
+flags are the glyph flags, plus the global settings that affect measurement.
+
+Every layout thread owns a Local, which sits in front of the shared table, so that the lock is
+only taken when a thread sees a word for the first time during a layout. Words are never freed
+during a layout. Once the layout is done, EndLayout() discards the least recently used words
+if the cache has grown beyond MaxBytes.
+*/
+class XO_API WordCache {
+public:
+	static const size_t MaxBytes = 4 * 1024 * 1024;
+
+	enum Flags {
+		FlagSnapHorzText = 0x10, // Above the GlyphFlags
+		FlagKerning      = 0x20,
+	};
+
+	// A word whose glyphs have been placed. The glyphs, and then the bytes of the word, follow this header in memory.
+	// The glyph positions are relative to the start of the word, and so are their OriginalCharIndex.
+	struct Word {
+		Pos                Width;
+		FontID             Font;
+		uint8_t            FontSizePx;
+		uint8_t            Flags;
+		uint16_t           NumChars;
+		uint32_t           NumBytes;
+		mutable FrameStamp LastUsed; // Layout in which this word was last used. Written by concurrent layout threads.
+
+		const RenderCharEl* Chars() const { return (const RenderCharEl*) (this + 1); }
+		const char*         Bytes() const { return (const char*) (Chars() + NumChars); }
+		size_t              TotalBytes() const { return sizeof(Word) + NumChars * sizeof(RenderCharEl) + NumBytes; }
+	};
+
+	struct Key {
+		FontID      Font;
+		uint8_t     FontSizePx;
+		uint8_t     Flags;
+		const char* Bytes;
+		uint32_t    NumBytes;
+	};
+
+	// Owned by a single thread
+	struct Local {
+		ohash::map<uint64_t, const Word*> Map;
+	};
+
+	~WordCache();
+
+	void Clear();     // Not thread safe
+	void EndLayout(); // Must not be called while a layout is running
+
+	// Returns null if the word has not been measured
+	const Word* Get(const Key& key, Local& local);
+
+	// Returns null in the astronomically unlikely event of a hash collision, in which case the caller
+	// must use its own measurements.
+	const Word* Insert(const Key& key, Pos width, const RenderCharEl* chars, size_t numChars, Local& local);
+
+protected:
+	std::mutex                  Lock;
+	ohash::map<uint64_t, Word*> Table;
+	size_t                      TotalBytes = 0;
+	uint32_t                    Generation = 0;
+
+	static uint64_t Hash(const Key& key);
+	static bool     Equals(const Word* w, const Key& key);
+};
+} // namespace xo
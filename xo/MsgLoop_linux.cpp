@@ -5,70 +5,115 @@
 #include "Event.h"
 #include "Doc.h"
 
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+
 /*
 
-We use select() to wait for X11 input messages, the same way one uses GetMessage() on Windows.
-We need to be able to wake that select() up, for example if we have a redraw pending. For example,
-the UI thread has made some changes to a document, and we want to get that document onto the
-screen. The document is marked as dirty, but the select() doesn't know it. The first thing that
-I tried, was to use inject XClientMessageEvent into the event stream, thereby waking up the
-select(). That works most of the time, but fairly often it doesn't work. I have no idea
-what's going on there, but I suspect it's something to do with message queues and the
-inherent asynchronous nature of the X11 system. What I resorted to instead, is to create an
-additional pipe, which I also add to the select() list. In order to wake up the select(), I
-write a single byte into that pipe. Whenever I wake up from the select(), I drain the pipe.
-This seems to work without any flaws.
-
--- OLD NEWS --
-NOTE: We're doing *something* wrong in the way that we treat SysWndLinux::PostRepaintMessage.
-For some reason, we can sometimes end up with a stale image, because our select() doesn't
-get triggered by our XClientMessage_Repaint.
-
-You can trigger the behaviour by running KitchenSink, DoKeyEventBubble function, and banging
-on the keys (like qwe) for a second or two, and then rapidly pressing [] in sequence.
-You'll notice that the screen stays on [ for a second, and then shows ]. Somehow the repaint
-message that got sent after the ] key doesn't cause the select() to wake up. A hack is
-to turn down the select timeout, but that's obviously nasty business.
+We use epoll to wait for X11 input messages, the same way one uses GetMessage() on Windows.
+Every window registers three file descriptors with our epoll instance:
+
+* The X11 connection, which tells us about input.
+* An eventfd, which the other threads use to wake us up, for example when the UI thread has
+  made changes to a document, and we want to get that document onto the screen. The first thing
+  that I tried was to inject an XClientMessageEvent into the event stream, but that fairly often
+  failed to wake us up, which left stale frames on the screen.
+* A timerfd, which is armed for the earliest DOM timer of the window's document. When it expires,
+  we post an EventTimer to the UI thread. Once the UI thread has run the timers, the document's
+  earliest timer changes, and it wakes us up via the eventfd, so that we can re-arm the timerfd.
+
+Rendering is paced by one more timerfd, which ticks at Global()->TargetFPS. A window that asks to
+be repainted is put on a pending list. If a whole frame interval has passed since we last rendered,
+then we render immediately, so that a single change reaches the screen with minimal latency.
+Otherwise we wait for the frame clock, so that a burst of repaint requests produces one frame.
+
+The epoll data of every registration is the SysWndLinux pointer, with the type of the file
+descriptor in the low bits. When a window is destroyed, it closes its file descriptors, which
+removes them from our epoll instance.
 */
 
 namespace xo {
 
-static cheapvec<DocGroupLinux*> SelectDocsWithEventsInQueue() {
-	fd_set readFd;
-	FD_ZERO(&readFd);
+enum EpollSources {
+	EpollSourceX     = 0,
+	EpollSourceWake  = 1,
+	EpollSourceTimer = 2,
+	EpollSourceFrame = 3, // The frame clock, which does not belong to any window
+	EpollSourceMask  = 3,
+};
 
-	int xf_max = 0;
-	for (DocGroup* dg : Global()->Docs) {
-		SysWndLinux* wnd = (SysWndLinux*) dg->Wnd;
-		FD_SET(wnd->XDisplay_FD, &readFd);
-		FD_SET(wnd->EventLoopWakePipe[0], &readFd);
-		xf_max = std::max(xf_max, wnd->XDisplay_FD);
-		xf_max = std::max(xf_max, wnd->EventLoopWakePipe[0]);
+static_assert(alignof(SysWndLinux) > EpollSourceMask, "Window pointers need free low bits for the epoll source type");
+
+// If the UI thread hasn't run the EventTimer that we posted after this long, then it probably dropped it (eg no layout yet)
+static const int64_t RepostTimerMS = 1000;
+
+struct MsgLoopLinux {
+	int                      Epoll           = -1;
+	int                      FrameTimerFD    = -1;
+	bool                     FrameTimerArmed = false;
+	int64_t                  LastFrameNS     = 0;
+	cheapvec<DocGroupLinux*> PendingRender;
+};
+
+static void DrainFD(int fd) {
+	uint64_t v;
+	while (read(fd, &v, sizeof(v)) > 0) {
 	}
+}
+
+// A delay of zero would disarm the timer, so the shortest delay is one nanosecond
+static void ArmTimerFD(int fd, int64_t delayNS) {
+	delayNS = std::max<int64_t>(delayNS, 1);
+	itimerspec t;
+	memset(&t, 0, sizeof(t));
+	t.it_value.tv_sec  = (time_t)(delayNS / 1000000000);
+	t.it_value.tv_nsec = (long) (delayNS % 1000000000);
+	timerfd_settime(fd, 0, &t, nullptr);
+}
 
-	cheapvec<DocGroupLinux*> ready;
+static void DisarmTimerFD(int fd) {
+	itimerspec t;
+	memset(&t, 0, sizeof(t));
+	timerfd_settime(fd, 0, &t, nullptr);
+}
 
-	timeval timeout = {2, 0}; // seconds, microseconds
-	int     nsel    = select(xf_max + 1, &readFd, nullptr, nullptr, &timeout);
-	//printf("select: %d\n", nsel);
-	if (nsel == -1)
-		return ready;
+static void EpollAdd(MsgLoopLinux& loop, int fd, SysWndLinux* wnd, EpollSources source) {
+	epoll_event ev;
+	memset(&ev, 0, sizeof(ev));
+	ev.events   = EPOLLIN;
+	ev.data.u64 = (uint64_t)(uintptr_t) wnd | source;
+	epoll_ctl(loop.Epoll, EPOLL_CTL_ADD, fd, &ev);
+}
 
-	for (DocGroup* dg : Global()->Docs) {
-		SysWndLinux* wnd         = (SysWndLinux*) dg->Wnd;
-		bool         hasXEvents  = FD_ISSET(wnd->XDisplay_FD, &readFd);
-		bool         hasPipeData = FD_ISSET(wnd->EventLoopWakePipe[0], &readFd);
-		if (hasXEvents || hasPipeData) {
-			ready.push((DocGroupLinux*) dg);
-			if (hasPipeData) {
-				// drain the pipe, because we're going to be re-rendering this document now.
-				char buf[64];
-				while (read(wnd->EventLoopWakePipe[0], buf, sizeof(buf)) > 0) {
-				}
-			}
-		}
+// Post an EventTimer if the document's earliest timer is due, and arm the window's timerfd for the next deadline
+static void UpdateDocTimers(DocGroupLinux* dg) {
+	SysWndLinux* wnd = (SysWndLinux*) dg->Wnd;
+	int64_t      due = dg->Doc->NextTimerDueMS();
+	if (due == INT64_MAX) {
+		DisarmTimerFD(wnd->EventLoopTimerFD);
+		return;
+	}
+
+	// Don't post again while the UI thread is busy with our previous event
+	int64_t now      = MilliTicks();
+	int64_t deadline = due == dg->TimerPostedDueMS ? due + RepostTimerMS : due;
+	if (deadline <= now) {
+		OriginalEvent ev;
+		ev.DocGroup   = dg;
+		ev.Event.Doc  = dg->Doc;
+		ev.Event.Type = EventTimer;
+		Global()->UIEventQueue.Add(ev);
+		dg->TimerPostedDueMS = due;
+		deadline             = now + RepostTimerMS;
+	}
+	ArmTimerFD(wnd->EventLoopTimerFD, (deadline - now) * 1000000);
+}
+
+static void AddPendingRender(MsgLoopLinux& loop, DocGroupLinux* dg) {
+	if (!dg->IsRenderPending) {
+		dg->IsRenderPending = true;
+		loop.PendingRender += dg;
 	}
-	return ready;
 }
 
 static void MapKeyToEvent(XKeyEvent& xkey, Event& ev, bool& dispatch, bool& isChar) {
@@ -175,9 +220,10 @@ bool ProcessEventsForDoc(DocGroupLinux* dg) {
 		case MotionNotify:
 			//printf("x,y = %d,%d\n", xev.xmotion.x, xev.xmotion.y);
 			ev.Event.Type           = EventMouseMove;
+			ev.Event.PointCount     = 1;
 			ev.Event.PointsAbs[0].x = xev.xmotion.x + cursorOffX;
 			ev.Event.PointsAbs[0].y = xev.xmotion.y + cursorOffY;
-			Global()->UIEventQueue.Add(ev);
+			Global()->UIEventQueue.AddOrCoalesce(ev);
 			break;
 		case ButtonPress:
 		case ButtonRelease:
@@ -193,33 +239,116 @@ bool ProcessEventsForDoc(DocGroupLinux* dg) {
 	return true;
 }
 
+// Register the windows that have been created since our last iteration
+static void RegisterNewWindows(MsgLoopLinux& loop) {
+	for (DocGroup* dg : Global()->Docs) {
+		SysWndLinux* wnd = (SysWndLinux*) dg->Wnd;
+		if (wnd->IsInEventLoop)
+			continue;
+		wnd->IsInEventLoop = true;
+		EpollAdd(loop, wnd->XDisplay_FD, wnd, EpollSourceX);
+		EpollAdd(loop, wnd->EventLoopWakeFD, wnd, EpollSourceWake);
+		EpollAdd(loop, wnd->EventLoopTimerFD, wnd, EpollSourceTimer);
+		UpdateDocTimers((DocGroupLinux*) dg);
+		AddPendingRender(loop, (DocGroupLinux*) dg);
+	}
+}
+
+static void RenderPendingDocs(MsgLoopLinux& loop) {
+	for (DocGroupLinux* dg : loop.PendingRender) {
+		dg->IsRenderPending = false;
+		if (dg->IsDirty()) {
+			RenderResult rr = dg->Render();
+			// This wakes us up again, and we'll render on the next frame
+			if (rr == RenderResultNeedMore) {
+				dg->Wnd->PostRepaintMessage();
+			} else {
+				dg->Wnd->ValidateWindow();
+			}
+			// Xlib may have read input events into its own queue while we were rendering, and
+			// those will never make the X11 connection readable.
+			SysWndLinux* wnd = (SysWndLinux*) dg->Wnd;
+			if (XEventsQueued(wnd->XDisplay, QueuedAlready) != 0)
+				ProcessEventsForDoc(dg);
+		}
+	}
+	loop.PendingRender.clear_noalloc();
+}
+
 XO_API void RunMessageLoop() {
+	MsgLoopLinux loop;
+	loop.Epoll        = epoll_create1(EPOLL_CLOEXEC);
+	loop.FrameTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	XO_ASSERT(loop.Epoll != -1 && loop.FrameTimerFD != -1);
+	EpollAdd(loop, loop.FrameTimerFD, nullptr, EpollSourceFrame);
+
 	AddOrRemoveDocsFromGlobalList();
+	RegisterNewWindows(loop);
+
+	const int   maxEvents = 64;
+	epoll_event events[maxEvents];
 
 	while (1) {
+		int nev = epoll_wait(loop.Epoll, events, maxEvents, -1);
+		if (nev == -1 && errno != EINTR)
+			break;
+
 		bool quit = false;
-		for (DocGroupLinux* dg : SelectDocsWithEventsInQueue()) {
-			if (!ProcessEventsForDoc(dg)) {
-				quit = true;
+		for (int i = 0; i < nev && !quit; i++) {
+			EpollSources   source = (EpollSources)(events[i].data.u64 & EpollSourceMask);
+			SysWndLinux*   wnd    = (SysWndLinux*) (uintptr_t)(events[i].data.u64 & ~(uint64_t) EpollSourceMask);
+			DocGroupLinux* dg     = wnd ? (DocGroupLinux*) wnd->DocGroup : nullptr;
+			switch (source) {
+			case EpollSourceX:
+				if (!ProcessEventsForDoc(dg))
+					quit = true;
+				AddPendingRender(loop, dg);
+				break;
+			case EpollSourceWake:
+				DrainFD(wnd->EventLoopWakeFD);
+				UpdateDocTimers(dg);
+				AddPendingRender(loop, dg);
+				break;
+			case EpollSourceTimer:
+				DrainFD(wnd->EventLoopTimerFD);
+				UpdateDocTimers(dg);
+				break;
+			case EpollSourceFrame:
+				DrainFD(loop.FrameTimerFD);
+				loop.FrameTimerArmed = false;
+				break;
+			default:
 				break;
 			}
 		}
 		if (quit)
 			break;
 
-		for (DocGroup* dg : Global()->Docs) {
-			if (dg->IsDirty()) {
-				RenderResult rr = dg->Render();
-				if (rr == RenderResultNeedMore) {
-					dg->Wnd->PostRepaintMessage();
-				} else {
-					dg->Wnd->ValidateWindow();
-				}
+		// Render now if a whole frame has passed since our last render, otherwise wait for the frame clock
+		if (loop.PendingRender.size() != 0 && !loop.FrameTimerArmed) {
+			int64_t now      = NanoTicks();
+			int64_t interval = 1000000000 / std::max(Global()->TargetFPS, 1);
+			if (now - loop.LastFrameNS >= interval) {
+				loop.LastFrameNS = now;
+				RenderPendingDocs(loop);
+			} else {
+				ArmTimerFD(loop.FrameTimerFD, loop.LastFrameNS + interval - now);
+				loop.FrameTimerArmed = true;
 			}
 		}
 
+		// A document that is removed here may still be waiting for the frame clock. We only compare
+		// the pointers, because the removed documents have already been deleted.
 		AddOrRemoveDocsFromGlobalList();
+		for (int i = (int) loop.PendingRender.size() - 1; i >= 0; i--) {
+			if (!Global()->Docs.contains(loop.PendingRender[i]))
+				loop.PendingRender.erase(i);
+		}
+		RegisterNewWindows(loop);
 	}
+
+	close(loop.FrameTimerFD);
+	close(loop.Epoll);
 }
 
 } // namespace xo
@@ -8,9 +8,16 @@
 
 namespace xo {
 
+// Arrange for a WM_TIMER message when each document's earliest timer is due
 static void SetupTimerMessagesForAllDocs() {
-	for (DocGroup* dg : Global()->Docs)
-		((DocGroupWindows*) dg)->SetSysWndTimer(dg->Doc->FastestTimerMS());
+	int64_t now = MilliTicks();
+	for (DocGroup* dg : Global()->Docs) {
+		int64_t  due   = dg->Doc->NextTimerDueMS();
+		uint32_t delay = 0;
+		if (due != INT64_MAX)
+			delay = (uint32_t) Clamp<int64_t>(due - now, 1, UINT32_MAX - 1);
+		((DocGroupWindows*) dg)->SetSysWndTimer(delay);
+	}
 }
 
 XO_API void RunMessageLoop() {
@@ -0,0 +1,140 @@
+#include "pch.h"
+#include "CompiledStyle.h"
+#include "../Doc.h"
+#include "../Dom/DomNode.h"
+#include "StyleResolve.h"
+#include "../../dependencies/hash/xxhash_xo_wrapper.h"
+
+namespace xo {
+
+void CompiledStyle::MakeKey(Tag tag, const cheapvec<StyleClassID>& classes, uint32_t states, cheapvec<uint32_t>& key) {
+	key.clear_noalloc();
+	key += (uint32_t) tag;
+	key += states;
+	for (size_t i = 0; i < classes.size(); i++)
+		key += classes[i].ID;
+}
+
+void CompiledStyle::Compile(const Doc* doc, Tag tag, const cheapvec<StyleClassID>& classes, uint32_t states) {
+	MakeKey(tag, classes, states, Key);
+
+	// Gather all of the attributes, in the order in which StyleResolver would apply them
+	cheapvec<StyleAttrib> all;
+	const Style&          tagStyle = doc->TagStyles[tag];
+	all.addn(tagStyle.Attribs.data, tagStyle.Attribs.size());
+	for (size_t i = 0; i < classes.size(); i++) {
+		const StyleClass* klass = doc->ClassStyles.GetByID(classes[i]);
+		all.addn(klass->Default.Attribs.data, klass->Default.Attribs.size());
+		if (!!(states & StateHover))
+			all.addn(klass->Hover.Attribs.data, klass->Hover.Attribs.size());
+		if (!!(states & StateFocus))
+			all.addn(klass->Focus.Attribs.data, klass->Focus.Attribs.size());
+		if (!!(states & StateCapture))
+			all.addn(klass->Capture.Attribs.data, klass->Capture.Attribs.size());
+		HasHoverStyle |= !klass->Hover.IsEmpty();
+		HasFocusStyle |= !klass->Focus.IsEmpty();
+		HasCaptureStyle |= !klass->Capture.IsEmpty();
+	}
+
+	// Walk backwards, keeping only the last write to each category.
+	// VCenter and Baseline clobber each other, so they share a slot.
+	bool seen[CatEND];
+	memset(seen, 0, sizeof(seen));
+	Attribs.clear_noalloc();
+	for (int i = (int) all.size() - 1; i >= 0; i--) {
+		StyleCategories cat = all[i].GetCategory() == CatBaseline ? CatVCenter : all[i].GetCategory();
+		if (seen[cat])
+			continue;
+		seen[cat] = true;
+		Attribs += all[i];
+		if (all[i].IsInherit() || all[i].IsVerbatim() || cat == CatVCenter)
+			IsPlain = false;
+	}
+	for (size_t i = 0, j = Attribs.size() - 1; i < Attribs.size() / 2; i++, j--)
+		std::swap(Attribs[i], Attribs[j]);
+}
+
+void CompiledVerbatim::Compile(Doc* doc, StyleAttrib attrib) {
+	Source = doc->GetStyleVerbatim(attrib.GetVerbatimID());
+
+	cheapvec<char> buf;
+	Style          exploded;
+	IsValid = StyleResolver::ExplodeVerbatimAttrib(doc, attrib, buf, exploded);
+	if (IsValid)
+		Attribs.addn(exploded.Attribs.data, exploded.Attribs.size());
+}
+
+CompiledStyleCache::~CompiledStyleCache() {
+	Clear();
+}
+
+void CompiledStyleCache::Clear() {
+	for (auto& it : Table)
+		delete it.second;
+	Table.clear();
+	for (auto& it : Verbatims)
+		delete it.second;
+	Verbatims.clear();
+	DeleteAll(RetiredVerbatims);
+}
+
+bool CompiledStyleCache::KeyEquals(const CompiledStyle* c, const cheapvec<uint32_t>& key) {
+	return c->Key.size() == key.size() && memcmp(c->Key.data, key.data, key.size() * sizeof(uint32_t)) == 0;
+}
+
+// Returns null in the astronomically unlikely event of a hash collision, in which case the caller
+// must resolve the styles the slow way.
+const CompiledStyle* CompiledStyleCache::Get(const Doc* doc, const DomNode* node, Local& local) {
+	InternalID id     = node->GetInternalID();
+	uint32_t   states = 0;
+	if (doc->UI.IsHovering(id))
+		states |= CompiledStyle::StateHover;
+	if (doc->UI.IsFocused(id))
+		states |= CompiledStyle::StateFocus;
+	if (doc->UI.IsCaptured(id))
+		states |= CompiledStyle::StateCapture;
+
+	CompiledStyle::MakeKey(node->GetTag(), node->GetClasses(), states, local.Key);
+	uint64_t hash = XXH64(local.Key.data, local.Key.size() * sizeof(uint32_t), 0);
+
+	const CompiledStyle** lc = local.Map.getp(hash);
+	if (lc != nullptr)
+		return KeyEquals(*lc, local.Key) ? *lc : nullptr;
+
+	std::lock_guard<std::mutex> lock(Lock);
+	CompiledStyle**             sc = Table.getp(hash);
+	if (sc == nullptr) {
+		CompiledStyle* c = new CompiledStyle();
+		c->Compile(doc, node->GetTag(), node->GetClasses(), states);
+		Table.insert(hash, c);
+		sc = Table.getp(hash);
+	}
+	local.Map.insert(hash, *sc);
+	return KeyEquals(*sc, local.Key) ? *sc : nullptr;
+}
+
+const CompiledVerbatim* CompiledStyleCache::GetVerbatim(Doc* doc, StyleAttrib attrib, Local& local) {
+	const char* verbatim = doc->GetStyleVerbatim(attrib.GetVerbatimID());
+	if (verbatim == nullptr)
+		return nullptr;
+
+	uint64_t                 key = CompiledVerbatim::MakeKey(attrib);
+	const CompiledVerbatim** lv  = local.Verbatims.getp(key);
+	if (lv != nullptr && strcmp((*lv)->Source.Z, verbatim) == 0)
+		return *lv;
+
+	// We compile while holding the lock, because Style::Parse may add strings to the document
+	std::lock_guard<std::mutex> lock(Lock);
+	CompiledVerbatim**          sv = Verbatims.getp(key);
+	if (sv == nullptr || strcmp((*sv)->Source.Z, verbatim) != 0) {
+		if (sv != nullptr)
+			RetiredVerbatims += *sv;
+		CompiledVerbatim* v = new CompiledVerbatim();
+		v->Compile(doc, attrib);
+		Verbatims.insert(key, v, true);
+		sv = Verbatims.getp(key);
+	}
+	local.Verbatims.insert(key, *sv, true);
+	return *sv;
+}
+} // namespace xo
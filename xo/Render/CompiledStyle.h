@@ -0,0 +1,89 @@
+#pragma once
+#include "../Style.h"
+
+namespace xo {
+
+class DomNode;
+
+/* The tag style and class styles of a node, merged together.
+
+Thousands of nodes typically share the same tag and list of classes, so instead of merging the
+tag style and every class for every node, during every layout, we do it once for every unique
+combination of [tag, classes, hover/focus/capture state].
+
+Attributes that are overridden by a later attribute are dropped, so applying Attribs in order
+has the same effect as applying the tag style and each of the classes in turn. If the result
+contains no inherited or verbatim attributes, then it can be copied straight into a StyleSet.
+*/
+class XO_API CompiledStyle {
+public:
+	enum States {
+		StateHover   = 1,
+		StateFocus   = 2,
+		StateCapture = 4,
+	};
+
+	cheapvec<uint32_t>    Key; // [tag, states, class IDs...]
+	cheapvec<StyleAttrib> Attribs;
+	bool                  IsPlain         = true; // No attributes that need to go through StyleResolver::SetOrExplode
+	bool                  HasHoverStyle   = false;
+	bool                  HasFocusStyle   = false;
+	bool                  HasCaptureStyle = false;
+
+	void Compile(const Doc* doc, Tag tag, const cheapvec<StyleClassID>& classes, uint32_t states);
+
+	static void MakeKey(Tag tag, const cheapvec<StyleClassID>& classes, uint32_t states, cheapvec<uint32_t>& key);
+};
+
+/* A verbatim attribute (such as "border: 1px $dark-border"), with its variables expanded and parsed.
+
+Source is a copy of the verbatim string, because the verbatim string table recycles the IDs of
+strings that are no longer referenced.
+*/
+class XO_API CompiledVerbatim {
+public:
+	xo::String            Source;
+	cheapvec<StyleAttrib> Attribs;
+	bool                  IsValid = false; // False if the expanded string failed to parse
+
+	void Compile(Doc* doc, StyleAttrib attrib);
+
+	static uint64_t MakeKey(StyleAttrib attrib) { return ((uint64_t) (uint32_t) attrib.GetVerbatimID() << 8) | (uint64_t) attrib.Category; }
+};
+
+/* Shared cache of CompiledStyle and CompiledVerbatim objects.
+
+The layout threads all read from this at the same time. Every thread owns a Local, which
+sits in front of the shared table, so that the lock is only taken when a thread sees a
+combination for the first time. Entries are never freed during a layout, so the pointers in
+the Locals remain valid until Clear() is called, which must happen when no layout is running.
+
+The verbatim attributes depend on the style variables, so Clear() must also be called whenever
+any style variable changes.
+*/
+class XO_API CompiledStyleCache {
+public:
+	// Owned by a single thread
+	struct Local {
+		ohash::map<uint64_t, const CompiledStyle*>    Map;
+		ohash::map<uint64_t, const CompiledVerbatim*> Verbatims;
+		cheapvec<uint32_t>                            Key;
+	};
+
+	~CompiledStyleCache();
+
+	void                 Clear(); // Call this whenever the tag styles, class styles, or style variables change
+	const CompiledStyle* Get(const Doc* doc, const DomNode* node, Local& local);
+
+	// Returns null if the verbatim ID is invalid. The doc is not const, for the same reason as StyleResolver::ExplodeVerbatimAttrib.
+	const CompiledVerbatim* GetVerbatim(Doc* doc, StyleAttrib attrib, Local& local);
+
+protected:
+	std::mutex                              Lock;
+	ohash::map<uint64_t, CompiledStyle*>    Table;
+	ohash::map<uint64_t, CompiledVerbatim*> Verbatims;
+	cheapvec<CompiledVerbatim*>             RetiredVerbatims; // Replaced because their ID was recycled, but a Local may still point to them
+
+	static bool KeyEquals(const CompiledStyle* c, const cheapvec<uint32_t>& key);
+};
+} // namespace xo
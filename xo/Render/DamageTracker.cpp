@@ -0,0 +1,191 @@
+#include "pch.h"
+#include "DamageTracker.h"
+#include "RenderDomEl.h"
+#include "../Doc.h"
+#include "../Dom/DomCanvas.h"
+#include "../Image/Image.h"
+#include "../../dependencies/hash/xxhash_xo_wrapper.h"
+
+namespace xo {
+
+static int64_t Area(const Box& b) {
+	return (int64_t) b.Width() * (int64_t) b.Height();
+}
+
+static Box Union(Box a, const Box& b) {
+	a.ExpandToFit(b);
+	return a;
+}
+
+static bool Overlaps(const Box& a, const Box& b) {
+	return a.Left <= b.Right && b.Left <= a.Right && a.Top <= b.Bottom && b.Top <= a.Bottom;
+}
+
+void DamageTracker::RectList::Add(Box r) {
+	if (!r.IsAreaPositive())
+		return;
+
+	for (int i = 0; i < Count; i++) {
+		if (Overlaps(Rects[i], r)) {
+			// The merged rectangle might now overlap others, so add it again from scratch
+			r = Union(Rects[i], r);
+			Rects[i] = Rects[--Count];
+			Add(r);
+			return;
+		}
+	}
+
+	if (Count < MaxRects) {
+		Rects[Count++] = r;
+		return;
+	}
+
+	// Merge with whichever rectangle grows the least
+	int     best     = 0;
+	int64_t bestCost = INT64_MAX;
+	for (int i = 0; i < Count; i++) {
+		int64_t cost = Area(Union(Rects[i], r)) - Area(Rects[i]);
+		if (cost < bestCost) {
+			best     = i;
+			bestCost = cost;
+		}
+	}
+	r           = Union(Rects[best], r);
+	Rects[best] = Rects[--Count];
+	Add(r);
+}
+
+void DamageTracker::RectList::Add(const RectList& list) {
+	for (int i = 0; i < list.Count; i++)
+		Add(list.Rects[i]);
+}
+
+bool DamageTracker::RectList::Intersects(const Box& r) const {
+	for (int i = 0; i < Count; i++) {
+		if (r.Left < Rects[i].Right && Rects[i].Left < r.Right && r.Top < Rects[i].Bottom && Rects[i].Top < r.Bottom)
+			return true;
+	}
+	return false;
+}
+
+bool DamageTracker::Update(const xo::Doc* doc, const RenderDomNode* root, int width, int height, int backBufferAge, bool forceFull, RectList& repaint) {
+	// Don't bother tracking anything if we're going to repaint the whole frame regardless
+	if (backBufferAge <= 0 || !Global()->EnablePartialRepaint) {
+		NumFrames = 0;
+		return false;
+	}
+
+	Next.clear_noalloc();
+	NumPerID.clear_noalloc();
+	Collect(doc, Point(0, 0), root);
+
+	bool     full = forceFull || NumFrames == 0 || width != Width || height != Height;
+	RectList damage;
+	if (full) {
+		damage.Add(Box(0, 0, width, height));
+	} else {
+		damage = Pending;
+		for (auto& it : Next) {
+			ElState* prev = Prev.getp(it.first);
+			if (prev == nullptr) {
+				damage.Add(it.second.Bounds);
+			} else if (prev->Hash != it.second.Hash || prev->Bounds != it.second.Bounds) {
+				damage.Add(prev->Bounds);
+				damage.Add(it.second.Bounds);
+			}
+		}
+		for (auto& it : Prev) {
+			if (!Next.contains(it.first))
+				damage.Add(it.second.Bounds);
+		}
+	}
+	Pending.Count = 0;
+	std::swap(Prev, Next);
+	Width  = width;
+	Height = height;
+	PushHistory(damage);
+
+	// The back buffer is missing the damage of every frame that was presented after it
+	if (full || backBufferAge > NumFrames)
+		return false;
+
+	repaint.Count = 0;
+	for (int i = 0; i < backBufferAge; i++)
+		repaint.Add(History[i]);
+	Box screen(0, 0, width, height);
+	for (int i = 0; i < repaint.Count; i++)
+		repaint.Rects[i].ClampTo(screen);
+	return true;
+}
+
+void DamageTracker::PushHistory(const RectList& damage) {
+	for (int i = MaxHistory - 1; i > 0; i--)
+		History[i] = History[i - 1];
+	History[0] = damage;
+	NumFrames  = Min(NumFrames + 1, MaxHistory);
+}
+
+void DamageTracker::Collect(const xo::Doc* doc, Point base, const RenderDomEl* el) {
+	uint32_t& n   = NumPerID[el->InternalID];
+	uint64_t  key = ((uint64_t) el->InternalID << 32) | n;
+	n++;
+	Next.insert(key, ElState{ElementBounds(base, el), ElementHash(doc, base, el)});
+
+	if (el->Tag != TagText) {
+		const RenderDomNode* node    = static_cast<const RenderDomNode*>(el);
+		Point                newBase = base + Point(node->Pos.Left, node->Pos.Top);
+		for (size_t i = 0; i < node->Children.size(); i++)
+			Collect(doc, newBase, node->Children[i]);
+	}
+}
+
+Box DamageTracker::ElementBounds(Point base, const RenderDomEl* el) {
+	Box b;
+	int pad = 1; // For the antialiased edges
+	if (el->Tag == TagText) {
+		// Glyphs can hang outside of the line box, so use the character cells, with generous padding
+		const RenderDomText* txt = static_cast<const RenderDomText*>(el);
+		b                        = txt->Pos;
+		b.Offset(base);
+		Point origin = base + Point(txt->Pos.Left, txt->Pos.Top);
+		for (size_t i = 0; i < txt->Text.size(); i++) {
+			const RenderCharEl& c = txt->Text[i];
+			b.ExpandToFit(Box(origin.X + c.X, origin.Y + c.Y, origin.X + c.X + c.Width, origin.Y + c.Y + IntToPos(txt->FontSizePx)));
+		}
+		pad += txt->FontSizePx / 2;
+	} else {
+		b = static_cast<const RenderDomNode*>(el)->BorderBox();
+		b.Offset(base);
+	}
+	return Box((PosRoundDown(b.Left) >> PosShift) - pad,
+	           (PosRoundDown(b.Top) >> PosShift) - pad,
+	           (PosRoundUp(b.Right) >> PosShift) + pad,
+	           (PosRoundUp(b.Bottom) >> PosShift) + pad);
+}
+
+uint64_t DamageTracker::ElementHash(const xo::Doc* doc, Point base, const RenderDomEl* el) {
+	Box pos = el->Pos;
+	pos.Offset(base);
+	uint64_t h = XXH64(&pos, sizeof(pos), el->Tag);
+	if (el->Tag == TagText) {
+		const RenderDomText* txt = static_cast<const RenderDomText*>(el);
+		h                        = XXH64(&txt->FontID, sizeof(txt->FontID), h);
+		h                        = XXH64(&txt->Color, sizeof(txt->Color), h);
+		h                        = XXH64(&txt->FontSizePx, sizeof(txt->FontSizePx), h);
+		h                        = XXH64(&txt->Flags, sizeof(txt->Flags), h);
+		h                        = XXH64(txt->Text.Data, txt->Text.Count * sizeof(RenderCharEl), h);
+	} else {
+		const RenderDomNode* node = static_cast<const RenderDomNode*>(el);
+		h                         = XXH64(&node->Style, sizeof(node->Style), h);
+		if (node->IsCanvas()) {
+			// The canvas pixels are not part of the render tree. The image can be drawn on without going
+			// through DomCanvas, so we can't rely on the element's version alone.
+			const DomCanvas* canvas = static_cast<const DomCanvas*>(doc->GetChildByInternalID(node->InternalID));
+			const Image*     img    = canvas ? doc->Images.Get(canvas->GetImageID()) : nullptr;
+			uint32_t         ver[3] = {canvas ? canvas->GetVersion() : 0, canvas ? (uint32_t) canvas->GetImageID() : 0, img ? img->ContentVersion : 0};
+			h                       = XXH64(ver, sizeof(ver), h);
+		}
+	}
+	return h;
+}
+} // namespace xo
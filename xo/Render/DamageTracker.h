@@ -0,0 +1,67 @@
+#pragma once
+#include "../Defs.h"
+
+namespace xo {
+
+class RenderDomEl;
+class RenderDomNode;
+
+/* Find the parts of the window that need to be repainted.
+
+Every frame, we record the bounds of every element in the render tree, along with a hash of
+everything that affects its appearance. These are keyed on the element's InternalID, plus a
+counter, because one DomText produces a RenderDomText for every line. Comparing the records
+against those of the previous frame tells us which rectangles have changed.
+
+Unless the device swaps by copying, the back buffer does not hold the previous frame, but the
+frame from BackBufferAge frames ago. So we also remember the damage of the last few frames,
+and repaint everything that has changed since the back buffer was last presented.
+
+All rectangles are in framebuffer pixels.
+*/
+class XO_API DamageTracker {
+public:
+	static const int MaxRects   = 4; // Beyond this, the two closest rectangles are merged together
+	static const int MaxHistory = 4; // If the back buffer is older than this, then we repaint the whole frame
+
+	struct RectList {
+		int Count = 0;
+		Box Rects[MaxRects];
+
+		void Add(Box r);
+		void Add(const RectList& list);
+		bool Intersects(const Box& r) const;
+	};
+
+	// Compute the rectangles to repaint. Returns false if the whole frame must be repainted.
+	bool Update(const xo::Doc* doc, const RenderDomNode* root, int width, int height, int backBufferAge, bool forceFull, RectList& repaint);
+
+	// The frame that was just drawn is incomplete (eg it is missing glyphs), so repaint the same damage next frame
+	void RepeatLastDamage() { Pending = History[0]; }
+
+	// Bounds of everything that the element draws, excluding its children
+	static Box ElementBounds(Point base, const RenderDomEl* el);
+
+	// Hash of everything that affects how the element is drawn, excluding its children.
+	// This includes the content version of a canvas' image.
+	static uint64_t ElementHash(const xo::Doc* doc, Point base, const RenderDomEl* el);
+
+protected:
+	struct ElState {
+		Box      Bounds;
+		uint64_t Hash;
+	};
+
+	int                              Width     = 0;
+	int                              Height    = 0;
+	int                              NumFrames = 0;       // Number of valid entries in History
+	RectList                         History[MaxHistory]; // Damage of recent frames. [0] is the most recent.
+	RectList                         Pending;             // Damage that is carried over into the next frame
+	ohash::map<uint64_t, ElState>    Prev;                // Elements of the previous frame
+	ohash::map<uint64_t, ElState>    Next;                // Elements of this frame
+	ohash::map<InternalID, uint32_t> NumPerID;            // Number of RenderDomEl seen so far for each InternalID
+
+	void Collect(const xo::Doc* doc, Point base, const RenderDomEl* el);
+	void PushHistory(const RectList& damage);
+};
+} // namespace xo
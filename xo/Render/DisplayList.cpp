@@ -0,0 +1,50 @@
+#include "pch.h"
+#include "DisplayList.h"
+
+namespace xo {
+
+DisplayList::~DisplayList() {
+	Clear();
+}
+
+void DisplayList::BeginFrame(uint32_t glyphAtlasEpoch, uint32_t vectorAtlasEpoch, bool useBoxInstances) {
+	Frame++;
+	if (glyphAtlasEpoch != GlyphAtlasEpoch || vectorAtlasEpoch != VectorAtlasEpoch || useBoxInstances != UseBoxInstances) {
+		Clear();
+		GlyphAtlasEpoch  = glyphAtlasEpoch;
+		VectorAtlasEpoch = vectorAtlasEpoch;
+		UseBoxInstances  = useBoxInstances;
+	}
+}
+
+void DisplayList::EndFrame(bool wholeFrame) {
+	if (!wholeFrame)
+		return;
+
+	cheapvec<InternalID> dead;
+	for (auto& it : Entries) {
+		if (it.second->LastUsed != Frame)
+			dead += it.first;
+	}
+	for (auto id : dead) {
+		delete Entries.get(id);
+		Entries.erase(id);
+	}
+}
+
+void DisplayList::Clear() {
+	for (auto& it : Entries)
+		delete it.second;
+	Entries.clear();
+}
+
+DisplayList::Entry* DisplayList::Use(InternalID root) {
+	Entry*& e = Entries[root];
+	if (e == nullptr)
+		e = new Entry();
+	else if (e->LastUsed == Frame)
+		return nullptr;
+	e->LastUsed = Frame;
+	return e;
+}
+} // namespace xo
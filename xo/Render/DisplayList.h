@@ -0,0 +1,63 @@
+#pragma once
+#include "../Defs.h"
+#include "../Text/GlyphCache.h"
+#include "VectorCache.h"
+#include "RenderStream.h"
+
+namespace xo {
+
+/* Recordings of subtrees of the render tree, which are replayed on subsequent frames.
+
+Most frames change very little of the document, such as a blinking caret, but without this, the
+Renderer would generate the vertices of every element, every frame. Instead, it records every
+subtree of moderate size into its own RenderStream, and keeps that here, keyed on the InternalID
+of the subtree's root. Along with the recording, we keep a hash of every element inside the subtree,
+which does not depend on where the subtree is. If the hash is the same on a subsequent frame, then
+the recording is played back, instead of being generated again. If the subtree has only moved by
+a whole number of pixels, which is what happens when scrolling, then the recorded vertices are
+translated in place. Anything else is recorded again.
+
+A recording holds texture pointers and atlas coordinates, so all recordings are discarded when
+the glyph cache or the vector cache replaces its atlases. A recording also remembers the glyphs
+and icons that it draws, so that replaying it keeps them from being evicted.
+
+Recordings that are not used by a whole-frame render are discarded. A partial repaint leaves out
+the subtrees that are outside of the clip, so it can't tell whether they're still alive.
+
+This object lives in RenderDoc, and is only used by the render thread, except for the Entries
+that the worker threads record into. Each Entry is handed to one job per frame.
+*/
+class XO_API DisplayList {
+public:
+	static const int MinElements = 8;   // Smaller subtrees are cheaper to generate than to keep
+	static const int MaxElements = 256; // Larger subtrees are split up, so that a change inside them doesn't need to record too much
+
+	struct Entry {
+		uint64_t                   Hash       = 0;
+		Point                      Origin;             // Position of the subtree's root when it was recorded
+		uint32_t                   LastUsed   = 0;     // DisplayList frame in which this was last used
+		bool                       IsComplete = false; // False if something was missing from the recording, such as a glyph
+		RenderStream               Stream;
+		ohash::set<GlyphCacheKey>  Glyphs;  // Glyphs drawn by Stream
+		ohash::set<VectorCacheKey> Vectors; // Icons drawn by Stream
+	};
+
+	~DisplayList();
+
+	// Discards everything if the atlases that our recordings refer to have changed, or if the vertex format has
+	void BeginFrame(uint32_t glyphAtlasEpoch, uint32_t vectorAtlasEpoch, bool useBoxInstances);
+	void EndFrame(bool wholeFrame);
+	void Clear();
+
+	// Returns the entry of the subtree, which is created if necessary. Returns null if the entry
+	// has already been used in this frame, which means that the subtree must be drawn directly.
+	Entry* Use(InternalID root);
+
+protected:
+	ohash::map<InternalID, Entry*> Entries;
+	uint32_t                       Frame            = 0;
+	uint32_t                       GlyphAtlasEpoch  = 0;
+	uint32_t                       VectorAtlasEpoch = 0;
+	bool                           UseBoxInstances  = false;
+};
+} // namespace xo
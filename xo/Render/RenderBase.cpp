@@ -74,6 +74,13 @@ uintptr_t RenderBase::GetTextureDeviceHandle(TextureID texID) const {
 	return TexIDToNative[absolute];
 }
 
+uintptr_t RenderBase::ForgetTexture(TextureID texID) {
+	uintptr_t handle        = GetTextureDeviceHandle(texID);
+	TextureID absolute      = texID - TEX_OFFSET_ONE - TexIDOffset;
+	TexIDToNative[absolute] = 0;
+	return handle;
+}
+
 void RenderBase::EnsureTextureProperlyDefined(Texture* tex, int texUnit) {
 	XO_ASSERT(tex->Width != 0 && tex->Height != 0);
 	XO_ASSERT(tex->Format != TexFormatInvalid);
@@ -32,6 +32,7 @@ static_assert((sizeof(ShaderPerObject) & 15) == 0, "ShaderPerFrame size must be
 enum GPUPrimitiveTypes {
 	GPUPrimQuads,
 	GPUPrimTriangles,
+	GPUPrimInstances, // Every 'vertex' is an instance, such as Vx_Box for ShaderBox
 };
 
 /* Base class of device-specific renderer (such as GL or DX).
@@ -95,14 +96,36 @@ public:
 	virtual void PreRender()         = 0;
 	virtual void PostRenderCleanup() = 0;
 
+	// Partial repaint. Rectangles are in framebuffer pixels. A device that can't tell how old its back buffer
+	// is returns zero from BackBufferAge, which makes every frame a full repaint, so it needn't implement the others.
+	virtual int  BackBufferAge() { return 0; }   // Number of frames since the contents of the back buffer were presented. 0 if unknown.
+	virtual void SetClipRect(const Box* rect) {} // Restrict drawing to 'rect'. While a clip rectangle is set, PreRender does not clear the frame.
+	virtual void ClearClipRect() {}              // Fill the clip rectangle with the clear color
+
 	virtual ProgBase* GetShader(Shaders shader)      = 0;
 	virtual void      ActivateShader(Shaders shader) = 0;
 
+	// True if the device can draw ShaderBox instances (Vx_Box). Otherwise boxes are drawn with ShaderUber.
+	virtual bool SupportsBoxInstances() { return false; }
+
 	virtual void Draw(GPUPrimitiveTypes type, int nvertex, const void* v) = 0;
 
 	virtual bool LoadTexture(Texture* tex, int texUnit) = 0;
 	virtual bool ReadBackbuffer(Image& image)           = 0;
 
+	// Release the device memory of a texture. The ID stays registered, because there is no "unregister",
+	// so the caller must never use it again.
+	virtual void FreeTexture(TextureID texID) {}
+
+	// Pipelined read back, for capturing a stream of frames. QueueReadBackbuffer starts copying the back buffer
+	// without waiting for the GPU, and returns false if the device can't do that, or already has too many reads
+	// in flight. ReadQueuedBackbuffer delivers the oldest queued frame. If that frame is not ready, and wait is
+	// false (or the wait times out), then it returns false, and the frame stays queued. A frame that is ready,
+	// but can't be read, is discarded with a warning.
+	virtual bool CanQueueReadBackbuffer() { return false; }
+	virtual bool QueueReadBackbuffer() { return false; }
+	virtual bool ReadQueuedBackbuffer(Image& image, bool wait) { return false; }
+
 protected:
 	static const TextureID TEX_OFFSET_ONE = 1; // This constant causes the TextureID that we expose to never be zero.
 	TextureID              TexIDOffset;
@@ -110,6 +133,7 @@ protected:
 	int                    FBWidth, FBHeight;
 
 	void        EnsureTextureProperlyDefined(Texture* tex, int texUnit);
+	uintptr_t   ForgetTexture(TextureID texID); // Clear the device handle of a texture, and return what it was
 	std::string CommonShaderDefines();
 };
 
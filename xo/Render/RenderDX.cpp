@@ -514,6 +514,14 @@ bool RenderDX::CreateTexture2D(Texture* tex) {
 	return true;
 }
 
+void RenderDX::FreeTexture(TextureID texID) {
+	Texture2D* t = (Texture2D*) ForgetTexture(texID);
+	Textures2D.erase(Textures2D.find(t));
+	t->View->Release();
+	t->Tex->Release();
+	delete t;
+}
+
 void RenderDX::UpdateTexture2D(ID3D11Texture2D* dxTex, Texture* tex) {
 	// This happens when a texture fails to upload to the GPU during synchronization from UI doc to render doc.
 	if (tex->Data == nullptr)
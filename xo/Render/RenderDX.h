@@ -67,6 +67,7 @@ public:
 	void Draw(GPUPrimitiveTypes type, int nvertex, const void* v) override;
 
 	bool LoadTexture(Texture* tex, int texUnit) override;
+	void FreeTexture(TextureID texID) override;
 	bool ReadBackbuffer(Image& image) override;
 
 private:
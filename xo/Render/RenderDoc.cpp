@@ -8,12 +8,17 @@
 namespace xo {
 
 LayoutResult::LayoutResult(const Doc& doc) {
-	IsLocked = false;
+	IsLocked        = false;
+	EnvironmentHash = 0;
+	FocusID         = InternalIDNull;
+	CaptureID       = InternalIDNull;
 	Root.SetPool(&Pool);
 	Root.InternalID = doc.Root.GetInternalID();
 }
 
 LayoutResult::~LayoutResult() {
+	for (auto& it : ChildIndices)
+		delete it.second;
 }
 
 const RenderDomNode* LayoutResult::Body() const {
@@ -27,6 +32,94 @@ const RenderDomNode* LayoutResult::Node(DomNode* node) const {
 	return Node(node->GetInternalID());
 }
 
+Box LayoutResult::ChildBox(const RenderDomEl* el) {
+	if (el->IsNode())
+		return static_cast<const RenderDomNode*>(el)->BorderBox();
+	return el->Pos;
+}
+
+const RenderDomEl* LayoutResult::ChildAt(const RenderDomNode* node, Point pos) const {
+	const auto& children = node->Children;
+	if (children.size() < MinIndexedChildren) {
+		// Walk backwards, yielding implicit z-order from child order
+		for (size_t i = children.size() - 1; i != -1; i--) {
+			if (ChildBox(children[i]).IsInsideMe(pos))
+				return children[i];
+		}
+		return nullptr;
+	}
+
+	ChildIndex* index = ChildIndices.get(node->InternalID);
+	if (index == nullptr) {
+		index = BuildChildIndex(node);
+		ChildIndices.insert(node->InternalID, index);
+	}
+
+	// A child that contains p must start in the range (p - MaxExtent, p]
+	Pos              p      = index->Vertical ? pos.Y : pos.X;
+	const ChildSpan* sorted = index->Sorted.data;
+	const ChildSpan* begin  = std::upper_bound(sorted, sorted + index->Sorted.size(), p - index->MaxExtent, [](Pos v, const ChildSpan& s) { return v < s.Start; });
+	const ChildSpan* end    = std::upper_bound(begin, sorted + index->Sorted.size(), p, [](Pos v, const ChildSpan& s) { return v < s.Start; });
+
+	// The highest child index is the top-most child
+	size_t best = -1;
+	for (const ChildSpan* s = begin; s != end; s++) {
+		if ((best == -1 || s->Child > best) && ChildBox(children[s->Child]).IsInsideMe(pos))
+			best = s->Child;
+	}
+	for (size_t i = 0; i < index->Large.size(); i++) {
+		uint32_t c = index->Large[i];
+		if ((best == -1 || c > best) && ChildBox(children[c]).IsInsideMe(pos))
+			best = c;
+	}
+	return best == -1 ? nullptr : children[best];
+}
+
+LayoutResult::ChildIndex* LayoutResult::BuildChildIndex(const RenderDomNode* node) const {
+	const auto& children = node->Children;
+	ChildIndex* index    = new ChildIndex();
+
+	// Index along whichever axis the children are spread out over
+	Pos minX = INT32_MAX, maxX = INT32_MIN, minY = INT32_MAX, maxY = INT32_MIN;
+	for (size_t i = 0; i < children.size(); i++) {
+		Box b = ChildBox(children[i]);
+		minX  = std::min(minX, b.Left);
+		maxX  = std::max(maxX, b.Right);
+		minY  = std::min(minY, b.Top);
+		maxY  = std::max(maxY, b.Bottom);
+	}
+	index->Vertical = (int64_t) maxY - minY >= (int64_t) maxX - minX;
+
+	// Children with no extent can never contain a point
+	cheapvec<Pos> extents;
+	for (size_t i = 0; i < children.size(); i++) {
+		Box b      = ChildBox(children[i]);
+		Pos extent = index->Vertical ? b.Height() : b.Width();
+		if (extent > 0)
+			extents += extent;
+	}
+	if (extents.size() == 0)
+		return index;
+
+	std::nth_element(extents.data, extents.data + extents.size() / 2, extents.data + extents.size());
+	Pos largeThreshold = extents[extents.size() / 2] * 4;
+
+	for (size_t i = 0; i < children.size(); i++) {
+		Box b      = ChildBox(children[i]);
+		Pos extent = index->Vertical ? b.Height() : b.Width();
+		if (extent <= 0)
+			continue;
+		if (extent > largeThreshold) {
+			index->Large += (uint32_t) i;
+		} else {
+			index->Sorted += ChildSpan{index->Vertical ? b.Top : b.Left, (uint32_t) i};
+			index->MaxExtent = std::max(index->MaxExtent, extent);
+		}
+	}
+	std::sort(index->Sorted.data, index->Sorted.data + index->Sorted.size(), [](const ChildSpan& a, const ChildSpan& b) { return a.Start < b.Start; });
+	return index;
+}
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
 ///////////////////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -50,7 +143,7 @@ RenderDoc::~RenderDoc() {
 	}
 }
 
-RenderResult RenderDoc::Render(RenderBase* driver) {
+RenderResult RenderDoc::Render(RenderBase* driver, bool fullRepaint) {
 	//XOTRACE_RENDER( "RenderDoc: Reset\n" );
 	if (!HasExpandedClassVariables) {
 		XOTRACE_RENDER("RenderDoc: Expand Class Variables\n");
@@ -61,16 +154,33 @@ RenderResult RenderDoc::Render(RenderBase* driver) {
 
 	LayoutResult* layout = new LayoutResult(Doc);
 
+	// Only this thread replaces LatestLayout, so it remains alive until we publish the new layout below
+	LayoutResult* previous = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(LayoutLock);
+		previous = LatestLayout;
+	}
+
 	XOTRACE_RENDER("RenderDoc: Layout\n");
 	CodeTimer t;
 	Layout    lay;
-	lay.PerformLayout(Doc, layout->Root, &layout->Pool);
+	lay.PerformLayout(Doc, *layout, previous, &CompiledStyles, &Words);
 	TimeLayout = t.MeasureAndRestart();
 
+	// The next layout only needs to know about changes that arrive after this one
+	Doc.ResetModifiedBitmap();
+
 	XOTRACE_RENDER("RenderDoc: Render\n");
-	Renderer     rend;
-	RenderResult res = rend.Render(&Doc, &VectorCache, driver, &layout->Root);
-	TimeRender       = t.MeasureAndRestart();
+	DamageTracker::RectList clip;
+	bool                    partial  = Damage.Update(&Doc, &layout->Root, Doc.UI.GetViewportWidth(), Doc.UI.GetViewportHeight(), driver->BackBufferAge(), fullRepaint, clip);
+	Renderer                rend;
+	DisplayList*            retained = Global()->EnableDisplayList ? &Retained : nullptr;
+	RenderResult            res      = rend.Render(&Doc, &VectorCache, driver, &layout->Root, partial ? &clip : nullptr, retained);
+	TimeRender                       = t.MeasureAndRestart();
+
+	// Glyphs or vectors were missing, so the same region must be painted again once they're ready
+	if (res == RenderResultNeedMore)
+		Damage.RepeatLastDamage();
 
 	layout->IDToNodeTable.resize(Doc.InternalIDSize());
 	PopulateIDToNode(layout, &layout->Root);
@@ -93,8 +203,14 @@ RenderResult RenderDoc::Render(RenderBase* driver) {
 }
 
 void RenderDoc::CopyFromCanonical(const xo::Doc& canonical, RenderStats& stats) {
+	uint32_t numClassTables = stats.Clone_NumClassTables;
+	uint32_t numTagStyles   = stats.Clone_NumTagStyles;
 	canonical.CloneSlowInto(Doc, 0, stats);
-	HasExpandedClassVariables = false;
+	if (stats.Clone_NumClassTables != numClassTables)
+		HasExpandedClassVariables = false;
+	// The compiled verbatim attributes have their style variables baked in
+	if (stats.Clone_NumClassTables != numClassTables || stats.Clone_NumTagStyles != numTagStyles || Doc.AnyStyleVariablesModified())
+		CompiledStyles.Clear();
 }
 
 LayoutResult* RenderDoc::AcquireLatestLayout() {
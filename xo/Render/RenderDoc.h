@@ -2,12 +2,28 @@
 #include "../Doc.h"
 #include "RenderDomEl.h"
 #include "VectorCache.h"
+#include "DamageTracker.h"
+#include "DisplayList.h"
+#include "CompiledStyle.h"
+#include "../Layout/WordCache.h"
 
 namespace xo {
 
 // Output from layout
 class XO_API LayoutResult {
 public:
+	// What the layout engine remembers about each node, so that the next layout can reuse
+	// the node's children if nothing that they depend on has changed.
+	struct NodeCache {
+		uint64_t StyleHash;     // Hash of the node's resolved styles, before defaults are applied
+		Pos      ContentWidth;  // Width that the children were laid out inside. PosNULL if the node was sized by its children.
+		Pos      ContentHeight; // Height that the children were laid out inside. PosNULL if the node was sized by its children.
+		Pos      Baseline;      // Baseline of the node's first line box
+		bool     IsValid;       // False if the node was not laid out
+		bool     OwnFlow;       // Node defines its own flow context, so the layout of its children is independent of its siblings
+		bool     Independent;   // OwnFlow, and neither dimension is sized by the space remaining in the parent. Such a node can be laid out on a worker.
+	};
+
 	LayoutResult(const Doc& doc);
 	~LayoutResult();
 
@@ -16,6 +32,13 @@ public:
 	xo::Pool                 Pool;
 	cheapvec<RenderDomNode*> IDToNodeTable; // Mapping from InternalID to Node. Use Node() function rather than this directly.
 
+	// State that the layout depended on. Populated by Layout.
+	cheapvec<NodeCache>    Cache;           // Indexed by InternalID
+	uint64_t               EnvironmentHash; // Hash of style tables and global layout settings. If this differs, then nothing can be reused.
+	InternalID             FocusID;
+	InternalID             CaptureID;
+	ohash::set<InternalID> HoverSet;
+
 	const RenderDomNode* Body() const; // This is the effective root of the DOM
 
 	// Returns null if invalid
@@ -26,6 +49,34 @@ public:
 	}
 
 	const RenderDomNode* Node(DomNode* node) const;
+
+	// Returns the top-most child of 'node' that contains 'pos', which is relative to the content box of 'node'.
+	// Nodes are tested against their border box. Only the thread that holds the lock on the layout may call this.
+	const RenderDomEl* ChildAt(const RenderDomNode* node, Point pos) const;
+
+protected:
+	// Nodes with fewer children than this are searched linearly
+	static const size_t MinIndexedChildren = 32;
+
+	struct ChildSpan {
+		Pos      Start; // Top or left edge of the child
+		uint32_t Child; // Index into Children
+	};
+
+	// Hit testing index over the children of a node. The children of a node are usually laid out in
+	// a row or a column, so we sort them by their leading edge along that axis. Children that are much
+	// larger than their siblings would widen every search, so they are tested one by one instead.
+	struct ChildIndex {
+		bool                Vertical  = true; // Sorted by top edge if true, otherwise by left edge
+		Pos                 MaxExtent = 0;    // Largest height (or width) of the children in Sorted
+		cheapvec<ChildSpan> Sorted;
+		cheapvec<uint32_t>  Large;
+	};
+
+	mutable ohash::map<InternalID, ChildIndex*> ChildIndices; // Built on demand by ChildAt
+
+	static Box  ChildBox(const RenderDomEl* el);
+	ChildIndex* BuildChildIndex(const RenderDomNode* node) const;
 };
 
 /* Document used by renderer.
@@ -46,7 +97,7 @@ public:
 	RenderDoc(DocGroup* group);
 	~RenderDoc();
 
-	RenderResult Render(RenderBase* driver);
+	RenderResult Render(RenderBase* driver, bool fullRepaint);
 	void         CopyFromCanonical(const xo::Doc& canonical, RenderStats& stats);
 
 	// Acquire the latest layout object. Call ReleaseLayout when you are done using it. Returns nullptr if no layouts exist.
@@ -59,6 +110,11 @@ protected:
 	// Variables on individual DOM element styles are baked in at final resolve time
 	bool HasExpandedClassVariables = false;
 
+	DamageTracker      Damage;         // Parts of the window that have changed since the back buffer was presented
+	DisplayList        Retained;       // Recordings of subtrees that were drawn by previous frames
+	CompiledStyleCache CompiledStyles; // Tag and class styles, merged for every combination of classes that we've seen, and expanded verbatim attributes
+	WordCache          Words;          // Measurements of the words that our layouts have seen
+
 	// Rendered state
 	std::mutex              LayoutLock;             // This guards the pointers LayoutResult and OldLayouts (but not necessarily the content that is pointed to)
 	LayoutResult*           LatestLayout = nullptr; // Most recent layout performed
@@ -63,4 +63,15 @@ RenderDomText::RenderDomText(xo::InternalID id, xo::Pool* pool) : RenderDomEl(id
 	FontSizePx = 0;
 	Flags      = 0;
 }
+
+const RenderCharEl* RenderDomText::GlyphAt(xo::Pos x) const {
+	// The glyphs on a line are placed from left to right, so we can binary search for the first one
+	// whose right edge is beyond x
+	const RenderCharEl* begin = Text.Data;
+	const RenderCharEl* end   = Text.Data + Text.Count;
+	const RenderCharEl* g     = std::partition_point(begin, end, [x](const RenderCharEl& c) { return c.X + c.Width <= x; });
+	if (g == end || g->X > x)
+		return nullptr;
+	return g;
+}
 }
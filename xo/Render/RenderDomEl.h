@@ -71,6 +71,9 @@ public:
 
 	bool IsSubPixel() const { return !!(Flags & FlagSubPixelGlyphs); }
 
+	// Returns the glyph that covers the horizontal position x, or null if there is none
+	const RenderCharEl* GlyphAt(xo::Pos x) const;
+
 	xo::FontID              FontID;
 	PoolArray<RenderCharEl> Text;
 	xo::Color               Color;
@@ -30,6 +30,18 @@ static bool GLIsBooted = false;
 #ifndef GL_ONE_MINUS_SRC1_ALPHA
 #define GL_ONE_MINUS_SRC1_ALPHA 0x88FB
 #endif
+#if XO_PLATFORM_LINUX_DESKTOP && !defined(GLX_BACK_BUFFER_AGE_EXT)
+#define GLX_BACK_BUFFER_AGE_EXT 0x20F4
+#endif
+
+// Instanced arrays, pixel buffer objects and fences come from our desktop GL loader. GLES 2 doesn't have them.
+#if XO_PLATFORM_WIN_DESKTOP || XO_PLATFORM_LINUX_DESKTOP
+#define XO_GL_INSTANCING 1
+#define XO_GL_PBO 1
+#else
+#define XO_GL_INSTANCING 0
+#define XO_GL_PBO 0
+#endif
 
 // GL_XO_RED_OR_LUMINANCE is used to define a single-channel texture
 // GL_RED is not defined in ES2
@@ -85,6 +97,10 @@ RenderGL::RenderGL() {
 	Have_Unpack_RowLength  = false;
 	Have_sRGB_Framebuffer  = false;
 	Have_BlendFuncExtended = false;
+	Have_BufferAge         = false;
+	Have_Instancing        = false;
+	Have_PBO               = false;
+	BufferAge              = 0;
 	AllProgs[0]            = &PRect;
 	AllProgs[1]            = &PRect2;
 	AllProgs[2]            = &PRect3;
@@ -95,7 +111,13 @@ RenderGL::RenderGL() {
 	AllProgs[7]            = &PArc;
 	AllProgs[8]            = &PCurve;
 	AllProgs[9]            = &PUber;
-	static_assert(NumProgs == 10, "Add your new shader here");
+	AllProgs[10]           = &PBox;
+	static_assert(NumProgs == 11, "Add your new shader here");
+	BatchVB  = 0;
+	QuadIB   = 0;
+	BoxVB    = 0;
+	CornerVB = 0;
+	BuildQuadIndices();
 	Reset();
 }
 
@@ -107,6 +129,30 @@ void RenderGL::Reset() {
 		AllProgs[i]->Reset();
 	memset(BoundTextures, 0, sizeof(BoundTextures));
 	ActiveShader = ShaderInvalid;
+	IsClipped    = false;
+	Batch.clear_noalloc();
+	BoxBatch.clear_noalloc();
+	// After a lost surface, our buffers and fences are gone along with everything else
+	for (auto& sb : UploadBuffers)
+		sb = StagingBuffer();
+	for (auto& sb : ReadbackBuffers)
+		sb = StagingBuffer();
+	NextUploadBuffer = 0;
+	FirstQueuedRead  = 0;
+	NumQueuedReads   = 0;
+}
+
+void RenderGL::BuildQuadIndices() {
+	QuadIndices.resize(MaxBatchQuads * 6);
+	for (int i = 0, v = 0; v < MaxBatchQuads * 4; v += 4) {
+		QuadIndices[i++] = v;
+		QuadIndices[i++] = v + 1;
+		QuadIndices[i++] = v + 3;
+
+		QuadIndices[i++] = v + 1;
+		QuadIndices[i++] = v + 2;
+		QuadIndices[i++] = v + 3;
+	}
 }
 
 const char* RenderGL::RendererName() {
@@ -210,7 +256,7 @@ bool RenderGL::InitializeDevice(SysWnd& wnd) {
 			wglMakeCurrent(dc, rc);
 			if (wglSwapIntervalEXT)
 				wglSwapIntervalEXT(Global()->EnableVSync ? 1 : 0);
-			allGood = CreateShaders();
+			allGood = CreateShaders() && CreateBuffers();
 			wglMakeCurrent(NULL, NULL);
 		} else {
 			Trace("SetPixelFormat failed: %d\n", GetLastError());
@@ -232,6 +278,8 @@ bool RenderGL::InitializeDevice(SysWnd& wnd) {
 bool RenderGL::InitializeDevice(SysWnd& wnd) {
 	if (!CreateShaders())
 		return false;
+	if (!CreateBuffers())
+		return false;
 	return true;
 }
 #elif XO_PLATFORM_LINUX_DESKTOP
@@ -241,9 +289,15 @@ bool RenderGL::InitializeDevice(SysWnd& wnd) {
 	int glxLoad = glx_LoadFunctions(w->XDisplay, 0);
 	Trace("oglload: %d\n", oglLoad);
 	Trace("glxload: %d\n", glxLoad);
+	const char* glxExt = glXQueryExtensionsString(w->XDisplay, DefaultScreen(w->XDisplay));
+	const char* age    = glxExt ? strstr(glxExt, "GLX_EXT_buffer_age") : nullptr;
+	Have_BufferAge     = age != nullptr && (age[18] == ' ' || age[18] == 0);
+	Trace("GLX_EXT_buffer_age: %d\n", Have_BufferAge ? 1 : 0);
 	if (!CreateShaders())
 		return false;
 	Trace("Shaders created\n");
+	if (!CreateBuffers())
+		return false;
 	return true;
 }
 #else
@@ -287,15 +341,28 @@ void RenderGL::CheckExtensions() {
 	}
 
 	Have_BlendFuncExtended = hasExtension("GL_ARB_blend_func_extended");
+#if XO_GL_INSTANCING
+	// The loader leaves the function pointers null if the driver doesn't have them
+	Have_Instancing = glVertexAttribDivisor != nullptr && glDrawArraysInstanced != nullptr &&
+	                  (version >= 33 || hasExtension("GL_ARB_instanced_arrays"));
+#endif
+#if XO_GL_PBO
+	Have_PBO = glMapBufferRange != nullptr && glFenceSync != nullptr && glClientWaitSync != nullptr &&
+	           (version >= 32 || (hasExtension("GL_ARB_map_buffer_range") && hasExtension("GL_ARB_sync")));
+#endif
 	Trace(
 	    "OpenGL Extensions ("
 	    "UNPACK_SUBIMAGE=%d, "
 	    "sRGB_FrameBuffer=%d, "
-	    "blend_func_extended=%d"
+	    "blend_func_extended=%d, "
+	    "instancing=%d, "
+	    "PBO=%d"
 	    ")\n",
 	    Have_Unpack_RowLength ? 1 : 0,
 	    Have_sRGB_Framebuffer ? 1 : 0,
-	    Have_BlendFuncExtended ? 1 : 0);
+	    Have_BlendFuncExtended ? 1 : 0,
+	    Have_Instancing ? 1 : 0,
+	    Have_PBO ? 1 : 0);
 }
 
 bool RenderGL::CreateShaders() {
@@ -319,6 +386,29 @@ bool RenderGL::CreateShaders() {
 	return true;
 }
 
+bool RenderGL::CreateBuffers() {
+	glGenBuffers(1, &BatchVB);
+	glGenBuffers(1, &QuadIB);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, QuadIB);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, QuadIndices.size() * sizeof(uint16_t), &QuadIndices[0], GL_STATIC_DRAW);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+
+	if (Have_Instancing && PBox.Prog != 0) {
+		const float corners[8] = {0, 0, 0, 1, 1, 0, 1, 1};
+		glGenBuffers(1, &BoxVB);
+		glGenBuffers(1, &CornerVB);
+		glBindBuffer(GL_ARRAY_BUFFER, CornerVB);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(corners), corners, GL_STATIC_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	bool ok = glGetError() == GL_NO_ERROR;
+	if (!ok)
+		Trace("Failed to create vertex/index buffers\n");
+	return ok;
+}
+
 void RenderGL::DeleteShadersAndTextures() {
 	for (int i = MaxTextureUnits - 1; i >= 0; i--) {
 		glActiveTexture(GL_TEXTURE0 + i);
@@ -331,6 +421,20 @@ void RenderGL::DeleteShadersAndTextures() {
 
 	glDeleteTextures((GLsizei) textures.size(), &textures[0]);
 
+	if (BatchVB)
+		glDeleteBuffers(1, &BatchVB);
+	if (QuadIB)
+		glDeleteBuffers(1, &QuadIB);
+	if (BoxVB)
+		glDeleteBuffers(1, &BoxVB);
+	if (CornerVB)
+		glDeleteBuffers(1, &CornerVB);
+	BatchVB  = 0;
+	QuadIB   = 0;
+	BoxVB    = 0;
+	CornerVB = 0;
+	DeleteStagingBuffers();
+
 	glUseProgram(0);
 
 	for (int i = 0; i < NumProgs; i++)
@@ -349,6 +453,7 @@ ProgBase* RenderGL::GetShader(Shaders shader) {
 	case ShaderArc: return &PArc;
 	case ShaderQuadraticSpline: return &PCurve;
 	case ShaderUber: return &PUber;
+	case ShaderBox: return &PBox;
 	default:
 		XO_ASSERT(false);
 		return NULL;
@@ -358,12 +463,13 @@ ProgBase* RenderGL::GetShader(Shaders shader) {
 void RenderGL::ActivateShader(Shaders shader) {
 	if (ActiveShader == shader)
 		return;
+	FlushBatch();
 	GLProg* p    = (GLProg*) GetShader(shader);
 	ActiveShader = shader;
 	XO_ASSERT(p->Prog != 0);
 	XOTRACE_RENDER("Activate shader %s\n", p->Name());
 	glUseProgram(p->Prog);
-	if (ActiveShader == ShaderTextRGB || ActiveShader == ShaderUber) {
+	if (ActiveShader == ShaderTextRGB || ActiveShader == ShaderUber || ActiveShader == ShaderBox) {
 		if (Have_BlendFuncExtended)
 			glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC1_COLOR, GL_ONE, GL_ONE_MINUS_SRC1_ALPHA);
 		// else we are screwed!
@@ -381,6 +487,10 @@ void RenderGL::ActivateShader(Shaders shader) {
 	Check();
 }
 
+bool RenderGL::SupportsBoxInstances() {
+	return BoxVB != 0;
+}
+
 void RenderGL::DestroyDevice(SysWnd& wnd) {
 #if XO_PLATFORM_WIN_DESKTOP
 	if (GLRC != NULL) {
@@ -400,6 +510,7 @@ void RenderGL::SurfaceLost() {
 	Reset();
 	SurfaceLost_ForgetTextures();
 	CreateShaders();
+	CreateBuffers();
 }
 
 bool RenderGL::BeginRender(SysWnd& wnd) {
@@ -421,6 +532,12 @@ bool RenderGL::BeginRender(SysWnd& wnd) {
 #elif XO_PLATFORM_LINUX_DESKTOP
 	auto w = (SysWndLinux*) &wnd;
 	glXMakeCurrent(w->XDisplay, w->XWindow, w->GLContext);
+	BufferAge = 0;
+	if (Have_BufferAge) {
+		unsigned int age = 0;
+		glXQueryDrawable(w->XDisplay, w->XWindow, GLX_BACK_BUFFER_AGE_EXT, &age);
+		BufferAge = (int) age;
+	}
 	return true;
 #else
 	return true;
@@ -428,6 +545,7 @@ bool RenderGL::BeginRender(SysWnd& wnd) {
 }
 
 void RenderGL::EndRender(SysWnd& wnd, uint32_t endRenderFlags) {
+	FlushBatch();
 #if XO_PLATFORM_WIN_DESKTOP
 	if (!(endRenderFlags & EndRenderNoSwap))
 		SwapBuffers(DC);
@@ -460,8 +578,10 @@ void RenderGL::PreRender() {
 		glClearColor(clear.r / 255.0f, clear.g / 255.0f, clear.b / 255.0f, clear.a / 255.0f);
 	}
 
+	// When we're only repainting part of the frame, the clear happens inside ClearClipRect
 	//glClear( GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ACCUM_BUFFER_BIT | GL_STENCIL_BUFFER_BIT );
-	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+	if (!IsClipped)
+		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 
 	XOTRACE_RENDER("PreRender 2\n");
 	Check();
@@ -501,6 +621,9 @@ void RenderGL::SetShaderFrameUniforms() {
 	if (SetMVProj(ShaderUber, PUber, mvprojT))
 		glUniform2f(PUber.v_Frame_VPort_HSize, FBWidth / 2.0f, FBHeight / 2.0f);
 
+	if (SetMVProj(ShaderBox, PBox, mvprojT))
+		glUniform1i(PBox.v_f_tex0, 0);
+
 	SetMVProj(ShaderRect3, PFill, mvprojT);
 	SetMVProj(ShaderFill, PFill, mvprojT);
 	SetMVProj(ShaderFillTex, PFillTex, mvprojT);
@@ -549,13 +672,73 @@ GLint RenderGL::TexFilterToGL(TexFilter f) {
 }
 
 void RenderGL::PostRenderCleanup() {
+	FlushBatch();
 	glUseProgram(0);
 	ActiveShader = ShaderInvalid;
 }
 
+int RenderGL::BackBufferAge() {
+	return BufferAge;
+}
+
+void RenderGL::SetClipRect(const Box* rect) {
+	FlushBatch();
+	if (rect != nullptr) {
+		// GL's origin is at the bottom left
+		glEnable(GL_SCISSOR_TEST);
+		glScissor(rect->Left, FBHeight - rect->Bottom, rect->Width(), rect->Height());
+		IsClipped = true;
+	} else {
+		glDisable(GL_SCISSOR_TEST);
+		IsClipped = false;
+	}
+}
+
+void RenderGL::ClearClipRect() {
+	FlushBatch();
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
 void RenderGL::Draw(GPUPrimitiveTypes type, int nvertex, const void* v) {
 	XOTRACE_RENDER("DrawQuad\n");
 
+	if (ActiveShader == ShaderUber && BatchVB != 0) {
+		const Vx_Uber* src = (const Vx_Uber*) v;
+		switch (type) {
+		case GPUPrimQuads:
+			XO_ASSERT(nvertex % 4 == 0);
+			if (Batch.size() + nvertex > MaxBatchQuads * 4)
+				FlushBatch();
+			Batch.addn(src, nvertex);
+			break;
+		case GPUPrimTriangles:
+			XO_ASSERT(nvertex % 3 == 0);
+			if (Batch.size() + (nvertex / 3) * 4 > MaxBatchQuads * 4)
+				FlushBatch();
+			for (int i = 0; i < nvertex; i += 3) {
+				Batch.addn(src + i, 3);
+				Batch += src[i + 2];
+			}
+			break;
+		default:
+			XO_TODO;
+		}
+		return;
+	}
+
+	if (ActiveShader == ShaderBox) {
+		XO_ASSERT(type == GPUPrimInstances && BoxVB != 0);
+		const Vx_Box* src = (const Vx_Box*) v;
+		for (int i = 0; i < nvertex;) {
+			if (BoxBatch.size() == MaxBatchBoxes)
+				FlushBatch();
+			int n = Min(nvertex - i, MaxBatchBoxes - (int) BoxBatch.size());
+			BoxBatch.addn(src + i, n);
+			i += n;
+		}
+		return;
+	}
+
 	SetShaderObjectUniforms();
 
 	int            stride = sizeof(Vx_PTC);
@@ -656,6 +839,10 @@ void RenderGL::Draw(GPUPrimitiveTypes type, int nvertex, const void* v) {
 		glVertexAttribPointer(PCurve.v_vflip, 1, GL_FLOAT, true, stride, vbyte + offsetof(Vx_PTCV4, V4.x));
 		glEnableVertexAttribArray(PCurve.v_vflip);
 		break;
+	case ShaderBox:
+		// Boxes are instanced, and always go through BoxBatch above
+		XO_DIE();
+		break;
 	case ShaderInvalid:
 		XO_DIE();
 		break;
@@ -684,38 +871,17 @@ void RenderGL::Draw(GPUPrimitiveTypes type, int nvertex, const void* v) {
 		glEnableVertexAttribArray(varvtexClamp);
 	}
 
-	int nindices = 0;
-	switch (type) {
-	case GPUPrimQuads: nindices = (nvertex / 2) * 3; break;
-	case GPUPrimTriangles: nindices = nvertex; break;
-	default: XO_TODO;
-	}
-
-	XO_ASSERT(nindices < 65536);
-	uint16_t* indices = (uint16_t*) MallocOrDie(sizeof(uint16_t) * nindices);
-
 	switch (type) {
 	case GPUPrimQuads:
-		for (int i = 0, v = 0; v < nvertex; v += 4) {
-			indices[i++] = v;
-			indices[i++] = v + 1;
-			indices[i++] = v + 3;
-
-			indices[i++] = v + 1;
-			indices[i++] = v + 2;
-			indices[i++] = v + 3;
-		}
-		glDrawElements(GL_TRIANGLES, nindices, GL_UNSIGNED_SHORT, indices);
+		XO_ASSERT(nvertex <= MaxBatchQuads * 4);
+		glDrawElements(GL_TRIANGLES, (nvertex / 4) * 6, GL_UNSIGNED_SHORT, &QuadIndices[0]);
 		break;
 	case GPUPrimTriangles:
-		for (int i = 0; i < nvertex; i++)
-			indices[i] = i;
-		glDrawElements(GL_TRIANGLES, nvertex, GL_UNSIGNED_SHORT, indices);
+		glDrawArrays(GL_TRIANGLES, 0, nvertex);
 		break;
 	default:
 		XO_TODO;
 	}
-	free(indices);
 
 	//auto vx = (Vx_PTC*) vbyte;
 	//XOTRACE_RENDER( "DrawQuad done (%f,%f) (%f,%f) (%f,%f) (%f,%f)\n", vx[0].Pos.x, vx[0].Pos.y, vx[1].Pos.x, vx[1].Pos.y, vx[2].Pos.x, vx[2].Pos.y, vx[3].Pos.x, vx[3].Pos.y );
@@ -723,6 +889,91 @@ void RenderGL::Draw(GPUPrimitiveTypes type, int nvertex, const void* v) {
 	Check();
 }
 
+void RenderGL::FlushBatch() {
+	if (BoxBatch.size() != 0)
+		FlushBoxBatch();
+
+	if (Batch.size() == 0)
+		return;
+
+	XO_ASSERT(ActiveShader == ShaderUber);
+	XOTRACE_RENDER("FlushBatch %d quads\n", (int) Batch.size() / 4);
+
+	// Orphan the previous contents, so that the driver doesn't need to stall on draws that are still in flight
+	glBindBuffer(GL_ARRAY_BUFFER, BatchVB);
+	glBufferData(GL_ARRAY_BUFFER, MaxBatchQuads * 4 * sizeof(Vx_Uber), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, Batch.size() * sizeof(Vx_Uber), &Batch[0]);
+
+	const uint8_t* vbyte  = nullptr; // offsets into BatchVB
+	int            stride = sizeof(Vx_Uber);
+	glVertexAttribPointer(PUber.v_v_pos, 2, GL_FLOAT, false, stride, vbyte + offsetof(Vx_Uber, Pos.x));
+	glVertexAttribPointer(PUber.v_v_uv1, 4, GL_FLOAT, false, stride, vbyte + offsetof(Vx_Uber, UV1.x));
+	glVertexAttribPointer(PUber.v_v_uv2, 4, GL_FLOAT, false, stride, vbyte + offsetof(Vx_Uber, UV2.x));
+	glVertexAttribPointer(PUber.v_v_color1, 4, GL_UNSIGNED_BYTE, true, stride, vbyte + offsetof(Vx_Uber, Color1));
+	glVertexAttribPointer(PUber.v_v_color2, 4, GL_UNSIGNED_BYTE, true, stride, vbyte + offsetof(Vx_Uber, Color2));
+	glVertexAttribPointer(PUber.v_v_shader, 1, GL_UNSIGNED_INT, false, stride, vbyte + offsetof(Vx_Uber, Shader));
+	glEnableVertexAttribArray(PUber.v_v_pos);
+	glEnableVertexAttribArray(PUber.v_v_uv1);
+	glEnableVertexAttribArray(PUber.v_v_uv2);
+	glEnableVertexAttribArray(PUber.v_v_color1);
+	glEnableVertexAttribArray(PUber.v_v_color2);
+	glEnableVertexAttribArray(PUber.v_v_shader);
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, QuadIB);
+	glDrawElements(GL_TRIANGLES, (GLsizei)(Batch.size() / 4) * 6, GL_UNSIGNED_SHORT, nullptr);
+
+	// The other shaders still source their vertices from client memory
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	Batch.clear_noalloc();
+	Check();
+}
+
+void RenderGL::FlushBoxBatch() {
+	XO_ASSERT(ActiveShader == ShaderBox);
+	XOTRACE_RENDER("FlushBoxBatch %d boxes\n", (int) BoxBatch.size());
+
+	glBindBuffer(GL_ARRAY_BUFFER, CornerVB);
+	glVertexAttribPointer(PBox.v_v_corner, 2, GL_FLOAT, false, 0, nullptr);
+	glEnableVertexAttribArray(PBox.v_v_corner);
+
+	glBindBuffer(GL_ARRAY_BUFFER, BoxVB);
+	glBufferData(GL_ARRAY_BUFFER, MaxBatchBoxes * sizeof(Vx_Box), nullptr, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, BoxBatch.size() * sizeof(Vx_Box), &BoxBatch[0]);
+
+	const uint8_t* ibyte     = nullptr; // offsets into BoxVB
+	int            stride    = sizeof(Vx_Box);
+	GLint          attribs[] = {PBox.v_v_rect, PBox.v_v_border, PBox.v_v_radii, PBox.v_v_bguv, PBox.v_v_border_left,
+                       PBox.v_v_border_top, PBox.v_v_border_right, PBox.v_v_border_bottom, PBox.v_v_bg_color, PBox.v_v_shader};
+	glVertexAttribPointer(PBox.v_v_rect, 4, GL_FLOAT, false, stride, ibyte + offsetof(Vx_Box, Rect));
+	glVertexAttribPointer(PBox.v_v_border, 4, GL_FLOAT, false, stride, ibyte + offsetof(Vx_Box, Border));
+	glVertexAttribPointer(PBox.v_v_radii, 4, GL_FLOAT, false, stride, ibyte + offsetof(Vx_Box, Radii));
+	glVertexAttribPointer(PBox.v_v_bguv, 4, GL_FLOAT, false, stride, ibyte + offsetof(Vx_Box, BGUV));
+	glVertexAttribPointer(PBox.v_v_border_left, 4, GL_UNSIGNED_BYTE, true, stride, ibyte + offsetof(Vx_Box, BorderColor[0]));
+	glVertexAttribPointer(PBox.v_v_border_top, 4, GL_UNSIGNED_BYTE, true, stride, ibyte + offsetof(Vx_Box, BorderColor[1]));
+	glVertexAttribPointer(PBox.v_v_border_right, 4, GL_UNSIGNED_BYTE, true, stride, ibyte + offsetof(Vx_Box, BorderColor[2]));
+	glVertexAttribPointer(PBox.v_v_border_bottom, 4, GL_UNSIGNED_BYTE, true, stride, ibyte + offsetof(Vx_Box, BorderColor[3]));
+	glVertexAttribPointer(PBox.v_v_bg_color, 4, GL_UNSIGNED_BYTE, true, stride, ibyte + offsetof(Vx_Box, BGColor));
+	glVertexAttribPointer(PBox.v_v_shader, 1, GL_UNSIGNED_INT, false, stride, ibyte + offsetof(Vx_Box, Shader));
+#if XO_GL_INSTANCING
+	for (GLint a : attribs) {
+		glEnableVertexAttribArray(a);
+		glVertexAttribDivisor(a, 1);
+	}
+
+	glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, (GLsizei) BoxBatch.size());
+
+	// The other shaders share these attribute slots, and they are not instanced
+	for (GLint a : attribs)
+		glVertexAttribDivisor(a, 0);
+#endif
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	BoxBatch.clear_noalloc();
+	Check();
+}
+
 /*
 void RenderGL::DrawTriangles( int nvert, const void* v, const uint16_t* indices )
 {
@@ -743,6 +994,17 @@ uint8_t demultiply(uint8_t a, uint8_t b) {
 	}
 }
 
+void RenderGL::FreeTexture(TextureID texID) {
+	FlushBatch();
+	GLuint t = (GLuint) ForgetTexture(texID);
+	for (int i = 0; i < MaxTextureUnits; i++) {
+		// Deleting a bound texture binds zero in its place
+		if (BoundTextures[i] == t)
+			BoundTextures[i] = 0;
+	}
+	glDeleteTextures(1, &t);
+}
+
 bool RenderGL::LoadTexture(Texture* tex, int texUnit) {
 	EnsureTextureProperlyDefined(tex, texUnit);
 
@@ -755,6 +1017,7 @@ bool RenderGL::LoadTexture(Texture* tex, int texUnit) {
 
 	GLuint glTexID = GetTextureDeviceHandleInt(tex->TexID);
 	if (BoundTextures[texUnit] != glTexID) {
+		FlushBatch();
 		glActiveTexture(GL_TEXTURE0 + texUnit);
 		glBindTexture(GL_TEXTURE_2D, glTexID);
 		BoundTextures[texUnit] = glTexID;
@@ -771,6 +1034,9 @@ bool RenderGL::LoadTexture(Texture* tex, int texUnit) {
 	if (!invRect.IsAreaPositive())
 		return true;
 
+	// Pending draws must sample the texture as it was when they were issued
+	FlushBatch();
+
 	int iformat = 0;
 	int format  = 0;
 	switch (tex->Format) {
@@ -787,10 +1053,18 @@ bool RenderGL::LoadTexture(Texture* tex, int texUnit) {
 		XO_TODO;
 	}
 
+	bool defineWhole = !Have_Unpack_RowLength || invRect == fullRect;
+
+	// A staged copy is packed tightly, so it doesn't need a row length
+	StagingBuffer* staged    = StageUpload(tex, defineWhole ? fullRect : invRect);
+	const void*    whole     = staged ? nullptr : tex->Data;
+	const void*    sub       = staged ? nullptr : tex->DataAt(invRect.Left, invRect.Top);
+	int            rowLength = staged ? 0 : tex->Stride / (int) tex->BytesPerPixel();
+
 	if (Have_Unpack_RowLength)
-		glPixelStorei(GL_UNPACK_ROW_LENGTH, tex->Stride / (int) tex->BytesPerPixel());
+		glPixelStorei(GL_UNPACK_ROW_LENGTH, rowLength);
 
-	if (!Have_Unpack_RowLength || invRect == fullRect) {
+	if (defineWhole) {
 		// desperate attempt to understand premultiplied alpha & sRGB
 		//xo::RGBA* copy = (xo::RGBA*) malloc(tex->Height * tex->Width * 4);
 		//for (int y = 0; y < tex->Height; y++) {
@@ -811,7 +1085,7 @@ bool RenderGL::LoadTexture(Texture* tex, int texUnit) {
 		//glTexImage2D(GL_TEXTURE_2D, 0, iformat, tex->Width, tex->Height, 0, format, GL_UNSIGNED_BYTE, copy);
 		//free(copy);
 
-		glTexImage2D(GL_TEXTURE_2D, 0, iformat, tex->Width, tex->Height, 0, format, GL_UNSIGNED_BYTE, tex->Data);
+		glTexImage2D(GL_TEXTURE_2D, 0, iformat, tex->Width, tex->Height, 0, format, GL_UNSIGNED_BYTE, whole);
 
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, TexFilterToGL(tex->FilterMin));
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, TexFilterToGL(tex->FilterMax));
@@ -821,16 +1095,106 @@ bool RenderGL::LoadTexture(Texture* tex, int texUnit) {
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
 		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	} else {
-		glTexSubImage2D(GL_TEXTURE_2D, 0, invRect.Left, invRect.Top, invRect.Width(), invRect.Height(), format, GL_UNSIGNED_BYTE, tex->DataAt(invRect.Left, invRect.Top));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, invRect.Left, invRect.Top, invRect.Width(), invRect.Height(), format, GL_UNSIGNED_BYTE, sub);
 	}
 
 	if (Have_Unpack_RowLength)
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 
+	if (staged) {
+		FenceStagingBuffer(*staged);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+
 	return true;
 }
 
+// Copy the pixels of rect into the next upload buffer, with rows aligned to GL_UNPACK_ALIGNMENT's default of 4
+RenderGL::StagingBuffer* RenderGL::StageUpload(const Texture* tex, Box rect) {
+#if XO_GL_PBO
+	size_t rowBytes = rect.Width() * tex->BytesPerPixel();
+	size_t pitch    = (rowBytes + 3) & ~(size_t) 3;
+	size_t bytes    = pitch * rect.Height();
+	if (!Have_PBO || bytes < MinStagedUploadSize)
+		return nullptr;
+
+	StagingBuffer& sb = UploadBuffers[NextUploadBuffer];
+	if (!WaitForStagingBuffer(sb, false))
+		return nullptr;
+	NextUploadBuffer = (NextUploadBuffer + 1) % NumUploadBuffers;
+
+	if (sb.Buffer == 0)
+		glGenBuffers(1, &sb.Buffer);
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, sb.Buffer);
+	if (sb.Size < bytes) {
+		glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, GL_STREAM_DRAW);
+		sb.Size = bytes;
+	}
+
+	// The fence has passed, so nobody else is using the buffer
+	uint8_t* dst = (uint8_t*) glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+	if (dst == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return nullptr;
+	}
+	for (int y = 0; y < rect.Height(); y++)
+		memcpy(dst + y * pitch, tex->DataAt(rect.Left, rect.Top + y), rowBytes);
+
+	// The contents of the buffer are undefined if the unmap fails, which can happen when the display mode changes
+	if (!glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER)) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return nullptr;
+	}
+	return &sb;
+#else
+	return nullptr;
+#endif
+}
+
+// Returns true if the GPU is finished with the buffer. If wait is false, then we only poll.
+bool RenderGL::WaitForStagingBuffer(StagingBuffer& sb, bool wait) {
+#if XO_GL_PBO
+	if (sb.Fence == nullptr)
+		return true;
+	// Without the flush, a fence that was placed in this frame might never be submitted
+	const GLuint64 oneSecond = 1000000000;
+	GLenum         res       = glClientWaitSync((GLsync) sb.Fence, GL_SYNC_FLUSH_COMMANDS_BIT, wait ? oneSecond : 0);
+	if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED)
+		return false;
+	glDeleteSync((GLsync) sb.Fence);
+	sb.Fence = nullptr;
+#endif
+	return true;
+}
+
+void RenderGL::FenceStagingBuffer(StagingBuffer& sb) {
+#if XO_GL_PBO
+	if (sb.Fence != nullptr)
+		glDeleteSync((GLsync) sb.Fence);
+	sb.Fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+#endif
+}
+
+void RenderGL::DeleteStagingBuffers() {
+#if XO_GL_PBO
+	auto release = [](StagingBuffer& sb) {
+		if (sb.Fence != nullptr)
+			glDeleteSync((GLsync) sb.Fence);
+		if (sb.Buffer != 0)
+			glDeleteBuffers(1, &sb.Buffer);
+		sb = StagingBuffer();
+	};
+	for (auto& sb : UploadBuffers)
+		release(sb);
+	for (auto& sb : ReadbackBuffers)
+		release(sb);
+#endif
+	FirstQueuedRead = 0;
+	NumQueuedReads  = 0;
+}
+
 bool RenderGL::ReadBackbuffer(Image& image) {
+	FlushBatch();
 	image.Alloc(TexFormatRGBA8, FBWidth, FBHeight);
 	if (Have_Unpack_RowLength)
 		glPixelStorei(GL_UNPACK_ROW_LENGTH, image.Stride / 4);
@@ -847,6 +1211,72 @@ bool RenderGL::ReadBackbuffer(Image& image) {
 	return true;
 }
 
+bool RenderGL::CanQueueReadBackbuffer() {
+#if XO_GL_PBO
+	return Have_PBO;
+#else
+	return false;
+#endif
+}
+
+bool RenderGL::QueueReadBackbuffer() {
+#if XO_GL_PBO
+	if (!Have_PBO || NumQueuedReads == NumReadbackBuffers)
+		return false;
+	FlushBatch();
+
+	StagingBuffer& sb    = ReadbackBuffers[(FirstQueuedRead + NumQueuedReads) % NumReadbackBuffers];
+	size_t         bytes = (size_t) FBWidth * (size_t) FBHeight * 4;
+	if (sb.Buffer == 0)
+		glGenBuffers(1, &sb.Buffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, sb.Buffer);
+	if (sb.Size < bytes) {
+		glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+		sb.Size = bytes;
+	}
+	// With a pack buffer bound, glReadPixels returns before the copy is done
+	glReadPixels(0, 0, FBWidth, FBHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	FenceStagingBuffer(sb);
+	sb.Width  = FBWidth;
+	sb.Height = FBHeight;
+	NumQueuedReads++;
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool RenderGL::ReadQueuedBackbuffer(Image& image, bool wait) {
+#if XO_GL_PBO
+	if (NumQueuedReads == 0)
+		return false;
+	StagingBuffer& sb = ReadbackBuffers[FirstQueuedRead];
+	if (!WaitForStagingBuffer(sb, wait))
+		return false;
+	FirstQueuedRead = (FirstQueuedRead + 1) % NumReadbackBuffers;
+	NumQueuedReads--;
+
+	size_t rowBytes = (size_t) sb.Width * 4;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, sb.Buffer);
+	const uint8_t* src = (const uint8_t*) glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, rowBytes * sb.Height, GL_MAP_READ_BIT);
+	if (src != nullptr) {
+		// our image is top-down
+		// glReadPixels is bottom-up
+		image.Alloc(TexFormatRGBA8, sb.Width, sb.Height);
+		for (int y = 0; y < sb.Height; y++)
+			memcpy(image.DataAtLine(y), src + (sb.Height - 1 - y) * rowBytes, rowBytes);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	} else {
+		XOTRACE_WARNING("Failed to map a queued read back. The frame is lost.\n");
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return src != nullptr;
+#else
+	return false;
+#endif
+}
+
 void RenderGL::PreparePreprocessor() {
 	if (BaseShader.size() != 0)
 		return;
@@ -909,6 +1339,7 @@ bool RenderGL::LoadProgram(GLuint& vshade, GLuint& fshade, GLuint& prog, const c
 
 	bool isTextRGB = strcmp(name, "TextRGB") == 0;
 	bool isUber    = strcmp(name, "Uber") == 0;
+	bool isBox     = strcmp(name, "Box") == 0;
 	if (isUber)
 		int abc = 123;
 
@@ -921,7 +1352,11 @@ bool RenderGL::LoadProgram(GLuint& vshade, GLuint& fshade, GLuint& prog, const c
 
 	glAttachShader(prog, vshade);
 	glAttachShader(prog, fshade);
-	if (isTextRGB || isUber) {
+	if (isBox) {
+		// Attribute 0 must not be instanced, on some compatibility profile drivers
+		glBindAttribLocation(prog, 0, "v_corner");
+	}
+	if (isTextRGB || isUber || isBox) {
 // NOTE: The following DOES WORK. It is unnecessary however, on the NVidia hardware that I have tested on.
 // BUT: It is necessary on Linux, Haswell Intel drivers
 #ifdef glBindFragDataLocationIndexed
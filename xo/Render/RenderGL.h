@@ -12,6 +12,7 @@
 #include "../Shaders/Processed_glsl/TextWholeShader.h"
 #include "../Shaders/Processed_glsl/ArcShader.h"
 #include "../Shaders/Processed_glsl/UberShader.h"
+#include "../Shaders/Processed_glsl/BoxShader.h"
 
 namespace xo {
 
@@ -32,13 +33,15 @@ public:
 	GLProg_Arc       PArc;
 	GLProg_Curve     PCurve;
 	GLProg_Uber      PUber;
-	static const int NumProgs = 10;
+	GLProg_Box       PBox;
+	static const int NumProgs = 11;
 	GLProg*          AllProgs[NumProgs]; // All of the above programs
 
 	RenderGL();
 	~RenderGL() override;
 
 	bool CreateShaders();
+	bool CreateBuffers();
 	void DeleteShadersAndTextures();
 	//void			DrawTriangles( int nvert, const void* v, const uint16_t* indices );
 
@@ -56,13 +59,22 @@ public:
 	void PreRender() override;
 	void PostRenderCleanup() override;
 
+	int  BackBufferAge() override;
+	void SetClipRect(const Box* rect) override;
+	void ClearClipRect() override;
+
 	void Draw(GPUPrimitiveTypes type, int nvertex, const void* v) override;
 
 	ProgBase* GetShader(Shaders shader) override;
 	void      ActivateShader(Shaders shader) override;
+	bool      SupportsBoxInstances() override;
 
 	bool LoadTexture(Texture* tex, int texUnit) override;
+	void FreeTexture(TextureID texID) override;
 	bool ReadBackbuffer(Image& image) override;
+	bool CanQueueReadBackbuffer() override;
+	bool QueueReadBackbuffer() override;
+	bool ReadQueuedBackbuffer(Image& image, bool wait) override;
 
 protected:
 	Shaders     ActiveShader;
@@ -71,6 +83,55 @@ protected:
 	bool        Have_Unpack_RowLength;
 	bool        Have_sRGB_Framebuffer;
 	bool        Have_BlendFuncExtended;
+	bool        Have_BufferAge;  // GLX_EXT_buffer_age
+	bool        Have_Instancing; // glVertexAttribDivisor and glDrawArraysInstanced
+	bool        Have_PBO;        // Pixel buffer objects, glMapBufferRange and fences
+	int         BufferAge;       // Age of the back buffer, queried at the start of the frame
+	bool        IsClipped;       // True while a clip rectangle is set
+
+	// Uber draws are accumulated here, and flushed whenever the shader or a texture binding changes,
+	// or when the frame ends. Every primitive is stored as a quad, so that all batches can share
+	// the same static index buffer. Triangles are stored as a quad whose 4th vertex repeats the 3rd.
+	static const int   MaxBatchQuads = 65536 / 4; // Limited by 16-bit indices
+	cheapvec<Vx_Uber>  Batch;
+	GLuint             BatchVB;     // Streaming vertex buffer, orphaned on every flush
+	GLuint             QuadIB;      // Static index buffer for MaxBatchQuads quads
+	cheapvec<uint16_t> QuadIndices; // CPU copy of QuadIB, for the non-batched shaders that still draw from client memory
+
+	// ShaderBox instances are batched the same way, and drawn with one instanced triangle strip
+	static const int MaxBatchBoxes = 16384;
+	cheapvec<Vx_Box> BoxBatch;
+	GLuint           BoxVB;    // Streaming instance buffer, orphaned on every flush
+	GLuint           CornerVB; // The 4 corners of the unit square, which every instance shares
+
+	// Pixel buffers for texture uploads and read back, so that the driver can copy to or from them while we
+	// carry on. A fence is placed after the last command that uses a buffer, and the buffer is only reused
+	// once the GPU has passed that fence. We never wait on an upload buffer. If the next one is still busy,
+	// then we upload straight from client memory, as we do for small uploads, and on GLES 2.
+	struct StagingBuffer {
+		GLuint Buffer = 0;
+		size_t Size   = 0;
+		void*  Fence  = nullptr; // GLsync
+		int    Width  = 0;       // Read back only
+		int    Height = 0;       // Read back only
+	};
+	static const int    NumUploadBuffers    = 4;
+	static const int    NumReadbackBuffers  = 3;
+	static const size_t MinStagedUploadSize = 64 * 1024; // Smaller uploads are cheaper to do from client memory
+	StagingBuffer       UploadBuffers[NumUploadBuffers];
+	StagingBuffer       ReadbackBuffers[NumReadbackBuffers];
+	int                 NextUploadBuffer = 0;
+	int                 FirstQueuedRead  = 0; // Oldest read back in flight, in ReadbackBuffers
+	int                 NumQueuedReads   = 0;
+
+	void FlushBatch();
+	void FlushBoxBatch();
+	void BuildQuadIndices();
+
+	StagingBuffer* StageUpload(const Texture* tex, Box rect); // Returns null if rect must be uploaded from client memory. Leaves the buffer bound.
+	bool           WaitForStagingBuffer(StagingBuffer& sb, bool wait);
+	void           FenceStagingBuffer(StagingBuffer& sb);
+	void           DeleteStagingBuffers();
 
 	void PreparePreprocessor();
 	void DeleteProgram(GLProg& prog);
@@ -0,0 +1,680 @@
+#include "pch.h"
+#include "RenderSoft.h"
+#include "../Text/GlyphCache.h"
+#include "../SysWnd.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define XO_SOFT_SSE2 1
+#include <emmintrin.h>
+#else
+#define XO_SOFT_SSE2 0
+#endif
+
+namespace xo {
+
+// These must match Renderer.cpp, and the Uber shader
+static const uint32_t SHADER_TYPE_MASK         = 15;
+static const uint32_t SHADER_FLAG_TEXBG        = 16;
+static const uint32_t SHADER_FLAG_TEXBG_PREMUL = 32;
+
+static const uint32_t SHADER_ARC           = 1;
+static const uint32_t SHADER_RECT          = 2;
+static const uint32_t SHADER_TEXT_SIMPLE   = 3;
+static const uint32_t SHADER_TEXT_SUBPIXEL = 4;
+
+// One RGBA pixel, as four floats
+#if XO_SOFT_SSE2
+struct F4 {
+	__m128 V;
+
+	F4() {}
+	F4(__m128 v) : V(v) {}
+	explicit F4(float x) : V(_mm_set1_ps(x)) {}
+	F4(float r, float g, float b, float a) : V(_mm_setr_ps(r, g, b, a)) {}
+
+	static F4 Load(const float* p) { return _mm_load_ps(p); } // p must be 16 byte aligned
+	static F4 LoadU(const float* p) { return _mm_loadu_ps(p); }
+	void      Store(float* p) const { _mm_store_ps(p, V); }
+	float     A() const { return _mm_cvtss_f32(_mm_shuffle_ps(V, V, _MM_SHUFFLE(3, 3, 3, 3))); }
+	F4        AAAA() const { return _mm_shuffle_ps(V, V, _MM_SHUFFLE(3, 3, 3, 3)); }
+};
+inline F4 operator+(F4 a, F4 b) { return _mm_add_ps(a.V, b.V); }
+inline F4 operator-(F4 a, F4 b) { return _mm_sub_ps(a.V, b.V); }
+inline F4 operator*(F4 a, F4 b) { return _mm_mul_ps(a.V, b.V); }
+#else
+struct F4 {
+	float V[4];
+
+	F4() {}
+	explicit F4(float x) { V[0] = V[1] = V[2] = V[3] = x; }
+	F4(float r, float g, float b, float a) {
+		V[0] = r;
+		V[1] = g;
+		V[2] = b;
+		V[3] = a;
+	}
+
+	static F4 Load(const float* p) { return F4(p[0], p[1], p[2], p[3]); }
+	static F4 LoadU(const float* p) { return F4(p[0], p[1], p[2], p[3]); }
+	void      Store(float* p) const { memcpy(p, V, sizeof(V)); }
+	float     A() const { return V[3]; }
+	F4        AAAA() const { return F4(V[3]); }
+};
+inline F4 operator+(F4 a, F4 b) { return F4(a.V[0] + b.V[0], a.V[1] + b.V[1], a.V[2] + b.V[2], a.V[3] + b.V[3]); }
+inline F4 operator-(F4 a, F4 b) { return F4(a.V[0] - b.V[0], a.V[1] - b.V[1], a.V[2] - b.V[2], a.V[3] - b.V[3]); }
+inline F4 operator*(F4 a, F4 b) { return F4(a.V[0] * b.V[0], a.V[1] * b.V[1], a.V[2] * b.V[2], a.V[3] * b.V[3]); }
+#endif
+
+static inline float Clamp01(float v) {
+	return v < 0 ? 0 : (v > 1 ? 1 : v);
+}
+
+static inline F4 Mix(F4 a, F4 b, float t) {
+	return a + (b - a) * F4(t);
+}
+
+// blend_over in the Uber shader
+static inline F4 BlendOver(F4 a, F4 b) {
+	return a * F4(1.0f - b.A()) + b;
+}
+
+static inline F4 Premultiply(F4 c) {
+	float a = c.A();
+	return c * F4(a, a, a, 1);
+}
+
+/* Conversion between 8-bit channels and linear floats.
+
+Encode is the exact inverse of Decode, so that pixels which are loaded into a tile, and not drawn
+over, are written back unchanged. It finds the nearest code by comparing against the midpoints
+between consecutive codes, starting from a coarse lookup table, which lands within a step or two
+of the answer.
+*/
+struct ChannelTransfer {
+	static const int CoarseSize = 4096;
+
+	float   Decode[256];
+	float   Mid[256];
+	uint8_t Coarse[CoarseSize];
+
+	ChannelTransfer(bool srgb) {
+		for (int i = 0; i < 256; i++)
+			Decode[i] = srgb ? SRGB2Linear((uint8_t) i) : i / 255.0f;
+		for (int i = 0; i < 255; i++)
+			Mid[i] = 0.5f * (Decode[i] + Decode[i + 1]);
+		Mid[255] = FLT_MAX;
+		int k    = 0;
+		for (int i = 0; i < CoarseSize; i++) {
+			float lower = i / (float) CoarseSize;
+			while (Mid[k] < lower)
+				k++;
+			Coarse[i] = (uint8_t) k;
+		}
+	}
+
+	uint8_t Encode(float v) const {
+		if (!(v > 0))
+			return 0;
+		if (v >= 1)
+			return 255;
+		int k = Coarse[(int) (v * CoarseSize)];
+		while (v > Mid[k])
+			k++;
+		return (uint8_t) k;
+	}
+};
+
+static const ChannelTransfer& LinearTransfer() {
+	static ChannelTransfer t(false);
+	return t;
+}
+
+static const ChannelTransfer& SRGBTransfer() {
+	static ChannelTransfer t(true);
+	return t;
+}
+
+static inline F4 FetchRGBA(const RenderSoft::SoftTexture* t, int x, int y) {
+	const float*   dec = SRGBTransfer().Decode; // RGBA textures are sRGB, just like GL_SRGB8_ALPHA8
+	const uint8_t* p   = &t->Texels[((size_t) y * t->Width + x) * 4];
+	return F4(dec[p[0]], dec[p[1]], dec[p[2]], p[3] * (1.0f / 255.0f));
+}
+
+static inline float FetchGrey(const RenderSoft::SoftTexture* t, int x, int y) {
+	return t->Texels[(size_t) y * t->Width + x] * (1.0f / 255.0f);
+}
+
+// Find the texels to sample, with GL_CLAMP_TO_EDGE
+static inline void TexelCoords(int size, bool linear, float u, int& i0, int& i1, float& frac) {
+	float f = u * size;
+	f       = f < -1.0f ? -1.0f : (f > size + 1.0f ? size + 1.0f : f); // NaN falls through to the clamp below
+	if (linear) {
+		f -= 0.5f;
+		float fl = floorf(f);
+		frac     = f - fl;
+		i0       = Clamp((int) fl, 0, size - 1);
+		i1       = Clamp((int) fl + 1, 0, size - 1);
+	} else {
+		i0   = Clamp((int) floorf(f), 0, size - 1);
+		i1   = i0;
+		frac = 0;
+	}
+}
+
+static F4 SampleRGBA(const RenderSoft::SoftTexture* t, float u, float v) {
+	bool  linear = t->Filter == TexFilterLinear;
+	int   x0, x1, y0, y1;
+	float ax, ay;
+	TexelCoords(t->Width, linear, u, x0, x1, ax);
+	TexelCoords(t->Height, linear, v, y0, y1, ay);
+	if (!linear)
+		return FetchRGBA(t, x0, y0);
+	F4 top    = Mix(FetchRGBA(t, x0, y0), FetchRGBA(t, x1, y0), ax);
+	F4 bottom = Mix(FetchRGBA(t, x0, y1), FetchRGBA(t, x1, y1), ax);
+	return Mix(top, bottom, ay);
+}
+
+static float SampleGrey(const RenderSoft::SoftTexture* t, float u, float v) {
+	bool  linear = t->Filter == TexFilterLinear;
+	int   x0, x1, y0, y1;
+	float ax, ay;
+	TexelCoords(t->Width, linear, u, x0, x1, ax);
+	TexelCoords(t->Height, linear, v, y0, y1, ay);
+	if (!linear)
+		return FetchGrey(t, x0, y0);
+	float top    = FetchGrey(t, x0, y0) + (FetchGrey(t, x1, y0) - FetchGrey(t, x0, y0)) * ax;
+	float bottom = FetchGrey(t, x0, y1) + (FetchGrey(t, x1, y1) - FetchGrey(t, x0, y1)) * ax;
+	return top + (bottom - top) * ay;
+}
+
+static float SampleRed(const RenderSoft::SoftTexture* t, float u, float v) {
+	if (t == nullptr)
+		return 0;
+	return t->Format == TexFormatGrey8 ? SampleGrey(t, u, v) : SampleRGBA(t, u, v).A();
+}
+
+static F4 ReadBGTex(const RenderSoft::Prim& p, float u, float v) {
+	if (p.Tex->Format != TexFormatRGBA8)
+		return F4(0.0f);
+	F4 c = SampleRGBA(p.Tex, u, v);
+	return (p.Shader & SHADER_FLAG_TEXBG_PREMUL) ? c : Premultiply(c);
+}
+
+// Produces the two outputs of the Uber shader, which feed dual source blending: the premultiplied color, and the
+// coverage of each channel. 'uv' is UV1.xyzw followed by UV2.xyzw. (sx, sy) is the pixel center.
+static inline void ShadePixel(const RenderSoft::Prim& p, float sx, float sy, const float* uv, F4& out0, F4& out1) {
+	bool texBG = (p.Shader & SHADER_FLAG_TEXBG) && p.Tex != nullptr;
+
+	switch (p.Shader & SHADER_TYPE_MASK) {
+	case SHADER_ARC: {
+		F4 bg     = F4::LoadU(p.Premul1);
+		F4 border = F4::LoadU(p.Premul2);
+		if (texBG)
+			bg = BlendOver(bg, ReadBGTex(p, uv[6], uv[7]));
+		float dx1        = sx - uv[0];
+		float dy1        = sy - uv[1];
+		float dx2        = sx - uv[2];
+		float dy2        = sy - uv[3];
+		float colorBlend = Clamp01(sqrtf(dx1 * dx1 + dy1 * dy1) - uv[4] + 0.5f);
+		float alphaBlend = Clamp01(uv[5] - sqrtf(dx2 * dx2 + dy2 * dy2) + 0.5f);
+		out0             = Mix(bg, border, colorBlend) * F4(alphaBlend);
+		out1             = out0.AAAA();
+		break;
+	}
+	case SHADER_RECT: {
+		F4 bg     = F4::LoadU(p.Premul1);
+		F4 border = F4::LoadU(p.Premul2);
+		if (texBG)
+			bg = BlendOver(bg, ReadBGTex(p, uv[2], uv[3]));
+		float edgeAlpha = Clamp01(uv[1] + 0.5f);
+		float dclamped  = Clamp01(uv[0] - uv[1] + 0.5f);
+		out0            = Mix(bg, border, dclamped) * F4(edgeAlpha);
+		out1            = out0.AAAA();
+		break;
+	}
+	case SHADER_TEXT_SIMPLE:
+		out0 = F4::LoadU(p.Premul1) * F4(SampleRed(p.Tex, uv[0], uv[1]));
+		out1 = out0.AAAA();
+		break;
+	case SHADER_TEXT_SUBPIXEL: {
+		const float offset = 1.0f / GlyphAtlasSize;
+		float       tap[7];
+		for (int i = 0; i < 7; i++) {
+			float u = uv[0] + offset * (i - 3);
+			u       = u < uv[4] ? uv[4] : (u > uv[6] ? uv[6] : u);
+			tap[i]  = SampleRed(p.Tex, u, uv[1]);
+		}
+		const float w0   = 0.56f;
+		const float w1   = 0.28f;
+		const float w2   = 0.16f;
+		float       r    = w2 * tap[0] + w1 * tap[1] + w0 * tap[2] + w1 * tap[3] + w2 * tap[4];
+		float       g    = w2 * tap[1] + w1 * tap[2] + w0 * tap[3] + w1 * tap[4] + w2 * tap[5];
+		float       b    = w2 * tap[2] + w1 * tap[3] + w0 * tap[4] + w1 * tap[5] + w2 * tap[6];
+		float       aR   = r * p.Color1[3];
+		float       aG   = g * p.Color1[3];
+		float       aB   = b * p.Color1[3];
+		float       avgA = (r + g + b) / 3.0f;
+		out0             = F4(p.Color1[0] * aR, p.Color1[1] * aG, p.Color1[2] * aB, avgA);
+		out1             = F4(aR, aG, aB, avgA);
+		break;
+	}
+	default:
+		out0 = F4(1, 1, 0, 1);
+		out1 = F4(1.0f);
+		break;
+	}
+}
+
+RenderSoft::RenderSoft() {
+	FBWidth  = 0;
+	FBHeight = 0;
+}
+
+RenderSoft::~RenderSoft() {
+	FreeTextures();
+	for (auto buf : TileBuffers)
+		AlignedFree(buf);
+}
+
+const char* RenderSoft::RendererName() {
+	return "Software";
+}
+
+bool RenderSoft::InitializeDevice(SysWnd& wnd) {
+	return true;
+}
+
+void RenderSoft::DestroyDevice(SysWnd& wnd) {
+	FreeTextures();
+}
+
+void RenderSoft::SurfaceLost() {
+	FreeTextures();
+}
+
+void RenderSoft::FreeTextures() {
+	Flush();
+	for (size_t i = 0; i < TexIDToNative.size(); i++)
+		delete (SoftTexture*) TexIDToNative[i];
+	SurfaceLost_ForgetTextures();
+	BoundTexture = nullptr;
+}
+
+bool RenderSoft::BeginRender(SysWnd& wnd) {
+	auto rect = wnd.GetRelativeClientRect();
+	return BeginRender(rect.Width(), rect.Height());
+}
+
+bool RenderSoft::BeginRender(int width, int height) {
+	if (width <= 0 || height <= 0)
+		return false;
+	if (width != FBWidth || height != FBHeight)
+		Resize(width, height);
+	return true;
+}
+
+// There is no way to present our back buffer to a window, so a window must read it back.
+void RenderSoft::EndRender(SysWnd& wnd, uint32_t endRenderFlags) {
+	EndRender(endRenderFlags);
+}
+
+void RenderSoft::EndRender(uint32_t endRenderFlags) {
+	Flush();
+	if (!(endRenderFlags & EndRenderNoSwap))
+		FrameCount++;
+}
+
+void RenderSoft::Resize(int width, int height) {
+	Flush();
+	FB.Alloc(TexFormatRGBA8, width, height);
+	FBWidth    = width;
+	FBHeight   = height;
+	FrameCount = 0;
+	Clip       = Box(0, 0, width, height);
+	TilesX     = (width + TileSize - 1) / TileSize;
+	TilesY     = (height + TileSize - 1) / TileSize;
+	Bins.clear();
+	Bins.resize(TilesX * TilesY);
+}
+
+void RenderSoft::PreRender() {
+	Mat4f mvproj;
+	mvproj.Identity();
+	Ortho(mvproj, 0, FBWidth, FBHeight, 0, 1, 0);
+	SetupToScreen(mvproj);
+
+	IsSRGB = Global()->EnableSRGBFramebuffer;
+
+	// Like glClearColor, on an sRGB framebuffer, this ends up storing the bytes of the clear color unchanged
+	const ChannelTransfer& t = IsSRGB ? SRGBTransfer() : LinearTransfer();
+	auto                   c = Global()->ClearColor;
+	ClearColor[0]            = t.Decode[c.r];
+	ClearColor[1]            = t.Decode[c.g];
+	ClearColor[2]            = t.Decode[c.b];
+	ClearColor[3]            = c.a / 255.0f;
+
+	// When we're only repainting part of the frame, the clear happens inside ClearClipRect
+	if (!IsClipped)
+		ClearClipRect();
+}
+
+void RenderSoft::PostRenderCleanup() {
+	Flush();
+	ActiveShader = ShaderInvalid;
+}
+
+int RenderSoft::BackBufferAge() {
+	// Our back buffer is never swapped out, so it always holds the previous frame
+	return FrameCount != 0 ? 1 : 0;
+}
+
+void RenderSoft::SetClipRect(const Box* rect) {
+	Clip = Box(0, 0, FBWidth, FBHeight);
+	if (rect != nullptr)
+		Clip.ClampTo(*rect);
+	IsClipped = rect != nullptr;
+}
+
+void RenderSoft::ClearClipRect() {
+	Prim p    = Prim();
+	p.IsClear = true;
+	p.Bounds  = Clip;
+	AddPrim(p);
+}
+
+ProgBase* RenderSoft::GetShader(Shaders shader) {
+	return &Prog;
+}
+
+void RenderSoft::ActivateShader(Shaders shader) {
+	ActiveShader = shader;
+}
+
+void RenderSoft::Draw(GPUPrimitiveTypes type, int nvertex, const void* v) {
+	// The document renderer only uses the Uber shader for boxes and text
+	if (ActiveShader != ShaderUber) {
+		XOTRACE_RENDER("RenderSoft ignoring draw with shader %d\n", (int) ActiveShader);
+		return;
+	}
+
+	const Vx_Uber* src = (const Vx_Uber*) v;
+	switch (type) {
+	case GPUPrimQuads:
+		XO_ASSERT(nvertex % 4 == 0);
+		// Same triangulation as the GL and DX index buffers
+		for (int i = 0; i < nvertex; i += 4) {
+			AddTriangle(src[i], src[i + 1], src[i + 3]);
+			AddTriangle(src[i + 1], src[i + 2], src[i + 3]);
+		}
+		break;
+	case GPUPrimTriangles:
+		XO_ASSERT(nvertex % 3 == 0);
+		for (int i = 0; i < nvertex; i += 3)
+			AddTriangle(src[i], src[i + 1], src[i + 2]);
+		break;
+	default:
+		XO_TODO;
+	}
+}
+
+void RenderSoft::AddTriangle(const Vx_Uber& v0, const Vx_Uber& v1, const Vx_Uber& v2) {
+	const Vx_Uber* v[3] = {&v0, &v1, &v2};
+
+	Prim p;
+	p.IsClear = false;
+
+	// Edge i is opposite vertex i. Reversing an edge negates A, B and C exactly, so two triangles that
+	// share an edge agree on which side of it every pixel center lies.
+	for (int i = 0; i < 3; i++) {
+		const VecBase2f& a = v[(i + 1) % 3]->Pos;
+		const VecBase2f& b = v[(i + 2) % 3]->Pos;
+		p.Edge[i][0]       = a.y - b.y;
+		p.Edge[i][1]       = b.x - a.x;
+		p.Edge[i][2]       = a.x * b.y - a.y * b.x;
+	}
+	float area = p.Edge[0][0] * v0.Pos.x + p.Edge[0][1] * v0.Pos.y + p.Edge[0][2];
+	if (area == 0 || !(area == area))
+		return;
+	if (area < 0) {
+		area = -area;
+		for (int i = 0; i < 3; i++) {
+			for (int j = 0; j < 3; j++)
+				p.Edge[i][j] = -p.Edge[i][j];
+		}
+	}
+	// Positive inside, and y points down, so a left edge has A > 0, and a top edge has A = 0 and B > 0
+	for (int i = 0; i < 3; i++)
+		p.EdgeTie[i] = p.Edge[i][0] > 0 || (p.Edge[i][0] == 0 && p.Edge[i][1] > 0);
+
+	// Every attribute is a plane: f(x,y) = sum(E_i(x,y) * f_i) / area
+	for (int k = 0; k < 8; k++) {
+		float f[3];
+		for (int i = 0; i < 3; i++)
+			f[i] = k < 4 ? (&v[i]->UV1.x)[k] : (&v[i]->UV2.x)[k - 4];
+		for (int j = 0; j < 3; j++)
+			p.Plane[k][j] = (p.Edge[0][j] * f[0] + p.Edge[1][j] * f[1] + p.Edge[2][j] * f[2]) / area;
+	}
+
+	// fromSRGB, in the vertex shader
+	const float*   dec = SRGBTransfer().Decode;
+	const uint8_t* c1  = (const uint8_t*) &v0.Color1;
+	const uint8_t* c2  = (const uint8_t*) &v0.Color2;
+	for (int i = 0; i < 3; i++) {
+		p.Color1[i] = dec[c1[i]];
+		p.Color2[i] = dec[c2[i]];
+	}
+	p.Color1[3] = c1[3] / 255.0f;
+	p.Color2[3] = c2[3] / 255.0f;
+	for (int i = 0; i < 4; i++) {
+		p.Premul1[i] = i < 3 ? p.Color1[i] * p.Color1[3] : p.Color1[3];
+		p.Premul2[i] = i < 3 ? p.Color2[i] * p.Color2[3] : p.Color2[3];
+	}
+	p.Shader = v0.Shader;
+	p.Tex    = BoundTexture;
+
+	// A pixel is covered if its center is covered, so these bounds are generous
+	float minX = Min(v0.Pos.x, Min(v1.Pos.x, v2.Pos.x));
+	float minY = Min(v0.Pos.y, Min(v1.Pos.y, v2.Pos.y));
+	float maxX = Max(v0.Pos.x, Max(v1.Pos.x, v2.Pos.x));
+	float maxY = Max(v0.Pos.y, Max(v1.Pos.y, v2.Pos.y));
+	if (maxX < Clip.Left || maxY < Clip.Top || minX > Clip.Right || minY > Clip.Bottom)
+		return;
+	p.Bounds.Left   = (int) floorf(Max(minX, (float) Clip.Left));
+	p.Bounds.Top    = (int) floorf(Max(minY, (float) Clip.Top));
+	p.Bounds.Right  = (int) ceilf(Min(maxX, (float) Clip.Right));
+	p.Bounds.Bottom = (int) ceilf(Min(maxY, (float) Clip.Bottom));
+	p.Bounds.ClampTo(Clip);
+	AddPrim(p);
+}
+
+void RenderSoft::AddPrim(const Prim& prim) {
+	if (!prim.Bounds.IsAreaPositive())
+		return;
+	uint32_t index = (uint32_t) Prims.size();
+	Prims += prim;
+	int tx0 = prim.Bounds.Left / TileSize;
+	int ty0 = prim.Bounds.Top / TileSize;
+	int tx1 = (prim.Bounds.Right - 1) / TileSize;
+	int ty1 = (prim.Bounds.Bottom - 1) / TileSize;
+	for (int ty = ty0; ty <= ty1; ty++) {
+		for (int tx = tx0; tx <= tx1; tx++) {
+			int tile = ty * TilesX + tx;
+			if (Bins[tile].size() == 0)
+				ActiveTiles += tile;
+			Bins[tile] += index;
+		}
+	}
+}
+
+void RenderSoft::Flush() {
+	if (Prims.size() == 0)
+		return;
+
+	int maxThreads = Global()->NumWorkerThreads + 1;
+	while (TileBuffers.size() < (size_t) maxThreads)
+		TileBuffers += (float*) AlignedAlloc(TileSize * TileSize * 4 * sizeof(float), 16);
+
+	RunJobsInParallel((int) ActiveTiles.size(), maxThreads, this, TileJob);
+
+	for (int tile : ActiveTiles)
+		Bins[tile].clear_noalloc();
+	ActiveTiles.clear_noalloc();
+	Prims.clear_noalloc();
+}
+
+void RenderSoft::TileJob(void* context, int job, int thread) {
+	RenderSoft* self = (RenderSoft*) context;
+	self->RenderTile(self->ActiveTiles[job], self->TileBuffers[thread]);
+}
+
+void RenderSoft::RenderTile(int tile, float* buf) {
+	Box tb;
+	tb.Left   = (tile % TilesX) * TileSize;
+	tb.Top    = (tile / TilesX) * TileSize;
+	tb.Right  = Min(tb.Left + TileSize, FBWidth);
+	tb.Bottom = Min(tb.Top + TileSize, FBHeight);
+
+	const ChannelTransfer& t = IsSRGB ? SRGBTransfer() : LinearTransfer();
+
+	for (int y = tb.Top; y < tb.Bottom; y++) {
+		const uint8_t* src = (const uint8_t*) FB.DataAt(tb.Left, y);
+		float*         dst = buf + (y - tb.Top) * TileSize * 4;
+		for (int x = tb.Left; x < tb.Right; x++, src += 4, dst += 4)
+			F4(t.Decode[src[0]], t.Decode[src[1]], t.Decode[src[2]], src[3] * (1.0f / 255.0f)).Store(dst);
+	}
+
+	const cheapvec<uint32_t>& bin = Bins[tile];
+	for (uint32_t i : bin) {
+		const Prim& p = Prims[i];
+		Box         r = p.Bounds;
+		r.ClampTo(tb);
+		if (!r.IsAreaPositive())
+			continue;
+		if (p.IsClear) {
+			F4 c = F4::LoadU(ClearColor);
+			for (int y = r.Top; y < r.Bottom; y++) {
+				float* dst = buf + ((y - tb.Top) * TileSize + r.Left - tb.Left) * 4;
+				for (int x = r.Left; x < r.Right; x++, dst += 4)
+					c.Store(dst);
+			}
+		} else {
+			RasterizeTriangle(p, r, tb, buf);
+		}
+	}
+
+	for (int y = tb.Top; y < tb.Bottom; y++) {
+		const float* src = buf + (y - tb.Top) * TileSize * 4;
+		uint8_t*     dst = (uint8_t*) FB.DataAt(tb.Left, y);
+		for (int x = tb.Left; x < tb.Right; x++, src += 4, dst += 4) {
+			dst[0] = t.Encode(src[0]);
+			dst[1] = t.Encode(src[1]);
+			dst[2] = t.Encode(src[2]);
+			dst[3] = (uint8_t) (Clamp01(src[3]) * 255.0f + 0.5f);
+		}
+	}
+}
+
+// Rasterize the part of 'p' that lies inside 'r', one span at a time. Pixel centers are at +0.5.
+void RenderSoft::RasterizeTriangle(const Prim& p, const Box& r, const Box& tile, float* buf) {
+	for (int y = r.Top; y < r.Bottom; y++) {
+		float py = y + 0.5f;
+		int   x0 = r.Left;
+		int   x1 = r.Right;
+		for (int e = 0; e < 3 && x0 < x1; e++) {
+			float A = p.Edge[e][0];
+			float k = p.Edge[e][1] * py + p.Edge[e][2];
+			if (A == 0) {
+				if (!(k > 0 || (k == 0 && p.EdgeTie[e])))
+					x1 = x0;
+				continue;
+			}
+			// The edge crosses this row at px = t. Pixel x is inside if its center is on the inside of t.
+			float t = -k / A - 0.5f;
+			t       = t < -65536.0f ? -65536.0f : (t > 65536.0f ? 65536.0f : t);
+			if (A > 0)
+				x0 = Max(x0, p.EdgeTie[e] ? (int) ceilf(t) : (int) floorf(t) + 1);
+			else
+				x1 = Min(x1, p.EdgeTie[e] ? (int) floorf(t) + 1 : (int) ceilf(t));
+		}
+		if (x0 >= x1)
+			continue;
+
+		float px = x0 + 0.5f;
+		float uv[8];
+		float duv[8];
+		for (int k = 0; k < 8; k++) {
+			uv[k]  = p.Plane[k][0] * px + p.Plane[k][1] * py + p.Plane[k][2];
+			duv[k] = p.Plane[k][0];
+		}
+
+		float* dst = buf + ((y - tile.Top) * TileSize + x0 - tile.Left) * 4;
+		F4     one(1.0f);
+		for (int x = x0; x < x1; x++, px += 1.0f, dst += 4) {
+			F4 out0, out1;
+			ShadePixel(p, px, py, uv, out0, out1);
+			// glBlendFuncSeparate(GL_ONE, GL_ONE_MINUS_SRC1_COLOR, GL_ONE, GL_ONE_MINUS_SRC1_ALPHA)
+			F4 d = F4::Load(dst);
+			(out0 + d * (one - out1)).Store(dst);
+			for (int k = 0; k < 8; k++)
+				uv[k] += duv[k];
+		}
+	}
+}
+
+void RenderSoft::FreeTexture(TextureID texID) {
+	Flush();
+	SoftTexture* st = (SoftTexture*) ForgetTexture(texID);
+	if (BoundTexture == st)
+		BoundTexture = nullptr;
+	delete st;
+}
+
+bool RenderSoft::LoadTexture(Texture* tex, int texUnit) {
+	EnsureTextureProperlyDefined(tex, texUnit);
+
+	if (!IsTextureValid(tex->TexID)) {
+		tex->TexID = RegisterTexture((uintptr_t) new SoftTexture());
+		tex->InvalidateWholeSurface();
+	}
+
+	SoftTexture* st = (SoftTexture*) GetTextureDeviceHandle(tex->TexID);
+	if (texUnit == 0)
+		BoundTexture = st;
+
+	// This happens when a texture fails to upload during synchronization from UI doc to render doc.
+	if (tex->Data == nullptr)
+		return true;
+
+	Box invRect  = tex->InvalidRect;
+	Box fullRect = Box(0, 0, tex->Width, tex->Height);
+	invRect.ClampTo(fullRect);
+	if (!invRect.IsAreaPositive())
+		return true;
+
+	// Pending draws must sample the texture as it was when they were issued
+	Flush();
+
+	if (st->Width != (int) tex->Width || st->Height != (int) tex->Height || st->Format != tex->Format) {
+		st->Width  = tex->Width;
+		st->Height = tex->Height;
+		st->Format = tex->Format;
+		st->Texels.resize((size_t) tex->Width * tex->Height * tex->BytesPerPixel());
+		invRect = fullRect;
+	}
+	st->Filter = tex->FilterMax;
+
+	size_t bpp = tex->BytesPerPixel();
+	for (int y = invRect.Top; y < invRect.Bottom; y++)
+		memcpy(&st->Texels[((size_t) y * st->Width + invRect.Left) * bpp], tex->DataAt(invRect.Left, y), invRect.Width() * bpp);
+
+	return true;
+}
+
+bool RenderSoft::ReadBackbuffer(Image& image) {
+	Flush();
+	if (!image.Alloc(TexFormatRGBA8, FBWidth, FBHeight))
+		return false;
+	image.CopyFrom(&FB);
+	return true;
+}
+} // namespace xo
@@ -0,0 +1,111 @@
+#pragma once
+
+#include "RenderBase.h"
+#include "../Image/Image.h"
+
+namespace xo {
+
+/* Software renderer, which needs neither a GPU nor a window.
+
+This implements the rect, arc and text modes of the Uber shader, which is all that the document
+renderer uses. Other shaders are ignored. The back buffer is an RGBA8 Image in memory.
+
+Draw calls are not rasterized immediately. Every triangle is set up (edge functions and attribute
+planes) as it arrives, and binned into the TileSize x TileSize tiles that it overlaps. When the frame
+is flushed, tiles are rasterized in parallel, each one into a small linear floating point buffer,
+so that blending happens in linear space, exactly like a GPU with an sRGB framebuffer. Within a
+tile, triangles are drawn in the order in which they were submitted, one span (row) at a time.
+
+For rendering without a window, call BeginRender(width, height) instead of BeginRender(SysWnd&),
+then render as usual, and fetch the result with ReadBackbuffer().
+*/
+class XO_API RenderSoft : public RenderBase {
+public:
+	static const int TileSize = 64;
+
+	RenderSoft();
+	~RenderSoft() override;
+
+	bool         BeginRender(int width, int height); // Start a frame without a window
+	void         EndRender(uint32_t endRenderFlags);  // Finish a frame that was started without a window
+	const Image& Backbuffer() const { return FB; }    // Only valid after a flush, such as ReadBackbuffer
+
+	// Implementation of RenderBase
+
+	const char* RendererName() override;
+
+	bool InitializeDevice(SysWnd& wnd) override;
+	void DestroyDevice(SysWnd& wnd) override;
+	void SurfaceLost() override;
+
+	bool BeginRender(SysWnd& wnd) override;
+	void EndRender(SysWnd& wnd, uint32_t endRenderFlags) override;
+
+	void PreRender() override;
+	void PostRenderCleanup() override;
+
+	int  BackBufferAge() override;
+	void SetClipRect(const Box* rect) override;
+	void ClearClipRect() override;
+
+	ProgBase* GetShader(Shaders shader) override;
+	void      ActivateShader(Shaders shader) override;
+
+	void Draw(GPUPrimitiveTypes type, int nvertex, const void* v) override;
+
+	bool LoadTexture(Texture* tex, int texUnit) override;
+	void FreeTexture(TextureID texID) override;
+	bool ReadBackbuffer(Image& image) override;
+
+	struct SoftTexture {
+		TexFormat         Format = TexFormatInvalid;
+		TexFilter         Filter = TexFilterLinear;
+		int               Width  = 0;
+		int               Height = 0;
+		cheapvec<uint8_t> Texels; // Tightly packed copy of the texture
+	};
+
+	// A clear, or a triangle that has been set up for rasterization
+	struct Prim {
+		Box                Bounds;        // Pixels that may be touched, already clipped
+		bool               IsClear;       // Fill Bounds with the clear color
+		float              Edge[3][3];    // A, B, C of each edge function A*x + B*y + C, which is positive inside the triangle
+		bool               EdgeTie[3];    // True if a pixel center that lies exactly on the edge is inside (top-left rule)
+		float              Plane[8][3];   // d/dx, d/dy, and value at the origin, of UV1.xyzw and UV2.xyzw
+		float              Color1[4];     // Linear, not premultiplied. Constant over the primitive.
+		float              Color2[4];     // Linear, not premultiplied. Constant over the primitive.
+		float              Premul1[4];    // Color1, premultiplied
+		float              Premul2[4];    // Color2, premultiplied
+		uint32_t           Shader;        // Uber shader mode and flags
+		const SoftTexture* Tex;           // Texture unit 0
+	};
+
+protected:
+	ProgBase                        Prog; // Returned by GetShader, so that callers see a valid shader
+	Shaders                         ActiveShader = ShaderInvalid;
+	const SoftTexture*              BoundTexture = nullptr;
+	Image                           FB;
+	int                             FrameCount = 0;     // Frames rendered into FB at its current size
+	Box                             Clip;               // Scissor rectangle
+	bool                            IsClipped = false;  // True if SetClipRect was given a rectangle
+	bool                            IsSRGB    = false;  // Blend in linear space, and store sRGB
+	cheapvec<Prim>                  Prims;
+	std::vector<cheapvec<uint32_t>> Bins; // Indices into Prims, for every tile
+	int                             TilesX = 0;
+	int                             TilesY = 0;
+	cheapvec<int>                   ActiveTiles; // Tiles with at least one primitive
+	cheapvec<float*>                TileBuffers; // One per thread, TileSize * TileSize * RGBA
+	float                           ClearColor[4];
+
+	void Resize(int width, int height);
+	void AddPrim(const Prim& prim);
+	void AddTriangle(const Vx_Uber& v0, const Vx_Uber& v1, const Vx_Uber& v2);
+	void Flush();
+	void FreeTextures();
+	void RenderTile(int tile, float* buf);
+
+	static void RasterizeTriangle(const Prim& p, const Box& r, const Box& tile, float* buf);
+
+	static void TileJob(void* context, int job, int thread);
+};
+} // namespace xo
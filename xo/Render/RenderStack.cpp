@@ -6,6 +6,8 @@ namespace xo {
 
 void RenderStackEl::Reset() {
 	Styles.Reset();
+	for (int i = 0; i < NumInheritedStyleCategories; i++)
+		Inherited[i] = StyleAttrib();
 	Pool            = NULL;
 	HasHoverStyle   = false;
 	HasFocusStyle   = false;
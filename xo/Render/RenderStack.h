@@ -1,17 +1,19 @@
 #pragma once
 #include "../Style.h"
 #include "../Base/MemPoolsAndContainers.h"
+#include "CompiledStyle.h"
 
 namespace xo {
 
 // A single item on the render stack
 class XO_API RenderStackEl {
 public:
-	xo::Pool* Pool; // This *could* be stored only inside RenderStack.Stack_Pools, but it is convenient to duplicate it here.
-	StyleSet  Styles;
-	bool      HasHoverStyle : 1;
-	bool      HasFocusStyle : 1;
-	bool      HasCaptureStyle : 1;
+	xo::Pool*   Pool; // This *could* be stored only inside RenderStack.Stack_Pools, but it is convenient to duplicate it here.
+	StyleSet    Styles;
+	StyleAttrib Inherited[NumInheritedStyleCategories]; // Final values of InheritedStyleCategories, which our children copy. Null if never set.
+	bool        HasHoverStyle : 1;
+	bool        HasFocusStyle : 1;
+	bool        HasCaptureStyle : 1;
 
 	void Reset();
 
@@ -36,11 +38,13 @@ styles to blow that limit often. If they do, then it's simply a performance hit.
 */
 class XO_API RenderStack {
 public:
-	const xo::Doc* Doc;
-	xo::Pool*      Pool;
-	StyleAttrib    Defaults[CatEND];
-	Style          VerbatimExplodeTemp; // Temporary object used for verbatim style explosion
-	cheapvec<char> VerbatimBufTemp;     // Temporary string used during verbatim explosion
+	const xo::Doc*            Doc;
+	xo::Pool*                 Pool;
+	StyleAttrib               Defaults[CatEND];
+	Style                     VerbatimExplodeTemp;      // Temporary object used for verbatim style explosion
+	cheapvec<char>            VerbatimBufTemp;          // Temporary string used during verbatim explosion
+	CompiledStyleCache*       CompiledStyles = nullptr; // Optional. May be shared with other threads.
+	CompiledStyleCache::Local CompiledLocal;            // Our private view of CompiledStyles
 
 	RenderStack();
 	~RenderStack();
@@ -64,6 +68,7 @@ public:
 	RenderStackEl& StackPush();
 	RenderStackEl& StackBack() { return Stack.back(); }
 	RenderStackEl& StackAt(size_t pos) { return Stack[pos]; }
+	const RenderStackEl& StackAt(size_t pos) const { return Stack[pos]; }
 	size_t         StackSize() const { return Stack.size(); }
 
 protected:
@@ -0,0 +1,132 @@
+#include "pch.h"
+#include "RenderStream.h"
+
+namespace xo {
+
+// These must match Renderer.cpp, and the Uber shader
+static const uint32_t SHADER_TYPE_MASK = 15;
+static const uint32_t SHADER_ARC       = 1;
+
+void RenderStream::Reset() {
+	Cmds.clear_noalloc();
+	Vertices.clear_noalloc();
+	LastTex     = nullptr;
+	LastTexUnit = 0;
+	LastShader  = ShaderInvalid;
+}
+
+void RenderStream::ActivateShader(Shaders shader) {
+	// Every glyph and box asks for its shader, so we drop the repeats, which lets consecutive instances merge
+	if (shader == LastShader)
+		return;
+	LastShader = shader;
+
+	Cmd& c = Cmds.add();
+	c.Type = CmdActivateShader;
+	c.Arg  = (int) shader;
+}
+
+void RenderStream::LoadTexture(Texture* tex, int texUnit) {
+	if (tex == LastTex && texUnit == LastTexUnit)
+		return;
+	LastTex     = tex;
+	LastTexUnit = texUnit;
+
+	Cmd& c = Cmds.add();
+	c.Type = CmdLoadTexture;
+	c.Arg  = texUnit;
+	c.Tex  = tex;
+}
+
+void RenderStream::DrawRaw(GPUPrimitiveTypes type, int nvertex, size_t vertexSize, const void* v, bool textured) {
+	// A run of instances is merged into one draw. Their layout is the same, because the shader can't change
+	// without a command in between, and they're adjacent in Vertices. The driver splits them into batches.
+	// We don't do this for quads and triangles, because drivers assume those fit in one vertex buffer.
+	if (type == GPUPrimInstances && Cmds.size() != 0 && Cmds.back().Type == CmdDraw && Cmds.back().Arg == (int) type && Cmds.back().Textured == textured) {
+		Cmds.back().NumVertices += (uint32_t) nvertex;
+		Vertices.addn((const uint8_t*) v, nvertex * vertexSize);
+		return;
+	}
+	Cmd& c        = Cmds.add();
+	c.Type        = CmdDraw;
+	c.Arg         = (int) type;
+	c.NumVertices = (uint32_t) nvertex;
+	c.Offset      = Vertices.size();
+	c.Textured    = textured;
+	Vertices.addn((const uint8_t*) v, nvertex * vertexSize);
+}
+
+void RenderStream::Include(const RenderStream* other) {
+	Cmd& c   = Cmds.add();
+	c.Type   = CmdInclude;
+	c.Stream = other;
+	// other leaves its own shader and texture bound
+	LastTex     = nullptr;
+	LastTexUnit = 0;
+	LastShader  = ShaderInvalid;
+}
+
+bool RenderStream::Translate(float dx, float dy) {
+	for (size_t i = 0; i < Cmds.size(); i++) {
+		const Cmd& c = Cmds[i];
+		if (c.Type == CmdInclude || (c.Type == CmdActivateShader && c.Arg != ShaderUber && c.Arg != ShaderBox))
+			return false;
+	}
+
+	Shaders shader = ShaderInvalid;
+	for (size_t i = 0; i < Cmds.size(); i++) {
+		const Cmd& c = Cmds[i];
+		if (c.Type == CmdActivateShader) {
+			shader = (Shaders) c.Arg;
+		} else if (c.Type == CmdDraw && shader == ShaderUber) {
+			Vx_Uber* v = (Vx_Uber*) &Vertices[c.Offset];
+			for (uint32_t j = 0; j < c.NumVertices; j++) {
+				v[j].Pos.x += dx;
+				v[j].Pos.y += dy;
+				// Arcs carry the centers of their two circles, in pixels. Everything else in UV1 and UV2 is relative to the box.
+				if ((v[j].Shader & SHADER_TYPE_MASK) == SHADER_ARC) {
+					v[j].UV1.x += dx;
+					v[j].UV1.y += dy;
+					v[j].UV1.z += dx;
+					v[j].UV1.w += dy;
+				}
+			}
+		} else if (c.Type == CmdDraw && shader == ShaderBox) {
+			Vx_Box* v = (Vx_Box*) &Vertices[c.Offset];
+			for (uint32_t j = 0; j < c.NumVertices; j++) {
+				v[j].Rect.x += dx;
+				v[j].Rect.y += dy;
+				v[j].Rect.z += dx;
+				v[j].Rect.w += dy;
+				v[j].BGUV.x -= v[j].BGUV.z * dx;
+				v[j].BGUV.y -= v[j].BGUV.w * dy;
+			}
+		}
+	}
+	return true;
+}
+
+void RenderStream::Play(RenderBase* driver) const {
+	bool textureOK = true;
+	for (size_t i = 0; i < Cmds.size(); i++) {
+		const Cmd& c = Cmds[i];
+		switch (c.Type) {
+		case CmdActivateShader:
+			driver->ActivateShader((Shaders) c.Arg);
+			break;
+		case CmdLoadTexture:
+			textureOK = driver->LoadTexture(c.Tex, c.Arg);
+			if (textureOK)
+				c.Tex->ClearInvalidRect();
+			break;
+		case CmdDraw:
+			if (textureOK || !c.Textured)
+				driver->Draw((GPUPrimitiveTypes) c.Arg, (int) c.NumVertices, &Vertices[c.Offset]);
+			break;
+		case CmdInclude:
+			c.Stream->Play(driver);
+			break;
+		}
+	}
+}
+} // namespace xo
@@ -0,0 +1,61 @@
+#pragma once
+#include "../Defs.h"
+#include "RenderBase.h"
+
+namespace xo {
+
+/* A recorded sequence of driver commands.
+
+Renderer records into one of these, so that a portion of the DOM can be turned into
+vertices on a worker thread. The render thread plays the streams back into the driver,
+in painter's order. Nothing here touches the graphics device until Play().
+
+Texture loads are deferred until Play(). Every draw call records whether it samples
+the most recently loaded texture. If that texture fails to load, then only the draws
+that sample it are skipped.
+
+A stream can include another stream, which is how the subtrees that are retained in
+the DisplayList are stitched into the frame, without copying their vertices.
+*/
+class XO_API RenderStream {
+public:
+	void Reset();
+	void ActivateShader(Shaders shader);
+	void LoadTexture(Texture* tex, int texUnit);
+	void DrawRaw(GPUPrimitiveTypes type, int nvertex, size_t vertexSize, const void* v, bool textured);
+	void Include(const RenderStream* other); // other is played at this point, so it must be complete by the time we Play()
+	void Play(RenderBase* driver) const;
+
+	// Move everything that we've drawn by (dx, dy) pixels. Returns false, and changes nothing, if
+	// we've drawn vertices of a shader that we don't know how to move.
+	bool Translate(float dx, float dy);
+
+	// Set textured if the vertices sample the texture from the most recent LoadTexture
+	template <typename TVertex>
+	void Draw(GPUPrimitiveTypes type, int nvertex, const TVertex* v, bool textured = false) { DrawRaw(type, nvertex, sizeof(TVertex), v, textured); }
+
+protected:
+	enum CmdType {
+		CmdActivateShader,
+		CmdLoadTexture,
+		CmdDraw,
+		CmdInclude,
+	};
+
+	struct Cmd {
+		CmdType             Type;
+		int                 Arg;         // Shader, texture unit, or primitive type
+		Texture*            Tex;         // CmdLoadTexture
+		const RenderStream* Stream;      // CmdInclude
+		uint32_t            NumVertices; // CmdDraw
+		size_t              Offset;      // CmdDraw. Byte offset into Vertices.
+		bool                Textured;    // CmdDraw. Samples the most recently loaded texture.
+	};
+
+	cheapvec<Cmd>     Cmds;
+	cheapvec<uint8_t> Vertices;
+	Texture*          LastTex     = nullptr; // Every glyph asks for its atlas, so we drop repeated loads of the same texture
+	int               LastTexUnit = 0;
+	Shaders           LastShader  = ShaderInvalid; // Shader that is active at the end of the stream, so far
+};
+} // namespace xo
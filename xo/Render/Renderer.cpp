@@ -7,6 +7,7 @@
 #include "Text/GlyphCache.h"
 #include "../Image/Image.h"
 #include "../Dom/DomCanvas.h"
+#include "../../dependencies/hash/xxhash_xo_wrapper.h"
 
 namespace xo {
 
@@ -18,45 +19,231 @@ const int SHADER_RECT          = 2;
 const int SHADER_TEXT_SIMPLE   = 3;
 const int SHADER_TEXT_SUBPIXEL = 4;
 
-RenderResult Renderer::Render(const xo::Doc* doc, xo::VectorCache* vcache, RenderBase* driver, const RenderDomNode* root) {
+RenderResult Renderer::Render(const xo::Doc* doc, xo::VectorCache* vcache, RenderBase* driver, const RenderDomNode* root, const DamageTracker::RectList* clip, DisplayList* retained) {
 	Doc         = doc;
 	Driver      = driver;
 	Images      = &doc->Images;
 	Vectors     = &doc->GetSvgTable();
 	VectorCache = vcache;
 	Strings     = &doc->Strings;
+	Clip        = clip;
+	Retained    = retained;
 
+	UseBoxInstances = Driver->SupportsBoxInstances();
+
+	// PreRender only clears the frame when there is no clip rectangle
+	Box nothing(0, 0, 0, 0);
+	Driver->SetClipRect(Clip != nullptr ? &nothing : nullptr);
 	Driver->PreRender();
 
-	Global()->GlyphCache->Lock.lock();
+	Glyphs = Global()->GlyphCache->BeginRender();
+	if (Retained != nullptr)
+		Retained->BeginFrame(Global()->GlyphCache->GetAtlasEpoch(), VectorCache->GetAtlasEpoch(), UseBoxInstances);
+
+	Flat.clear_noalloc();
+	NumElements   = 0;
+	uint64_t hash = 0;
+	FlattenEl(Point(0, 0), root, hash);
+	if (Retained != nullptr) {
+		for (auto& f : Flat) {
+			if (f.IsSubtree)
+				f.Retained = Retained->Use(f.El->InternalID);
+		}
+	}
+
+	int numThreads = Global()->NumWorkerThreads + 1;
+	NumJobs        = Clamp(NumElements / MinElementsPerJob, 1, numThreads * JobsPerThread);
+	numThreads     = Min(numThreads, NumJobs);
+	while (Streams.size() < (size_t) NumJobs)
+		Streams += new RenderStream();
+	while (Workers.size() < (size_t) numThreads) {
+		Renderer* w    = new Renderer();
+		w->Doc         = Doc;
+		w->Images      = Images;
+		w->Strings     = Strings;
+		w->Vectors     = Vectors;
+		w->VectorCache = VectorCache;
+		Workers += w;
+	}
+	for (auto w : Workers) {
+		w->Glyphs          = Glyphs;
+		w->UseBoxInstances = UseBoxInstances;
+	}
+
+	RunJobsInParallel(NumJobs, numThreads, this, JobFunc);
+
+	// We are serial again
+	if (Clip == nullptr) {
+		for (int i = 0; i < NumJobs; i++)
+			Streams[i]->Play(Driver);
+	} else {
+		for (int r = 0; r < Clip->Count; r++) {
+			Driver->SetClipRect(&Clip->Rects[r]);
+			Driver->ClearClipRect();
+			for (int i = 0; i < NumJobs; i++)
+				Streams[i]->Play(Driver);
+		}
+		Driver->SetClipRect(nullptr);
+	}
 
-	// This phase is probably worth parallelizing
-	RenderEl(Point(0, 0), root);
-	// After RenderEl we are serial again.
+	for (auto w : Workers) {
+		for (const auto& key : w->GlyphsNeeded)
+			GlyphsNeeded.insert(key);
+		for (const auto& key : w->VectorsNeeded)
+			VectorsNeeded.insert(key);
+		w->GlyphsNeeded.clear();
+		w->VectorsNeeded.clear();
+		w->Glyphs = nullptr;
+	}
 
 	Driver->PostRenderCleanup();
 
 	bool moreNeeded = GlyphsNeeded.size() != 0 || VectorsNeeded.size() != 0;
 
-	RenderGlyphsNeeded();
-	Global()->GlyphCache->Lock.unlock();
+	RequestGlyphsNeeded();
+	Glyphs = nullptr;
+	Global()->GlyphCache->EndFrame(Clip == nullptr, Driver);
 
 	RenderVectorsNeeded();
+	VectorCache->EndFrame(Clip == nullptr, Driver);
+
+	if (Retained != nullptr)
+		Retained->EndFrame(Clip == nullptr);
 
 	return moreNeeded ? RenderResultNeedMore : RenderResultDone;
 }
 
-void Renderer::RenderEl(Point base, const RenderDomEl* el) {
-	if (el->Tag == TagText) {
-		Point newBase = base + Point(el->Pos.Left, el->Pos.Top);
-		RenderText(newBase, static_cast<const RenderDomText*>(el));
+Renderer::~Renderer() {
+	DeleteAll(Streams);
+	DeleteAll(Workers);
+}
+
+void Renderer::JobFunc(void* renderer, int job, int thread) {
+	Renderer* self = (Renderer*) renderer;
+	Renderer* w    = self->Workers[thread];
+	w->Out         = self->Streams[job];
+	w->Out->Reset();
+
+	// Our piece is the flattened elements that start inside our share of the tree
+	int           first = (int) ((int64_t) self->NumElements * job / self->NumJobs);
+	int           last  = (int) ((int64_t) self->NumElements * (job + 1) / self->NumJobs);
+	const FlatEl* flat  = self->Flat.data;
+	size_t        begin = std::lower_bound(flat, flat + self->Flat.size(), first, [](const FlatEl& f, int n) { return f.First < n; }) - flat;
+	size_t        end   = std::lower_bound(flat, flat + self->Flat.size(), last, [](const FlatEl& f, int n) { return f.First < n; }) - flat;
+	for (size_t i = begin; i < end; i++)
+		w->RenderFlatEl(self->Flat[i]);
+}
+
+// Returns the number of elements in the subtree of el. If we're retaining subtrees, then hash
+// receives a hash of the subtree, which does not depend on where the subtree is.
+int Renderer::FlattenEl(Point base, const RenderDomEl* el, uint64_t& hash) {
+	size_t first      = Flat.size();
+	int    firstIndex = NumElements++;
+
+	// Children can overflow their parent, so we can't skip the subtree of an element that is outside the clip
+	if (Clip == nullptr || Clip->Intersects(DamageTracker::ElementBounds(base, el))) {
+		FlatEl& f = Flat.add();
+		f         = FlatEl();
+		f.El      = el;
+		f.Base    = base;
+		f.First   = firstIndex;
+	}
+	if (Retained != nullptr)
+		hash = DamageTracker::ElementHash(Doc, Point(-el->Pos.Left, -el->Pos.Top), el);
+	if (el->Tag == TagText)
+		return 1;
+
+	const RenderDomNode* node    = static_cast<const RenderDomNode*>(el);
+	Point                newBase = base + Point(node->Pos.Left, node->Pos.Top);
+	int                  count   = 1;
+	for (size_t i = 0; i < node->Children.size(); i++) {
+		const RenderDomEl* child     = node->Children[i];
+		uint64_t           childHash = 0;
+		count += FlattenEl(newBase, child, childHash);
+		if (Retained != nullptr) {
+			// Where the child is inside of us is part of our appearance, but not of the child's
+			Point at(child->Pos.Left, child->Pos.Top);
+			hash = XXH64(&at, sizeof(at), hash);
+			hash = XXH64(&childHash, sizeof(childHash), hash);
+		}
+	}
+
+	if (Retained != nullptr && count >= DisplayList::MinElements && count <= DisplayList::MaxElements) {
+		// Our subtree becomes a single element. If one of our children was already a subtree, then we swallow it.
+		Flat.resize(first);
+		FlatEl& f   = Flat.add();
+		f           = FlatEl();
+		f.El        = el;
+		f.Base      = base;
+		f.First     = firstIndex;
+		f.IsSubtree = true;
+		f.Hash      = hash;
+	}
+	return count;
+}
+
+void Renderer::RenderFlatEl(const FlatEl& el) {
+	if (el.IsSubtree) {
+		RenderSubtree(el);
+	} else if (el.El->Tag == TagText) {
+		Point newBase = el.Base + Point(el.El->Pos.Left, el.El->Pos.Top);
+		RenderText(newBase, static_cast<const RenderDomText*>(el.El));
+	} else {
+		RenderNode(el.Base, static_cast<const RenderDomNode*>(el.El));
+	}
+}
+
+void Renderer::RenderSubtree(const FlatEl& el) {
+	DisplayList::Entry* e = el.Retained;
+	if (e == nullptr) {
+		DrawSubtree(el.Base, el.El);
+		return;
+	}
+
+	// Text is rounded to the pixel grid, so a recording can only be moved by whole pixels without changing how it looks
+	Point origin = el.Base + Point(el.El->Pos.Left, el.El->Pos.Top);
+	Point delta  = origin - e->Origin;
+	bool  reuse  = e->IsComplete && e->Hash == el.Hash;
+	if (reuse && delta != Point(0, 0)) {
+		reuse = (delta.X & PosMask) == 0 && (delta.Y & PosMask) == 0 && e->Stream.Translate(PosToReal(delta.X), PosToReal(delta.Y));
+		if (reuse)
+			e->Origin = origin;
+	}
+
+	if (reuse) {
+		// Keep our glyphs and icons from being evicted
+		for (const auto& key : e->Glyphs)
+			Glyphs->UseGlyph(key);
+		xo::VectorCache::Elem cached;
+		for (const auto& key : e->Vectors)
+			VectorCache->Get(key, cached);
 	} else {
-		const RenderDomNode* node = static_cast<const RenderDomNode*>(el);
-		RenderNode(base, node);
-		Point newBase = base + Point(node->Pos.Left, node->Pos.Top);
-		for (size_t i = 0; i < node->Children.size(); i++)
-			RenderEl(newBase, node->Children[i]);
+		RenderStream* out = Out;
+		e->Stream.Reset();
+		e->Glyphs.clear();
+		e->Vectors.clear();
+		e->Hash       = el.Hash;
+		e->Origin     = origin;
+		e->IsComplete = true;
+		Out           = &e->Stream;
+		Recording     = e;
+		DrawSubtree(el.Base, el.El);
+		Recording = nullptr;
+		Out       = out;
 	}
+	Out->Include(&e->Stream);
+}
+
+void Renderer::DrawSubtree(Point base, const RenderDomEl* el) {
+	if (el->Tag == TagText) {
+		RenderText(base + Point(el->Pos.Left, el->Pos.Top), static_cast<const RenderDomText*>(el));
+		return;
+	}
+	const RenderDomNode* node = static_cast<const RenderDomNode*>(el);
+	RenderNode(base, node);
+	Point newBase = base + Point(node->Pos.Left, node->Pos.Top);
+	for (size_t i = 0; i < node->Children.size(); i++)
+		DrawSubtree(newBase, node->Children[i]);
 }
 
 struct BoxRadiusSet {
@@ -120,8 +307,12 @@ void Renderer::RenderNode(Point base, const RenderDomNode* node) {
 			bgImage     = VectorCache->GetAtlas(bgImageCache.Atlas);
 			bgImageRect = Box(bgImageCache.X, bgImageCache.Y, bgImageCache.X + key.Width, bgImageCache.Y + key.Height);
 			shaderFlags |= SHADER_FLAG_TEXBG_PREMUL;
+			if (Recording)
+				Recording->Vectors.insert(key);
 		} else {
 			VectorsNeeded.insert(key);
+			if (Recording)
+				Recording->IsComplete = false;
 		}
 	}
 
@@ -135,8 +326,8 @@ void Renderer::RenderNode(Point base, const RenderDomNode* node) {
 	}
 
 	if (bgImage) {
-		if (LoadTexture(bgImage, TexUnit0))
-			shaderFlags |= SHADER_FLAG_TEXBG;
+		LoadTexture(bgImage, TexUnit0);
+		shaderFlags |= SHADER_FLAG_TEXBG;
 	}
 
 	BoxF   rr  = style->BorderRadius.ToRealBox2BitPrecision();
@@ -194,6 +385,23 @@ void Renderer::RenderNode(Point base, const RenderDomNode* node) {
 			uvOffset = Vec2f((float) bgImageRect.Left / bgImage->Width, (float) bgImageRect.Top / bgImage->Height);
 		}
 
+		if (UseBoxInstances) {
+			// The Box shader evaluates all of the geometry below, analytically, from these 88 bytes.
+			// Its corner regions are split at the center of the box, so radii can't exceed half of it.
+			Vx_Box box;
+			box.Rect   = VEC4(left, top, right, bottom);
+			box.Border = VEC4(border.Left, border.Top, border.Right, border.Bottom);
+			box.Radii  = VEC4(Min(rad[0], halfMinDim), Min(rad[1], halfMinDim), Min(rad[2], halfMinDim), Min(rad[3], halfMinDim));
+			box.BGUV   = VEC4(uvOffset.x - uvScale.x * (left + border.Left), uvOffset.y - uvScale.y * (top + border.Top), uvScale.x, uvScale.y);
+			for (int i = 0; i < 4; i++)
+				box.BorderColor[i] = borderRGBA[i];
+			box.BGColor = bgRGBA;
+			box.Shader  = shaderFlags;
+			Out->ActivateShader(ShaderBox);
+			Out->Draw(GPUPrimInstances, 1, &box, bgImage != nullptr);
+			return;
+		}
+
 		// Refer to log entry from 2017-01-24 for what A,B,C1,C2,D,E means here, as well as x1..x8 and y1..y4
 
 		float x[8];
@@ -352,8 +560,8 @@ void Renderer::RenderNode(Point base, const RenderDomNode* node) {
 			vx[c++].Set1(shader, VEC2(x[5], y[5]), VEC4(infinitelyThickBorder, -hpad, u[0], v[0]), bgRGBA, borderRGBA[Right]);
 		}
 
-		Driver->ActivateShader(ShaderUber);
-		Driver->Draw(GPUPrimQuads, c, vx);
+		Out->ActivateShader(ShaderUber);
+		Out->Draw(GPUPrimQuads, c, vx, bgImage != nullptr);
 
 		if (anyArcs) {
 			// TODO: Fade between adjacent border colors
@@ -373,7 +581,7 @@ void Renderer::RenderCornerArcs(int shaderFlags, Corners corner, Vec2f edge, Vec
 	if (borderWidth.x == 0 && borderWidth.y == 0)
 		borderRGBA = bgRGBA;
 
-	Driver->ActivateShader(ShaderUber);
+	Out->ActivateShader(ShaderUber);
 	float maxOuterRadius = Max(outerRadii.x, outerRadii.y);
 	float fanRadius;
 	int   divs;
@@ -474,7 +682,7 @@ void Renderer::RenderCornerArcs(int shaderFlags, Corners corner, Vec2f edge, Vec
 		vx[0].Set(SHADER_ARC | shaderFlags, center, arcCenters, VEC4(arcRadii.x, arcRadii.y, centerUV.x, centerUV.y), bgRGBA, borderRGBA);
 		vx[1].Set(SHADER_ARC | shaderFlags, fanPos, arcCenters, VEC4(arcRadii.x, arcRadii.y, fanUV.x, fanUV.y), bgRGBA, borderRGBA);
 		vx[2].Set(SHADER_ARC | shaderFlags, fanPosNext, arcCenters, VEC4(arcRadii.x, arcRadii.y, fanUVNext.x, fanUVNext.y), bgRGBA, borderRGBA);
-		Driver->Draw(GPUPrimTriangles, 3, vx);
+		Out->Draw(GPUPrimTriangles, 3, vx, (shaderFlags & SHADER_FLAG_TEXBG) != 0);
 		fanPos   = fanPosNext;
 		outerPos = outerPosNext;
 		innerPos = innerPosNext;
@@ -523,8 +731,8 @@ void Renderer::RenderQuadratic(Point base, const RenderDomNode* node) {
 		corners[i].V4.x  = -1;
 	}
 
-	Driver->ActivateShader(ShaderQuadraticSpline);
-	Driver->Draw(GPUPrimTriangles, 12, corners);
+	Out->ActivateShader(ShaderQuadraticSpline);
+	Out->Draw(GPUPrimTriangles, 12, corners);
 }
 
 void Renderer::RenderText(Point base, const RenderDomText* node) {
@@ -541,13 +749,19 @@ void Renderer::RenderText(Point base, const RenderDomText* node) {
 
 void Renderer::RenderTextChar_SubPixel(Point base, const RenderDomText* node, const RenderCharEl& txtEl) {
 	GlyphCacheKey glyphKey(node->FontID, txtEl.Char, node->FontSizePx, GlyphFlag_SubPixel_RGB);
-	const Glyph*  glyph = Global()->GlyphCache->GetGlyph(glyphKey);
+	const Glyph*  glyph = Glyphs->UseGlyph(glyphKey);
 	if (!glyph) {
 		GlyphsNeeded.insert(glyphKey);
+		if (Recording)
+			Recording->IsComplete = false;
 		return;
 	}
+	if (Recording)
+		Recording->Glyphs.insert(glyphKey);
+	if (glyph->IsNull())
+		return;
 
-	TextureAtlas* atlas       = Global()->GlyphCache->GetAtlasMutable(glyph->AtlasID);
+	TextureAtlas* atlas       = Glyphs->GetAtlas(glyph->AtlasID);
 	float         atlasScaleX = 1.0f / atlas->Width;
 	float         atlasScaleY = 1.0f / atlas->Height;
 
@@ -617,22 +831,27 @@ void Renderer::RenderTextChar_SubPixel(Point base, const RenderDomText* node, co
 		corners[i].Shader = SHADER_TEXT_SUBPIXEL;
 	}
 
-	Driver->ActivateShader(ShaderUber);
-	//Driver->ActivateShader(ShaderTextRGB);
-	if (!LoadTexture(atlas, TexUnit0))
-		return;
-	Driver->Draw(GPUPrimQuads, 4, corners);
+	Out->ActivateShader(ShaderUber);
+	//Out->ActivateShader(ShaderTextRGB);
+	LoadTexture(atlas, TexUnit0);
+	Out->Draw(GPUPrimQuads, 4, corners, true);
 }
 
 void Renderer::RenderTextChar_WholePixel(Point base, const RenderDomText* node, const RenderCharEl& txtEl) {
 	GlyphCacheKey glyphKey(node->FontID, txtEl.Char, node->FontSizePx, 0);
-	const Glyph*  glyph = Global()->GlyphCache->GetGlyph(glyphKey);
+	const Glyph*  glyph = Glyphs->UseGlyph(glyphKey);
 	if (!glyph) {
 		GlyphsNeeded.insert(glyphKey);
+		if (Recording)
+			Recording->IsComplete = false;
 		return;
 	}
+	if (Recording)
+		Recording->Glyphs.insert(glyphKey);
+	if (glyph->IsNull())
+		return;
 
-	TextureAtlas* atlas       = Global()->GlyphCache->GetAtlasMutable(glyph->AtlasID);
+	TextureAtlas* atlas       = Glyphs->GetAtlas(glyph->AtlasID);
 	float         atlasScaleX = 1.0f / atlas->Width;
 	float         atlasScaleY = 1.0f / atlas->Height;
 
@@ -687,16 +906,15 @@ void Renderer::RenderTextChar_WholePixel(Point base, const RenderDomText* node,
 		corners[i].Shader = SHADER_TEXT_SIMPLE;
 	}
 
-	//Driver->ActivateShader(ShaderTextWhole);
-	Driver->ActivateShader(ShaderUber);
-	if (!LoadTexture(atlas, TexUnit0))
-		return;
-	Driver->Draw(GPUPrimQuads, 4, corners);
+	//Out->ActivateShader(ShaderTextWhole);
+	Out->ActivateShader(ShaderUber);
+	LoadTexture(atlas, TexUnit0);
+	Out->Draw(GPUPrimQuads, 4, corners, true);
 }
 
-void Renderer::RenderGlyphsNeeded() {
-	for (const auto& key : GlyphsNeeded)
-		Global()->GlyphCache->RenderGlyph(key);
+void Renderer::RequestGlyphsNeeded() {
+	if (GlyphsNeeded.size() != 0)
+		Global()->GlyphCache->RequestGlyphs(GlyphsNeeded);
 	GlyphsNeeded.clear();
 }
 
@@ -706,12 +924,8 @@ void Renderer::RenderVectorsNeeded() {
 	VectorsNeeded.clear();
 }
 
-bool Renderer::LoadTexture(Texture* tex, TexUnits texUnit) {
-	if (!Driver->LoadTexture(tex, texUnit))
-		return false;
-
-	tex->ClearInvalidRect();
-	return true;
+void Renderer::LoadTexture(Texture* tex, TexUnits texUnit) {
+	Out->LoadTexture(tex, texUnit);
 }
 
 float Renderer::CircleFrom3Pt(const Vec2f& a, const Vec2f& b, const Vec2f& c, Vec2f& center, float& radius) {
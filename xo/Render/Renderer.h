@@ -2,18 +2,54 @@
 #include "../Defs.h"
 #include "../Text/GlyphCache.h"
 #include "VectorCache.h"
+#include "RenderStream.h"
+#include "DamageTracker.h"
+#include "DisplayList.h"
 
 namespace xo {
 
 /* An instance of this is created for each render.
 Any state that is persisted between renderings is stored in RenderGL.
+
+We flatten the tree into painter's order, and split it into contiguous pieces, which are
+turned into vertices on the worker threads. Every piece records into its own RenderStream,
+and once they're all done, the streams are played back into the driver, in order. Each thread
+has its own worker Renderer, which collects the glyphs and vectors that were missing, and
+those are merged back into ours at the end. Missing glyphs are handed to the glyph cache, which
+rasterizes them on the worker threads, so we'll find them on a subsequent frame.
+
+When only part of the frame is repainted, elements outside of the clip rectangles are left
+out of the flattened tree, and the streams are played once for every clip rectangle.
+
+If we're given a DisplayList, then subtrees of moderate size are flattened into a single
+element, which is recorded into the DisplayList, or replayed from it if the subtree has not
+changed since a previous frame. The job's stream includes the subtree's stream at that point.
+Jobs are split up by the number of elements in the tree, rather than the number of flattened
+elements, so that a frame in which everything has to be recorded is still spread evenly.
 */
 class XO_API Renderer {
 public:
+	~Renderer();
+
 	// I initially tried to not pass Doc in here, but I eventually needed it to lookup canvas objects
-	RenderResult Render(const xo::Doc* doc, xo::VectorCache* vcache, RenderBase* driver, const RenderDomNode* root);
+	// If clip is not null, then only the pixels inside it are repainted.
+	// If retained is not null, then unchanged subtrees are replayed from it.
+	RenderResult Render(const xo::Doc* doc, xo::VectorCache* vcache, RenderBase* driver, const RenderDomNode* root, const DamageTracker::RectList* clip = nullptr, DisplayList* retained = nullptr);
 
 protected:
+	static const int MinElementsPerJob = 256; // Don't split the tree into pieces smaller than this
+	static const int JobsPerThread     = 4;   // Smaller pieces let the threads that finish early pick up the slack
+
+	// An element of the flattened tree, along with the origin of its parent's content box
+	struct FlatEl {
+		const RenderDomEl*  El;
+		Point               Base;
+		int                 First;               // Number of elements of the tree that precede this one. Used to divide the work into jobs.
+		bool                IsSubtree = false;   // El stands for its whole subtree
+		uint64_t            Hash      = 0;       // IsSubtree: Hash of the subtree, which does not depend on where it is
+		DisplayList::Entry* Retained  = nullptr; // IsSubtree: Where the subtree is recorded. If null, then it is drawn directly.
+	};
+
 	enum TexUnits {
 		TexUnit0 = 0,
 	};
@@ -23,26 +59,41 @@ protected:
 		BottomRight,
 		TopRight,
 	};
-	const xo::Doc*             Doc         = nullptr;
-	const ImageStore*          Images      = nullptr;
-	const StringTable*         Strings     = nullptr;
-	const VariableTable*       Vectors     = nullptr;
-	xo::VectorCache*           VectorCache = nullptr;
-	RenderBase*                Driver      = nullptr;
-	ohash::set<GlyphCacheKey>  GlyphsNeeded;
-	ohash::set<VectorCacheKey> VectorsNeeded;
-
-	void RenderEl(Point base, const RenderDomEl* node);
+	const xo::Doc*                 Doc         = nullptr;
+	const ImageStore*              Images      = nullptr;
+	const StringTable*             Strings     = nullptr;
+	const VariableTable*           Vectors     = nullptr;
+	xo::VectorCache*               VectorCache = nullptr;
+	RenderBase*                    Driver      = nullptr;
+	RenderStream*                  Out         = nullptr; // Destination of the piece that we're currently rendering
+	const DamageTracker::RectList* Clip        = nullptr; // Null when repainting the whole frame
+	DisplayList*                   Retained    = nullptr; // Null when we're not retaining subtrees
+	DisplayList::Entry*            Recording   = nullptr; // Subtree that we're currently recording, which is told about the glyphs and icons that we use
+	GlyphTableRef                  Glyphs;                // Snapshot of the glyph cache, taken at the start of the frame
+	ohash::set<GlyphCacheKey>      GlyphsNeeded;
+	ohash::set<VectorCacheKey>     VectorsNeeded;
+	cheapvec<FlatEl>               Flat;
+	cheapvec<RenderStream*>        Streams; // One per job, in painter's order
+	cheapvec<Renderer*>            Workers; // One per thread
+	int                            NumJobs         = 0;
+	int                            NumElements     = 0; // Number of elements of the tree that we've flattened so far
+	bool                           UseBoxInstances = false; // Draw boxes as Vx_Box instances, instead of Vx_Uber quads
+
+	int  FlattenEl(Point base, const RenderDomEl* el, uint64_t& hash);
+	void RenderFlatEl(const FlatEl& el);
+	void RenderSubtree(const FlatEl& el);
+	void DrawSubtree(Point base, const RenderDomEl* el);
 	void RenderNode(Point base, const RenderDomNode* node);
 	void RenderCornerArcs(int shaderFlags, Corners corner, Vec2f edge, Vec2f outerRadii, Vec2f borderWidth, Vec2f centerUV, Vec2f uvScale, uint32_t bgRGBA, uint32_t borderRGBA);
 	void RenderQuadratic(Point base, const RenderDomNode* node);
 	void RenderText(Point base, const RenderDomText* node);
 	void RenderTextChar_WholePixel(Point base, const RenderDomText* node, const RenderCharEl& txtEl);
 	void RenderTextChar_SubPixel(Point base, const RenderDomText* node, const RenderCharEl& txtEl);
-	void RenderGlyphsNeeded();
+	void RequestGlyphsNeeded();
 	void RenderVectorsNeeded();
 
-	bool         LoadTexture(Texture* tex, TexUnits texUnit); // Load a texture and reset invalid rectangle
+	void         LoadTexture(Texture* tex, TexUnits texUnit); // Load a texture and reset invalid rectangle. Deferred until the stream is played back.
+	static void  JobFunc(void* renderer, int job, int thread);
 	static float CircleFrom3Pt(const Vec2f& a, const Vec2f& b, const Vec2f& c, Vec2f& center, float& radius);
 	static Vec2f PtOnEllipse(float flipX, float flipY, float a, float b, float theta);
 };
@@ -7,20 +7,40 @@ namespace xo {
 void StyleResolver::ResolveAndPush(RenderStack& stack, const DomNode* node) {
 	RenderStackEl& result = stack.StackPush();
 
-	// 1. Inherited by default
-	for (int i = 0; i < NumInheritedStyleCategories; i++)
-		SetInherited(stack, node, InheritedStyleCategories[i]);
+	// 1. Inherited by default. Our parent has already resolved these, so we don't need to search the stack.
+	if (stack.StackSize() >= 2) {
+		const RenderStackEl& parent = stack.StackAt(stack.StackSize() - 2);
+		for (int i = 0; i < NumInheritedStyleCategories; i++) {
+			if (!parent.Inherited[i].IsNull())
+				SetFinal(result, parent.Inherited[i]);
+		}
+	}
 
-	// 2. Tag style
-	Set(stack, node, stack.Doc->TagStyles[node->GetTag()]);
+	// 2 & 3. Tag style and classes, merged ahead of time
+	const CompiledStyle* compiled = stack.CompiledStyles ? stack.CompiledStyles->Get(stack.Doc, node, stack.CompiledLocal) : nullptr;
+	if (compiled != nullptr) {
+		if (compiled->IsPlain)
+			result.Styles.Set((int) compiled->Attribs.size(), compiled->Attribs.data, result.Pool);
+		else
+			Set(stack, node, compiled->Attribs.size(), compiled->Attribs.data);
+		result.HasHoverStyle |= compiled->HasHoverStyle;
+		result.HasFocusStyle |= compiled->HasFocusStyle;
+		result.HasCaptureStyle |= compiled->HasCaptureStyle;
+	} else {
+		// 2. Tag style
+		Set(stack, node, stack.Doc->TagStyles[node->GetTag()]);
 
-	// 3. Classes
-	const cheapvec<StyleClassID>& classes = node->GetClasses();
-	for (size_t i = 0; i < classes.size(); i++)
-		Set(stack, node, *stack.Doc->ClassStyles.GetByID(classes[i]));
+		// 3. Classes
+		const cheapvec<StyleClassID>& classes = node->GetClasses();
+		for (size_t i = 0; i < classes.size(); i++)
+			Set(stack, node, *stack.Doc->ClassStyles.GetByID(classes[i]));
+	}
 
 	// 4. Node Styles
 	Set(stack, node, node->GetStyle());
+
+	for (int i = 0; i < NumInheritedStyleCategories; i++)
+		result.Inherited[i] = result.Styles.Get(InheritedStyleCategories[i]);
 }
 
 static void RecursiveVariableResolve(const Doc* doc, cheapvec<char>& buf) {
@@ -147,6 +167,14 @@ void StyleResolver::SetOrExplode(RenderStack& stack, const DomEl* node, RenderSt
 		// that all variables have been substituted, even if they are undefined.
 		// HOWEVER.... We COULD be defining new strings!
 
+		// Normally the attribute has already been expanded and parsed, by this or an earlier layout
+		const CompiledVerbatim* compiled = stack.CompiledStyles ? stack.CompiledStyles->GetVerbatim(const_cast<Doc*>(stack.Doc), attrib, stack.CompiledLocal) : nullptr;
+		if (compiled != nullptr) {
+			if (compiled->IsValid)
+				Set(stack, node, compiled->Attribs.size(), compiled->Attribs.data);
+			return;
+		}
+
 		stack.VerbatimExplodeTemp.Attribs.count = 0;
 
 		if (ExplodeVerbatimAttrib(const_cast<Doc*>(stack.Doc), attrib, stack.VerbatimBufTemp, stack.VerbatimExplodeTemp))
@@ -4,10 +4,11 @@
 namespace xo {
 
 TextureAtlas::TextureAtlas() {
-	memset(this, 0, sizeof(*this));
+	ResetTexture();
 }
 
 TextureAtlas::~TextureAtlas() {
+	free(Data);
 }
 
 void TextureAtlas::Initialize(uint32_t width, uint32_t height, xo::TexFormat format, uint32_t padding) {
@@ -18,9 +19,10 @@ void TextureAtlas::Initialize(uint32_t width, uint32_t height, xo::TexFormat for
 	Stride        = (int) (width * TexFormatBytesPerPixel(format));
 	size_t nbytes = height * Stride;
 	Data          = (uint8_t*) MallocOrDie(nbytes);
-	PosTop        = Padding;
-	PosBottom     = Padding;
-	PosRight      = Padding;
+	NumAllocs     = 0;
+	UsedTexels    = 0;
+	Skyline.clear_noalloc();
+	Skyline += SkylineNode{Padding, Padding, Width - Padding};
 }
 
 void TextureAtlas::Zero() {
@@ -29,26 +31,99 @@ void TextureAtlas::Zero() {
 
 void TextureAtlas::Free() {
 	free(Data);
-	memset(this, 0, sizeof(*this));
-	TexID = TextureIDNull;
+	ResetTexture();
+	Padding    = 0;
+	NumAllocs  = 0;
+	UsedTexels = 0;
+	Skyline.clear();
+}
+
+// An atlas starts out with all of its Texture fields zeroed, instead of the Texture defaults
+void TextureAtlas::ResetTexture() {
+	static_cast<Texture&>(*this) = Texture();
+	InvalidRect                  = Box(0, 0, 0, 0);
+	TexID                        = TextureIDNull;
+	FilterMin                    = TexFilterNearest;
+	FilterMax                    = TexFilterNearest;
 }
 
 bool TextureAtlas::Alloc(uint16_t width, uint16_t height, uint16_t& x, uint16_t& y) {
-	if (width > Width)
-		return false;
-	if (PosRight + width > Width) {
-		// move onto next line
-		PosTop   = PosBottom;
-		PosRight = 0;
+	// Every rectangle owns the padding on its right and bottom edges
+	uint32_t w = width + Padding;
+	uint32_t h = height + Padding;
+
+	int      best       = -1;
+	uint32_t bestBottom = UINT32_MAX;
+	uint32_t bestWidth  = UINT32_MAX;
+	for (size_t i = 0; i < Skyline.size(); i++) {
+		int top = FitAt(i, w, h);
+		if (top < 0)
+			continue;
+		uint32_t bottom = (uint32_t) top + h;
+		if (bottom < bestBottom || (bottom == bestBottom && Skyline[i].Width < bestWidth)) {
+			best       = (int) i;
+			bestBottom = bottom;
+			bestWidth  = Skyline[i].Width;
+		}
 	}
-	// can't fit vertically
-	if (PosTop + height + Padding > Height)
+	if (best == -1)
 		return false;
-	x = PosRight;
-	y = PosTop;
-	PosRight += width + Padding;
-	PosBottom = std::max(PosBottom, PosTop + height + Padding);
-	InvalidRect.ExpandToFit(Box(x, y, x + width, y + height));
+
+	SkylineNode node = {Skyline[best].X, bestBottom, w};
+	Skyline.insert(best, node);
+
+	// Trim or remove the segments that are now hidden underneath the new one
+	for (size_t i = best + 1; i < Skyline.size();) {
+		uint32_t end = node.X + node.Width;
+		if (Skyline[i].X >= end)
+			break;
+		uint32_t overlap = end - Skyline[i].X;
+		if (overlap < Skyline[i].Width) {
+			Skyline[i].X += overlap;
+			Skyline[i].Width -= overlap;
+			break;
+		}
+		Skyline.erase(i, i + 1);
+	}
+	MergeSkyline();
+
+	x = (uint16_t) node.X;
+	y = (uint16_t) (bestBottom - h);
+	NumAllocs++;
+	UsedTexels += (uint64_t) w * (uint64_t) h;
 	return true;
 }
+
+void TextureAtlas::AddToStats(AtlasStats& stats) const {
+	stats.NumAtlases++;
+	stats.NumEntries += NumAllocs;
+	stats.TotalTexels += (uint64_t) Width * (uint64_t) Height;
+	stats.UsedTexels += UsedTexels;
+}
+
+// Returns the row at which a rectangle whose left edge is at Skyline[node] would sit, or -1 if it doesn't fit
+int TextureAtlas::FitAt(size_t node, uint32_t width, uint32_t height) const {
+	if (Skyline[node].X + width > Width)
+		return -1;
+	uint32_t top    = 0;
+	int32_t  remain = (int32_t) width;
+	for (size_t i = node; remain > 0; i++) {
+		top = std::max(top, Skyline[i].Y);
+		if (top + height > Height)
+			return -1;
+		remain -= (int32_t) Skyline[i].Width;
+	}
+	return (int) top;
+}
+
+void TextureAtlas::MergeSkyline() {
+	for (size_t i = 0; i + 1 < Skyline.size();) {
+		if (Skyline[i].Y == Skyline[i + 1].Y) {
+			Skyline[i].Width += Skyline[i + 1].Width;
+			Skyline.erase(i + 1, i + 2);
+		} else {
+			i++;
+		}
+	}
 }
+} // namespace xo
@@ -3,8 +3,32 @@
 
 namespace xo {
 
-// This is brain dead naive. We obviously need a better box packer.
-// The one from freetype-gl looks decent, or maybe stb_rect_pack.
+// Occupancy of all of the atlases owned by a cache
+struct XO_API AtlasStats {
+	uint32_t NumAtlases     = 0;
+	uint32_t NumEntries     = 0;
+	uint64_t TotalTexels    = 0;
+	uint64_t UsedTexels     = 0; // Texels covered by entries, including their padding
+	uint64_t NumEvicted     = 0; // Entries evicted since the cache was created
+	uint32_t NumCompactions = 0; // Number of times the cache has repacked its atlases
+	uint64_t NumLoaded      = 0; // Entries that were read from a persistent cache, instead of being rendered
+
+	float Occupancy() const { return TotalTexels == 0 ? 0 : (float) ((double) UsedTexels / (double) TotalTexels); }
+};
+
+/* A texture that is shared by many small images.
+
+Rectangles are packed with the skyline bottom-left heuristic. We keep track of the lowest free
+row in every column, as a list of horizontal segments (the skyline), and place every new
+rectangle where its bottom edge will be highest up, breaking ties in favour of the narrowest
+segment. This packs glyphs of mixed sizes far more tightly than filling one row at a time.
+
+Alloc does not touch InvalidRect. The caller must invalidate the rectangle once it has written
+the pixels, which lets the glyph cache keep texture uploads on the render thread.
+
+Individual rectangles cannot be freed. The owner of the atlas evicts stale entries by packing
+the surviving entries into new atlases, and discarding the old ones.
+*/
 class XO_API TextureAtlas : public Texture {
 public:
 	TextureAtlas();
@@ -14,11 +38,26 @@ public:
 	void Free();
 	bool Alloc(uint16_t width, uint16_t height, uint16_t& x, uint16_t& y);
 
+	uint32_t GetPadding() const { return Padding; }
+	uint32_t GetNumAllocs() const { return NumAllocs; }
+	uint64_t GetUsedTexels() const { return UsedTexels; }
+	void     AddToStats(AtlasStats& stats) const;
+
 protected:
-	uint32_t Padding;
+	struct SkylineNode {
+		uint32_t X;
+		uint32_t Y; // Lowest free row in the columns [X, X + Width)
+		uint32_t Width;
+	};
+
+	uint32_t              Padding    = 0;
+	uint32_t              NumAllocs  = 0;
+	uint64_t              UsedTexels = 0;
+	cheapvec<SkylineNode> Skyline; // Sorted by X, and spans [Padding, Width)
+
+	void ResetTexture();
 
-	uint32_t PosTop;
-	uint32_t PosBottom;
-	uint32_t PosRight;
+	int  FitAt(size_t node, uint32_t width, uint32_t height) const;
+	void MergeSkyline();
 };
-}
+} // namespace xo
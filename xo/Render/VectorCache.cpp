@@ -3,6 +3,7 @@
 #include "../Image/Image.h"
 #include "../Canvas/Canvas2D.h"
 #include "../Containers/VariableTable.h"
+#include "RenderBase.h"
 
 namespace xo {
 
@@ -19,54 +20,138 @@ VectorCache::VectorCache() {
 
 VectorCache::~VectorCache() {
 	for (auto a : Atlases)
-		a.Free();
+		a->Free();
+	DeleteAll(Atlases);
 }
 
-bool VectorCache::Get(int iconID, int width, int height, Elem& cached) const {
+bool VectorCache::Get(int iconID, int width, int height, Elem& cached) {
 	return Get(VectorCacheKey::Make(iconID, width, height), cached);
 }
 
-bool VectorCache::Get(const VectorCacheKey& key, Elem& cached) const {
+bool VectorCache::Get(const VectorCacheKey& key, Elem& cached) {
 	Elem* c = Map.getp(key);
 	if (!c)
 		return false;
+	// Every thread that touches this icon during a frame writes the same value
+	if (c->LastUsed.Load() != Frame)
+		c->LastUsed.Store(Frame);
 	cached = *c;
 	return true;
 }
 
 void VectorCache::Set(int iconID, const Image& img) {
 	Elem e = AllocAtlas(iconID, img.Width, img.Height);
-	Atlases[e.Atlas].CopyFrom(e.X, e.Y, img.Data, img.Stride, img.Width, img.Height);
+	Atlases[e.Atlas]->CopyFrom(e.X, e.Y, img.Data, img.Stride, img.Width, img.Height);
+	Atlases[e.Atlas]->InvalidRect.ExpandToFit(Box(e.X, e.Y, e.X + img.Width, e.Y + img.Height));
 }
 
 VectorCache::Elem VectorCache::AllocAtlas(int iconID, int width, int height) {
+	Elem e = AllocSpace(width, height);
+	Map.insert(VectorCacheKey::Make(iconID, width, height), e);
+	return e;
+}
+
+VectorCache::Elem VectorCache::AllocSpace(int width, int height) {
 	XO_ASSERT(width <= MaxSize);
 	XO_ASSERT(height <= MaxSize);
 
 	Elem e;
+	e.LastUsed.Store(Frame);
 
 	for (size_t i = 0; i < Atlases.size(); i++) {
-		if (Atlases[i].Alloc(width, height, e.X, e.Y)) {
+		if (Atlases[i]->Alloc(width, height, e.X, e.Y)) {
 			e.Atlas = (int) i;
-			Map.insert(VectorCacheKey::Make(iconID, width, height), e);
 			return e;
 		}
 	}
-	Atlases.push_back(TextureAtlas());
-	TextureAtlas& atlas = Atlases.back();
-	uint32_t      aw    = 64;
-	uint32_t      ah    = 64;
+	TextureAtlas* atlas = new TextureAtlas();
+	uint32_t      aw    = AtlasSize;
+	uint32_t      ah    = AtlasSize;
 	while (aw < (uint32_t) width)
 		aw *= 2;
 	while (ah < (uint32_t) height)
 		ah *= 2;
-	atlas.Initialize(aw, ah, TexFormatRGBA8, 2);
-	XO_VERIFY(atlas.Alloc(width, height, e.X, e.Y));
-	e.Atlas = (int) Atlases.size() - 1;
-	Map.insert(VectorCacheKey::Make(iconID, width, height), e);
+	atlas->Initialize(aw, ah, TexFormatRGBA8, 2);
+	if (SpareTextures.size() != 0) {
+		atlas->TexID = SpareTextures.rpop();
+		atlas->InvalidateWholeSurface();
+	}
+	XO_VERIFY(atlas->Alloc(width, height, e.X, e.Y));
+	e.Atlas = (int) Atlases.size();
+	Atlases += atlas;
 	return e;
 }
 
+void VectorCache::EndFrame(bool wholeFrame, RenderBase* driver) {
+	if (wholeFrame)
+		Frame++;
+
+	// Only try to reclaim space after we've had to create a new atlas
+	if (Atlases.size() > 1 && Atlases.size() > NumAtlasesAfterCompact) {
+		Compact();
+		NumAtlasesAfterCompact = Atlases.size();
+	}
+
+	while (SpareTextures.size() > MaxSpareTextures) {
+		TextureID id = SpareTextures.rpop();
+		if (driver->IsTextureValid(id))
+			driver->FreeTexture(id);
+	}
+}
+
+AtlasStats VectorCache::GetStats() const {
+	AtlasStats s = Stats;
+	for (size_t i = 0; i < Atlases.size(); i++)
+		Atlases[i]->AddToStats(s);
+	return s;
+}
+
+// Evict the icons that have not been drawn recently, and pack the rest into new atlases.
+// The new atlases inherit the device textures of the old ones.
+void VectorCache::Compact() {
+	struct Survivor {
+		VectorCacheKey Key;
+		Elem           El;
+	};
+	cheapvec<Survivor> live;
+	uint32_t           numEvicted = 0;
+	for (auto& it : Map) {
+		if (Frame - it.second.LastUsed.Load() > EvictAfterFrames)
+			numEvicted++;
+		else
+			live += Survivor{it.first, it.second};
+	}
+	if (numEvicted == 0)
+		return;
+
+	// Tallest first packs best
+	std::sort(live.data, live.data + live.size(), [](const Survivor& a, const Survivor& b) { return a.Key.Height > b.Key.Height; });
+
+	cheapvec<TextureAtlas*> old;
+	std::swap(old, Atlases);
+	for (auto a : old) {
+		if (a->TexID != TextureIDNull)
+			SpareTextures += a->TexID;
+	}
+
+	Map.clear();
+	for (const auto& s : live) {
+		const TextureAtlas* src = old[s.El.Atlas];
+		Elem                e   = AllocSpace(s.Key.Width, s.Key.Height);
+		e.LastUsed              = s.El.LastUsed;
+		Atlases[e.Atlas]->CopyFrom(e.X, e.Y, src->DataAt(s.El.X, s.El.Y), src->Stride, s.Key.Width, s.Key.Height);
+		Map.insert(s.Key, e);
+	}
+
+	for (auto a : old)
+		a->Free();
+	DeleteAll(old);
+	AtlasEpoch++;
+
+	Stats.NumEvicted += numEvicted;
+	Stats.NumCompactions++;
+}
+
 VectorCache::Elem VectorCache::Render(const VariableTable& vectors, VectorCacheKey key) {
 	const char* svg = vectors.GetByID(key.IconID);
 	if (!svg) {
@@ -75,8 +160,8 @@ VectorCache::Elem VectorCache::Render(const VariableTable& vectors, VectorCacheK
 	}
 
 	auto elem = AllocAtlas(key.IconID, key.Width, key.Height);
-	auto tex  = Atlases[elem.Atlas].Window(elem.X, elem.Y, key.Width, key.Height);
-	Atlases[elem.Atlas].InvalidRect.ExpandToFit(Box(elem.X, elem.Y, key.Width, key.Height));
+	auto tex  = Atlases[elem.Atlas]->Window(elem.X, elem.Y, key.Width, key.Height);
+	Atlases[elem.Atlas]->InvalidRect.ExpandToFit(Box(elem.X, elem.Y, key.Width, key.Height));
 	Canvas2D canvas(&tex);
 	canvas.RenderSVG(svg);
 	return elem;
@@ -16,34 +16,55 @@ struct VectorCacheKey {
 	bool                  operator==(const VectorCacheKey& s) const { return IconID == s.IconID && Width == s.Width && Height == s.Height; }
 };
 
-// Cache of rasterized vector icons
+/* Cache of rasterized vector icons
+
+Icons share atlases of at least AtlasSize x AtlasSize. Like GlyphCache, whenever we've had to
+create a new atlas, we evict the icons that have not been drawn for EvictAfterFrames whole
+frames, and pack the survivors into as few atlases as possible.
+*/
 class XO_API VectorCache {
 public:
 	// Element cached inside texture atlas
 	struct Elem {
-		int      Atlas;
-		uint16_t X;
-		uint16_t Y;
+		int        Atlas;
+		uint16_t   X;
+		uint16_t   Y;
+		FrameStamp LastUsed; // Frame in which this icon was last drawn. Written by concurrent renderers.
 	};
 
 	// Set will panic if you try to insert an item larger than this.
 	// An RGBA 4096x4096 texture is 64MB.
 	static const int MaxSize = 4096;
 
+	static const int      AtlasSize        = 256; // Smallest atlas. 256 x 256 x RGBA = 256k
+	static const uint32_t EvictAfterFrames = 300; // Icons that have not been drawn for this many frames are evicted when the atlases fill up
+	static const size_t   MaxSpareTextures = 2;   // Device textures of discarded atlases beyond this many are freed by EndFrame
+
 	VectorCache();
 	~VectorCache();
 
-	bool Get(int iconID, int width, int height, Elem& cached) const; // Thread safe
-	bool Get(const VectorCacheKey& key, Elem& cached) const;         // Thread safe
-	void Set(int iconID, const Image& img);                          // Not thread safe
-	Elem AllocAtlas(int iconID, int width, int height);              // Not thread safe
-	Elem Render(const VariableTable& vectors, VectorCacheKey key);   // Not thread safe
+	bool Get(int iconID, int width, int height, Elem& cached);     // Thread safe. Marks the icon as in use.
+	bool Get(const VectorCacheKey& key, Elem& cached);             // Thread safe. Marks the icon as in use.
+	void Set(int iconID, const Image& img);                        // Not thread safe
+	Elem AllocAtlas(int iconID, int width, int height);            // Not thread safe
+	Elem Render(const VariableTable& vectors, VectorCacheKey key); // Not thread safe
+	void EndFrame(bool wholeFrame, RenderBase* driver);            // Not thread safe
 
-	TextureAtlas* GetAtlas(int atlas) { return &Atlases[atlas]; }
+	TextureAtlas* GetAtlas(int atlas) { return Atlases[atlas]; }
+	AtlasStats    GetStats() const;
+	uint32_t      GetAtlasEpoch() const { return AtlasEpoch; } // Changes whenever the atlases are replaced, which invalidates every Elem and atlas pointer
 
 private:
 	ohash::map<VectorCacheKey, Elem> Map;
-	cheapvec<TextureAtlas>           Atlases;
+	cheapvec<TextureAtlas*>          Atlases;
+	uint32_t                         Frame                  = 0;
+	size_t                           NumAtlasesAfterCompact = 0;
+	uint32_t                         AtlasEpoch             = 0;
+	AtlasStats                       Stats;         // Only NumEvicted and NumCompactions are maintained here
+	cheapvec<TextureID>              SpareTextures; // Device textures of discarded atlases, which are handed to new atlases
+
+	Elem AllocSpace(int width, int height);
+	void Compact();
 };
 }
 
@@ -62,6 +62,18 @@ struct XO_API Vx_Uber {
 	}
 };
 
+// One box, drawn by ShaderBox as a single instance. The shader evaluates the borders and rounded
+// corners analytically, so this replaces the many Vx_Uber quads and arc fans of a box.
+struct XO_API Vx_Box {
+	VecBase4f Rect;           // Left, top, right, bottom of the border box, in pixels
+	VecBase4f Border;         // Left, top, right, bottom border widths
+	VecBase4f Radii;          // Top-left, top-right, bottom-right, bottom-left outer radii
+	VecBase4f BGUV;           // Background texture UV = BGUV.xy + BGUV.zw * pixel
+	uint32_t  BorderColor[4]; // Left, top, right, bottom
+	uint32_t  BGColor;
+	uint32_t  Shader; // SHADER_FLAG_TEXBG and SHADER_FLAG_TEXBG_PREMUL
+};
+
 enum VertexType {
 	VertexType_NULL,
 	VertexType_PTC,
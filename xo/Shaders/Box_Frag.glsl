@@ -0,0 +1,124 @@
+#XO_PLATFORM_WIN_DESKTOP
+#XO_PLATFORM_LINUX_DESKTOP
+uniform sampler2D	f_tex0;
+
+varying		vec2	f_pixel;
+varying		vec4	f_rect;
+varying		vec4	f_border;
+varying		vec4	f_radii;
+varying		vec2	f_uv;
+varying		vec4	f_border_left;
+varying		vec4	f_border_top;
+varying		vec4	f_border_right;
+varying		vec4	f_border_bottom;
+varying		vec4	f_bg_color;
+varying 	float	f_shader;
+
+// See Uber_Frag.glsl for why we need two outputs
+out		vec4		out_color0;
+out		vec4		out_color1;
+
+// color must be premultiplied
+void write_color(vec4 color)
+{
+	out_color0 = color;
+	out_color1 = color.aaaa;
+}
+
+vec4 blend_over(vec4 a, vec4 b)
+{
+	return (1.0 - b.a) * a + b;
+}
+
+// Signed distance from p to a rectangle with elliptical corners. Positive outside.
+// rx and ry are the radii of the corners, in the order top-left, top-right, bottom-right, bottom-left.
+// The distance is exact along the straight edges, and a good approximation around the corners,
+// which is all we need for antialiasing.
+float rounded_rect_distance(vec2 p, vec4 rect, vec4 rx, vec4 ry)
+{
+	vec2 center = 0.5 * (rect.xy + rect.zw);
+	bool left = p.x < center.x;
+	bool top = p.y < center.y;
+	vec2 r;
+	if (top)
+		r = left ? vec2(rx.x, ry.x) : vec2(rx.y, ry.y);
+	else
+		r = left ? vec2(rx.w, ry.w) : vec2(rx.z, ry.z);
+
+	vec2 corner = vec2(left ? rect.x + r.x : rect.z - r.x, top ? rect.y + r.y : rect.w - r.y);
+	vec2 q = p - corner;
+	bool inCorner = (left ? q.x < 0.0 : q.x > 0.0) && (top ? q.y < 0.0 : q.y > 0.0);
+	if (inCorner && r.x > 0.0 && r.y > 0.0)
+		return (length(q / r) - 1.0) * min(r.x, r.y);
+
+	return max(max(rect.x - p.x, p.x - rect.z), max(rect.y - p.y, p.y - rect.w));
+}
+
+void main()
+{
+	int shader = int(f_shader);
+	bool enableBGTex = (shader & SHADER_FLAG_TEXBG) != 0;
+	bool bgTexPremul = (shader & SHADER_FLAG_TEXBG_PREMUL) != 0;
+
+	vec2 p = f_pixel;
+	vec4 outer = f_rect;
+	vec4 inner = vec4(outer.xy + f_border.xy, outer.zw - f_border.zw);
+
+	// Inner radii shrink by the border width, independently in x and y, so inner corners can be elliptical
+	vec4 innerRX = max(f_radii - f_border.xzzx, vec4(0, 0, 0, 0));
+	vec4 innerRY = max(f_radii - f_border.yyww, vec4(0, 0, 0, 0));
+
+	float outerDistance = rounded_rect_distance(p, outer, f_radii, f_radii);
+	float innerDistance = 1000.0;
+	if (inner.x < inner.z && inner.y < inner.w)
+		innerDistance = rounded_rect_distance(p, inner, innerRX, innerRY);
+
+	// The same +0.5 as the RECT mode of the Uber shader: fragments sit at pixel centers
+	float edgeAlpha = clamp(0.5 - outerDistance, 0.0, 1.0);
+	float borderBlend = clamp(0.5 + innerDistance, 0.0, 1.0);
+
+	// Which side's border are we on? Corners are split along the line from the outer corner to the inner corner.
+	vec2 center = 0.5 * (outer.xy + outer.zw);
+	vec4 borderColor;
+	float borderWidth;
+	if (p.x < center.x && p.y < center.y)
+	{
+		bool isTop = p.x >= inner.x || (p.y < inner.y && (p.y - outer.y) * f_border.x < (p.x - outer.x) * f_border.y);
+		borderColor = isTop ? f_border_top : f_border_left;
+		borderWidth = isTop ? f_border.y : f_border.x;
+	}
+	else if (p.x >= center.x && p.y < center.y)
+	{
+		bool isTop = p.x <= inner.z || (p.y < inner.y && (p.y - outer.y) * f_border.z < (outer.z - p.x) * f_border.y);
+		borderColor = isTop ? f_border_top : f_border_right;
+		borderWidth = isTop ? f_border.y : f_border.z;
+	}
+	else if (p.x >= center.x)
+	{
+		bool isBottom = p.x <= inner.z || (p.y > inner.w && (outer.w - p.y) * f_border.z < (outer.z - p.x) * f_border.w);
+		borderColor = isBottom ? f_border_bottom : f_border_right;
+		borderWidth = isBottom ? f_border.w : f_border.z;
+	}
+	else
+	{
+		bool isBottom = p.x >= inner.x || (p.y > inner.w && (outer.w - p.y) * f_border.x < (p.x - outer.x) * f_border.w);
+		borderColor = isBottom ? f_border_bottom : f_border_left;
+		borderWidth = isBottom ? f_border.w : f_border.x;
+	}
+
+	vec4 bg_color = premultiply(f_bg_color);
+	if (enableBGTex)
+	{
+		vec4 bg_tex = texture2D(f_tex0, f_uv);
+		if (!bgTexPremul)
+			bg_tex = premultiply(bg_tex);
+		bg_color = blend_over(bg_color, bg_tex);
+	}
+
+	// A side without a border must not bleed its color into the antialiased edge
+	vec4 border_color = borderWidth > 0.0 ? premultiply(borderColor) : bg_color;
+
+	vec4 color = mix(bg_color, border_color, borderBlend);
+	color *= edgeAlpha;
+	write_color(color);
+}
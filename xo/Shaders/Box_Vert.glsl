@@ -0,0 +1,48 @@
+#XO_PLATFORM_WIN_DESKTOP
+#XO_PLATFORM_LINUX_DESKTOP
+uniform		mat4	mvproj;
+
+// One instance per box. Only v_corner is per-vertex.
+// CPU -> Vertex Shader: 4 * 16 + 6 * 4 = 88 bytes per box
+
+attribute	vec2	v_corner;        // (0,0), (0,1), (1,0), (1,1), drawn as a triangle strip
+attribute	vec4	v_rect;          // left, top, right, bottom of the border box
+attribute	vec4	v_border;        // left, top, right, bottom border widths
+attribute	vec4	v_radii;         // top-left, top-right, bottom-right, bottom-left outer radii
+attribute	vec4	v_bguv;          // background texture UV = v_bguv.xy + v_bguv.zw * pixel
+attribute	vec4	v_border_left;
+attribute	vec4	v_border_top;
+attribute	vec4	v_border_right;
+attribute	vec4	v_border_bottom;
+attribute	vec4	v_bg_color;
+attribute	float	v_shader;
+
+varying		vec2	f_pixel;
+varying		vec4	f_rect;
+varying		vec4	f_border;
+varying		vec4	f_radii;
+varying		vec2	f_uv;
+varying		vec4	f_border_left;
+varying		vec4	f_border_top;
+varying		vec4	f_border_right;
+varying		vec4	f_border_bottom;
+varying		vec4	f_bg_color;
+varying 	float	f_shader;
+
+void main()
+{
+	// Pad by a pixel on every side, for the antialiased edge
+	vec2 pixel = mix(v_rect.xy - vec2(1, 1), v_rect.zw + vec2(1, 1), v_corner);
+	gl_Position = mvproj * vec4(pixel.x, pixel.y, 0, 1);
+	f_pixel = pixel;
+	f_rect = v_rect;
+	f_border = v_border;
+	f_radii = v_radii;
+	f_uv = v_bguv.xy + v_bguv.zw * pixel;
+	f_border_left = fromSRGB(v_border_left);
+	f_border_top = fromSRGB(v_border_top);
+	f_border_right = fromSRGB(v_border_right);
+	f_border_bottom = fromSRGB(v_border_bottom);
+	f_bg_color = fromSRGB(v_bg_color);
+	f_shader = v_shader;
+}
@@ -0,0 +1,252 @@
+#include "pch.h"
+#if XO_BUILD_OPENGL
+#include "BoxShader.h"
+
+namespace xo {
+
+GLProg_Box::GLProg_Box()
+{
+	Reset();
+}
+
+void GLProg_Box::Reset()
+{
+	ResetBase();
+	v_mvproj = -1;
+	v_v_corner = -1;
+	v_v_rect = -1;
+	v_v_border = -1;
+	v_v_radii = -1;
+	v_v_bguv = -1;
+	v_v_border_left = -1;
+	v_v_border_top = -1;
+	v_v_border_right = -1;
+	v_v_border_bottom = -1;
+	v_v_bg_color = -1;
+	v_v_shader = -1;
+	v_f_tex0 = -1;
+}
+
+const char* GLProg_Box::VertSrc()
+{
+	return
+		"uniform		mat4	mvproj;\n"
+		"\n"
+		"// One instance per box. Only v_corner is per-vertex.\n"
+		"// CPU -> Vertex Shader: 4 * 16 + 6 * 4 = 88 bytes per box\n"
+		"\n"
+		"attribute	vec2	v_corner;        // (0,0), (0,1), (1,0), (1,1), drawn as a triangle strip\n"
+		"attribute	vec4	v_rect;          // left, top, right, bottom of the border box\n"
+		"attribute	vec4	v_border;        // left, top, right, bottom border widths\n"
+		"attribute	vec4	v_radii;         // top-left, top-right, bottom-right, bottom-left outer radii\n"
+		"attribute	vec4	v_bguv;          // background texture UV = v_bguv.xy + v_bguv.zw * pixel\n"
+		"attribute	vec4	v_border_left;\n"
+		"attribute	vec4	v_border_top;\n"
+		"attribute	vec4	v_border_right;\n"
+		"attribute	vec4	v_border_bottom;\n"
+		"attribute	vec4	v_bg_color;\n"
+		"attribute	float	v_shader;\n"
+		"\n"
+		"varying		vec2	f_pixel;\n"
+		"varying		vec4	f_rect;\n"
+		"varying		vec4	f_border;\n"
+		"varying		vec4	f_radii;\n"
+		"varying		vec2	f_uv;\n"
+		"varying		vec4	f_border_left;\n"
+		"varying		vec4	f_border_top;\n"
+		"varying		vec4	f_border_right;\n"
+		"varying		vec4	f_border_bottom;\n"
+		"varying		vec4	f_bg_color;\n"
+		"varying 	float	f_shader;\n"
+		"\n"
+		"void main()\n"
+		"{\n"
+		"	// Pad by a pixel on every side, for the antialiased edge\n"
+		"	vec2 pixel = mix(v_rect.xy - vec2(1, 1), v_rect.zw + vec2(1, 1), v_corner);\n"
+		"	gl_Position = mvproj * vec4(pixel.x, pixel.y, 0, 1);\n"
+		"	f_pixel = pixel;\n"
+		"	f_rect = v_rect;\n"
+		"	f_border = v_border;\n"
+		"	f_radii = v_radii;\n"
+		"	f_uv = v_bguv.xy + v_bguv.zw * pixel;\n"
+		"	f_border_left = fromSRGB(v_border_left);\n"
+		"	f_border_top = fromSRGB(v_border_top);\n"
+		"	f_border_right = fromSRGB(v_border_right);\n"
+		"	f_border_bottom = fromSRGB(v_border_bottom);\n"
+		"	f_bg_color = fromSRGB(v_bg_color);\n"
+		"	f_shader = v_shader;\n"
+		"}\n"
+;
+}
+
+const char* GLProg_Box::FragSrc()
+{
+	return
+		"uniform sampler2D	f_tex0;\n"
+		"\n"
+		"varying		vec2	f_pixel;\n"
+		"varying		vec4	f_rect;\n"
+		"varying		vec4	f_border;\n"
+		"varying		vec4	f_radii;\n"
+		"varying		vec2	f_uv;\n"
+		"varying		vec4	f_border_left;\n"
+		"varying		vec4	f_border_top;\n"
+		"varying		vec4	f_border_right;\n"
+		"varying		vec4	f_border_bottom;\n"
+		"varying		vec4	f_bg_color;\n"
+		"varying 	float	f_shader;\n"
+		"\n"
+		"// See Uber_Frag.glsl for why we need two outputs\n"
+		"out		vec4		out_color0;\n"
+		"out		vec4		out_color1;\n"
+		"\n"
+		"// color must be premultiplied\n"
+		"void write_color(vec4 color)\n"
+		"{\n"
+		"	out_color0 = color;\n"
+		"	out_color1 = color.aaaa;\n"
+		"}\n"
+		"\n"
+		"vec4 blend_over(vec4 a, vec4 b)\n"
+		"{\n"
+		"	return (1.0 - b.a) * a + b;\n"
+		"}\n"
+		"\n"
+		"// Signed distance from p to a rectangle with elliptical corners. Positive outside.\n"
+		"// rx and ry are the radii of the corners, in the order top-left, top-right, bottom-right, bottom-left.\n"
+		"// The distance is exact along the straight edges, and a good approximation around the corners,\n"
+		"// which is all we need for antialiasing.\n"
+		"float rounded_rect_distance(vec2 p, vec4 rect, vec4 rx, vec4 ry)\n"
+		"{\n"
+		"	vec2 center = 0.5 * (rect.xy + rect.zw);\n"
+		"	bool left = p.x < center.x;\n"
+		"	bool top = p.y < center.y;\n"
+		"	vec2 r;\n"
+		"	if (top)\n"
+		"		r = left ? vec2(rx.x, ry.x) : vec2(rx.y, ry.y);\n"
+		"	else\n"
+		"		r = left ? vec2(rx.w, ry.w) : vec2(rx.z, ry.z);\n"
+		"\n"
+		"	vec2 corner = vec2(left ? rect.x + r.x : rect.z - r.x, top ? rect.y + r.y : rect.w - r.y);\n"
+		"	vec2 q = p - corner;\n"
+		"	bool inCorner = (left ? q.x < 0.0 : q.x > 0.0) && (top ? q.y < 0.0 : q.y > 0.0);\n"
+		"	if (inCorner && r.x > 0.0 && r.y > 0.0)\n"
+		"		return (length(q / r) - 1.0) * min(r.x, r.y);\n"
+		"\n"
+		"	return max(max(rect.x - p.x, p.x - rect.z), max(rect.y - p.y, p.y - rect.w));\n"
+		"}\n"
+		"\n"
+		"void main()\n"
+		"{\n"
+		"	int shader = int(f_shader);\n"
+		"	bool enableBGTex = (shader & SHADER_FLAG_TEXBG) != 0;\n"
+		"	bool bgTexPremul = (shader & SHADER_FLAG_TEXBG_PREMUL) != 0;\n"
+		"\n"
+		"	vec2 p = f_pixel;\n"
+		"	vec4 outer = f_rect;\n"
+		"	vec4 inner = vec4(outer.xy + f_border.xy, outer.zw - f_border.zw);\n"
+		"\n"
+		"	// Inner radii shrink by the border width, independently in x and y, so inner corners can be elliptical\n"
+		"	vec4 innerRX = max(f_radii - f_border.xzzx, vec4(0, 0, 0, 0));\n"
+		"	vec4 innerRY = max(f_radii - f_border.yyww, vec4(0, 0, 0, 0));\n"
+		"\n"
+		"	float outerDistance = rounded_rect_distance(p, outer, f_radii, f_radii);\n"
+		"	float innerDistance = 1000.0;\n"
+		"	if (inner.x < inner.z && inner.y < inner.w)\n"
+		"		innerDistance = rounded_rect_distance(p, inner, innerRX, innerRY);\n"
+		"\n"
+		"	// The same +0.5 as the RECT mode of the Uber shader: fragments sit at pixel centers\n"
+		"	float edgeAlpha = clamp(0.5 - outerDistance, 0.0, 1.0);\n"
+		"	float borderBlend = clamp(0.5 + innerDistance, 0.0, 1.0);\n"
+		"\n"
+		"	// Which side's border are we on? Corners are split along the line from the outer corner to the inner corner.\n"
+		"	vec2 center = 0.5 * (outer.xy + outer.zw);\n"
+		"	vec4 borderColor;\n"
+		"	float borderWidth;\n"
+		"	if (p.x < center.x && p.y < center.y)\n"
+		"	{\n"
+		"		bool isTop = p.x >= inner.x || (p.y < inner.y && (p.y - outer.y) * f_border.x < (p.x - outer.x) * f_border.y);\n"
+		"		borderColor = isTop ? f_border_top : f_border_left;\n"
+		"		borderWidth = isTop ? f_border.y : f_border.x;\n"
+		"	}\n"
+		"	else if (p.x >= center.x && p.y < center.y)\n"
+		"	{\n"
+		"		bool isTop = p.x <= inner.z || (p.y < inner.y && (p.y - outer.y) * f_border.z < (outer.z - p.x) * f_border.y);\n"
+		"		borderColor = isTop ? f_border_top : f_border_right;\n"
+		"		borderWidth = isTop ? f_border.y : f_border.z;\n"
+		"	}\n"
+		"	else if (p.x >= center.x)\n"
+		"	{\n"
+		"		bool isBottom = p.x <= inner.z || (p.y > inner.w && (outer.w - p.y) * f_border.z < (outer.z - p.x) * f_border.w);\n"
+		"		borderColor = isBottom ? f_border_bottom : f_border_right;\n"
+		"		borderWidth = isBottom ? f_border.w : f_border.z;\n"
+		"	}\n"
+		"	else\n"
+		"	{\n"
+		"		bool isBottom = p.x >= inner.x || (p.y > inner.w && (outer.w - p.y) * f_border.x < (p.x - outer.x) * f_border.w);\n"
+		"		borderColor = isBottom ? f_border_bottom : f_border_left;\n"
+		"		borderWidth = isBottom ? f_border.w : f_border.x;\n"
+		"	}\n"
+		"\n"
+		"	vec4 bg_color = premultiply(f_bg_color);\n"
+		"	if (enableBGTex)\n"
+		"	{\n"
+		"		vec4 bg_tex = texture2D(f_tex0, f_uv);\n"
+		"		if (!bgTexPremul)\n"
+		"			bg_tex = premultiply(bg_tex);\n"
+		"		bg_color = blend_over(bg_color, bg_tex);\n"
+		"	}\n"
+		"\n"
+		"	// A side without a border must not bleed its color into the antialiased edge\n"
+		"	vec4 border_color = borderWidth > 0.0 ? premultiply(borderColor) : bg_color;\n"
+		"\n"
+		"	vec4 color = mix(bg_color, border_color, borderBlend);\n"
+		"	color *= edgeAlpha;\n"
+		"	write_color(color);\n"
+		"}\n"
+;
+}
+
+const char* GLProg_Box::Name()
+{
+	return "Box";
+}
+
+
+bool GLProg_Box::LoadVariablePositions()
+{
+	int nfail = 0;
+
+	nfail += (v_mvproj = glGetUniformLocation( Prog, "mvproj" )) == -1;
+	nfail += (v_v_corner = glGetAttribLocation( Prog, "v_corner" )) == -1;
+	nfail += (v_v_rect = glGetAttribLocation( Prog, "v_rect" )) == -1;
+	nfail += (v_v_border = glGetAttribLocation( Prog, "v_border" )) == -1;
+	nfail += (v_v_radii = glGetAttribLocation( Prog, "v_radii" )) == -1;
+	nfail += (v_v_bguv = glGetAttribLocation( Prog, "v_bguv" )) == -1;
+	nfail += (v_v_border_left = glGetAttribLocation( Prog, "v_border_left" )) == -1;
+	nfail += (v_v_border_top = glGetAttribLocation( Prog, "v_border_top" )) == -1;
+	nfail += (v_v_border_right = glGetAttribLocation( Prog, "v_border_right" )) == -1;
+	nfail += (v_v_border_bottom = glGetAttribLocation( Prog, "v_border_bottom" )) == -1;
+	nfail += (v_v_bg_color = glGetAttribLocation( Prog, "v_bg_color" )) == -1;
+	nfail += (v_v_shader = glGetAttribLocation( Prog, "v_shader" )) == -1;
+	nfail += (v_f_tex0 = glGetUniformLocation( Prog, "f_tex0" )) == -1;
+	if (nfail != 0)
+		Trace("Failed to bind %d variables of shader Box\n", nfail);
+
+	return nfail == 0;
+}
+
+uint32_t GLProg_Box::PlatformMask()
+{
+	return Platform_WinDesktop | Platform_LinuxDesktop;
+}
+
+xo::VertexType GLProg_Box::VertexType()
+{
+	return VertexType_NULL;
+}
+
+} // namespace xo
+
+#endif // XO_BUILD_OPENGL
+
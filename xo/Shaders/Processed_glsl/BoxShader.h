@@ -0,0 +1,38 @@
+#pragma once
+#if XO_BUILD_OPENGL
+
+#include "../../Render/RenderGL_Defs.h"
+
+namespace xo {
+
+class GLProg_Box : public GLProg
+{
+public:
+	GLProg_Box();
+	virtual void            Reset();
+	virtual const char*     VertSrc();
+	virtual const char*     FragSrc();
+	virtual const char*     Name();
+	virtual bool            LoadVariablePositions();  // Performs glGet[Uniform|Attrib]Location for all variables. Returns true if all variables are found.
+	virtual uint32_t        PlatformMask();           // Combination of Platform bits.
+	virtual xo::VertexType  VertexType();             // Only meaningful on DirectX
+
+	GLint v_mvproj;                          // uniform mat4
+	GLint v_v_corner;                        // attribute vec2
+	GLint v_v_rect;                          // attribute vec4
+	GLint v_v_border;                        // attribute vec4
+	GLint v_v_radii;                         // attribute vec4
+	GLint v_v_bguv;                          // attribute vec4
+	GLint v_v_border_left;                   // attribute vec4
+	GLint v_v_border_top;                    // attribute vec4
+	GLint v_v_border_right;                  // attribute vec4
+	GLint v_v_border_bottom;                 // attribute vec4
+	GLint v_v_bg_color;                      // attribute vec4
+	GLint v_v_shader;                        // attribute float
+	GLint v_f_tex0;                          // uniform sampler2D
+};
+
+} // namespace xo
+
+#endif // XO_BUILD_OPENGL
+
@@ -4,6 +4,7 @@
 #include "CloneHelpers.h"
 #include "Text/FontStore.h"
 #include "Render/StyleResolve.h"
+#include "../dependencies/hash/xxhash_xo_wrapper.h"
 
 namespace xo {
 
@@ -903,11 +904,39 @@ void Style::CloneSlowInto(Style& c) const {
 	c.Attribs = Attribs;
 }
 
+bool Style::Equals(const Style& b) const {
+	if (Attribs.size() != b.Attribs.size())
+		return false;
+	for (size_t i = 0; i < Attribs.size(); i++) {
+		if (Attribs[i].Key() != b.Attribs[i].Key())
+			return false;
+	}
+	return true;
+}
+
 void Style::CloneFastInto(Style& c, Pool* pool) const {
 	//Name.CloneFastInto( c.Name, pool );
 	ClonePodvecWithMemCopy(c.Attribs, Attribs, pool);
 }
 
+// Hash the fields of the attributes, in chunks, so that the unused bits don't affect the result
+static uint64_t HashAttribs(const StyleAttrib* attribs, size_t n, uint64_t seed) {
+	const size_t chunk = 64;
+	uint64_t     keys[chunk];
+	uint64_t     h = seed;
+	for (size_t i = 0; i < n; i += chunk) {
+		size_t count = std::min(n - i, chunk);
+		for (size_t j = 0; j < count; j++)
+			keys[j] = attribs[i + j].Key();
+		h = XXH64(keys, count * sizeof(uint64_t), h);
+	}
+	return h;
+}
+
+uint64_t Style::Hash(uint64_t seed) const {
+	return HashAttribs(Attribs.data, Attribs.size(), seed);
+}
+
 #define XX(name, type, setfunc, cat) \
 	\
 void Style::Set##name(type value) \
@@ -1010,6 +1039,11 @@ bool StyleSet::Contains(StyleCategories cat) const {
 	return GetSlot(cat) != 0;
 }
 
+uint64_t StyleSet::Hash() const {
+	// Every attribute carries its own category, so the lookup table adds no information
+	return HashAttribs(Attribs, Count, 0);
+}
+
 void StyleSet::MigrateLookup(const void* lutsrc, void* lutdst, GetSlotFunc getter, SetSlotFunc setter) {
 	for (int i = CatFIRST; i < CatEND; i++) {
 		int32_t slot = getter(lutsrc, (StyleCategories) i);
@@ -1114,6 +1148,7 @@ void StyleTable::AddDummyStyleZero() {
 }
 
 void StyleTable::Discard() {
+	Version++;
 	Classes.discard();
 	Names.discard();
 }
@@ -1123,6 +1158,7 @@ const StyleClass* StyleTable::GetByID(StyleClassID id) const {
 }
 
 StyleClass* StyleTable::GetOrCreate(const char* name) {
+	Version++;
 	TempString n(name);
 	// find existing
 	int* pindex = NameToIndex.getp(n);
@@ -1199,6 +1235,16 @@ void StyleTable::ExpandVerbatimVariables(Doc* doc) {
 	}
 }
 
+uint64_t StyleTable::Hash() const {
+	uint64_t h = 0;
+	for (const auto& c : Classes) {
+		const Style* pseudoGroup = c.All4PseudoTypes();
+		for (size_t i = 0; i < 4; i++)
+			h = pseudoGroup[i].Hash(h);
+	}
+	return h;
+}
+
 void StyleTable::DebugDump() const {
 	Trace("%d classes:\n", (int) NameToIndex.size());
 	for (auto it : NameToIndex)
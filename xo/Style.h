@@ -501,6 +501,10 @@ public:
 	const char* GetBackgroundImage(StringTable* strings) const;
 	FontID      GetFont() const;
 
+	// All of the meaningful fields, packed together. Two attributes are equal if their keys are equal.
+	// Use this instead of the raw bytes, which include the unused bits.
+	uint64_t Key() const { return (uint64_t) Category | ((uint64_t) SubType << 8) | ((uint64_t) Flags << 16) | ((uint64_t) ValU32 << 32); }
+
 protected:
 	void SetString(StyleCategories cat, const char* str, Doc* doc);
 	void SetU32(StyleCategories cat, uint32_t val);
@@ -543,9 +547,11 @@ public:
 		Set(a);
 	}
 
-	void Discard();
-	void CloneSlowInto(Style& c) const;
-	void CloneFastInto(Style& c, Pool* pool) const;
+	void     Discard();
+	void     CloneSlowInto(Style& c) const;
+	void     CloneFastInto(Style& c, Pool* pool) const;
+	uint64_t Hash(uint64_t seed) const;
+	bool     Equals(const Style& b) const;
 
 	bool IsEmpty() const { return Attribs.size() == 0; }
 
@@ -610,6 +616,7 @@ public:
 	void        EraseOrSetNull(StyleCategories cat) const; // If an item was already set, then Contains() will return true, but Get() will return a null StyleAttrib
 	bool        Contains(StyleCategories cat) const;
 	void        Reset();
+	uint64_t    Hash() const; // Two sets that were built by the same sequence of Set() calls have the same hash
 
 protected:
 	typedef void (*SetSlotFunc)(void* lookup, StyleCategories cat, int32_t slot);
@@ -678,6 +685,11 @@ public:
 
 /* Store all style classes in one table, that is owned by one document.
 This allows us to reference styles by a 32-bit integer ID instead of by name.
+
+The version is incremented every time a class is handed out for modification, which lets
+the renderer skip copying the table when nothing has changed. If you hold onto a StyleClass*,
+then call GetOrCreate again before you modify it. Debug builds verify, on every render sync,
+that the classes have not changed without the version changing.
 */
 class XO_API StyleTable {
 public:
@@ -692,9 +704,12 @@ public:
 	void              CloneSlowInto(StyleTable& c) const;             // Does not clone NameToIndex
 	void              CloneFastInto(StyleTable& c, Pool* pool) const; // Does not clone NameToIndex
 	void              ExpandVerbatimVariables(Doc* doc);              // Expand style $variables
+	uint64_t          Hash() const;                                   // Hash of all class styles
+	uint32_t          GetVersion() const { return Version; }
 	void              DebugDump() const;
 
 protected:
+	uint32_t                Version = 0;
 	cheapvec<String>        Names; // Names and Classes are parallel
 	cheapvec<StyleClass>    Classes;
 	ohash::map<String, int> NameToIndex;
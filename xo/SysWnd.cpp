@@ -112,6 +112,9 @@ void SysWnd::PostCursorChangedMessage() {
 void SysWnd::PostRepaintMessage() {
 }
 
+void SysWnd::PostTimersChangedMessage() {
+}
+
 bool SysWnd::CopySurfaceToImage(Box box, Image& img) {
 	return false;
 }
@@ -43,6 +43,7 @@ public:
 	virtual void  SetPosition(Box box, uint32_t setPosFlags);
 	virtual void  PostCursorChangedMessage();
 	virtual void  PostRepaintMessage();
+	virtual void  PostTimersChangedMessage(); // Wake the message loop, so that it can wait for the new earliest timer
 	virtual bool  CopySurfaceToImage(Box box, Image& img);
 
 	// Add an icon to the system tray.
@@ -3,12 +3,12 @@
 #include "DocGroup.h"
 #include "Render/RenderGL.h"
 #include "Render/RenderDX.h"
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
 
 namespace xo {
 
 SysWndLinux::SysWndLinux() {
-	EventLoopWakePipe[0] = 0;
-	EventLoopWakePipe[1] = 0;
 }
 
 SysWndLinux::~SysWndLinux() {
@@ -20,12 +20,13 @@ SysWndLinux::~SysWndLinux() {
 	}
 	XDisplay    = nullptr;
 	XDisplay_FD = -1;
-	if (EventLoopWakePipe[0]) {
-		close(EventLoopWakePipe[0]);
-		close(EventLoopWakePipe[1]);
-		EventLoopWakePipe[0] = 0;
-		EventLoopWakePipe[1] = 0;
-	}
+	// Closing these removes them from the message loop's epoll set
+	if (EventLoopWakeFD != -1)
+		close(EventLoopWakeFD);
+	if (EventLoopTimerFD != -1)
+		close(EventLoopTimerFD);
+	EventLoopWakeFD  = -1;
+	EventLoopTimerFD = -1;
 }
 
 Error SysWndLinux::Create(uint32_t createFlags) {
@@ -40,7 +41,8 @@ Error SysWndLinux::Create(uint32_t createFlags) {
 		XDisplay = nullptr;
 		return Error("no appropriate XVisual found");
 	}
-	pipe2(EventLoopWakePipe, O_NONBLOCK);
+	EventLoopWakeFD  = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	EventLoopTimerFD = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
 	XDisplay_FD = ConnectionNumber(XDisplay);
 	Trace("visual %p selected\n", (void*) VisualInfo->visualid);
 	ColorMap = XCreateColormap(XDisplay, XWindowRoot, VisualInfo->visual, AllocNone);
@@ -92,9 +94,15 @@ void SysWndLinux::PostRepaintMessage() {
 	XFlush(XDisplay);
 	printf("posting repaint msg: %u (status %d)\n", nrepaint++, r);
 	*/
-	write(EventLoopWakePipe[1], "r", 1);
+	uint64_t one = 1;
+	write(EventLoopWakeFD, &one, sizeof(one));
 	//static uint32_t nrepaint = 0;
 	//printf("posting repaint msg: %u\n", nrepaint++);
 }
 
+void SysWndLinux::PostTimersChangedMessage() {
+	uint64_t one = 1;
+	write(EventLoopWakeFD, &one, sizeof(one));
+}
+
 } // namespace xo
\ No newline at end of file
@@ -44,7 +44,9 @@ public:
 	Window       XWindow;
 	GLXContext   GLContext = nullptr;
 	XEvent       Event;
-	int          EventLoopWakePipe[2]; // read,write ends of pipe used to wake message loop's select()
+	int          EventLoopWakeFD  = -1;    // eventfd used to wake the message loop
+	int          EventLoopTimerFD = -1;    // timerfd that the message loop arms for our document's earliest timer
+	bool         IsInEventLoop    = false; // True once the message loop has registered our file descriptors
 
 	SysWndLinux();
 	~SysWndLinux() override;
@@ -53,6 +55,7 @@ public:
 	Box   GetRelativeClientRect() override;
 	void  PostCursorChangedMessage() override;
 	void  PostRepaintMessage() override;
+	void  PostTimersChangedMessage() override;
 };
 } // namespace xo
 #endif
\ No newline at end of file
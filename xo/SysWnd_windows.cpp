@@ -112,6 +112,10 @@ void SysWndWindows::PostRepaintMessage() {
 	::InvalidateRect(Wnd, nullptr, false);
 }
 
+void SysWndWindows::PostTimersChangedMessage() {
+	PostMessage(Wnd, WM_XO_TIMERS_CHANGED, 0, 0);
+}
+
 bool SysWndWindows::CopySurfaceToImage(Box box, Image& img) {
 	RECT r;
 	GetClientRect(Wnd, &r);
@@ -10,6 +10,7 @@ public:
 		WM_XO_CURSOR_CHANGED = WM_USER,
 		WM_XO_SYSTRAY_ICON,
 		WM_XO_TOUCHED_BY_OTHER_THREAD,
+		WM_XO_TIMERS_CHANGED,
 	};
 	enum {
 		SysTrayIconID = 1,
@@ -31,6 +32,7 @@ public:
 	Box   GetRelativeClientRect() override;
 	void  PostCursorChangedMessage() override;
 	void  PostRepaintMessage() override;
+	void  PostTimersChangedMessage() override;
 	bool  CopySurfaceToImage(Box box, Image& img) override;
 	void  AddToSystemTray(const char* title, bool hideInsteadOfClose) override;
 	void  ShowSystemTrayAlert(const char* msg) override;
@@ -1,11 +1,39 @@
 #include "pch.h"
 #include "FontStore.h"
 #include "../../dependencies/hash/xxhash_xo_wrapper.h"
+#include FT_TRUETYPE_TABLES_H
+#include FT_TRUETYPE_TAGS_H
+#include FT_TRUETYPE_IDS_H
 
 namespace xo {
 
-static const int  ManifestVersion = 1;
-static const char UnitSeparator   = 31;
+/* The font manifest lives in the cache directory, and maps lowercase facenames to font files.
+
+It is an open addressed hash table, which we use in place, straight out of a mapping of the file.
+The layout is
+	ManifestHeader
+	ManifestSlot[NumSlots]  NumSlots is a power of 2, and the table is at most half full
+	char[StringsSize]       Null terminated strings, referred to by their offset from the start of this block
+The file is in native byte order, since it's only a cache for this machine.
+*/
+static const uint32_t ManifestMagic   = 0x746e6678; // 'xfnt'
+static const uint32_t ManifestVersion = 2;
+
+struct ManifestHeader {
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t DirHash; // ComputeFontDirHash() at the time the manifest was built
+	uint32_t NumSlots;
+	uint32_t NumFonts;
+	uint32_t StringsSize;
+	uint32_t Reserved;
+};
+
+struct ManifestSlot {
+	uint64_t Hash;     // XXH64 of the lowercase facename
+	uint32_t Facename; // Offset of the lowercase facename. Zero if the slot is empty.
+	uint32_t Filename; // Offset of the font's path
+};
 
 FontTableImmutable::FontTableImmutable() {
 }
@@ -178,7 +206,7 @@ FontID FontStore::InsertByFacename(const char* facename) {
 		return FontIDNull;
 	}
 
-	return Insert_Internal(facename, face);
+	return Insert_Internal(facename, filename, face);
 }
 
 FontID FontStore::GetFallbackFontID() {
@@ -221,7 +249,54 @@ const Font* FontStore::GetByFacename_Internal(const char* facename) const {
 	return nullptr;
 }
 
-FontID FontStore::Insert_Internal(const char* facename, FT_Face face) {
+static uint32_t ReadBE32(const uint8_t* p) {
+	return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | (uint32_t) p[3];
+}
+
+// Identifies a font in the persistent glyph cache, by the contents of its file.
+// For sfnt fonts (TrueType, OpenType, and collections of them), we only hash the table directory and
+// head.checkSumAdjustment. The directory holds a checksum of every table, so this identifies the
+// contents without reading them, and only the first page of the mapping is touched.
+// Other formats are rare enough that we hash the whole file.
+// Our tweaks are mixed in, because they change the rasterized glyphs.
+static uint64_t HashFontFile(const char* filename, const Font& font) {
+	MappedFile file;
+	if (!file.Open(filename))
+		return 0;
+	const uint8_t* d    = file.Data;
+	size_t         size = file.Size;
+	uint64_t       seed = ((uint64_t) font.FTFace->face_index << 32) | (uint32_t) font.MaxAutoHinterSize;
+
+	size_t dir = 0; // Offset of the sfnt offset table
+	if (size >= 16 && ReadBE32(d) == 0x74746366) { // 'ttcf'
+		uint32_t numFonts = ReadBE32(d + 8);
+		if ((uint64_t) font.FTFace->face_index < numFonts && 12 + 4 * (size_t) numFonts <= size)
+			dir = ReadBE32(d + 12 + 4 * font.FTFace->face_index);
+		else
+			dir = size;
+	}
+
+	uint64_t h = 0;
+	if (dir + 12 <= size) {
+		uint32_t version   = ReadBE32(d + dir);
+		size_t   numTables = ((size_t) d[dir + 4] << 8) | d[dir + 5];
+		size_t   dirSize   = 12 + 16 * numTables;
+		if ((version == 0x00010000 || version == 0x74727565 || version == 0x4f54544f) && dir + dirSize <= size) { // 1.0, 'true', 'OTTO'
+			h = XXH64(d + dir, dirSize, seed);
+			for (size_t i = 0; i < numTables; i++) {
+				const uint8_t* rec    = d + dir + 12 + 16 * i;
+				uint32_t       offset = ReadBE32(rec + 8);
+				if (ReadBE32(rec) == 0x68656164 && (uint64_t) offset + 12 <= size) // 'head'
+					h = XXH64(d + offset + 8, 4, h);
+			}
+		}
+	}
+	if (h == 0)
+		h = XXH64(d, size, seed);
+	return h != 0 ? h : 1;
+}
+
+FontID FontStore::Insert_Internal(const char* facename, const char* filename, FT_Face face) {
 	Font* font     = new Font();
 	font->Facename = facename;
 	font->FTFace   = face;
@@ -232,6 +307,9 @@ FontID FontStore::Insert_Internal(const char* facename, FT_Face face) {
 	FacenameToFontID.insert(low, font->ID);
 	LoadFontConstants(*font);
 	LoadFontTweaks(*font);
+	LoadKerning(*font);
+	if (Global()->EnableGlyphDiskCache)
+		font->FileHash = HashFontFile(filename, *font);
 	return font->ID;
 }
 
@@ -294,24 +372,75 @@ void FontStore::LoadFontTweaks(Font& font) {
 	//	font.MaxAutoHinterSize = 50;
 }
 
+// Copy the horizontal kerning pairs out of the TrueType 'kern' table, so that layout never needs
+// to call FT_Get_Kerning, which does a binary search per pair, and needs the face's lock.
+// We interpret the table in the same way as Freetype: we only read format 0 subtables, and
+// an override subtable replaces the sum of the subtables before it.
+// Fonts that only have GPOS kerning have no 'kern' table, and Freetype ignores those too.
+void FontStore::LoadKerning(Font& font) {
+	font.Kerning.clear();
+	if (!FT_HAS_KERNING(font.FTFace))
+		return;
+
+	FT_ULong size = 0;
+	if (FT_Load_Sfnt_Table(font.FTFace, TTAG_kern, 0, nullptr, &size) != 0 || size < 4)
+		return;
+	cheapvec<uint8_t> table;
+	table.resize(size);
+	if (FT_Load_Sfnt_Table(font.FTFace, TTAG_kern, 0, table.data, &size) != 0)
+		return;
+
+	auto u16 = [](const uint8_t* p) -> uint32_t { return ((uint32_t) p[0] << 8) | p[1]; };
+
+	const uint8_t* p         = table.data;
+	const uint8_t* end       = table.data + size;
+	uint32_t       numTables = std::min(u16(p + 2), (uint32_t) 32);
+	p += 4;
+	for (uint32_t t = 0; t < numTables && p + 6 <= end; t++) {
+		uint32_t length   = u16(p + 2);
+		uint32_t coverage = u16(p + 4);
+		if (length <= 6 + 8)
+			break;
+		const uint8_t* next = std::min(p + length, end);
+
+		bool isHorizontal = (coverage & 3) == 1;
+		bool isFormat0    = (coverage >> 8) == 0;
+		if (isHorizontal && isFormat0 && p + 14 <= next) {
+			uint32_t       numPairs = std::min(u16(p + 6), (uint32_t) (next - (p + 14)) / 6);
+			const uint8_t* pair     = p + 14;
+			for (uint32_t i = 0; i < numPairs; i++, pair += 6) {
+				uint32_t key   = Font::KerningKey(u16(pair), u16(pair + 2));
+				int16_t  value = (int16_t) u16(pair + 4);
+				int16_t* prev  = font.Kerning.getp(key);
+				if (prev == nullptr)
+					font.Kerning.insert(key, value);
+				else if (coverage & 8)
+					*prev = value;
+				else
+					*prev += value;
+			}
+		}
+		p = next;
+	}
+	XOTRACE_FONTS("Font %s has %d kerning pairs\n", font.Facename.Z, (int) font.Kerning.size());
+}
+
 const char* FontStore::GetFilenameFromFacename(const char* facename) {
 	if (!IsFontTableLoaded) {
-		if (!LoadFontTable())
+		if (!LoadFontTable(ManifestFilename()))
 			BuildAndSaveFontTable();
+		if (!IsFontTableLoaded)
+			return nullptr;
 	}
 
 	String name = facename;
 	name.MakeLower();
-	String* fn = FacenameToFilename.getp(name);
+	const char* fn = FindInManifest(name.CStr());
 	if (fn != nullptr)
-		return fn->Z;
+		return fn;
 
 	name += " regular";
-	fn = FacenameToFilename.getp(name);
-	if (fn != nullptr)
-		return fn->Z;
-
-	return nullptr;
+	return FindInManifest(name.CStr());
 
 	/*
 	// We need to build a cache here and save it to disk.
@@ -337,6 +466,133 @@ const char* FontStore::GetFilenameFromFacename(const char* facename) {
 	*/
 }
 
+// Reads the family and style names out of the 'name' table of the first face inside a TrueType or
+// OpenType file, or collection. We pick the same name records that Freetype does for family_name and
+// style_name, and reduce them to ASCII the same way, so the facenames match the ones we would get
+// from an FT_Face. Creating an FT_Face reads a lot more of the file than we need.
+// Returns false if the file is not an sfnt, or if it has no family name, in which case the caller
+// should ask Freetype.
+static bool ReadSfntNames(const uint8_t* file, size_t size, std::string& family, std::string& style) {
+	auto u16 = [](const uint8_t* p) -> uint32_t { return ((uint32_t) p[0] << 8) | p[1]; };
+	auto u32 = [](const uint8_t* p) -> uint32_t { return ((uint32_t) p[0] << 24) | ((uint32_t) p[1] << 16) | ((uint32_t) p[2] << 8) | p[3]; };
+
+	if (size < 12)
+		return false;
+	size_t font = 0;
+	if (u32(file) == TTAG_ttcf) {
+		if (u32(file + 8) == 0 || size < 16)
+			return false;
+		font = u32(file + 12);
+		if (font > size - 12)
+			return false;
+	}
+	uint32_t version = u32(file + font);
+	if (version != 0x00010000 && version != TTAG_OTTO && version != TTAG_true)
+		return false;
+
+	uint32_t numTables = u16(file + font + 4);
+	if (numTables > (size - font - 12) / 16)
+		return false;
+	size_t name    = 0;
+	size_t nameLen = 0;
+	for (uint32_t i = 0; i < numTables; i++) {
+		const uint8_t* rec = file + font + 12 + i * 16;
+		if (u32(rec) == TTAG_name) {
+			name    = u32(rec + 8);
+			nameLen = u32(rec + 12);
+			break;
+		}
+	}
+	if (name == 0 || name > size || nameLen > size - name || nameLen < 6)
+		return false;
+
+	const uint8_t* table   = file + name;
+	uint32_t       count   = std::min(u16(table + 2), (uint32_t) (nameLen - 6) / 12);
+	size_t         strings = u16(table + 4);
+
+	// Rank the records in the same order of preference as Freetype: US English Windows names, then any
+	// other English Windows names, then English Apple names, then Apple Roman names, then any Windows name.
+	auto rank = [&](const uint8_t* rec) -> int {
+		uint32_t platform = u16(rec);
+		uint32_t encoding = u16(rec + 2);
+		uint32_t language = u16(rec + 4);
+		if (platform == TT_PLATFORM_MICROSOFT) {
+			if (encoding != TT_MS_ID_SYMBOL_CS && encoding != TT_MS_ID_UNICODE_CS && encoding != TT_MS_ID_UCS_4)
+				return 0;
+			if (language == TT_MS_LANGID_ENGLISH_UNITED_STATES)
+				return 5;
+			return (language & 0x3FF) == 0x009 ? 4 : 1;
+		} else if (platform == TT_PLATFORM_MACINTOSH || platform == TT_PLATFORM_APPLE_UNICODE) {
+			if (language == TT_MAC_LANGID_ENGLISH)
+				return 3;
+			return encoding == TT_MAC_ID_ROMAN ? 2 : 0;
+		}
+		return 0;
+	};
+
+	auto readName = [&](uint32_t nameID, std::string& out) -> bool {
+		const uint8_t* best     = nullptr;
+		int            bestRank = 0;
+		for (uint32_t i = 0; i < count; i++) {
+			const uint8_t* rec = table + 6 + i * 12;
+			if (u16(rec + 6) != nameID || u16(rec + 8) == 0)
+				continue;
+			int r = rank(rec);
+			if (r > bestRank) {
+				best     = rec;
+				bestRank = r;
+			}
+		}
+		if (best == nullptr)
+			return false;
+
+		size_t len = u16(best + 8);
+		size_t at  = strings + u16(best + 10);
+		if (at > nameLen || len > nameLen - at)
+			return false;
+		const uint8_t* str = table + at;
+
+		// Freetype reduces names to printable ASCII, with '?' in place of everything else, and stops at
+		// the first null. Mac names are 8 bit, and the others are UTF-16BE. Each UTF-16 unit is converted
+		// on its own, so a surrogate pair becomes two question marks.
+		bool   wide = u16(best) != TT_PLATFORM_MACINTOSH;
+		size_t step = wide ? 2 : 1;
+		out.clear();
+		for (size_t i = 0; i + step <= len; i += step) {
+			uint32_t code = wide ? u16(str + i) : str[i];
+			if (code == 0)
+				break;
+			out += code < 32 || code > 127 ? '?' : (char) code;
+		}
+		return !out.empty();
+	};
+
+	if (!readName(TT_NAME_ID_TYPOGRAPHIC_FAMILY, family) && !readName(TT_NAME_ID_FONT_FAMILY, family))
+		return false;
+	if (!readName(TT_NAME_ID_TYPOGRAPHIC_SUBFAMILY, style) && !readName(TT_NAME_ID_FONT_SUBFAMILY, style))
+		style.clear();
+	return true;
+}
+
+struct FontScan {
+	const cheapvec<String>* Files;
+	cheapvec<String>*       Facenames; // Empty if we could not read the names, in which case we ask Freetype
+};
+
+static void FontScanJob(void* context, int job, int thread) {
+	FontScan*  scan = (FontScan*) context;
+	MappedFile file;
+	if (!file.Open((*scan->Files)[job].CStr()))
+		return;
+	std::string family, style;
+	if (ReadSfntNames(file.Data, file.Size, family, style))
+		(*scan->Facenames)[job] = (family + " " + style).c_str();
+}
+
+String FontStore::ManifestFilename() {
+	return Global()->CacheDir + XO_DIR_SEP_STR + "fonts";
+}
+
 void FontStore::BuildAndSaveFontTable() {
 	Trace("Building font table on %d directories\n", (int) Directories.size());
 
@@ -351,98 +607,131 @@ void FontStore::BuildAndSaveFontTable() {
 		FindFiles(Directories[i].CStr(), cb);
 	}
 
-	String cacheFile = Global()->CacheDir + XO_DIR_SEP_STR + "fonts";
-	FILE*  manifest  = fopen(cacheFile.CStr(), "wb");
-	if (manifest == nullptr) {
-		Trace("Failed to open font cache file %s. Aborting.\n", cacheFile.CStr());
-		XO_DIE_MSG("Failed to open font cache file");
-	}
-	fprintf(manifest, "%d\n", ManifestVersion);
-	fprintf(manifest, "%llu\n", (long long unsigned) ComputeFontDirHash());
+	// Most of the time goes into waiting for the disk, so this is worth spreading out even when the files are few
+	cheapvec<String> facenames;
+	facenames.resize(files.size());
+	FontScan scan;
+	scan.Files     = &files;
+	scan.Facenames = &facenames;
+	RunJobsInParallel((int) files.size(), Global()->NumWorkerThreads + 1, &scan, FontScanJob);
 
+	// The first file with a given facename wins
+	ohash::map<String, String> table;
 	for (size_t i = 0; i < files.size(); i++) {
-		FT_Face  face;
-		FT_Error e = FT_New_Face(FTLibrary, files[i].CStr(), 0, &face);
-		if (e == 0) {
-			String facename     = face->family_name;
-			String style        = face->style_name;
-			String fullFacename = facename + " " + style;
-			fprintf(manifest, "%s%c%s\n", files[i].CStr(), UnitSeparator, fullFacename.CStr());
+		if (facenames[i].IsEmpty()) {
+			FT_Face  face;
+			FT_Error e = FT_New_Face(FTLibrary, files[i].CStr(), 0, &face);
+			if (e != 0) {
+				Trace("Failed to load font (filename=%s)\n", files[i].CStr());
+				continue;
+			}
+			facenames[i] = String(face->family_name) + " " + face->style_name;
 			FT_Done_Face(face);
-		} else {
-			Trace("Failed to load font (filename=%s)\n", files[i].CStr());
 		}
+		XOTRACE_FONTS("Font %s -> %s\n", facenames[i].CStr(), files[i].CStr());
+		facenames[i].MakeLower();
+		table.insert(facenames[i], files[i]);
 	}
 
-	fclose(manifest);
+	ManifestHeader head;
+	memset(&head, 0, sizeof(head));
+	head.Magic    = ManifestMagic;
+	head.Version  = ManifestVersion;
+	head.DirHash  = ComputeFontDirHash();
+	head.NumFonts = (uint32_t) table.size();
+	head.NumSlots = 16;
+	while (head.NumSlots < head.NumFonts * 2)
+		head.NumSlots *= 2;
+
+	cheapvec<ManifestSlot> slots;
+	slots.resize(head.NumSlots);
+	cheapvec<char> strings;
+	strings += 0; // A zero offset marks an empty slot
+	uint32_t mask = head.NumSlots - 1;
+	for (auto& it : table) {
+		uint64_t hash = XXH64(it.first.CStr(), it.first.Length(), 0);
+		uint32_t i    = (uint32_t) hash & mask;
+		while (slots[i].Facename != 0)
+			i = (i + 1) & mask;
+		slots[i].Hash     = hash;
+		slots[i].Facename = (uint32_t) strings.size();
+		strings.addn(it.first.CStr(), it.first.Length() + 1);
+		slots[i].Filename = (uint32_t) strings.size();
+		strings.addn(it.second.CStr(), it.second.Length() + 1);
+	}
+	head.StringsSize = (uint32_t) strings.size();
 
-	LoadFontTable();
+	// Write to a temporary file and move it into place, because other xo processes may have the manifest mapped,
+	// and they will keep seeing the old file until they unmap it.
+	String cacheFile = ManifestFilename();
+	String tempFile  = cacheFile + ".tmp";
+	FILE*  manifest  = fopen(tempFile.CStr(), "wb");
+	if (manifest == nullptr) {
+		Trace("Failed to open font cache file %s. Aborting.\n", tempFile.CStr());
+		XO_DIE_MSG("Failed to open font cache file");
+	}
+	bool ok = fwrite(&head, sizeof(head), 1, manifest) == 1;
+	ok      = ok && fwrite(slots.data, sizeof(ManifestSlot), slots.size(), manifest) == slots.size();
+	ok      = ok && fwrite(strings.data, 1, strings.size(), manifest) == strings.size();
+	ok      = fclose(manifest) == 0 && ok;
+
+	Manifest.Close();
+	if (!ok || !RenameFile(tempFile.CStr(), cacheFile.CStr())) {
+		// Windows won't replace a file that another process has mapped, so we use our new file where it is
+		Trace("Failed to replace font cache file %s\n", cacheFile.CStr());
+		if (LoadFontTable(tempFile))
+			return;
+	}
+
+	LoadFontTable(cacheFile);
 }
 
-bool FontStore::LoadFontTable() {
+bool FontStore::LoadFontTable(const String& filename) {
 	XOTRACE_FONTS("LoadFontTable enter\n");
 
-	FacenameToFilename.clear();
-	FILE* manifest = fopen((Global()->CacheDir + XO_DIR_SEP_STR + "fonts").CStr(), "rb");
-	if (manifest == nullptr)
+	IsFontTableLoaded = false;
+	if (!Manifest.Open(filename.CStr()))
 		return false;
 
-	XOTRACE_FONTS("LoadFontTable file loaded\n");
-
-	int      version = 0;
-	uint64_t hash    = 0;
-	bool     ok      = true;
-	ok               = ok && 1 == fscanf(manifest, "%d\n", &version);
-	ok               = ok && 1 == fscanf(manifest, "%llu\n", (long long unsigned*) &hash);
-	if (version != ManifestVersion || hash != ComputeFontDirHash()) {
-		fclose(manifest);
+	XOTRACE_FONTS("LoadFontTable file mapped\n");
+
+	// We only validate the overall layout here. The offsets inside the slots are checked as we probe them.
+	const ManifestHeader* head = (const ManifestHeader*) Manifest.Data;
+	bool                  ok   = Manifest.Size >= sizeof(ManifestHeader);
+	ok                         = ok && head->Magic == ManifestMagic && head->Version == ManifestVersion;
+	ok                         = ok && head->NumSlots != 0 && (head->NumSlots & (head->NumSlots - 1)) == 0;
+	ok                         = ok && head->StringsSize != 0;
+	ok                         = ok && Manifest.Size == sizeof(ManifestHeader) + (uint64_t) head->NumSlots * sizeof(ManifestSlot) + head->StringsSize;
+	ok                         = ok && Manifest.Data[Manifest.Size - 1] == 0;
+	if (!ok || head->DirHash != ComputeFontDirHash()) {
+		Manifest.Close();
 		return false;
 	}
 
-	XOTRACE_FONTS("LoadFontTable version & hash good\n");
-
-	// Read the rest of the file into one buffer
-	cheapvec<char> remain;
-	{
-		char   buf[1024];
-		size_t nbytes = 0;
-		while ((nbytes = fread(buf, 1, sizeof(buf), manifest)) != 0)
-			remain.addn(buf, nbytes);
-	}
-
-	fclose(manifest);
-
-	// Parse the contents out line by line, using character 31 as a field separator
-	const char* buf       = &remain[0];
-	size_t      lineStart = 0;
-	size_t      term1     = 0;
-	for (size_t i = 0; true; i++) {
-		if (i == remain.size() || buf[i] == '\n') {
-			if (i - term1 > 1) {
-				String path, facename;
-				path.Set(buf + lineStart, term1 - lineStart);
-				facename.Set(buf + term1 + 1, i - term1 - 1);
-				XOTRACE_FONTS("Font %s -> %s\n", facename.CStr(), path.CStr());
-				facename.MakeLower();
-				//Trace("Font %s -> %s\n", facename.CStr(), path.CStr());
-				FacenameToFilename.insert(facename, path);
-			}
-			lineStart = i + 1;
-			term1     = lineStart;
-		}
-		if (i == remain.size())
-			break;
-		if (buf[i] == UnitSeparator)
-			term1 = i;
-	}
-
 	IsFontTableLoaded = true;
 
-	XOTRACE_FONTS("LoadFontTable success (%d fonts)\n", FacenameToFilename.size());
+	XOTRACE_FONTS("LoadFontTable success (%d fonts)\n", (int) head->NumFonts);
 
 	return true;
 }
 
+// facename must be lowercase
+const char* FontStore::FindInManifest(const char* facename) const {
+	const ManifestHeader* head    = (const ManifestHeader*) Manifest.Data;
+	const ManifestSlot*   slots   = (const ManifestSlot*) (head + 1);
+	const char*           strings = (const char*) (slots + head->NumSlots);
+	uint64_t              hash    = XXH64(facename, strlen(facename), 0);
+	uint32_t              mask    = head->NumSlots - 1;
+	for (uint32_t i = (uint32_t) hash & mask, n = 0; n < head->NumSlots; i = (i + 1) & mask, n++) {
+		const ManifestSlot& slot = slots[i];
+		if (slot.Facename == 0 || slot.Facename >= head->StringsSize || slot.Filename >= head->StringsSize)
+			break;
+		if (slot.Hash == hash && strcmp(strings + slot.Facename, facename) == 0)
+			return strings + slot.Filename;
+	}
+	return nullptr;
+}
+
 uint64_t FontStore::ComputeFontDirHash() {
 	auto hstate = XXH64_createState();
 	XXH64_reset(hstate, 0);
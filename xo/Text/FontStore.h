@@ -81,20 +81,23 @@ private:
 	cheapvec<Font*>              Fonts;
 	cheapvec<String>             Directories;
 	ohash::map<String, FontID>   FacenameToFontID;   // Facename is lowercase
-	ohash::map<String, String>   FacenameToFilename; // Facename is lowercase
+	MappedFile                   Manifest;           // Facename -> filename. See FontStore.cpp for the layout.
 	ohash::map<uint32_t, FontID> CacheByWeight;      // accelerate FontID + Weight lookups, so we don't need to go via the Facename for ("Segoe UI", 700) -> "SegoeUI Bold"
 	FT_Library                   FTLibrary;
 	bool                         IsFontTableLoaded;
 
 	const Font* GetByFacename_Internal(const char* facename) const;
-	FontID      Insert_Internal(const char* facename, FT_Face face);
+	FontID      Insert_Internal(const char* facename, const char* filename, FT_Face face);
 	void        LoadFontConstants(Font& font);
 	void        LoadFontTweaks(Font& font);
+	void        LoadKerning(Font& font);
 	const char* GetFilenameFromFacename(const char* facename);
 	void        BuildAndSaveFontTable();
-	bool        LoadFontTable();
+	bool        LoadFontTable(const String& filename);
+	const char* FindInManifest(const char* facename) const;
 	uint64_t    ComputeFontDirHash();
 
-	static bool IsFontFilename(const char* filename);
+	static String ManifestFilename();
+	static bool   IsFontFilename(const char* filename);
 };
 } // namespace xo
@@ -1,7 +1,9 @@
 #include "pch.h"
 #include "GlyphCache.h"
 #include "FontStore.h"
-#include "Render/TextureAtlas.h"
+#include "../Render/RenderBase.h"
+#include "../../dependencies/hash/xxhash_xo_wrapper.h"
+#include FT_OUTLINE_H
 
 namespace xo {
 
@@ -14,68 +16,115 @@ namespace xo {
 static const uint32_t SubPixelHintKillShift      = 0;
 static const uint32_t SubPixelHintKillMultiplier = (1 << SubPixelHintKillShift);
 
-// GCC 4.6 for Android forces us to set the value of this constant in the .cpp file, not in the .h file.
-const uint32_t GlyphCache::NullGlyphIndex = 0; // Our first element in 'Glyphs' is always the null glyph
+/* The persistent glyph cache, at CacheDir/glyphs
 
-GlyphCache::GlyphCache() {
-	Initialize();
-}
+This is an open addressed hash table, which we use in place, straight out of a mapping of the file.
+	DiskHeader
+	DiskSlot[NumSlots]   NumSlots is a power of 2, and the table is at most half full
+	uint8_t[PixelsSize]  The bitmap of every glyph, Width x Height, tightly packed
+Glyphs are keyed on Font::FileHash, because FontIDs change from one run to the next. That hash
+identifies the contents of the font file from its sfnt table directory (see HashFontFile).
+Everything else that changes the output of Rasterize, such as the text gamma, goes into SettingsHash,
+and we ignore the file if that doesn't match. Only the header is checked when the file is opened.
+Each slot is checked when we read it.
+We store the bitmaps of individual glyphs, and not whole atlases, so that a run only uploads the
+glyphs that it draws, and compaction is free to repack the atlases.
+The file is in native byte order, since it's only a cache for this machine.
+*/
+static const uint32_t DiskMagic     = 0x68706c67; // 'glph'
+static const uint32_t DiskVersion   = 1;
+static const uint32_t MaxDiskGlyphs = 32768; // Glyphs from previous runs accumulate in the file, up to this limit
 
-GlyphCache::~GlyphCache() {
-}
+struct DiskHeader {
+	uint32_t Magic;
+	uint32_t Version;
+	uint64_t SettingsHash;
+	uint32_t NumSlots;
+	uint32_t NumGlyphs;
+	uint32_t PixelsSize;
+	uint32_t Reserved;
+};
 
-void GlyphCache::Clear() {
-	for (size_t i = 0; i < Atlasses.size(); i++)
-		Atlasses[i]->Free();
-	DeleteAll(Atlasses);
-	Glyphs.clear();
-	Table.clear();
-	Initialize();
-}
+struct DiskKey {
+	uint64_t FontHash; // Font::FileHash. Zero if the slot is empty.
+	uint32_t Char;
+	uint8_t  Size;
+	uint8_t  Flags;
+	uint16_t Reserved;
+};
 
-void GlyphCache::Initialize() {
-	NullGlyph.SetNull();
-	Glyphs += Glyph();
-	Glyphs.back().SetNull();
+struct GlyphCache::DiskSlot {
+	DiskKey      Key;
+	GlyphMetrics Metrics;
+	uint16_t     Width;
+	uint16_t     Height;
+	uint32_t     Pixels; // Offset of the bitmap from the start of the pixels
+};
+
+static DiskKey MakeDiskKey(uint64_t fontHash, const GlyphCacheKey& key) {
+	DiskKey k;
+	memset(&k, 0, sizeof(k));
+	k.FontHash = fontHash;
+	k.Char     = key.Char;
+	k.Size     = key.Size;
+	k.Flags    = key.Flags;
+	return k;
 }
 
-const Glyph* GlyphCache::GetGlyph(const GlyphCacheKey& key) const {
-	uint32_t* pos = Table.getp(key);
-	if (pos != nullptr)
-		return &Glyphs[*pos];
-	else
-		return nullptr;
+static uint64_t HashDiskKey(const DiskKey& k) {
+	return XXH64(&k, sizeof(k), 0);
 }
 
-const Glyph* GlyphCache::GetOrRenderGlyph(const GlyphCacheKey& key) {
-	auto g = GetGlyph(key);
-	if (g)
-		return g;
-	RenderGlyph(key);
-	return GetGlyph(key);
+static bool IsBitmapInside(uint32_t offset, uint16_t width, uint16_t height, uint32_t pixelsSize) {
+	return width <= GlyphAtlasSize && height <= GlyphAtlasSize && (uint64_t) offset + width * height <= pixelsSize;
 }
 
-uint32_t GlyphCache::RenderGlyph(const GlyphCacheKey& key) {
-	XOTRACE_FONTS("RenderGlyph %d\n", (int) key.Char);
+static String DiskCacheFilename() {
+	return Global()->CacheDir + XO_DIR_SEP_STR + "glyphs";
+}
 
-	XO_ASSERT(key.Size != 0);
-	const Font*                 font = Global()->FontStore->GetByFontID(key.FontID);
-	std::lock_guard<std::mutex> lock(font->FTFace_Lock);
+// Everything, besides the font and the GlyphCacheKey, that changes the glyphs that we rasterize
+static uint64_t DiskSettingsHash() {
+	struct {
+		uint32_t SlotSize;
+		int32_t  FreetypeVersion[3];
+		uint32_t SubPixelHintKillShift;
+		uint32_t UseFreetypeSubpixel;
+		float    SubPixelTextGamma;
+		float    WholePixelTextGamma;
+	} s;
+	memset(&s, 0, sizeof(s));
+	s.SlotSize              = sizeof(DiskKey) + sizeof(GlyphMetrics);
+	s.FreetypeVersion[0]    = FREETYPE_MAJOR;
+	s.FreetypeVersion[1]    = FREETYPE_MINOR;
+	s.FreetypeVersion[2]    = FREETYPE_PATCH;
+	s.SubPixelHintKillShift = SubPixelHintKillShift;
+	s.UseFreetypeSubpixel   = Global()->UseFreetypeSubpixel;
+	s.SubPixelTextGamma     = Global()->SubPixelTextGamma;
+	s.WholePixelTextGamma   = Global()->WholePixelTextGamma;
+	return XXH64(&s, sizeof(s), 0);
+}
 
-	FT_UInt iFTGlyph = FT_Get_Char_Index(font->FTFace, key.Char);
+// Load a glyph into the face's glyph slot, optionally rasterizing it. Caller must hold font->FTFace_Lock.
+// horzMultiplier is the factor by which the glyph has been stretched horizontally.
+static bool LoadFTGlyph(const Font* font, const GlyphCacheKey& key, bool render, FT_UInt& iFTGlyph, int32_t& horzMultiplier) {
+	iFTGlyph = FT_Get_Char_Index(font->FTFace, key.Char);
 
 	bool isSubPixel    = GlyphFlag_IsSubPixel(key.Flags);
 	bool useFTSubpixel = isSubPixel && Global()->UseFreetypeSubpixel;
 
-	uint32_t pixSize                = key.Size;
-	int32_t  combinedHorzMultiplier = 1;
+	uint32_t pixSize = key.Size;
+	horzMultiplier   = 1;
 	if (isSubPixel)
-		combinedHorzMultiplier = SubPixelHintKillMultiplier * (useFTSubpixel ? 1 : 3);
+		horzMultiplier = SubPixelHintKillMultiplier * (useFTSubpixel ? 1 : 3);
 
-	FT_Error e = FT_Set_Pixel_Sizes(font->FTFace, combinedHorzMultiplier * pixSize, pixSize);
+	FT_Error e = FT_Set_Pixel_Sizes(font->FTFace, horzMultiplier * pixSize, pixSize);
 	XO_ASSERT(e == 0);
 
-	uint32_t ftflags = FT_LOAD_RENDER | FT_LOAD_LINEAR_DESIGN;
+	uint32_t ftflags = FT_LOAD_LINEAR_DESIGN;
+	if (render)
+		ftflags |= FT_LOAD_RENDER;
+
 	// See FontStore::LoadFontTweaks for details of why we have this "MaxAutoHinterSize"
 	if (isSubPixel && pixSize <= font->MaxAutoHinterSize)
 		ftflags |= FT_LOAD_FORCE_AUTOHINT;
@@ -86,10 +135,300 @@ uint32_t GlyphCache::RenderGlyph(const GlyphCacheKey& key) {
 	e = FT_Load_Glyph(font->FTFace, iFTGlyph, ftflags);
 	if (e != 0) {
 		Trace("Failed to load glyph for character %d (%d)\n", key.Char, iFTGlyph);
-		Table.insert(key, NullGlyphIndex);
-		return NullGlyphIndex;
+		return false;
+	}
+	return true;
+}
+
+// Read the metrics of the glyph in the face's glyph slot. This produces the same numbers whether
+// or not the glyph has been rasterized, which is what allows layout to skip the rasterization.
+static void ReadMetrics(const Font* font, const GlyphCacheKey& key, FT_UInt iFTGlyph, int32_t horzMultiplier, GlyphMetrics& m) {
+	FT_GlyphSlot slot = font->FTFace->glyph;
+
+	int32_t left = 0;
+	int32_t top  = 0;
+	if (slot->format == FT_GLYPH_FORMAT_OUTLINE) {
+		// This is the grid fitting that Freetype's rasterizer performs when it positions the bitmap.
+		// We don't set an LCD filter, so Freetype doesn't add any padding to the bitmap.
+		FT_BBox cbox;
+		FT_Outline_Get_CBox(&slot->outline, &cbox);
+		FT_Pos xMin = cbox.xMin & -64;
+		FT_Pos yMin = cbox.yMin & -64;
+		FT_Pos xMax = (cbox.xMax + 63) & -64;
+		FT_Pos yMax = (cbox.yMax + 63) & -64;
+		left        = (int32_t) (xMin >> 6);
+		top         = (int32_t) (yMax >> 6);
+		m.HasPixels = xMax != xMin || yMax != yMin;
+	} else {
+		left        = slot->bitmap_left;
+		top         = slot->bitmap_top;
+		m.HasPixels = (slot->bitmap.width | slot->bitmap.rows) != 0;
+	}
+
+	m.FTGlyphIndex            = iFTGlyph;
+	m.MetricLeft              = left / horzMultiplier;
+	m.MetricLeftx256          = left * 256 / horzMultiplier;
+	m.MetricTop               = top;
+	m.MetricWidth             = (uint16_t)(slot->metrics.width / (64 * horzMultiplier));
+	m.MetricHoriAdvance       = slot->advance.x / (64 * horzMultiplier);
+	m.MetricLinearHoriAdvance = (slot->linearHoriAdvance * (int32_t) key.Size) / (float) font->FTFace->units_per_EM;
+}
+
+const Glyph* GlyphTable::UseGlyph(const GlyphCacheKey& key) const {
+	const Glyph* g = Glyphs.getp(key);
+	if (g == nullptr)
+		return nullptr;
+	// Every thread that touches this glyph during a frame writes the same value
+	uint32_t frame = Frame->load(std::memory_order_relaxed);
+	if (g->LastUsed.Load() != frame)
+		g->LastUsed.Store(frame);
+	return g;
+}
+
+const GlyphMetrics* GlyphTable::GetMetrics(const GlyphCacheKey& key) const {
+	const Glyph* g = Glyphs.getp(key);
+	if (g != nullptr)
+		return g;
+	return Metrics.getp(key);
+}
+
+GlyphCache::GlyphCache() {
+	Frame = 0;
+	Initialize();
+}
+
+GlyphCache::~GlyphCache() {
+}
+
+void GlyphCache::Clear() {
+	SpareTextures.clear();
+	PendingUploads.clear();
+	Requested.clear();
+	Measured.clear();
+	NumAtlasesAfterCompact = 0;
+	AtlasEpoch++;
+	Initialize();
+}
+
+void GlyphCache::Initialize() {
+	Publish(std::make_shared<GlyphTable>());
+}
+
+GlyphTableRef GlyphCache::GetTable() const {
+	return std::atomic_load(&Current);
+}
+
+void GlyphCache::Publish(std::shared_ptr<GlyphTable> table) {
+	table->Frame = &Frame;
+	std::atomic_store(&Current, GlyphTableRef(table));
+}
+
+void GlyphCache::RenderGlyphs(const ohash::set<GlyphCacheKey>& keys) {
+	GlyphTableRef table = GetTable();
+
+	cheapvec<GlyphCacheKey> missing;
+	for (const auto& key : keys) {
+		if (table->GetGlyph(key) == nullptr)
+			missing += key;
+	}
+	if (missing.size() == 0)
+		return;
+
+	// Split the glyphs up by font, because a Freetype face can only be used by one thread at a time
+	std::sort(missing.data, missing.data + missing.size(), [](const GlyphCacheKey& a, const GlyphCacheKey& b) {
+		return a.FontID != b.FontID ? a.FontID < b.FontID : a.Size < b.Size;
+	});
+	Batch batch;
+	batch.Cache = this;
+	batch.Glyphs.resize(missing.size());
+	for (size_t i = 0; i < missing.size(); i++) {
+		batch.Glyphs[i].Key = missing[i];
+		if (i == 0 || missing[i].FontID != missing[i - 1].FontID)
+			batch.JobStart += (uint32_t) i;
+	}
+	int numJobs = (int) batch.JobStart.size();
+	batch.JobStart += (uint32_t) missing.size();
+
+	RunJobsInParallel(numJobs, Global()->NumWorkerThreads + 1, &batch, RasterizeJob);
+
+	std::lock_guard<std::mutex> lock(WriteLock);
+	auto                        next = std::make_shared<GlyphTable>(*GetTable());
+	for (const auto& r : batch.Glyphs) {
+		// Somebody else might have beaten us to it
+		if (!next->Glyphs.contains(r.Key)) {
+			Insert(*next, r);
+			if (r.FromDisk)
+				Stats.NumLoaded++;
+		}
+	}
+	Publish(next);
+}
+
+void GlyphCache::RequestGlyphs(const ohash::set<GlyphCacheKey>& keys) {
+	bool queue = false;
+	{
+		std::lock_guard<std::mutex> lock(QueueLock);
+		for (const auto& key : keys)
+			Requested.insert(key);
+		if (!IsDrainQueued && Requested.size() != 0) {
+			IsDrainQueued = true;
+			queue         = true;
+		}
+	}
+	if (queue)
+		Global()->JobQueue.Add({this, DrainJob});
+}
+
+void GlyphCache::DrainJob(void* cache) {
+	GlyphCache* self = (GlyphCache*) cache;
+	while (true) {
+		ohash::set<GlyphCacheKey> keys;
+		{
+			std::lock_guard<std::mutex> lock(self->QueueLock);
+			if (self->Requested.size() == 0) {
+				self->IsDrainQueued = false;
+				return;
+			}
+			std::swap(keys, self->Requested);
+		}
+		self->RenderGlyphs(keys);
+	}
+}
+
+void GlyphCache::RasterizeJob(void* batch, int job, int thread) {
+	Batch* b = (Batch*) batch;
+	for (uint32_t i = b->JobStart[job]; i < b->JobStart[job + 1]; i++)
+		b->Cache->Rasterize(b->Glyphs[i]);
+}
+
+const Glyph* GlyphCache::GetOrRenderGlyph(const GlyphCacheKey& key, GlyphTableRef& table) {
+	auto g = table->UseGlyph(key);
+	if (g)
+		return g;
+	ohash::set<GlyphCacheKey> keys;
+	keys.insert(key);
+	RenderGlyphs(keys);
+	table = GetTable();
+	return table->UseGlyph(key);
+}
+
+void GlyphCache::LoadMetrics(const GlyphCacheKey& key, GlyphMetrics& metrics) {
+	XO_ASSERT(key.Size != 0);
+	const Font* font = Global()->FontStore->GetByFontID(key.FontID);
+
+	const DiskSlot* slot = FindOnDisk(font, key);
+	if (slot != nullptr) {
+		metrics = slot->Metrics;
+		return;
+	}
+
+	std::lock_guard<std::mutex> lock(font->FTFace_Lock);
+
+	FT_UInt iFTGlyph       = 0;
+	int32_t horzMultiplier = 1;
+	if (!LoadFTGlyph(font, key, false, iFTGlyph, horzMultiplier)) {
+		metrics.SetNull();
+		return;
+	}
+	ReadMetrics(font, key, iFTGlyph, horzMultiplier, metrics);
+}
+
+void GlyphCache::AddMetrics(const ohash::map<GlyphCacheKey, GlyphMetrics>& metrics) {
+	if (metrics.size() == 0)
+		return;
+	{
+		std::lock_guard<std::mutex> lock(WriteLock);
+		auto                        next = std::make_shared<GlyphTable>(*GetTable());
+		for (const auto& it : metrics) {
+			if (!next->Glyphs.contains(it.first))
+				next->Metrics.insert(it.first, it.second);
+		}
+		Publish(next);
+	}
+	std::lock_guard<std::mutex> lock(QueueLock);
+	for (const auto& it : metrics)
+		Measured.insert(it.first);
+}
+
+GlyphTableRef GlyphCache::BeginRender() {
+	// Rasterize the glyphs that layout has just measured, so that new text is not missing from the frame
+	ohash::set<GlyphCacheKey> measured;
+	{
+		std::lock_guard<std::mutex> lock(QueueLock);
+		std::swap(measured, Measured);
+	}
+	if (measured.size() != 0)
+		RenderGlyphs(measured);
+
+	// Take the snapshot first, so that we're sure to have the upload rectangles of every glyph inside it
+	GlyphTableRef                           table = GetTable();
+	cheapvec<std::pair<TextureAtlas*, Box>> uploads;
+	{
+		std::lock_guard<std::mutex> lock(UploadLock);
+		std::swap(uploads, PendingUploads);
 	}
+	for (const auto& u : uploads)
+		u.first->InvalidRect.ExpandToFit(u.second);
+	return table;
+}
+
+void GlyphCache::EndFrame(bool wholeFrame, RenderBase* driver) {
+	if (wholeFrame)
+		Frame++;
+
+	// Only try to reclaim space after we've had to create a new atlas
+	size_t numAtlases = GetTable()->NumAtlases();
+	if (numAtlases > 1 && numAtlases > NumAtlasesAfterCompact) {
+		Compact();
+		NumAtlasesAfterCompact = GetTable()->NumAtlases();
+	}
+
+	std::lock_guard<std::mutex> lock(WriteLock);
+	while (SpareTextures.size() > MaxSpareTextures) {
+		TextureID id = SpareTextures.rpop();
+		if (driver->IsTextureValid(id))
+			driver->FreeTexture(id);
+	}
+}
+
+AtlasStats GlyphCache::GetStats() {
+	std::lock_guard<std::mutex> lock(WriteLock);
+	AtlasStats                  s     = Stats;
+	GlyphTableRef               table = GetTable();
+	for (size_t i = 0; i < table->NumAtlases(); i++)
+		table->GetAtlas((uint32_t) i)->AddToStats(s);
+	return s;
+}
+
+// Runs Freetype. This does not touch any of our shared state.
+void GlyphCache::Rasterize(Rasterized& r) {
+	const GlyphCacheKey& key = r.Key;
+	XOTRACE_FONTS("RenderGlyph %d\n", (int) key.Char);
+
+	XO_ASSERT(key.Size != 0);
+	const Font* font = Global()->FontStore->GetByFontID(key.FontID);
+
+	bool isSubPixel = GlyphFlag_IsSubPixel(key.Flags);
+
+	// The sub-pixel shader does its own clamping, but the whole-pixel shader is naive, and
+	// each glyph needs 3 pixels of padding around it. That could be fixed so that the whole-pixel
+	// shader also clamps itself.
+	r.Padding = isSubPixel ? 0 : 3;
+	r.Filter  = TexFilterNearest;
+	if (!isSubPixel && (!Global()->SnapHorzText || !Global()->RoundLineHeights))
+		r.Filter = TexFilterLinear;
 
+	if (LoadFromDisk(font, r))
+		return;
+
+	std::lock_guard<std::mutex> lock(font->FTFace_Lock);
+
+	FT_UInt iFTGlyph       = 0;
+	int32_t horzMultiplier = 1;
+	if (!LoadFTGlyph(font, key, true, iFTGlyph, horzMultiplier)) {
+		r.G.SetNull();
+		return;
+	}
 	int  width        = font->FTFace->glyph->bitmap.width;
 	int  height       = font->FTFace->glyph->bitmap.rows;
 	int  naturalWidth = width;
@@ -107,59 +446,299 @@ uint32_t GlyphCache::RenderGlyph(const GlyphCacheKey& key) {
 		// of our absolute texel bounds, and when it does so, it must read pure black.
 		horzPad = 1;
 	}
-	uint16_t      atlasX = 0;
-	uint16_t      atlasY = 0;
-	TextureAtlas* atlas  = NULL;
+	XO_ASSERT(naturalWidth + horzPad * 2 <= GlyphAtlasSize);
 
-	// The sub-pixel shader does its own clamping, but the whole-pixel shader is naive, and
-	// each glyph needs 3 pixels of padding around it. That could be fixed so that the whole-pixel
-	// shader also clamps itself.
-	int glyphPadding = isSubPixel ? 0 : 3;
-
-	for (int pass = 0; true; pass++) {
-		if (Atlasses.size() == 0 || pass != 0) {
-			TextureAtlas* newAtlas = new TextureAtlas();
-			newAtlas->Initialize(GlyphAtlasSize, GlyphAtlasSize, TexFormatGrey8, glyphPadding);
-			newAtlas->Zero();
-			if (isSubPixel) {
-				newAtlas->FilterMin = TexFilterNearest;
-				newAtlas->FilterMax = TexFilterNearest;
-			} else if (!Global()->SnapHorzText || !Global()->RoundLineHeights) {
-				newAtlas->FilterMin = TexFilterLinear;
-				newAtlas->FilterMax = TexFilterLinear;
-			}
-			Atlasses += newAtlas;
-		}
-		atlas = Atlasses.back();
-		XO_ASSERT(naturalWidth + horzPad * 2 <= GlyphAtlasSize);
-		if (atlas->Alloc(naturalWidth + horzPad * 2, height, atlasX, atlasY))
-			break;
-	}
+	Glyph& g = r.G;
+	ReadMetrics(font, key, iFTGlyph, horzMultiplier, g);
+	g.Width    = isEmpty ? 0 : naturalWidth + horzPad * 2;
+	g.Height   = height;
+	g.X        = 0;
+	g.Y        = 0;
+	g.AtlasID  = 0;
+	g.LastUsed.Store(0);
 
+	r.Pixels.resize(g.Width * g.Height);
+	if (g.Width == 0 || g.Height == 0)
+		return;
 	if (isSubPixel)
-		FilterAndCopyBitmap(font, atlas->DataAt(atlasX, atlasY), atlas->Stride);
+		FilterAndCopyBitmap(font, r.Pixels.data, g.Width);
 	else
-		CopyBitmap(font, atlas->DataAt(atlasX, atlasY), atlas->Stride);
-
-	if (key.Char == '1')
-		int abc = 123;
-
-	Glyph g;
-	g.FTGlyphIndex            = iFTGlyph;
-	g.Width                   = isEmpty ? 0 : naturalWidth + horzPad * 2;
-	g.Height                  = height;
-	g.X                       = atlasX;
-	g.Y                       = atlasY;
-	g.AtlasID                 = (uint32_t) Atlasses.find(atlas);
-	g.MetricLeft              = font->FTFace->glyph->bitmap_left / combinedHorzMultiplier;
-	g.MetricLeftx256          = font->FTFace->glyph->bitmap_left * 256 / combinedHorzMultiplier;
-	g.MetricTop               = font->FTFace->glyph->bitmap_top;
-	g.MetricWidth             = (uint16_t)(font->FTFace->glyph->metrics.width / (64 * combinedHorzMultiplier));
-	g.MetricHoriAdvance       = font->FTFace->glyph->advance.x / (64 * combinedHorzMultiplier);
-	g.MetricLinearHoriAdvance = (font->FTFace->glyph->linearHoriAdvance * (int32_t) pixSize) / (float) font->FTFace->units_per_EM;
-	Table.insert(key, (uint32_t) Glyphs.size());
-	Glyphs += g;
-	return (uint32_t)(Glyphs.size() - 1);
+		CopyBitmap(font, r.Pixels.data, g.Width);
+}
+
+// Returns the glyph from the persistent cache, or null if it's not there
+const GlyphCache::DiskSlot* GlyphCache::FindOnDisk(const Font* font, const GlyphCacheKey& key) {
+	if (font->FileHash == 0)
+		return nullptr;
+	std::call_once(DiskOpened, [this] { OpenDiskCache(); });
+	if (Disk.Data == nullptr)
+		return nullptr;
+
+	const DiskHeader* head  = (const DiskHeader*) Disk.Data;
+	const DiskSlot*   slots = (const DiskSlot*) (head + 1);
+	DiskKey           k     = MakeDiskKey(font->FileHash, key);
+	uint32_t          mask  = head->NumSlots - 1;
+	for (uint32_t i = (uint32_t) HashDiskKey(k) & mask, n = 0; n < head->NumSlots && slots[i].Key.FontHash != 0; i = (i + 1) & mask, n++) {
+		const DiskSlot& s = slots[i];
+		if (memcmp(&s.Key, &k, sizeof(k)) == 0)
+			return IsBitmapInside(s.Pixels, s.Width, s.Height, head->PixelsSize) ? &s : nullptr;
+	}
+	return nullptr;
+}
+
+// Fill in r from the persistent cache, if the glyph is there. r.Padding and r.Filter must already be set.
+bool GlyphCache::LoadFromDisk(const Font* font, Rasterized& r) {
+	const DiskSlot* slot = FindOnDisk(font, r.Key);
+	if (slot == nullptr)
+		return false;
+
+	const DiskHeader* head   = (const DiskHeader*) Disk.Data;
+	const uint8_t*    pixels = Disk.Data + sizeof(DiskHeader) + head->NumSlots * sizeof(DiskSlot);
+
+	Glyph& g = r.G;
+	g.SetNull();
+	(GlyphMetrics&) g = slot->Metrics;
+	g.Width           = slot->Width;
+	g.Height          = slot->Height;
+	r.FromDisk        = true;
+	r.Pixels.resize(g.Width * g.Height);
+	memcpy(r.Pixels.data, pixels + slot->Pixels, g.Width * g.Height);
+	return true;
+}
+
+void GlyphCache::OpenDiskCache() {
+	if (!Disk.Open(DiskCacheFilename().CStr()))
+		return;
+
+	const DiskHeader* head = (const DiskHeader*) Disk.Data;
+	bool              ok   = Disk.Size >= sizeof(DiskHeader);
+	ok                     = ok && head->Magic == DiskMagic && head->Version == DiskVersion && head->SettingsHash == DiskSettingsHash();
+	ok                     = ok && head->NumSlots != 0 && (head->NumSlots & (head->NumSlots - 1)) == 0;
+	ok                     = ok && Disk.Size == sizeof(DiskHeader) + (uint64_t) head->NumSlots * sizeof(DiskSlot) + head->PixelsSize;
+	if (!ok) {
+		Disk.Close();
+		return;
+	}
+	XOTRACE_FONTS("Opened glyph cache file with %u glyphs\n", head->NumGlyphs);
+}
+
+void GlyphCache::SaveDiskCache() {
+	if (!Global()->EnableGlyphDiskCache)
+		return;
+	std::call_once(DiskOpened, [this] { OpenDiskCache(); });
+
+	// Pixels points into one of our atlases, or into the previous file
+	struct Entry {
+		DiskKey             Key;
+		const GlyphMetrics* Metrics;
+		uint16_t            Width;
+		uint16_t            Height;
+		const uint8_t*      Pixels;
+		int                 Stride;
+	};
+	cheapvec<Entry>      entries;
+	ohash::set<uint64_t> keys; // HashDiskKey of everything in entries
+
+	// The glyphs of this run come first, so that they survive MaxDiskGlyphs
+	GlyphTableRef table = GetTable();
+	for (const auto& it : table->Glyphs) {
+		const Font* font = Global()->FontStore->GetByFontID(it.first.FontID);
+		if (font->FileHash == 0)
+			continue;
+		if (entries.size() == MaxDiskGlyphs)
+			break;
+		const Glyph& g = it.second;
+		Entry        e;
+		e.Key     = MakeDiskKey(font->FileHash, it.first);
+		e.Metrics = &g;
+		e.Width   = g.Width;
+		e.Height  = g.Height;
+		e.Pixels  = nullptr;
+		e.Stride  = 0;
+		if (g.Width != 0 && g.Height != 0) {
+			const TextureAtlas* atlas = table->GetAtlas(g.AtlasID);
+			e.Pixels                  = (const uint8_t*) atlas->DataAt(g.X, g.Y);
+			e.Stride                  = atlas->Stride;
+		}
+		entries += e;
+		keys.insert(HashDiskKey(e.Key));
+	}
+
+	if (Disk.Data != nullptr) {
+		const DiskHeader* head   = (const DiskHeader*) Disk.Data;
+		const DiskSlot*   slots  = (const DiskSlot*) (head + 1);
+		const uint8_t*    pixels = (const uint8_t*) (slots + head->NumSlots);
+		for (uint32_t i = 0; i < head->NumSlots && entries.size() < MaxDiskGlyphs; i++) {
+			const DiskSlot& s = slots[i];
+			if (s.Key.FontHash == 0 || keys.contains(HashDiskKey(s.Key)) || !IsBitmapInside(s.Pixels, s.Width, s.Height, head->PixelsSize))
+				continue;
+			entries += Entry{s.Key, &s.Metrics, s.Width, s.Height, pixels + s.Pixels, s.Width};
+		}
+	}
+
+	DiskHeader head;
+	memset(&head, 0, sizeof(head));
+	head.Magic        = DiskMagic;
+	head.Version      = DiskVersion;
+	head.SettingsHash = DiskSettingsHash();
+	head.NumGlyphs    = (uint32_t) entries.size();
+	head.NumSlots     = 16;
+	while (head.NumSlots < head.NumGlyphs * 2)
+		head.NumSlots *= 2;
+
+	cheapvec<DiskSlot> slots;
+	slots.resize(head.NumSlots);
+	cheapvec<uint8_t> pixels;
+	uint32_t          mask = head.NumSlots - 1;
+	for (const auto& e : entries) {
+		uint32_t i = (uint32_t) HashDiskKey(e.Key) & mask;
+		while (slots[i].Key.FontHash != 0)
+			i = (i + 1) & mask;
+		DiskSlot& s = slots[i];
+		s.Key       = e.Key;
+		s.Metrics   = *e.Metrics;
+		s.Width     = e.Width;
+		s.Height    = e.Height;
+		s.Pixels    = (uint32_t) pixels.size();
+		for (uint16_t y = 0; y < e.Height; y++)
+			pixels.addn(e.Pixels + y * e.Stride, e.Width);
+	}
+	if (pixels.size() > 0xffffffffu)
+		return;
+	head.PixelsSize = (uint32_t) pixels.size();
+
+	// Write to a temporary file and move it into place, because other xo processes may have the old file mapped
+	String filename = DiskCacheFilename();
+	String tempFile = filename + ".tmp";
+	FILE*  file     = fopen(tempFile.CStr(), "wb");
+	if (file == nullptr) {
+		Trace("Failed to open glyph cache file %s\n", tempFile.CStr());
+		return;
+	}
+	bool ok = fwrite(&head, sizeof(head), 1, file) == 1;
+	ok      = ok && fwrite(slots.data, sizeof(DiskSlot), slots.size(), file) == slots.size();
+	ok      = ok && fwrite(pixels.data, 1, pixels.size(), file) == pixels.size();
+	ok      = fclose(file) == 0 && ok;
+
+	// Our entries point into Disk, so we can only let go of it now
+	Disk.Close();
+	if (!ok || !RenameFile(tempFile.CStr(), filename.CStr())) {
+		Trace("Failed to write glyph cache file %s\n", filename.CStr());
+		remove(tempFile.CStr());
+		return;
+	}
+	XOTRACE_FONTS("Saved %u glyphs to the glyph cache file\n", head.NumGlyphs);
+}
+
+// Copy a rasterized glyph into an atlas, and add it to table. Caller must hold WriteLock.
+void GlyphCache::Insert(GlyphTable& table, const Rasterized& r) {
+	Glyph g    = r.G;
+	g.LastUsed.Store(Frame);
+	if (!g.IsNull()) {
+		uint16_t      x     = 0;
+		uint16_t      y     = 0;
+		TextureAtlas* atlas = AllocAtlas(table, r.Padding, r.Filter, g.Width, g.Height, x, y, g.AtlasID);
+		if (g.Width != 0 && g.Height != 0) {
+			atlas->CopyFrom(x, y, r.Pixels.data, g.Width, g.Width, g.Height);
+			std::lock_guard<std::mutex> lock(UploadLock);
+			PendingUploads += std::pair<TextureAtlas*, Box>(atlas, Box(x, y, x + g.Width, y + g.Height));
+		}
+		g.X = x;
+		g.Y = y;
+	}
+	table.Glyphs.insert(r.Key, g);
+	table.Metrics.erase(r.Key);
+}
+
+// Find space in an atlas with the given padding and filter, creating a new atlas if necessary.
+// Caller must hold WriteLock.
+TextureAtlas* GlyphCache::AllocAtlas(GlyphTable& table, uint32_t padding, TexFilter filter, uint16_t width, uint16_t height, uint16_t& x, uint16_t& y, uint32_t& atlasID) {
+	for (size_t i = 0; i < table.Atlases.size(); i++) {
+		TextureAtlas* atlas = table.Atlases[i].get();
+		if (atlas->GetPadding() == padding && atlas->FilterMin == filter && atlas->Alloc(width, height, x, y)) {
+			atlasID = (uint32_t) i;
+			return atlas;
+		}
+	}
+
+	auto atlas = std::make_shared<TextureAtlas>();
+	atlas->Initialize(GlyphAtlasSize, GlyphAtlasSize, TexFormatGrey8, padding);
+	atlas->Zero();
+	atlas->FilterMin = filter;
+	atlas->FilterMax = filter;
+	if (SpareTextures.size() != 0) {
+		atlas->TexID = SpareTextures.rpop();
+		atlas->InvalidateWholeSurface();
+	}
+	XO_VERIFY(atlas->Alloc(width, height, x, y));
+	atlasID = (uint32_t) table.Atlases.size();
+	table.Atlases.push_back(atlas);
+	return atlas.get();
+}
+
+// Evict the glyphs that have not been drawn recently, and pack the rest into new atlases.
+// The new atlases inherit the device textures of the old ones. Readers that are still holding
+// the previous snapshot keep the old atlases alive, but only the render thread uses the device
+// textures, and it calls us between frames.
+void GlyphCache::Compact() {
+	std::lock_guard<std::mutex> lock(WriteLock);
+	GlyphTableRef               prev  = GetTable();
+	uint32_t                    frame = Frame;
+
+	cheapvec<std::pair<GlyphCacheKey, Glyph>> live;
+	uint32_t                                  numEvicted = 0;
+	for (auto& it : prev->Glyphs) {
+		if (frame - it.second.LastUsed.Load() > EvictAfterFrames)
+			numEvicted++;
+		else
+			live += std::pair<GlyphCacheKey, Glyph>(it.first, it.second);
+	}
+	if (numEvicted == 0)
+		return;
+
+	// Tallest first packs best
+	std::sort(live.data, live.data + live.size(), [](const std::pair<GlyphCacheKey, Glyph>& a, const std::pair<GlyphCacheKey, Glyph>& b) {
+		return a.second.Height > b.second.Height;
+	});
+
+	for (size_t i = 0; i < prev->NumAtlases(); i++) {
+		if (prev->GetAtlas((uint32_t) i)->TexID != TextureIDNull)
+			SpareTextures += prev->GetAtlas((uint32_t) i)->TexID;
+	}
+
+	// Layout may still need the metrics of the glyphs that we evict
+	auto next     = std::make_shared<GlyphTable>();
+	next->Metrics = prev->Metrics;
+	for (auto& it : prev->Glyphs) {
+		if (frame - it.second.LastUsed.Load() > EvictAfterFrames)
+			next->Metrics.insert(it.first, it.second);
+	}
+	for (const auto& it : live) {
+		Glyph g = it.second;
+		if (!g.IsNull()) {
+			const TextureAtlas* src = prev->GetAtlas(g.AtlasID);
+			uint16_t            x   = 0;
+			uint16_t            y   = 0;
+			TextureAtlas*       dst = AllocAtlas(*next, src->GetPadding(), src->FilterMin, g.Width, g.Height, x, y, g.AtlasID);
+			if (g.Width != 0 && g.Height != 0)
+				dst->CopyFrom(x, y, src->DataAt(g.X, g.Y), src->Stride, g.Width, g.Height);
+			g.X = x;
+			g.Y = y;
+		}
+		next->Glyphs.insert(it.first, g);
+	}
+
+	// Every atlas is new, so every atlas will be uploaded in full
+	{
+		std::lock_guard<std::mutex> lock(UploadLock);
+		PendingUploads.clear_noalloc();
+	}
+	Publish(next);
+	AtlasEpoch++;
+
+	Stats.NumEvicted += numEvicted;
+	Stats.NumCompactions++;
+	XOTRACE_RENDER("GlyphCache: evicted %u glyphs, %d -> %d atlases\n", numEvicted, (int) prev->NumAtlases(), (int) next->NumAtlases());
 }
 
 void GlyphCache::FilterAndCopyBitmap(const Font* font, void* target, int target_stride) {
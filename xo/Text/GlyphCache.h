@@ -1,9 +1,9 @@
 #pragma once
 #include "../Defs.h"
+#include "../Render/TextureAtlas.h"
 
 namespace xo {
 
-class TextureAtlas;
 class Font;
 
 enum GlyphFlags {
@@ -12,25 +12,33 @@ enum GlyphFlags {
 
 inline bool GlyphFlag_IsSubPixel(uint32_t flags) { return !!(flags & GlyphFlag_SubPixel_RGB); }
 
-struct Glyph {
-	uint32_t AtlasID;
+// Everything that layout needs to know about a glyph. This can be obtained from Freetype without rasterizing the glyph.
+struct GlyphMetrics {
 	uint32_t FTGlyphIndex;
-	uint16_t X;
-	uint16_t Y;
-	uint16_t Width;
-	uint16_t Height;
 	int16_t  MetricLeft; // intended for use by SnapHorzText
 	int16_t  MetricLeftx256;
 	int16_t  MetricTop;
 	uint16_t MetricWidth;
 	int32_t  MetricHoriAdvance; // intended for use by SnapHorzText
 	float    MetricLinearHoriAdvance;
+	bool     HasPixels; // False if the rasterized glyph would be empty, such as a space
 
 	// A Null glyph is one that could not be found in the font
-	bool IsNull() const { return Width == 0 && MetricLinearHoriAdvance == 0; }
+	bool IsNull() const { return !HasPixels && MetricLinearHoriAdvance == 0; }
 	void SetNull() { memset(this, 0, sizeof(*this)); }
 };
 
+struct Glyph : GlyphMetrics {
+	uint32_t           AtlasID;
+	uint16_t           X;
+	uint16_t           Y;
+	uint16_t           Width;
+	uint16_t           Height;
+	mutable FrameStamp LastUsed; // GlyphCache frame in which this glyph was last drawn. Written by readers.
+
+	void SetNull() { *this = Glyph(); }
+};
+
 struct GlyphCacheKey {
 	xo::FontID FontID;
 	uint32_t   Char;
@@ -49,61 +57,175 @@ struct GlyphCacheKey {
 
 static const int GlyphAtlasSize = 512; // 512 x 512 x 8bit = 256k per atlas
 
+class GlyphCache;
+
+/* An immutable snapshot of the glyph cache.
+
+Readers hold a reference to a GlyphTable for as long as they use the glyphs and atlases
+inside it, and that reference is what keeps them alive. The pixels of a glyph are written
+into its atlas before the glyph is published, and are never modified afterwards, so they
+can be read without any locks. Other parts of the same atlas may be written to while we
+read, by the threads that are rasterizing new glyphs.
+*/
+class XO_API GlyphTable {
+public:
+	// Returns NULL if the glyph is not in the cache. Even if the glyph pointer is not NULL, you must still check
+	// whether it is the logical "null glyph", which is empty. You can detect that with Glyph.IsNull().
+	const Glyph* GetGlyph(const GlyphCacheKey& key) const { return Glyphs.getp(key); }
+
+	// Same as GetGlyph, but also marks the glyph as being in use, so that it is not evicted.
+	// This may be called by many threads at once.
+	const Glyph* UseGlyph(const GlyphCacheKey& key) const;
+
+	// Returns the metrics of a glyph that has either been rasterized or measured, or NULL if it is neither
+	const GlyphMetrics* GetMetrics(const GlyphCacheKey& key) const;
+
+	TextureAtlas* GetAtlas(uint32_t i) const { return Atlases[i].get(); }
+	size_t        NumAtlases() const { return Atlases.size(); }
+
+protected:
+	friend class GlyphCache;
+	const std::atomic<uint32_t>*               Frame = nullptr; // GlyphCache::Frame
+	ohash::map<GlyphCacheKey, Glyph>           Glyphs;
+	ohash::map<GlyphCacheKey, GlyphMetrics>    Metrics; // Glyphs that have been measured, but not rasterized
+	std::vector<std::shared_ptr<TextureAtlas>> Atlases;
+};
+
+typedef std::shared_ptr<const GlyphTable> GlyphTableRef;
+
 /* Maintains a cache of all information (including textures) that is needed to render text.
 
-During a render, the cache is read-only. After rendering, we go in and resolve all the cache
-misses. On the next render, those glyphs will get rendered.
-
-NOTE: This was initially created for exclusive use by the main xo renderer, which puts text
-onto the screen, via the GPU. Subsequently, I needed something to cache glyphs when rendering
-text to Canvas, so I decided to reuse this cache for that purpose. The design of the main renderer
-is that while rendering, it treats the glyph cache as immutable. This means that if it's
-rendering a scene, and a glyph bitmap is not ready, then it simply proceeds, and skips the
-rendering of that glyph. It does however record the fact that it needs that glyph. At the
-end of the render, it goes back and calls RenderGlyph() for every glyph that it missed.
-This design allows the common case (all glyphs are cached) to be fast, because there is
-zero locking overhead during rendering.
-HOWEVER, the UI runs on a different thread to the renderer, and now that we want to be
-able to use this cache for Canvas rendering (which happens on the UI thread), we need
-to make the cache safe to use from both the renderer and the UI. As a very simple
-first approach, we just add a giant lock over the whole thing. The renderer takes that lock
-at a massively coarse scale, and the Canvas renderer takes it at very fine scales (every
-time it draws a glyph). Since Canvas is the 2nd class citizen here, we're fine with this.
+The cache is read through immutable GlyphTable snapshots, which are obtained with GetTable()
+without taking any locks. When glyphs are added, we copy the latest snapshot, add the glyphs
+to the copy, and publish the copy. A snapshot is freed when its last reader lets go of it.
+
+The renderer and the Canvas renderer share this cache, but they run on different threads.
+The renderer takes its snapshot at the start of the frame, and if a glyph is missing, then it
+skips the rendering of that glyph, and hands the missing glyphs to RequestGlyphs() at the end of
+the frame. Those are rasterized by a job on the worker threads, which publishes them when it is
+done, and the renderer picks them up on a subsequent frame.
+
+Layout only needs glyph metrics, and it needs them immediately, so it calls LoadMetrics(), which
+asks Freetype for the glyph's metrics without rasterizing it. That is cheap enough to do in the
+middle of layout, so a single layout pass is always enough. At the end of layout, the new metrics
+are published with AddMetrics(), and those glyphs are rasterized at the start of the next render,
+so that the first frame of new text is complete. Canvas needs the pixels immediately, so it calls
+RenderGlyphs(), which rasterizes on the calling thread and the worker threads. Either way,
+rasterization is split up by font, because a Freetype face can only be used by one thread at a
+time. Nobody ever waits for the renderer.
+
+Writers are serialized by WriteLock, but that is only held while copying bitmaps into atlases,
+and while publishing, never while running Freetype.
+
+Atlas texture uploads belong to the render thread, so writers don't touch TextureAtlas::InvalidRect
+of an atlas that might have been published. They record the rectangles in PendingUploads, and the
+render thread applies them in BeginRender(), after taking its snapshot.
 
 If a glyph render fails, then the resulting Glyph will have .IsNull() == true.
+
+If Global()->EnableGlyphDiskCache is set, then the glyphs that we have rasterized are saved into
+CacheDir at shutdown, and on the next run, LoadMetrics and Rasterize read them out of that file,
+instead of running Freetype. See the comments above DiskHeader in GlyphCache.cpp.
+
+Glyphs are never freed individually. Whenever the cache has had to create a new atlas, it
+evicts the glyphs that have not been drawn for EvictAfterFrames frames, and packs the survivors
+into as few atlases as possible. Only whole-frame renders advance the frame counter, because a
+partial repaint does not draw every glyph that is on screen. An evicted glyph that is still
+needed is simply a cache miss, which costs us another frame.
 */
 class XO_API GlyphCache {
 public:
-	static const uint32_t NullGlyphIndex; // = 0. Our first element in 'Glyphs' is always the null glyph (GCC 4.6 won't allow us to write =0 here)
-
-	// Giant lock on the entire cache. Guards access to all data in here.
-	std::mutex Lock;
+	static const uint32_t EvictAfterFrames = 300; // Glyphs that have not been drawn for this many frames are evicted when the atlases fill up
+	static const size_t   MaxSpareTextures = 2;   // Device textures of discarded atlases beyond this many are freed by EndFrame
 
 	GlyphCache();
 	~GlyphCache();
 
-	void Clear();
+	void            Clear(); // Not thread safe
 
-	// Returns NULL if the glyph is not in the cache. Even if the glyph pointer is not NULL, you must still check
-	// whether it is the logical "null glyph", which is empty. You can detect that with Glyph.IsNull().
-	const Glyph* GetGlyph(const GlyphCacheKey& key) const;
+	GlyphTableRef GetTable() const; // Lock free
+
+	// Rasterize the glyphs that are not yet in the cache, and wait until they are published
+	void            RenderGlyphs(const ohash::set<GlyphCacheKey>& keys);
+
+	// Queue the glyphs for rasterization by a worker thread, and return immediately
+	void            RequestGlyphs(const ohash::set<GlyphCacheKey>& keys);
+
+	// Used by layout. Runs Freetype, but does not rasterize the glyph. Thread safe.
+	void            LoadMetrics(const GlyphCacheKey& key, GlyphMetrics& metrics);
+
+	// Publish the metrics that were obtained with LoadMetrics, and have the glyphs rasterized by the next BeginRender
+	void            AddMetrics(const ohash::map<GlyphCacheKey, GlyphMetrics>& metrics);
+
+	// Used by the Canvas renderer. If the glyph is missing, it is rendered, and table is refreshed.
+	const Glyph* GetOrRenderGlyph(const GlyphCacheKey& key, GlyphTableRef& table);
+
+	// Called by the renderer at the start of every frame. Returns the snapshot to render from.
+	// This rasterizes the glyphs that layout has measured since the previous frame.
+	GlyphTableRef BeginRender();
+
+	// Called by the renderer at the end of every frame, after it has released its snapshot.
+	void            EndFrame(bool wholeFrame, RenderBase* driver);
 
-	const Glyph* GetOrRenderGlyph(const GlyphCacheKey& key);
+	AtlasStats GetStats();
 
-	uint32_t RenderGlyph(const GlyphCacheKey& key);
+	// Changes whenever the atlases are replaced, which invalidates the atlas pointers and coordinates
+	// of every glyph that was obtained before. Only the render thread may call this.
+	uint32_t GetAtlasEpoch() const { return AtlasEpoch; }
 
-	const TextureAtlas* GetAtlas(uint32_t i) const { return Atlasses[i]; }
-	TextureAtlas*       GetAtlasMutable(uint32_t i) { return Atlasses[i]; }
+	// Write our glyphs into the persistent cache, if it is enabled. Must not run concurrently with anything else.
+	void            SaveDiskCache();
 
 protected:
-	cheapvec<TextureAtlas*>             Atlasses;
-	cheapvec<Glyph>                     Glyphs;
-	ohash::map<GlyphCacheKey, uint32_t> Table;
-	Glyph                               NullGlyph;
-
-	void Initialize();
-	void FilterAndCopyBitmap(const Font* font, void* target, int target_stride);
-	void CopyBitmap(const Font* font, void* target, int target_stride);
+	// A glyph that has been rasterized, but not yet copied into an atlas
+	struct Rasterized {
+		GlyphCacheKey     Key;
+		Glyph             G;
+		uint32_t          Padding;
+		TexFilter         Filter;
+		bool              FromDisk; // Read out of the persistent cache
+		cheapvec<uint8_t> Pixels;   // G.Width x G.Height
+	};
+
+	struct DiskSlot;
+
+	// A batch of glyphs, sorted by font, with one job per font
+	struct Batch {
+		GlyphCache*          Cache;
+		cheapvec<Rasterized> Glyphs;
+		cheapvec<uint32_t>   JobStart; // Index into Glyphs of the first glyph of each job, plus a terminator
+	};
+
+	std::atomic<uint32_t>                   Frame;
+	GlyphTableRef                           Current;                    // Only accessed with std::atomic_load and std::atomic_store
+	std::mutex                              WriteLock;                  // Held while modifying atlases and publishing a new snapshot
+	size_t                                  NumAtlasesAfterCompact = 0; // Only used by EndFrame
+	uint32_t                                AtlasEpoch             = 0; // Incremented by Clear and Compact, which only run on the render thread
+	AtlasStats                              Stats;                      // Guarded by WriteLock. Only NumEvicted and NumCompactions are maintained here.
+	cheapvec<TextureID>                     SpareTextures;              // Guarded by WriteLock. Device textures of discarded atlases, which are handed to new atlases.
+	std::mutex                              UploadLock;                 // Guards PendingUploads
+	cheapvec<std::pair<TextureAtlas*, Box>> PendingUploads;             // Regions of atlases that the render thread must upload
+	std::mutex                              QueueLock;                  // Guards Requested, Measured and IsDrainQueued
+	ohash::set<GlyphCacheKey>               Requested;                  // Glyphs waiting for the worker thread
+	ohash::set<GlyphCacheKey>               Measured;                   // Glyphs waiting for the next BeginRender
+	bool                                    IsDrainQueued = false;
+	std::once_flag                          DiskOpened;                 // The persistent cache is opened by the first thread that needs it
+	MappedFile                              Disk;                       // The persistent cache. Closed if it is missing, or was built with different settings. Read-only until SaveDiskCache.
+
+	void            Initialize();
+	void            Rasterize(Rasterized& r);
+	void            OpenDiskCache();
+	bool            LoadFromDisk(const Font* font, Rasterized& r);
+	const DiskSlot* FindOnDisk(const Font* font, const GlyphCacheKey& key);
+	void            Insert(GlyphTable& table, const Rasterized& r);
+	void            Publish(std::shared_ptr<GlyphTable> table);
+	TextureAtlas*   AllocAtlas(GlyphTable& table, uint32_t padding, TexFilter filter, uint16_t width, uint16_t height, uint16_t& x, uint16_t& y, uint32_t& atlasID);
+	void            Compact();
+	void            FilterAndCopyBitmap(const Font* font, void* target, int target_stride);
+	void            CopyBitmap(const Font* font, void* target, int target_stride);
+
+	static void RasterizeJob(void* batch, int job, int thread);
+	static void DrainJob(void* cache);
 };
 } // namespace xo
 
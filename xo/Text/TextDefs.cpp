@@ -13,6 +13,7 @@ Font::Font() {
 	Descender_x256               = 0;
 	// See FontStore::LoadFontTweaks for more details
 	MaxAutoHinterSize = 0;
+	FileHash          = 0;
 }
 
 Font::~Font() {
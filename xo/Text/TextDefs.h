@@ -24,8 +24,20 @@ public:
 	int32_t  Ascender_x256;                // Ascender
 	int32_t  Descender_x256;               // Descender
 	uint32_t MaxAutoHinterSize;            // Maximum font size at which we force use of the auto hinter. Heuristic thumb-suck observations. Only applies to sub-pixel rendering.
+	uint64_t FileHash;                     // Identifies the font in the persistent glyph cache. Zero if the persistent glyph cache is disabled.
+
+	ohash::map<uint32_t, int16_t> Kerning; // Horizontal kerning of glyph pairs, in font units. See FontStore::LoadKerning.
 
 	Font();
 	~Font();
+
+	// Returns the kerning between two glyphs, in font units. Does not touch FTFace, so it needs no lock.
+	int32_t GetKerning(uint32_t leftGlyph, uint32_t rightGlyph) const {
+		if (Kerning.size() == 0)
+			return 0;
+		return Kerning.get(KerningKey(leftGlyph, rightGlyph));
+	}
+
+	static uint32_t KerningKey(uint32_t leftGlyph, uint32_t rightGlyph) { return (leftGlyph << 16) | (rightGlyph & 0xffff); }
 };
 }